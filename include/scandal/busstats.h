@@ -0,0 +1,125 @@
+/*
+ *  busstats.h
+ *
+ *  Bus load accounting.
+ *
+ *  Counts frames and data bytes sent and received, by message type and, for
+ *  received frames, by source node. Each frame is also charged its wire
+ *  time, using the worst case number of stuff bits, and a scheduler task
+ *  turns that into a bus utilisation figure once per window.
+ *
+ *  Only frames which get past this node's acceptance filters are seen, so
+ *  the utilisation is a lower bound unless the node receives everything.
+ *
+ *  Everything is a handful of adds per frame, and is meant to be left on.
+ *  Define DISABLE_BUSSTATS to compile it out.
+ */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCANDAL_BUSSTATS__
+#define __SCANDAL_BUSSTATS__
+
+#include <scandal/types.h>
+#include <scandal/can.h>
+#include <scandal/engine.h>
+
+#include <project/scandal_config.h>
+
+/* Bit rate the utilisation is worked out against */
+#ifndef SCANDAL_CAN_BITRATE
+#define SCANDAL_CAN_BITRATE		50000
+#endif
+
+/* Length of the utilisation window, in ms */
+#ifndef SCANDAL_BUSSTATS_WINDOW
+#define SCANDAL_BUSSTATS_WINDOW		1000
+#endif
+
+/* Number of source nodes tracked. Nodes beyond this are only counted in
+   the overflow counter */
+#ifndef SCANDAL_BUSSTATS_NODES
+#define SCANDAL_BUSSTATS_NODES		16
+#endif
+
+/* Per type counters are indexed by message type, then these two */
+#define BUSSTATS_OTHER			SCANDAL_NUM_MSG_TYPES		/* Extended, unknown type */
+#define BUSSTATS_STD			(SCANDAL_NUM_MSG_TYPES + 1)	/* Standard frames */
+#define BUSSTATS_NUM_CLASSES		(SCANDAL_NUM_MSG_TYPES + 2)
+
+#define BUSSTATS_RX			0
+#define BUSSTATS_TX			1
+
+/* Scandal command numbers. Commands from SCANDAL_COMMAND_BASE up are
+   reserved for the engine and are not passed to scandal_user_handle_command().
+   Each request carries the address to reply to in data[7]. The reply is a
+   command to that node, numbered request + SCANDAL_COMMAND_REPLY. */
+#define SCANDAL_COMMAND_BASE		0x3F0
+#define SCANDAL_COMMAND_REPLY		0x008
+#define SCANDAL_CMD_BUSSTATS_CLASS	0x3F0	/* data[0] class, data[1] RX/TX -> frames, bytes */
+#define SCANDAL_CMD_BUSSTATS_NODE	0x3F1	/* data[0] node -> frames, bytes */
+#define SCANDAL_CMD_BUSSTATS_UTIL	0x3F2	/* -> last, smoothed, max (0.1%), overflow frames */
+#define SCANDAL_CMD_BUSSTATS_RESET	0x3F3	/* no reply */
+
+typedef struct busstats_count {
+	u32	frames;
+	u32	bytes;
+} scandal_busstats_count;
+
+typedef struct busstats_node {
+	u08	node;
+	u08	used;
+	scandal_busstats_count	rx;
+} scandal_busstats_node;
+
+typedef struct busstats {
+	scandal_busstats_count	classes[BUSSTATS_NUM_CLASSES][2];
+	scandal_busstats_node	nodes[SCANDAL_BUSSTATS_NODES];
+	u32	node_overflow;		/* Frames from nodes that didn't fit */
+	u32	wire_bits;		/* Total wire time, in bit times */
+	u32	window_bits;		/* Wire time in the current window */
+	u16	util_last;		/* Utilisation of the last window, in 0.1% */
+	u16	util_smoothed;		/* Moving average over ~4 windows, in 0.1% */
+	u16	util_max;
+} scandal_busstats;
+
+/* Worst case length of a frame on the wire, in bits, including stuff bits,
+   the ACK slot, end of frame and interframe space */
+static inline u16 scandal_frame_bits(u08 ext, u08 length){
+	u16 data = 8 * (length > CAN_MSG_MAXSIZE ? CAN_MSG_MAXSIZE : length);
+
+	if(ext)
+		return 67 + data + (54 + data - 1) / 4;
+	return 47 + data + (34 + data - 1) / 4;
+}
+
+#if !DISABLE_BUSSTATS
+void	scandal_init_busstats(void);
+void	scandal_busstats_rx(can_msg *msg);
+void	scandal_busstats_tx(can_msg *msg);
+void	scandal_get_busstats(scandal_busstats *stats);
+void	scandal_reset_busstats(void);
+u08	scandal_busstats_node_count(u08 node, scandal_busstats_count *count);
+void	scandal_handle_busstats_command(u16 num, u08 *data);
+#else
+#define scandal_init_busstats()
+#define scandal_busstats_rx(msg)
+#define scandal_busstats_tx(msg)
+#endif
+
+#endif
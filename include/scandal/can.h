@@ -33,6 +33,7 @@
 
 /* Includes */
 #include <scandal/types.h>
+#include <scandal/timer.h>
 
 /* Constant definitions */
 
@@ -63,8 +64,25 @@ typedef struct can_mg {
   u08 data[CAN_MSG_MAXSIZE];
   u08 length;
   u08 ext;
+  sc_utime_t rcvd_us; /* sc_get_timer_us() when the frame arrived. Set by
+                         the CAN driver on receive. On transmit, drivers
+                         with a queue use it for when the frame was queued */
 } can_msg;
 
+/* Arbitration field, as a number where lower wins. A standard frame sends
+   dominant RTR and IDE bits where an extended one sends recessive SRR and
+   IDE, so it wins against extended frames with the same base ID */
+static inline u32 can_arb_key(u32 id, u08 ext){
+  if(ext == CAN_EXT_MSG)
+    return (((id & CAN_ID_EXT_MASK) >> 18) << 19) | (1UL << 18) | (id & 0x3FFFF);
+  return (id & CAN_ID_STD_MASK) << 19;
+}
+
+/* Top three bits of the arbitration field. For Scandal frames this is the
+   priority in the identifier */
+#define CAN_ARB_CLASS(key)	((key) >> 27)
+#define CAN_NUM_ARB_CLASSES	8
+
 /* Standard CAN Layer Prototypes */
 /* Initialise the controller such that it is scandal compliant,
     using the correct baud rate (DEFAULT_BAUD) */
@@ -76,11 +94,38 @@ u08  can_get_msg(can_msg* msg);
 /* Send a message using the CAN controller */
 u08  can_send_msg(can_msg* msg, u08 priority);
 
+/* Zero copy send. can_tx_reserve() returns the driver's next free transmit
+   slot, or 0 if there is none. Fill in id, ext, length and data there, then
+   can_tx_commit() to send it. Nothing goes out, and the slot can be
+   abandoned, until the commit. Only one slot may be reserved at a time, and
+   not from an interrupt handler. */
+can_msg *can_tx_reserve(void);
+u08  can_tx_commit(can_msg* msg, u08 priority);
+
+/* Drivers with a transmit queue refill the controller from it as each
+   frame goes. can_tx_flush() loads as many queued frames as there is room
+   for, without waiting, and returns how many are still queued. Drivers
+   without a queue return 0 */
+u08  can_tx_flush(void);
+
+typedef struct can_tx_stats {
+  u16 depth;            /* Frames queued now */
+  u16 high_water;       /* Most frames ever queued at once */
+  u32 overruns;         /* Frames dropped because the queue was full */
+} can_tx_stats;
+
+void can_get_tx_stats(can_tx_stats *stats);
+
 /* Register a message ID/mask. This guarantees that these messages will
   not be filtered out by hardware filters. Other messages are not
   guaranteed */
 u08  can_register_id(u32 mask, u32 data, u08 priority, u08 ext);
 
+/* As can_register_id(), for frames expected about rate times a second.
+  Drivers which can hold more than one frame per filter give the fastest
+  registrations the most room. Others treat it as can_register_id() */
+u08  can_register_id_rate(u32 mask, u32 data, u16 rate, u08 ext);
+
 /* Should be called when the CAN controller has an interrupt */
 /* \todo This is probably not the right location for this */
 void can_interrupt(void);
@@ -0,0 +1,121 @@
+/*
+ *  can_admit.h
+ *
+ *  Software admission check for received frames.
+ *
+ *  When there are more registrations than acceptance filters, can_filter
+ *  merges them, and the merged filters let in frames nothing registered
+ *  for. Every one of those used to go through the receive ring and
+ *  handle_ext_message() before being thrown away. The admission set is a
+ *  small Bloom filter over what the registrations accept, and the receive
+ *  interrupt checks each frame against it before queueing it, so nearly
+ *  all of them are dropped there instead. It never drops a frame a
+ *  registration accepts.
+ *
+ *  Registrations are grouped by their mask, as there are only ever a few
+ *  different ones (one per in-channel, packed channels, config and
+ *  commands). Each registration's masked id goes into the set once. A frame
+ *  is looked up once per group, masked with that group's mask, and is
+ *  admitted if any lookup finds all its bits set. Where there are more
+ *  masks than groups, the closest groups share the bits both care about.
+ *
+ *  can_admit_build() rebuilds the set from the driver's registration list,
+ *  and enables it, but only if the driver says its filters let in more than
+ *  the registrations do. can_admit_check() is cheap enough to call from an
+ *  interrupt handler: a couple of multiplies and CAN_ADMIT_HASHES bit tests
+ *  per group.
+ */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCANDAL_CAN_ADMIT__
+#define __SCANDAL_CAN_ADMIT__
+
+#include <scandal/types.h>
+#include <scandal/can.h>
+#include <scandal/can_filter.h>
+
+/* Size of the set, as a power of two in bits. 512 bits with the engine's
+   30 or so registrations gives about 1% false positives per group */
+#ifndef CAN_ADMIT_LOG2_BITS
+#define CAN_ADMIT_LOG2_BITS	9
+#endif
+#define CAN_ADMIT_BITS		(1U << CAN_ADMIT_LOG2_BITS)
+
+/* Bits set per registration and tested per lookup */
+#define CAN_ADMIT_HASHES	3
+
+/* Different masks looked up separately. Must be at least 2 */
+#ifndef CAN_ADMIT_MAX_GROUPS
+#define CAN_ADMIT_MAX_GROUPS	4
+#endif
+
+typedef struct can_admit {
+	volatile u08	enabled;	/* 0 admits everything */
+	u08		num_groups;
+	u08		ext[CAN_ADMIT_MAX_GROUPS];
+	u32		mask[CAN_ADMIT_MAX_GROUPS];
+	u32		bits[CAN_ADMIT_BITS / 32];
+	volatile u32	rejected;	/* Frames can_admit_check() turned away */
+} can_admit;
+
+/* Rebuilds the set from count registrations. It is only enabled when
+   needed is set, i.e. when the hardware filters aren't exact */
+void	can_admit_build(can_admit *admit, const can_filter *regs, u16 count, u08 needed);
+
+/* Bits set, out of CAN_ADMIT_BITS. The false positive rate per group is
+   about (set / CAN_ADMIT_BITS) ^ CAN_ADMIT_HASHES */
+u16	can_admit_fill(const can_admit *admit);
+
+/* Group g's masked id, as the set hashes it */
+static inline u32 can_admit_key(u32 masked, u08 g){
+	return masked ^ ((u32)g << 29);
+}
+
+static inline u08 can_admit_test(const can_admit *admit, u32 key){
+	u32 h1 = key * 0x9E3779B1UL;
+	u32 h2 = (key * 0x85EBCA77UL) | 1;
+	u16 bit;
+	u08 i;
+
+	for(i=0; i<CAN_ADMIT_HASHES; i++){
+		bit = h1 >> (32 - CAN_ADMIT_LOG2_BITS);
+		if(!(admit->bits[bit >> 5] & (1UL << (bit & 31))))
+			return 0;
+		h1 += h2;
+	}
+	return 1;
+}
+
+/* Whether a received frame might be one a registration accepts. Counts
+   the ones it turns away */
+static inline u08 can_admit_check(can_admit *admit, u32 id, u08 ext){
+	u08 g;
+
+	if(!admit->enabled)
+		return 1;
+
+	for(g=0; g<admit->num_groups; g++)
+		if(admit->ext[g] == ext && can_admit_test(admit, can_admit_key(id & admit->mask[g], g)))
+			return 1;
+
+	admit->rejected++;
+	return 0;
+}
+
+#endif
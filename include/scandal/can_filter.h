@@ -0,0 +1,164 @@
+/*
+ *  can_filter.h
+ *
+ *  Acceptance filter compiler.
+ *
+ *  A node registers for frames with can_register_id(), one (mask, id)
+ *  pair at a time, and there are usually more registrations than the
+ *  controller has filters. The drivers keep every registration, and
+ *  compile the whole set into whatever filters their controller has each
+ *  time it changes:
+ *
+ *    can_filter_compile_objects()	any number of independent mask
+ *					filters, e.g. the LPC11C14's 20
+ *					receive message objects
+ *    can_filter_compile_mcp2510()	two masks, one shared by two
+ *					filters and one by four
+ *    can_filter_compile_aflut()	identifier ranges in a lookup
+ *					table, as the LPC1768's acceptance
+ *					filter takes them
+ *
+ *  The result always accepts every frame the registrations do. Where
+ *  there aren't enough filters, registrations are merged, cheapest first,
+ *  so that as little else as possible gets through. What a merge costs
+ *  comes from a traffic profile if there is one (frames and their rates,
+ *  e.g. from the bus statistics), or otherwise from the number of
+ *  identifiers it lets in, with standard and extended frames taken to be
+ *  half the traffic each. Either way the report says how much traffic
+ *  the registrations want and how much the compiled filters let in.
+ *
+ *  These are pure functions of their arguments, with no state and no
+ *  hardware access, so they run on the host as well.
+ */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCANDAL_CAN_FILTER__
+#define __SCANDAL_CAN_FILTER__
+
+#include <scandal/types.h>
+#include <scandal/can.h>
+
+#include <project/scandal_config.h>
+
+/* Registrations a driver keeps. Past this, can_filter_add() merges them.
+   The engine makes one per in-channel, one per node packed channels come
+   from and four of its own */
+#ifndef CAN_FILTER_MAX_REGS
+#define CAN_FILTER_MAX_REGS	(2 * NUM_IN_CHANNELS + 10)
+#endif
+
+/* A registration's don't care bits above its lowest care bit each double
+   the ranges it takes in a lookup table. Past this many, the lowest care
+   bits are given up instead */
+#define CAN_FILTER_MAX_SPLIT_BITS	4
+
+/* A hardware filter which ignores the IDE bit */
+#define CAN_FILTER_ANY		2
+
+/* Traffic in the uniform model. Standard and extended identifiers each
+   have half */
+#define CAN_FILTER_SPACE	(1ULL << 40)
+
+/* A registration, as can_register_id() takes it: the frame is accepted
+   when (frame id & mask) == (id & mask) and its ext matches */
+typedef struct can_filter {
+	u32	mask;
+	u32	id;
+	u08	ext;
+} can_filter;
+
+/* A mask filter, in the arbitration field layout the C_CAN and MCP2510
+   registers use: a standard identifier is in bits 28 to 18. ext may be
+   CAN_FILTER_ANY */
+typedef struct can_hw_filter {
+	u32	mask;
+	u32	id;
+	u08	ext;
+} can_hw_filter;
+
+/* Identifiers lo to hi inclusive, as can_msg has them */
+typedef struct can_filter_range {
+	u32	lo;
+	u32	hi;
+	u08	ext;
+} can_filter_range;
+
+/* A frame seen on the bus, and how often, in any unit */
+typedef struct can_filter_traffic {
+	u32	id;
+	u08	ext;
+	u32	rate;
+} can_filter_traffic;
+
+typedef struct can_filter_report {
+	u16	filters;	/* Hardware filters, masks or ranges used */
+	u64	wanted;		/* Traffic the registrations accept */
+	u64	admitted;	/* Traffic the compiled filters accept */
+	u64	total;		/* The profile's total, or CAN_FILTER_SPACE */
+} can_filter_report;
+
+/* MCP2510 filters. mask[0] applies to filter[0] and [1], which feed
+   RXB0, and mask[1] to filter[2] to [5], which feed RXB1. Filters with
+   nothing to do repeat one that has */
+typedef struct can_filter_mcp2510 {
+	u32		mask[2];
+	can_hw_filter	filter[6];
+} can_filter_mcp2510;
+
+/* A compile takes a traffic profile, or 0 for the uniform model, and
+   fills in a report, if it is given one */
+typedef struct can_filter_profile {
+	const can_filter_traffic	*frames;
+	u16				count;
+} can_filter_profile;
+
+/* Adds a registration to a list holding at most max, which must be from
+   2 to CAN_FILTER_MAX_REGS. If the list is full, the two closest registrations (counting
+   the new one) are merged to make room, so it never fails. Returns the
+   new count */
+u16	can_filter_add(can_filter *list, u16 count, u16 max, const can_filter *reg);
+
+/* Compiles count registrations into at most max mask filters, where max
+   is at least 2. out must have room for count filters. any_ext says
+   whether a filter may ignore the IDE bit. Returns the number of
+   filters */
+u16	can_filter_compile_objects(const can_filter *regs, u16 count,
+			can_hw_filter *out, u16 max, u08 any_ext,
+			const can_filter_profile *profile, can_filter_report *report);
+
+/* Returns the number of distinct filters, or 0 if there are no
+   registrations or more than CAN_FILTER_MAX_REGS */
+u08	can_filter_compile_mcp2510(const can_filter *regs, u16 count,
+			can_filter_mcp2510 *out,
+			const can_filter_profile *profile, can_filter_report *report);
+
+/* Compiles into at most max ranges, sorted standard first then by lo,
+   using at most words table words: a standard range takes one, an
+   extended identifier one and an extended range two. max must be at
+   least 2, and out must have room for max + 1. Returns the number of
+   ranges, or 0 if there are more than CAN_FILTER_MAX_REGS registrations */
+u16	can_filter_compile_aflut(const can_filter *regs, u16 count,
+			can_filter_range *out, u16 max, u16 words,
+			const can_filter_profile *profile, can_filter_report *report);
+
+/* Whether a compiled filter or range accepts a frame */
+u08	can_hw_filter_match(const can_hw_filter *filter, u32 id, u08 ext);
+u08	can_filter_range_match(const can_filter_range *range, u32 id, u08 ext);
+
+#endif
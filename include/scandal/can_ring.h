@@ -0,0 +1,108 @@
+/*
+ *  can_ring.h
+ *
+ *  Single producer, single consumer ring of CAN messages.
+ *
+ *  Used to hand received frames from a CAN interrupt handler (the producer)
+ *  to the Scandal engine (the consumer) without disabling interrupts. The
+ *  producer only ever writes head and the consumer only ever writes tail, so
+ *  neither side needs a lock. Nothing in here is hardware specific, so the
+ *  same code can be exercised on a PC with a thread standing in for the
+ *  interrupt handler.
+ */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCANDAL_CAN_RING__
+#define __SCANDAL_CAN_RING__
+
+#include <scandal/types.h>
+#include <scandal/can.h>
+
+/* Default receive ring size. Must be a power of two */
+#ifndef CAN_RX_RING_SIZE
+#define CAN_RX_RING_SIZE	32
+#endif
+
+/* Ordering between the slot contents and the index that publishes them.
+   On a single core micro a compiler barrier is all that is needed, but the
+   atomic builtins give us the right thing on a multi-core host as well. */
+#if defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 7)))
+#define CAN_RING_LOAD_ACQUIRE(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define CAN_RING_STORE_RELEASE(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#define CAN_RING_LOAD_ACQUIRE(p)	({ u16 __v = *(p); __asm__ __volatile__("" ::: "memory"); __v; })
+#define CAN_RING_STORE_RELEASE(p, v)	do { __asm__ __volatile__("" ::: "memory"); *(p) = (v); } while(0)
+#endif
+
+typedef struct can_ring {
+	volatile u16	head;		/* Next slot to fill, written by the producer only */
+	volatile u16	tail;		/* Next slot to empty, written by the consumer only */
+	u16		mask;		/* Number of slots - 1 */
+	can_msg		*msgs;		/* Slot storage */
+	volatile u32	overruns;	/* Frames dropped because the ring was full */
+	volatile u32	lost;		/* Frames the controller overwrote before we read them */
+} can_ring;
+
+/* size must be a power of two, no larger than 32768 */
+static inline void can_ring_init(can_ring *ring, can_msg *msgs, u16 size){
+	ring->head = 0;
+	ring->tail = 0;
+	ring->mask = size - 1;
+	ring->msgs = msgs;
+	ring->overruns = 0;
+	ring->lost = 0;
+}
+
+/* Number of frames waiting. Safe to call from either side */
+static inline u16 can_ring_count(can_ring *ring){
+	return (u16)(ring->head - ring->tail);
+}
+
+/* Producer side: returns the slot to fill next, or 0 if the ring is full (in
+   which case the frame is counted as an overrun). The frame is not visible to
+   the consumer until can_ring_commit() is called. */
+static inline can_msg *can_ring_reserve(can_ring *ring){
+	u16 head = ring->head;
+
+	if((u16)(head - CAN_RING_LOAD_ACQUIRE(&ring->tail)) > ring->mask){
+		ring->overruns++;
+		return 0;
+	}
+
+	return &ring->msgs[head & ring->mask];
+}
+
+static inline void can_ring_commit(can_ring *ring){
+	CAN_RING_STORE_RELEASE(&ring->head, (u16)(ring->head + 1));
+}
+
+/* Consumer side: copies out the oldest frame. Returns 0 if the ring is empty */
+static inline u08 can_ring_get(can_ring *ring, can_msg *msg){
+	u16 tail = ring->tail;
+
+	if(CAN_RING_LOAD_ACQUIRE(&ring->head) == tail)
+		return 0;
+
+	*msg = ring->msgs[tail & ring->mask];
+	CAN_RING_STORE_RELEASE(&ring->tail, (u16)(tail + 1));
+
+	return 1;
+}
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ *  can_txq.h
+ *
+ *  Transmit queue, ordered the way the bus arbitrates.
+ *
+ *  Frames come out lowest arbitration field first (see can_arb_key()), and
+ *  frames with the same identifier in the order they were queued. So a
+ *  critical frame queued behind a burst of telemetry goes out next, rather
+ *  than after the burst, just as it would if the telemetry came from
+ *  another node.
+ *
+ *  Like can_ring, frames are built in place: can_txq_reserve() returns a
+ *  free slot, and can_txq_commit() queues whatever was built there. The
+ *  queue is a binary min-heap of slot numbers, with a bitmap of the slots
+ *  in use, so it holds at most CAN_TXQ_MAX frames. Unlike can_ring there is
+ *  no lock free side: use it from one context only, or with the CAN
+ *  interrupt disabled around calls from the other.
+ */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCANDAL_CAN_TXQ__
+#define __SCANDAL_CAN_TXQ__
+
+#include <scandal/types.h>
+#include <scandal/can.h>
+
+#define CAN_TXQ_MAX		32
+
+typedef struct can_txq_slot {
+	can_msg		msg;
+	u32		key;		/* can_arb_key() of msg */
+	u16		seq;		/* Order queued, for ties */
+} can_txq_slot;
+
+typedef struct can_txq {
+	can_txq_slot	*slots;
+	u08		size;
+	u08		count;		/* Frames queued */
+	u08		high_water;	/* Most frames ever queued at once */
+	u32		used;		/* Bit n set while slot n is queued */
+	u08		heap[CAN_TXQ_MAX];
+	u16		seq;
+	u32		overruns;	/* Frames dropped because the queue was full */
+} can_txq;
+
+/* size must be no larger than CAN_TXQ_MAX */
+static inline void can_txq_init(can_txq *q, can_txq_slot *slots, u08 size){
+	q->slots = slots;
+	q->size = size;
+	q->count = 0;
+	q->high_water = 0;
+	q->used = 0;
+	q->seq = 0;
+	q->overruns = 0;
+}
+
+static inline u08 can_txq_count(can_txq *q){
+	return q->count;
+}
+
+/* Whether slot a goes before slot b. Sequence numbers are compared modulo
+   2^16, which is safe with far fewer than 32768 frames queued */
+static inline u08 can_txq_before(can_txq *q, u08 a, u08 b){
+	if(q->slots[a].key != q->slots[b].key)
+		return q->slots[a].key < q->slots[b].key;
+	return (s16)(q->slots[a].seq - q->slots[b].seq) < 0;
+}
+
+/* Returns a free slot to build a frame in, or 0 if the queue is full (in
+   which case the frame is counted as an overrun). Nothing is queued until
+   can_txq_commit() */
+static inline can_msg *can_txq_reserve(can_txq *q){
+	if(q->count >= q->size){
+		q->overruns++;
+		return 0;
+	}
+
+	return &q->slots[__builtin_ctzl(~(unsigned long)q->used)].msg;
+}
+
+/* Queues the frame built in the slot can_txq_reserve() returned */
+static inline void can_txq_commit(can_txq *q, can_msg *msg){
+	u08 slot = (can_txq_slot *)msg - q->slots;
+	u08 i = q->count++, parent;
+
+	q->slots[slot].key = can_arb_key(msg->id, msg->ext);
+	q->slots[slot].seq = q->seq++;
+	q->used |= 1UL << slot;
+	if(q->count > q->high_water)
+		q->high_water = q->count;
+
+	/* Sift up */
+	q->heap[i] = slot;
+	while(i > 0){
+		parent = (i - 1) >> 1;
+		if(!can_txq_before(q, q->heap[i], q->heap[parent]))
+			break;
+		q->heap[i] = q->heap[parent];
+		q->heap[parent] = slot;
+		i = parent;
+	}
+}
+
+/* The frame that goes next, or 0 if the queue is empty. It stays queued
+   until can_txq_release() */
+static inline can_msg *can_txq_peek(can_txq *q){
+	if(q->count == 0)
+		return 0;
+	return &q->slots[q->heap[0]].msg;
+}
+
+/* Removes the frame can_txq_peek() returned */
+static inline void can_txq_release(can_txq *q){
+	u08 slot, i = 0, child;
+
+	q->used &= ~(1UL << q->heap[0]);
+	slot = q->heap[--q->count];
+
+	/* Sift down */
+	while((child = 2 * i + 1) < q->count){
+		if(child + 1 < q->count && can_txq_before(q, q->heap[child + 1], q->heap[child]))
+			child++;
+		if(!can_txq_before(q, q->heap[child], slot))
+			break;
+		q->heap[i] = q->heap[child];
+		i = child;
+	}
+	q->heap[i] = slot;
+}
+
+#endif
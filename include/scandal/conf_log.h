@@ -0,0 +1,120 @@
+/*
+ *  conf_log.h
+ *
+ *  Log-structured store for the scandal config.
+ *
+ *  sc_write_conf() used to erase the config sector and write the whole
+ *  config back every time anything in it changed, which blocked for a few
+ *  hundred milliseconds on the LPC11C14 and wore the sector out a whole
+ *  erase per parameter. Instead, the config flash is a journal: each write
+ *  appends records holding just the bytes that changed, and the sector is
+ *  only erased when it fills, when the live config is written out afresh.
+ *
+ *  A bank is laid out as
+ *
+ *    header	'S' 'C' 'L' version, sequence number, CRC
+ *    records	tag, length, offset, data, CRC, each padded out to
+ *		SC_CONF_WRITE_UNIT with erased bytes
+ *    erased	to the end of the bank
+ *
+ *  The records of one write are tagged CONF_LOG_MORE but for the last,
+ *  which is CONF_LOG_END, and are only applied if they all made it, so a
+ *  write cut short by a reset takes effect completely or not at all.
+ *  Compaction writes the config into the next bank, and its header last,
+ *  so with two or more banks the old bank stays valid until the new one
+ *  is. With one bank, a reset during compaction loses the config, as a
+ *  reset during any write used to.
+ *
+ *  Mounting replays the newest valid bank into a RAM image, which is what
+ *  reads come from. Flash written before the log, with the config as is at
+ *  the start of bank 0, is taken as the image, and turned into a log by
+ *  the first write.
+ *
+ *  The image is the config followed by SC_USER_STORE_SIZE bytes of user
+ *  storage, see scandal/user_store.h. Where the user storage used to be
+ *  kept as is at the start of a bank of its own, the arch names that bank
+ *  SC_USER_STORE_LEGACY_BANK, and it is taken as the user storage until
+ *  the log has any, or the bank is compacted into. If the old storage,
+ *  SC_USER_STORE_LEGACY_SIZE bytes, was bigger than the new, what was
+ *  written past the new size is counted in legacy_lost, and the engine
+ *  reports it as a LEN_ERR.
+ *
+ *  Each arch's flash driver gives the geometry in arch/flash.h and
+ *  provides the three backend functions below. The banks must read as
+ *  memory and erase to 0xFF.
+ */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCANDAL_CONF_LOG__
+#define __SCANDAL_CONF_LOG__
+
+#include <scandal/types.h>
+#include <scandal/eeprom.h>
+
+#include <arch/flash.h>
+
+/* Archs without a backend have no user storage either */
+#ifndef SC_USER_STORE_SIZE
+#define SC_USER_STORE_SIZE	0
+#endif
+
+/* What the log holds */
+#define CONF_LOG_USER_OFFSET	sizeof(scandal_config)
+#define CONF_LOG_IMAGE_SIZE	(sizeof(scandal_config) + SC_USER_STORE_SIZE)
+
+#if defined(SC_USER_STORE_LEGACY_BANK) && !defined(SC_USER_STORE_LEGACY_SIZE)
+#define SC_USER_STORE_LEGACY_SIZE	SC_USER_STORE_SIZE
+#endif
+
+/* Record tags. Erased flash reads as 0xFF, which is neither */
+#define CONF_LOG_END		0x01
+#define CONF_LOG_MORE		0x02
+
+/* Most data bytes in one record */
+#define CONF_LOG_MAX_DATA	64
+
+typedef struct sc_conf_log {
+	u08	image[CONF_LOG_IMAGE_SIZE];	/* The config and user storage, as flash has them */
+	u08	bank;				/* Bank being appended to */
+	u16	seq;				/* Its sequence number */
+	u16	end;				/* Where the next record goes */
+	u32	records;			/* Records appended */
+	u32	compactions;			/* Banks erased to make room */
+	u16	legacy_lost;			/* Bytes of the old user storage that didn't fit */
+} sc_conf_log;
+
+/* Replays the flash into the image. Called by sc_init_eeprom() */
+void	sc_conf_log_mount(void);
+
+/* Copies length bytes of the image from offset */
+void	sc_conf_log_read(u16 offset, void *data, u16 length);
+
+/* Makes the image from offset what data is, appending records for the
+   bytes that differ, or compacting if there isn't room for them.
+   Nothing is written if nothing differs */
+void	sc_conf_log_write(u16 offset, const void *data, u16 length);
+
+/* Backend, in each arch's flash driver. Banks are numbered from 0 to
+   SC_CONF_BANKS - 1. Writes start on a SC_CONF_WRITE_UNIT boundary and
+   are a whole number of units long, and only ever go to erased flash */
+const u08	*sc_conf_bank(u08 bank);
+void		sc_conf_bank_erase(u08 bank);
+void		sc_conf_bank_write(u08 bank, u16 offset, const u08 *data, u16 length);
+
+#endif
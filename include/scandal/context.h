@@ -0,0 +1,140 @@
+/*
+ *  context.h
+ *
+ *  Engine context.
+ *
+ *  Everything the engine keeps between calls lives in one scandal_engine.
+ *  Firmware has just the one, scandal_default_engine, and sc_self is its
+ *  address, so it costs nothing over plain globals.
+ *
+ *  With SCANDAL_MULTI_ENGINE set (the default on the host arch), sc_self
+ *  is a per-thread pointer instead. A program can then set up any number
+ *  of engines with scandal_engine_setup(), and run one on the calling
+ *  thread with scandal_engine_init() and scandal_engine_handle(). The rest
+ *  of the API acts on whichever engine the thread last selected, so a
+ *  pool of worker threads can share out thousands of nodes between them,
+ *  as long as only one thread runs a given engine at a time.
+ *
+ *  Only the engine's own sources should need this header.
+ */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCANDAL_CONTEXT__
+#define __SCANDAL_CONTEXT__
+
+#include <scandal/types.h>
+#include <scandal/engine.h>
+#include <scandal/eeprom.h>
+#include <scandal/conf_log.h>
+#include <scandal/user_store.h>
+#include <scandal/freshness.h>
+#include <scandal/scheduler.h>
+#include <scandal/publisher.h>
+#include <scandal/busstats.h>
+#include <scandal/latency.h>
+#include <scandal/wavesculptor.h>
+
+#include <project/scandal_config.h>
+
+/* In-channel lookup index.
+   Channel frames are matched against my_config.ins[] through a small hash
+   table keyed on (source node, source channel number), rather than by
+   scanning every in-channel. Each bucket holds the first in-channel slot
+   which hashes there, and further slots are chained through
+   in_channel_index_next[]. Chains are kept in ascending slot order, so when
+   one source fans out to several in-channels, they are updated in the same
+   order as before. */
+#ifndef IN_CHANNEL_INDEX_BITS
+#if NUM_IN_CHANNELS <= 8
+#define IN_CHANNEL_INDEX_BITS	4
+#elif NUM_IN_CHANNELS <= 32
+#define IN_CHANNEL_INDEX_BITS	6
+#elif NUM_IN_CHANNELS <= 128
+#define IN_CHANNEL_INDEX_BITS	8
+#else
+#define IN_CHANNEL_INDEX_BITS	9
+#endif
+#endif
+
+#define IN_CHANNEL_INDEX_SIZE	(1 << IN_CHANNEL_INDEX_BITS)
+#define IN_CHANNEL_INDEX_NONE	0xFFFF
+
+typedef struct scandal_engine {
+	/* engine.c */
+	scandal_config			my_config;
+	in_channel			in_channels[NUM_IN_CHANNELS];
+	in_channel_handler		in_channel_handlers[NUM_IN_CHANNELS];
+	in_channel_timed_handler	in_channel_timed_handlers[NUM_IN_CHANNELS];
+	standard_message_handler	user_std_msg_handler;
+	u32				user_std_msg_handler_set;
+	ext_message_handler		user_ext_msg_handlers[SCANDAL_NUM_MSG_TYPES];
+	u16				user_msg_types;
+	u16				in_channel_index_head[IN_CHANNEL_INDEX_SIZE];
+	u16				in_channel_index_next[NUM_IN_CHANNELS];
+	u08				heartbeat_task;
+	u08				config_session;		/* Config changes are being staged */
+	u08				config_session_task;	/* Its timeout */
+	sc_time_t			config_session_time;	/* When it last heard anything */
+	u08				config_staged_addr;	/* The address it will commit */
+	scandal_drain_stats		drain_stats;
+	uint64_t			timesync_offset;
+
+	/* conf_log.c */
+	sc_conf_log			conf_log;
+
+	/* user_store.c */
+	sc_user_store			user_store;
+
+	/* error.c */
+	u08				last_scandal_error;
+	u08				last_user_error;
+	u32				num_errors;
+
+	in_channel_freshness		freshness;
+	scandal_scheduler		scheduler;
+	publisher_channel		publisher[NUM_OUT_CHANNELS];
+	u08				out_channel_formats[NUM_OUT_CHANNELS];
+#if !DISABLE_BUSSTATS
+	scandal_busstats		busstats;
+#endif
+#if SCANDAL_LATENCY_HISTOGRAMS
+	u16				latency_hists[LATENCY_NUM_HISTS][SCANDAL_LATENCY_BUCKETS];
+#endif
+
+	/* drivers/wavesculptor.c */
+	ws_base_callback		ws_base_handler_cb;
+	ws_status_callback		ws_status_handler_cb;
+	ws_bus_callback			ws_bus_handler_cb;
+	ws_velocity_callback		ws_velocity_handler_cb;
+	ws_temp_callback		ws_temp_handler_cb;
+
+	/* Whatever runs the engine, e.g. the host arch's node */
+	void				*owner;
+} scandal_engine;
+
+extern scandal_engine scandal_default_engine;
+
+#if SCANDAL_MULTI_ENGINE
+extern SCANDAL_NODE_LOCAL scandal_engine *scandal_current_engine;
+#define sc_self			(scandal_current_engine)
+#else
+#define sc_self			(&scandal_default_engine)
+#endif
+
+#endif
@@ -47,7 +47,9 @@ typedef struct conf {
 void sc_init_eeprom(void);
 void sc_read_conf(scandal_config *conf);
 void sc_write_conf(scandal_config *conf);
-void sc_user_eeprom_read_block(u32 loc, u08 *data, u08 length);
-void sc_user_eeprom_write_block(u32 loc, u08 *data, u08 length);
+/* User storage. LEN_ERR, with nothing read or written, if the block runs
+   past the SC_USER_STORE_SIZE bytes the arch has */
+u08  sc_user_eeprom_read_block(u32 loc, u08 *data, u08 length);
+u08  sc_user_eeprom_write_block(u32 loc, u08 *data, u08 length);
 
 #endif
@@ -43,7 +43,8 @@
 typedef struct in_chan{
 	s32	value;
 	u32 time;
-	u32	rcvd_time;
+	u32	rcvd_time;	/* sc_get_timer() time the frame arrived */
+	sc_utime_t	rcvd_us;	/* sc_get_timer_us() time the frame arrived */
 } in_channel;
 
 //#warning SIZEOF_IN_CHAN_CONFIG MAY ONLY WORK FOR MSP430
@@ -61,6 +62,41 @@ typedef struct out_chan_config{
 
 /* Global configuration */
 #define HEARTBEAT_PERIOD		1000
+
+/* How much of the receive queue handle_scandal() works through on each call.
+   A limit of 0 means no limit: keep going until the queue is empty. The
+   default of a single frame per call is what Scandal has always done */
+#ifndef SCANDAL_DRAIN_MAX_FRAMES
+#define SCANDAL_DRAIN_MAX_FRAMES	1
+#endif
+
+#ifndef SCANDAL_DRAIN_BUDGET_US
+#define SCANDAL_DRAIN_BUDGET_US		0
+#endif
+
+/* Time scandal_init() gives the bus to settle, in ms */
+#ifndef SCANDAL_INIT_DELAY
+#ifdef host
+#define SCANDAL_INIT_DELAY		0
+#else
+#define SCANDAL_INIT_DELAY		100
+#endif
+#endif
+
+/* How long a config session stays open without a config message, in ms,
+   before it is aborted */
+#ifndef SCANDAL_CONFIG_SESSION_TIMEOUT
+#define SCANDAL_CONFIG_SESSION_TIMEOUT	10000
+#endif
+
+/* More than one engine in a process. See scandal/context.h */
+#ifndef SCANDAL_MULTI_ENGINE
+#ifdef host
+#define SCANDAL_MULTI_ENGINE		1
+#else
+#define SCANDAL_MULTI_ENGINE		0
+#endif
+#endif
 #define SCANDAL_VERSION			0x0A		/* Version 0.10 */
 
 /* Message type definitions */
@@ -73,6 +109,22 @@ typedef struct out_chan_config{
 #define USER_CONFIG_TYPE		6 
 #define COMMAND_TYPE			7
 #define TIMESYNC_TYPE                   8
+#define PACKED16_TYPE                   10	/* See scandal/packed.h */
+#define PACKED24_TYPE                   11
+#define SCANDAL_NUM_MSG_TYPES           (PACKED24_TYPE + 1)
+
+/* Message type mask bits, used to select which message types are passed on
+   to scandal_user_handle_message(). SCANDAL_MSG_OTHER covers any type the
+   engine doesn't know about. */
+#define SCANDAL_MSG_TYPE_BIT(type)      ((u16)1 << (type))
+#define SCANDAL_MSG_OTHER               ((u16)1 << 15)
+#define SCANDAL_MSG_ALL                 0xFFFF
+
+/* Types passed to scandal_user_handle_message() unless the node asks for
+   something else with scandal_set_user_message_types() */
+#ifndef SCANDAL_USER_MESSAGE_TYPES
+#define SCANDAL_USER_MESSAGE_TYPES      SCANDAL_MSG_ALL
+#endif
 
 /* Frame Definition #defines */
 
@@ -152,6 +204,14 @@ Heartbeat consists of the following:
 #define CONFIG_IN_CHAN_SOURCE 		1	/* Data: 16 bits channel number, 8 bits source node, 16 bits source num */
 #define CONFIG_OUT_CHAN_M		2	/* Data: 16 bits channel number, 32 bits new M */
 #define CONFIG_OUT_CHAN_B		3	/* Data: 16 bits channel number, 32 bits new B */
+#define CONFIG_IN_CHAN_MAX_AGE		4	/* Data: 16 bits channel number, 32 bits max age in ms (0 = never stale) */
+#define CONFIG_OUT_CHAN_MIN_INTERVAL	5	/* Data: 16 bits channel number, 32 bits min interval in ms */
+#define CONFIG_OUT_CHAN_MAX_INTERVAL	6	/* Data: 16 bits channel number, 32 bits max interval in ms (0 = none) */
+#define CONFIG_OUT_CHAN_DEADBAND	7	/* Data: 16 bits channel number, 32 bits deadband */
+#define CONFIG_OUT_CHAN_FORMAT		8	/* Data: 16 bits channel number, 8 bits SCANDAL_FORMAT_* */
+#define CONFIG_SESSION_BEGIN		9	/* No data. Stage the following changes */
+#define CONFIG_SESSION_COMMIT		10	/* No data. Write the staged changes out */
+#define CONFIG_SESSION_ABORT		11	/* No data. Go back to the config in flash */
 
 /* Utility macros for manipulating messages */
 #define SCANDAL_MSG_PRIORITY(msg)         ((msg->id >> PRI_OFFSET) & ((1<<PRI_BITS) -1))
@@ -227,6 +287,21 @@ typedef struct channel_frame {
 	u32 length;
 } sc_channel_frame;
 
+/* Receive drain statistics, as kept by handle_scandal_drain() */
+typedef struct drain_stats {
+	u32		calls;			/* Number of drain calls */
+	u32		frames;			/* Total frames drained */
+	u16		last_frames;		/* Frames drained by the last call */
+	u16		max_frames;		/* Most frames drained by a single call */
+	sc_utime_t	last_time_us;		/* Time spent in the last call */
+	sc_utime_t	max_time_us;		/* Longest time spent in a single call */
+	u32		limit_stops;		/* Calls which stopped on the frame limit */
+	u32		budget_exhaustions;	/* Calls which ran out of time budget */
+	sc_utime_t	last_queue_us;		/* Arrival to dispatch delay of the last frame */
+	sc_utime_t	max_queue_us;		/* Longest arrival to dispatch delay */
+	u64		total_queue_us;		/* Sum of delays, divide by frames for the mean */
+} scandal_drain_stats;
+
 /* Function Prototypes */
 u08 			scandal_init(void);
 s32 			scandal_get_m(u16 chan_num);
@@ -237,19 +312,40 @@ void			scandal_set_b(u16 chan_num, s32 value);
 s32 			scandal_get_in_channel_value(u16 chan_num);
 sc_time_t 		scandal_get_in_channel_time(u16 chan_num);
 sc_time_t 		scandal_get_in_channel_rcvd_time(u16 chan_num);
+sc_utime_t		scandal_get_in_channel_rcvd_us(u16 chan_num);
 u08 			scandal_in_channel_is_valid(u16 chan_num);
 in_channel*		scandal_get_in_channel(u16 chan_num);
 
 typedef			void (*in_channel_handler)(int32_t value, uint32_t src_time);
+typedef			void (*in_channel_timed_handler)(int32_t value, uint32_t src_time, sc_utime_t rcvd_us);
 typedef			void (*standard_message_handler)(can_msg *msg);
+typedef			u08 (*ext_message_handler)(can_msg *msg);
 
 void			scandal_register_in_channel_handler(int chan_num, in_channel_handler handler);
+void			scandal_register_in_channel_timed_handler(int chan_num, in_channel_timed_handler handler);
 void            register_standard_message_handler(standard_message_handler handler);
+u08			scandal_register_ext_message_handler(u08 type, ext_message_handler handler);
+void			scandal_set_user_message_types(u16 type_mask);
 
 u08 			scandal_get_addr(void);
 u32 			scandal_get_mac(void);
 u32 			scandal_get_time(void);
 
 void 			handle_scandal(void);
+u16			handle_scandal_drain(u16 max_frames, sc_utime_t budget_us);
+void			scandal_get_drain_stats(scandal_drain_stats *stats);
+void			scandal_reset_drain_stats(void);
+u08			scandal_get_heartbeat_task(void);
+
+struct scandal_engine;
+void			scandal_engine_setup(struct scandal_engine *engine, void *owner);
+struct scandal_engine	*scandal_get_engine(void);
+void			*scandal_get_engine_owner(void);
+#if SCANDAL_MULTI_ENGINE
+void			scandal_select_engine(struct scandal_engine *engine);
+u08			scandal_engine_init(struct scandal_engine *engine);
+u16			scandal_engine_handle(struct scandal_engine *engine, u16 max_frames,
+					sc_utime_t budget_us);
+#endif
 
 #endif
@@ -0,0 +1,72 @@
+/*
+ *  freshness.h
+ *
+ *  In-channel freshness deadlines.
+ *
+ *  Each in-channel can be given a maximum age. If no new value arrives
+ *  within that time the channel is marked stale and its freshness handler
+ *  is called. When a value does arrive, the channel recovers and the
+ *  handler is called again. Deadlines are kept in a min-heap, so checking
+ *  costs nothing unless a channel is actually expiring.
+ */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCANDAL_FRESHNESS__
+#define __SCANDAL_FRESHNESS__
+
+#include <scandal/types.h>
+#include <scandal/timer.h>
+
+#include <project/scandal_config.h>
+
+/* Maximum age, in ms, given to every in-channel at startup. 0 means the
+   channel never goes stale. Projects can override this in scandal_config.h */
+#ifndef SCANDAL_IN_CHANNEL_MAX_AGE
+#define SCANDAL_IN_CHANNEL_MAX_AGE	0
+#endif
+
+#define IN_CHANNEL_FRESH		0
+#define IN_CHANNEL_STALE		1
+
+/* Called with IN_CHANNEL_STALE once when a channel expires, and with
+   IN_CHANNEL_FRESH once when it next receives a value */
+typedef void (*in_channel_freshness_handler)(u16 chan_num, u08 state);
+
+typedef struct in_chan_freshness {
+	u16		heap[NUM_IN_CHANNELS];		/* Channels with a pending deadline, earliest first */
+	u16		pos[NUM_IN_CHANNELS];		/* Where each channel sits in heap[] */
+	u16		count;				/* Entries in heap[] */
+	sc_time_t	deadline[NUM_IN_CHANNELS];
+	sc_time_t	max_age[NUM_IN_CHANNELS];	/* 0 = never stale */
+	u08		stale[NUM_IN_CHANNELS];
+	in_channel_freshness_handler	handlers[NUM_IN_CHANNELS];
+} in_channel_freshness;
+
+void	scandal_init_freshness(void);
+void	scandal_set_in_channel_max_age(u16 chan_num, sc_time_t max_age);
+sc_time_t	scandal_get_in_channel_max_age(u16 chan_num);
+void	scandal_register_in_channel_freshness_handler(u16 chan_num, in_channel_freshness_handler handler);
+u08	scandal_in_channel_is_stale(u16 chan_num);
+
+/* Used by the engine */
+void	scandal_freshness_touch(u16 chan_num, sc_time_t rcvd_time);
+void	scandal_freshness_reset(u16 chan_num);
+void	scandal_check_freshness(sc_time_t now);
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ *  latency.h
+ *
+ *  Receive path latency histograms.
+ *
+ *  Each histogram counts samples into log2 buckets of microseconds: bucket
+ *  0 holds 0us, bucket k holds [2^(k-1), 2^k) us, and the last bucket
+ *  holds everything longer. Histograms are kept for:
+ *
+ *    LATENCY_ISR	receive interrupt to frame queued, in the CAN driver
+ *    LATENCY_QUEUE	frame received to frame dispatched by handle_scandal()
+ *    LATENCY_HANDLER	+ class: time spent handling a frame, by message type
+ *    LATENCY_TX_QUEUE	+ class: time a frame waits in the CAN driver's
+ *			transmit queue for a message object, by the priority
+ *			in its identifier (see CAN_ARB_CLASS). Frames which go
+ *			straight out count as 0us
+ *
+ *  Times come from sc_get_timer_us(), which each arch provides. Build with
+ *  SCANDAL_LATENCY_HISTOGRAMS set to 1 to turn them on; otherwise recording
+ *  compiles to nothing.
+ */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCANDAL_LATENCY__
+#define __SCANDAL_LATENCY__
+
+#include <scandal/types.h>
+#include <scandal/timer.h>
+#include <scandal/engine.h>
+#include <scandal/can.h>
+
+#include <project/scandal_config.h>
+
+#ifndef SCANDAL_LATENCY_HISTOGRAMS
+#define SCANDAL_LATENCY_HISTOGRAMS	0
+#endif
+
+/* 16 buckets covers up to 16ms, with anything longer in the last */
+#ifndef SCANDAL_LATENCY_BUCKETS
+#define SCANDAL_LATENCY_BUCKETS		16
+#endif
+
+#define LATENCY_ISR			0
+#define LATENCY_QUEUE			1
+#define LATENCY_HANDLER			2	/* + message type, or one of the two below */
+#define LATENCY_HANDLER_OTHER		(LATENCY_HANDLER + SCANDAL_NUM_MSG_TYPES)
+#define LATENCY_HANDLER_STD		(LATENCY_HANDLER + SCANDAL_NUM_MSG_TYPES + 1)
+#define LATENCY_TX_QUEUE		(LATENCY_HANDLER + SCANDAL_NUM_MSG_TYPES + 2)
+#define LATENCY_NUM_HISTS		(LATENCY_TX_QUEUE + CAN_NUM_ARB_CLASSES)
+
+/* Scandal commands, see SCANDAL_COMMAND_BASE in scandal/busstats.h.
+   A dump request has the histogram in data[0] and the node to reply to in
+   data[7]. The reply is a series of commands numbered request +
+   SCANDAL_COMMAND_REPLY, each carrying the histogram, the first bucket
+   number and three big endian 16 bit counts. */
+#define SCANDAL_CMD_LATENCY_DUMP	0x3F4
+#define SCANDAL_CMD_LATENCY_RESET	0x3F5
+
+/* Sync byte at the start of each histogram in a UART dump. It is followed
+   by the histogram number, the number of buckets, then the counts as big
+   endian u16s */
+#define LATENCY_UART_SYNC		0xA5
+
+#if SCANDAL_LATENCY_HISTOGRAMS
+
+static inline u08 scandal_latency_bucket(sc_utime_t us){
+	u08 b;
+
+	if(us == 0)
+		return 0;
+	/* Number of significant bits */
+	b = 8 * sizeof(unsigned long) - __builtin_clzl((unsigned long)us);
+	return b < SCANDAL_LATENCY_BUCKETS ? b : SCANDAL_LATENCY_BUCKETS - 1;
+}
+
+/* Counts saturate rather than wrap */
+static inline void scandal_latency_count(u16 *counts, sc_utime_t us){
+	u16 *count = &counts[scandal_latency_bucket(us)];
+
+	if(*count != 0xFFFF)
+		(*count)++;
+}
+
+/* Safe to call from an interrupt, as long as each histogram is only ever
+   recorded into from one context. Callers need scandal/context.h */
+#define scandal_latency_record(hist, us) \
+	scandal_latency_count(sc_self->latency_hists[hist], (us))
+
+void	scandal_reset_latency(void);
+void	scandal_dump_latency_uart(void);
+void	scandal_handle_latency_command(u16 num, u08 *data);
+
+#else
+
+#define scandal_latency_record(hist, us)
+#define scandal_reset_latency()
+
+#endif
+
+#endif
@@ -76,6 +76,10 @@
 					 (((u32)((msg)->data[1] & 0xFF)) << 16) |\
 					 (((u32)((msg)->data[2] & 0xFF)) << 8) |\
 					 (((u32)((msg)->data[3] & 0xFF))))
+/* A channel message may be sent with just the value, and no timestamp */
+#define CHANNEL_SHORT_LENGTH            4
+#define CHANNEL_MSG_HAS_TIME(msg)       ((msg)->length >= 8)
+
 #define CHANNEL_MSG_TIME(msg)           ((((u32)(msg)->data[4] & 0xFF) << 24) |\
 					 (((u32)((msg)->data[5] & 0xFF) << 16) |\
 					 (((u32)(msg)->data[6] & 0xFF) << 8) |\
@@ -171,6 +175,14 @@ Heartbeat consists of the following:
 #define CONFIG_IN_CHAN_SOURCE 		1	/* Data: 16 bits channel number, 8 bits source node, 16 bits source num */
 #define CONFIG_OUT_CHAN_M		2	/* Data: 16 bits channel number, 32 bits new M */
 #define CONFIG_OUT_CHAN_B		3	/* Data: 16 bits channel number, 32 bits new B */
+#define CONFIG_IN_CHAN_MAX_AGE		4	/* Data: 16 bits channel number, 32 bits max age in ms (0 = never stale) */
+#define CONFIG_OUT_CHAN_MIN_INTERVAL	5	/* Data: 16 bits channel number, 32 bits min interval in ms */
+#define CONFIG_OUT_CHAN_MAX_INTERVAL	6	/* Data: 16 bits channel number, 32 bits max interval in ms (0 = none) */
+#define CONFIG_OUT_CHAN_DEADBAND	7	/* Data: 16 bits channel number, 32 bits deadband */
+#define CONFIG_OUT_CHAN_FORMAT		8	/* Data: 16 bits channel number, 8 bits SCANDAL_FORMAT_* */
+#define CONFIG_SESSION_BEGIN		9	/* No data. Stage the following changes */
+#define CONFIG_SESSION_COMMIT		10	/* No data. Write the staged changes out */
+#define CONFIG_SESSION_ABORT		11	/* No data. Go back to the config in flash */
 
 
 /* Generic utility macros */
@@ -262,6 +274,7 @@ static inline u32 scandal_mk_timesync_id(u08 priority){
 u08 scandal_send_heartbeat(u32 status);
 u08 scandal_send_channel_with_timestamp(u08 priority, u16 chan_num,
 		u32 value, sc_time_t timestamp);
+u08 scandal_send_short_channel(u08 priority, u16 chan_num, u32 value);
 u08 scandal_send_scandal_error(u08 err);
 u08 scandal_send_user_error(u08 err);
 u08 scandal_send_reset(u08 priority, u08 node);
@@ -0,0 +1,135 @@
+/*
+ *  packed.h
+ *
+ *  Packed channel frames.
+ *
+ *  A packed frame carries several consecutive channels from one node with a
+ *  single shared timestamp, rather than one 8 byte frame per channel. The ID
+ *  is laid out like a channel message, with the number of the first channel
+ *  in the channel number field. The data is the low 16 bits of the
+ *  timestamp followed by the values, all big endian:
+ *
+ *    PACKED16_TYPE:  ts16 | v0 16 | v1 16 | v2 16    up to 3 channels
+ *    PACKED24_TYPE:  ts16 | v0 24 | v1 24            up to 2 channels
+ *
+ *  The number of channels is given by the frame length. Values are signed
+ *  and sign extended on the way in. The receiver rebuilds the full timestamp
+ *  from its own clock, so this relies on the nodes being time synced to
+ *  within about 30 seconds.
+ *
+ *  Which format an out-channel uses is chosen on the sending node, per
+ *  channel, with scandal_set_out_channel_format() or the
+ *  CONFIG_OUT_CHAN_FORMAT config parameter. A receiving node can ask for a
+ *  format by sending that config message to the producer. Receivers always
+ *  accept all formats.
+ */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCANDAL_PACKED__
+#define __SCANDAL_PACKED__
+
+#include <scandal/types.h>
+#include <scandal/can.h>
+#include <scandal/engine.h>
+#include <scandal/timer.h>
+
+#include <project/scandal_config.h>
+
+/* Out-channel formats */
+#define SCANDAL_FORMAT_CHANNEL		0	/* One CHANNEL_TYPE frame per channel */
+#define SCANDAL_FORMAT_PACKED16		1
+#define SCANDAL_FORMAT_PACKED24		2
+#define SCANDAL_FORMAT_SHORT		3	/* CHANNEL_TYPE frame with no timestamp */
+
+#define PACKED_TIME_BYTES		2
+#define PACKED16_MAX_VALUES		3
+#define PACKED24_MAX_VALUES		2
+
+#define PACKED16_MIN			(-32768L)
+#define PACKED16_MAX			32767L
+#define PACKED24_MIN			(-8388608L)
+#define PACKED24_MAX			8388607L
+
+/* Both packed types differ only in the bottom bit, so one acceptance filter
+   takes both from a given node */
+#define PACKED_TYPE_MASK		(0xFEUL << TYPE_OFFSET)
+
+static inline u08 scandal_packed_width(u08 type){
+	return (type == PACKED16_TYPE) ? 2 : 3;
+}
+
+static inline u08 scandal_packed_max_values(u08 type){
+	return (type == PACKED16_TYPE) ? PACKED16_MAX_VALUES : PACKED24_MAX_VALUES;
+}
+
+static inline u32 scandal_mk_packed_id(u08 priority, u08 type, u08 source, u16 first_chan){
+	return( ((u32)(priority & 0x07) << PRI_OFFSET) |
+		((u32)type << TYPE_OFFSET) |
+		((u32)(source & 0xFF) << CHANNEL_SOURCE_ADDR_OFFSET) |
+		((u32)(first_chan & 0x03FF) << CHANNEL_NUM_OFFSET));
+}
+
+/* Number of values in a received packed frame */
+static inline u08 scandal_packed_count(can_msg *msg, u08 type){
+	u08 n;
+
+	if(msg->length <= PACKED_TIME_BYTES)
+		return 0;
+
+	n = (msg->length - PACKED_TIME_BYTES) / scandal_packed_width(type);
+	if(n > scandal_packed_max_values(type))
+		n = scandal_packed_max_values(type);
+	return n;
+}
+
+static inline s32 scandal_packed_value(can_msg *msg, u08 type, u08 index){
+	u08 *p;
+	u32 v;
+
+	if(type == PACKED16_TYPE){
+		p = &msg->data[PACKED_TIME_BYTES + 2 * index];
+		return (s16)(((u16)p[0] << 8) | p[1]);
+	}
+
+	p = &msg->data[PACKED_TIME_BYTES + 3 * index];
+	v = ((u32)p[0] << 16) | ((u32)p[1] << 8) | p[2];
+	if(v & 0x800000UL)
+		return (s32)v - 0x1000000L;
+	return (s32)v;
+}
+
+/* Rebuild a full 32 bit timestamp from the low 16 bits sent, by picking the
+   value nearest to our own idea of the time */
+static inline u32 scandal_packed_time(can_msg *msg, u32 now){
+	u16 ts = ((u16)msg->data[0] << 8) | msg->data[1];
+
+	return now + (s16)(ts - (u16)now);
+}
+
+void	scandal_init_packed(void);
+u08	scandal_set_out_channel_format(u16 chan_num, u08 format);
+u08	scandal_get_out_channel_format(u16 chan_num);
+u08	scandal_build_packed_msg(can_msg *msg, u08 pri, u08 format, u16 first_chan,
+			s32 *values, u08 count, sc_time_t timestamp);
+u08	scandal_send_packed_channels(u08 pri, u08 format, u16 first_chan, s32 *values, u08 count);
+u08	scandal_send_channels(u08 pri, u16 first_chan, s32 *values, u16 count);
+u08	scandal_send_channels_with_timestamp(u08 pri, u16 first_chan, s32 *values,
+			u16 count, sc_time_t timestamp);
+
+#endif
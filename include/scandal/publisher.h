@@ -0,0 +1,84 @@
+/*
+ *  publisher.h
+ *
+ *  Out-channel publisher.
+ *
+ *  Instead of sending a channel every time it is sampled, the application
+ *  hands each new value to scandal_publish() and the publisher decides
+ *  whether it is worth a frame. A value is sent once the channel's minimum
+ *  interval has passed, if it has moved by at least the deadband since the
+ *  last value sent, or if the maximum interval has passed. A value held
+ *  back by the minimum interval is sent by the publisher's own task as soon
+ *  as the interval is up.
+ *
+ *  Values go out in the channel's configured format, as with
+ *  scandal_send_channels(). The defaults (no minimum interval, no maximum
+ *  interval, deadband of 0) send every value.
+ */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCANDAL_PUBLISHER__
+#define __SCANDAL_PUBLISHER__
+
+#include <scandal/types.h>
+#include <scandal/timer.h>
+
+#include <project/scandal_config.h>
+
+/* How often, in ms, the publisher looks for held-back values and channels
+   which are due for a keep-alive */
+#ifndef SCANDAL_PUBLISHER_PERIOD
+#define SCANDAL_PUBLISHER_PERIOD	10
+#endif
+
+typedef struct publisher_params {
+	u32	min_interval;	/* ms, 0 = no limit */
+	u32	max_interval;	/* ms, 0 = no keep-alive */
+	u32	deadband;	/* Change needed to send early. 0 sends every value */
+} scandal_publisher_params;
+
+typedef struct publisher_stats {
+	u32	sent;
+	u32	suppressed;	/* Values which were never sent */
+} scandal_publisher_stats;
+
+typedef struct publisher_chan {
+	scandal_publisher_params	params;
+	scandal_publisher_stats		stats;
+	s32		value;		/* Most recent value */
+	sc_time_t	timestamp;	/* Time the most recent value was taken */
+	s32		sent_value;	/* Last value sent */
+	sc_time_t	sent_time;	/* sc_get_timer() when it was sent */
+	u08		priority;
+	u08		flags;
+} publisher_channel;
+
+#define PUBLISHER_HAVE_VALUE	(1<<0)	/* value is valid */
+#define PUBLISHER_HAVE_SENT	(1<<1)	/* sent_value is valid */
+#define PUBLISHER_PENDING	(1<<2)	/* value is waiting on the min interval */
+
+void	scandal_init_publisher(void);
+u08	scandal_publish(u08 pri, u16 chan_num, s32 value);
+u08	scandal_publish_scaled(u08 pri, u16 chan_num, s32 value);
+u08	scandal_set_publisher_params(u16 chan_num, scandal_publisher_params *params);
+u08	scandal_get_publisher_params(u16 chan_num, scandal_publisher_params *params);
+u08	scandal_get_publisher_stats(u16 chan_num, scandal_publisher_stats *stats);
+void	scandal_reset_publisher_stats(void);
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ *  scheduler.h
+ *
+ *  Cooperative periodic task scheduler.
+ *
+ *  Tasks are registered with a period, a phase (the delay before their first
+ *  run) and a priority, and are run from handle_scandal() when they fall due.
+ *  Release times are kept in a min-heap, so finding the next task to run is
+ *  O(1) and rescheduling one is O(log n). Tasks run to completion; a task
+ *  which takes too long simply delays the ones behind it.
+ */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCANDAL_SCHEDULER__
+#define __SCANDAL_SCHEDULER__
+
+#include <scandal/types.h>
+#include <scandal/timer.h>
+
+#include <project/scandal_config.h>
+
+/* Number of task slots, including the engine's own heartbeat task */
+#ifndef SCANDAL_MAX_TASKS
+#define SCANDAL_MAX_TASKS	8
+#endif
+
+#define SCANDAL_NO_TASK		0xFF
+
+/* Periods and phases are given in ms, but tasks are released on the
+   microsecond timer, so they may be no longer than about 35 minutes */
+#define SCANDAL_TASK_MAX_PERIOD	2000000
+
+typedef void (*scandal_task_fn)(void *arg);
+
+/* Per-task instrumentation. Jitter is how late a task started compared with
+   its release time. An overrun is a release which was skipped because the
+   task had not run by the time the next one came around. */
+typedef struct task_stats {
+	u32		runs;
+	u32		overruns;
+	sc_utime_t	last_runtime_us;
+	sc_utime_t	max_runtime_us;
+	sc_utime_t	last_jitter_us;
+	sc_utime_t	max_jitter_us;
+} scandal_task_stats;
+
+typedef struct task {
+	scandal_task_fn	fn;
+	void		*arg;
+	sc_utime_t	period_us;
+	sc_utime_t	release_us;	/* When the task is next due */
+	u08		priority;	/* Lower runs first when release times tie */
+	u08		pos;		/* Where the task sits in the heap */
+	scandal_task_stats	stats;
+} scandal_task;
+
+typedef struct scheduler {
+	scandal_task	tasks[SCANDAL_MAX_TASKS];
+	u08		heap[SCANDAL_MAX_TASKS];
+	u08		count;
+} scandal_scheduler;
+
+void	scandal_init_scheduler(void);
+u08	scandal_add_task(scandal_task_fn fn, void *arg, u32 period_ms, u32 phase_ms, u08 priority);
+u08	scandal_remove_task(u08 task_id);
+u08	scandal_set_task_period(u08 task_id, u32 period_ms);
+u08	scandal_get_task_stats(u08 task_id, scandal_task_stats *stats);
+void	scandal_reset_task_stats(u08 task_id);
+sc_utime_t	scandal_time_to_next_task(void);
+
+/* Used by the engine */
+void	scandal_run_tasks(void);
+
+#endif
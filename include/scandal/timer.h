@@ -30,28 +30,22 @@
 
 #include <scandal/types.h>
 
-/* Global variables */ 
-extern uint64_t timesync_offset; 
-
 /* Time in milliseconds */
 typedef u32 sc_time_t;
 
+/* Time in microseconds. This wraps about every 71 minutes, so it is only
+   good for measuring intervals, not for telling the time */
+typedef u32 sc_utime_t;
+
 /* Function Prototypes */
 void sc_init_timer(void);
 void sc_set_timer(sc_time_t time);
 sc_time_t sc_get_timer(void);
+sc_utime_t sc_get_timer_us(void);
 
-static inline uint64_t scandal_get_realtime(void){
-	return (uint64_t)sc_get_timer() + timesync_offset;
-}
-
-static inline uint32_t scandal_get_realtime32(void){
-	return (scandal_get_realtime()) & 0xFFFFFFFF;
-}
-
-static inline void scandal_set_realtime(uint64_t timestamp){
-    uint32_t mytime = (uint32_t)sc_get_timer(); 
-    timesync_offset = timestamp - mytime; 
-}
+/* Network time, in ms, kept in step with the other nodes by timesync */
+uint64_t scandal_get_realtime(void);
+uint32_t scandal_get_realtime32(void);
+void scandal_set_realtime(uint64_t timestamp);
 
 #endif
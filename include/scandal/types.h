@@ -80,7 +80,7 @@ typedef uint64_t       u64;
 #define AVAILABLE_64
 
 #else
-#if defined(lpc11c14) || defined(lpc1768)
+#if defined(lpc11c14) || defined(lpc1768) || defined(host)
 #include <arch/types.h>
 typedef uint8_t        u08;
 typedef int8_t         s08;
@@ -112,6 +112,15 @@ typedef uint64_t       u64;
 #endif
 #endif
 
+/* Storage class for what each thread needs its own copy of, such as the
+   engine it is running (see scandal/context.h). Only the host arch runs
+   engines on more than one thread, so elsewhere it is plain static */
+#ifdef host
+#define SCANDAL_NODE_LOCAL	__thread
+#else
+#define SCANDAL_NODE_LOCAL
+#endif
+
 /* Generic types (Defined in terms of the above) */
 //typedef u08            bool; 
 
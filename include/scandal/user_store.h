@@ -0,0 +1,80 @@
+/*
+ *  user_store.h
+ *
+ *  RAM cache of the user storage.
+ *
+ *  sc_user_eeprom_write_block() used to go straight to flash. On the
+ *  LPC11C14 it erased and rewrote sector 6 for every call, keeping only the
+ *  block written, and on the MSP430 it ignored loc. The user storage is now
+ *  part of the config log's image (see scandal/conf_log.h), after the
+ *  config, and sc_user_eeprom_read_block() and sc_user_eeprom_write_block()
+ *  go to a RAM copy of it.
+ *
+ *  A write that changes anything widens the dirty span. Flushing writes the
+ *  span through the log, which appends only the bytes that differ, as one
+ *  group that takes effect completely or not at all. With two banks,
+ *  compaction leaves the old image valid until the new one's header is
+ *  written.
+ *
+ *  The span is flushed by sc_user_store_flush(), by the engine once it has
+ *  been dirty for SC_USER_STORE_FLUSH_DELAY ms, and by the engine before it
+ *  resets the node. Everything written meanwhile goes in the one flush,
+ *  however often it is written. A reset the engine doesn't do, e.g. by the
+ *  watchdog, loses what hasn't been flushed. With a delay of 0, each write
+ *  is flushed as it is made.
+ */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCANDAL_USER_STORE__
+#define __SCANDAL_USER_STORE__
+
+#include <scandal/types.h>
+#include <scandal/timer.h>
+#include <scandal/conf_log.h>
+
+/* How long the user storage is left dirty, in ms. The engine looks every
+   that often, so it is flushed between one and two delays after the write
+   that dirtied it */
+#ifndef SC_USER_STORE_FLUSH_DELAY
+#define SC_USER_STORE_FLUSH_DELAY	1000
+#endif
+
+typedef struct sc_user_store {
+	u08		cache[SC_USER_STORE_SIZE ? SC_USER_STORE_SIZE : 1];
+	u16		dirty_start;	/* Dirty span, empty when they're equal */
+	u16		dirty_end;
+	sc_time_t	dirtied;	/* When the span last went from empty */
+	u32		flushes;	/* Flushes that had anything to write */
+} sc_user_store;
+
+/* Fills the cache from the log's image. Called by sc_init_eeprom(), after
+   sc_conf_log_mount() */
+void	sc_user_store_load(void);
+
+/* Writes the dirty span through the log */
+void	sc_user_store_flush(void);
+
+/* Whether anything written is yet to be flushed */
+u08	sc_user_store_dirty(void);
+
+/* Flushes if the span has been dirty for SC_USER_STORE_FLUSH_DELAY.
+   Called by the engine */
+void	sc_user_store_poll(void);
+
+#endif
@@ -1,3 +1,6 @@
+#ifndef __SCANDAL_WAVESCULPTOR__
+#define __SCANDAL_WAVESCULPTOR__
+
 #include <scandal/tritium.h>
 #include <scandal/can.h>
 #include <scandal/engine.h>
@@ -102,3 +105,5 @@ uint8_t check_device_valid(Wavesculptor_Output_Struct *dataStruct);
 int32_t check_device_type(Wavesculptor_Output_Struct *dataStruct);
 void send_ws_drive_commands(float rpm, float phase_current, float bus_current, Wavesculptor_Output_Struct *dataStruct);
 u08 scandal_send_ws_reset(Wavesculptor_Output_Struct *dataStruct);
+
+#endif
@@ -0,0 +1,343 @@
+/* --------------------------------------------------------------------------
+	C_CAN Model
+	File name: c_can.c
+
+	Register level model of the LPC11C14's C_CAN controller. See
+	arch/c_can.h.
+   -------------------------------------------------------------------------- */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <scandal/types.h>
+#include <scandal/can.h>
+
+#include <arch/c_can.h>
+
+#include <string.h>
+
+/* The register bits the model cares about, as in arch/can.h for the
+   lpc11c14 */
+#define C_CAN_CNTL_IE		(1 << 1)
+#define C_CAN_STAT_TXOK		(1 << 3)
+#define C_CAN_STAT_RXOK		(1 << 4)
+
+#define C_CAN_CMDREQ_BUSY	0x8000
+#define C_CAN_CMDREQ_NUM	0x003F
+
+#define C_CAN_CMD_DATAB		(1 << 0)
+#define C_CAN_CMD_DATAA		(1 << 1)
+#define C_CAN_CMD_TREQ		(1 << 2)	/* NewDat when reading */
+#define C_CAN_CMD_INTPND	(1 << 3)
+#define C_CAN_CMD_CTRL		(1 << 4)
+#define C_CAN_CMD_ARB		(1 << 5)
+#define C_CAN_CMD_MASK		(1 << 6)
+#define C_CAN_CMD_WR		(1 << 7)
+
+#define C_CAN_MSK2_MXTD		(1 << 15)
+#define C_CAN_MSK2_MDIR		(1 << 14)
+#define C_CAN_ARB2_MVAL		(1 << 15)
+#define C_CAN_ARB2_XTD		(1 << 14)
+#define C_CAN_ARB2_DIR		(1 << 13)
+
+#define C_CAN_MCTRL_NEWD	(1 << 15)
+#define C_CAN_MCTRL_MLST	(1 << 14)
+#define C_CAN_MCTRL_INTP	(1 << 13)
+#define C_CAN_MCTRL_UMSK	(1 << 12)
+#define C_CAN_MCTRL_TXIE	(1 << 11)
+#define C_CAN_MCTRL_RXIE	(1 << 10)
+#define C_CAN_MCTRL_TXRQ	(1 << 8)
+#define C_CAN_MCTRL_EOB		(1 << 7)
+#define C_CAN_MCTRL_DLC		0x000F
+
+c_can c_can_model;
+
+u32 c_can_access_cycles = 4;
+u32 c_can_xfer_cycles = 18;
+
+static c_can_if *c_can_interface(c_can_regs *regs, u08 n){
+	return n == 0 ? &regs->IF1 : &regs->IF2;
+}
+
+/* TXREQ, ND, IR, MSGV and INT from the message objects */
+static void c_can_update(void){
+	c_can_regs *regs = &c_can_model.regs;
+	u32 txreq = 0, nd = 0, ir = 0, msgv = 0;
+	u08 i;
+
+	for(i = 0; i < C_CAN_NUM_OBJS; i++){
+		if(c_can_model.objs[i].mctrl & C_CAN_MCTRL_TXRQ)
+			txreq |= 1UL << i;
+		if(c_can_model.objs[i].mctrl & C_CAN_MCTRL_NEWD)
+			nd |= 1UL << i;
+		if(c_can_model.objs[i].mctrl & C_CAN_MCTRL_INTP)
+			ir |= 1UL << i;
+		if(c_can_model.objs[i].arb2 & C_CAN_ARB2_MVAL)
+			msgv |= 1UL << i;
+	}
+
+	regs->TXREQ1 = txreq & 0xFFFF;
+	regs->TXREQ2 = txreq >> 16;
+	regs->ND1 = nd & 0xFFFF;
+	regs->ND2 = nd >> 16;
+	regs->IR1 = ir & 0xFFFF;
+	regs->IR2 = ir >> 16;
+	regs->MSGV1 = msgv & 0xFFFF;
+	regs->MSGV2 = msgv >> 16;
+	regs->INT = ir ? __builtin_ctzl(ir) + 1 : 0;
+}
+
+/* Moves data between interface n and message object num, as its CMDMSK
+   says */
+static void c_can_transfer(u08 n, u08 num){
+	c_can_if *cif = c_can_interface(&c_can_model.regs, n);
+	c_can_obj *obj = &c_can_model.objs[num - 1];
+	u32 cmd = cif->CMDMSK;
+
+	c_can_model.stats.transfers++;
+
+	if(cmd & C_CAN_CMD_WR){
+		if(cmd & C_CAN_CMD_MASK){
+			obj->msk1 = cif->MSK1;
+			obj->msk2 = cif->MSK2;
+		}
+		if(cmd & C_CAN_CMD_ARB){
+			obj->arb1 = cif->ARB1;
+			obj->arb2 = cif->ARB2;
+		}
+		if(cmd & C_CAN_CMD_CTRL)
+			obj->mctrl = cif->MCTRL;
+		if(cmd & C_CAN_CMD_TREQ)
+			obj->mctrl |= C_CAN_MCTRL_TXRQ;
+		if(cmd & C_CAN_CMD_DATAA){
+			obj->data[0] = cif->DA1;
+			obj->data[1] = cif->DA2;
+		}
+		if(cmd & C_CAN_CMD_DATAB){
+			obj->data[2] = cif->DB1;
+			obj->data[3] = cif->DB2;
+		}
+	} else {
+		if(cmd & C_CAN_CMD_MASK){
+			cif->MSK1 = obj->msk1;
+			cif->MSK2 = obj->msk2;
+		}
+		if(cmd & C_CAN_CMD_ARB){
+			cif->ARB1 = obj->arb1;
+			cif->ARB2 = obj->arb2;
+		}
+		if(cmd & C_CAN_CMD_CTRL)
+			cif->MCTRL = obj->mctrl;
+		if(cmd & C_CAN_CMD_DATAA){
+			cif->DA1 = obj->data[0];
+			cif->DA2 = obj->data[1];
+		}
+		if(cmd & C_CAN_CMD_DATAB){
+			cif->DB1 = obj->data[2];
+			cif->DB2 = obj->data[3];
+		}
+		if(cmd & C_CAN_CMD_INTPND)
+			obj->mctrl &= ~C_CAN_MCTRL_INTP;
+		if(cmd & C_CAN_CMD_TREQ)
+			obj->mctrl &= ~C_CAN_MCTRL_NEWD;
+	}
+
+	c_can_update();
+}
+
+/* Works out what the driver did with the last access, and brings the
+   registers up to now */
+static void c_can_sync(void){
+	c_can_regs *regs = &c_can_model.regs;
+	c_can_if *cif, *seen;
+	u08 n, busy, num;
+
+	for(n = 0; n < C_CAN_NUM_IFS && c_can_model.accessed; n++){
+		cif = c_can_interface(regs, n);
+		seen = c_can_interface(&c_can_model.seen, n);
+		busy = c_can_model.accessed_at < c_can_model.busy_until[n];
+
+		if(busy && memcmp((void *)&cif->CMDMSK, (void *)&seen->CMDMSK,
+				sizeof(c_can_if) - sizeof(u32)) != 0)
+			c_can_model.stats.violations++;
+
+		if(cif->CMDREQ != seen->CMDREQ){
+			if(busy)
+				c_can_model.stats.violations++;
+			num = cif->CMDREQ & C_CAN_CMDREQ_NUM;
+			if(num >= 1 && num <= C_CAN_NUM_OBJS){
+				c_can_transfer(n, num);
+				c_can_model.busy_until[n] = c_can_model.now + c_can_xfer_cycles;
+				c_can_model.last_if = n;
+				cif->CMDREQ = C_CAN_CMDREQ_BUSY | num;
+			} else {
+				cif->CMDREQ = 0;
+			}
+		} else if(busy && n == c_can_model.last_if &&
+				memcmp((void *)regs, (void *)&c_can_model.seen, sizeof(c_can_regs)) == 0) {
+			c_can_model.stats.busy_polls++;
+		}
+	}
+
+	c_can_model.accessed = 0;
+
+	for(n = 0; n < C_CAN_NUM_IFS; n++){
+		cif = c_can_interface(regs, n);
+		if(c_can_model.now >= c_can_model.busy_until[n])
+			cif->CMDREQ = 0;
+	}
+
+	c_can_model.seen = *regs;
+}
+
+void c_can_reset(void){
+	memset(&c_can_model, 0, sizeof(c_can_model));
+	c_can_model.regs.CNTL = 1;
+	c_can_model.seen = c_can_model.regs;
+}
+
+c_can_regs *c_can_access(void){
+	c_can_sync();
+	c_can_model.accessed = 1;
+	c_can_model.accessed_at = c_can_model.now;
+	c_can_model.now += c_can_access_cycles;
+	c_can_model.stats.accesses++;
+	c_can_model.stats.cycles += c_can_access_cycles;
+	return &c_can_model.regs;
+}
+
+void c_can_elapse(u32 cycles){
+	c_can_sync();
+	c_can_model.now += cycles;
+	c_can_model.stats.cycles += cycles;
+}
+
+void c_can_irq_enable(u08 on){
+	c_can_model.irq_enabled = on;
+}
+
+u08 c_can_irq_pending(void){
+	c_can_sync();
+	return c_can_model.irq_enabled && (c_can_model.regs.CNTL & C_CAN_CNTL_IE) &&
+		c_can_model.regs.INT != 0;
+}
+
+u08 c_can_transmit(can_msg *msg){
+	c_can_obj *obj;
+	u08 i;
+
+	c_can_sync();
+
+	for(i = 0; i < C_CAN_NUM_OBJS; i++){
+		obj = &c_can_model.objs[i];
+		if((obj->mctrl & C_CAN_MCTRL_TXRQ) && (obj->arb2 & C_CAN_ARB2_MVAL))
+			break;
+	}
+	if(i == C_CAN_NUM_OBJS)
+		return 0;
+
+	if(obj->arb2 & C_CAN_ARB2_XTD){
+		msg->id = ((u32)(obj->arb2 & 0x1FFF) << 16) | obj->arb1;
+		msg->ext = CAN_EXT_MSG;
+	} else {
+		msg->id = (obj->arb2 & 0x1FFF) >> 2;
+		msg->ext = CAN_STD_MSG;
+	}
+	msg->length = obj->mctrl & C_CAN_MCTRL_DLC;
+	if(msg->length > CAN_MSG_MAXSIZE)
+		msg->length = CAN_MSG_MAXSIZE;
+	for(i = 0; i < CAN_MSG_MAXSIZE; i++)
+		msg->data[i] = obj->data[i >> 1] >> ((i & 1) * 8);
+
+	obj->mctrl &= ~C_CAN_MCTRL_TXRQ;
+	if(obj->mctrl & C_CAN_MCTRL_TXIE)
+		obj->mctrl |= C_CAN_MCTRL_INTP;
+	c_can_model.regs.STAT |= C_CAN_STAT_TXOK;
+	c_can_update();
+	c_can_model.seen = c_can_model.regs;
+
+	return (obj - c_can_model.objs) + 1;
+}
+
+u08 c_can_receive(can_msg *msg){
+	c_can_obj *obj;
+	u32 id, arb, mask;
+	u08 i;
+
+	c_can_sync();
+
+	/* Arbitration and mask fields as one 29 bit identifier, with the
+	   standard identifier in the top 11 bits, as in the registers */
+	id = msg->ext == CAN_EXT_MSG ? msg->id & 0x1FFFFFFF : (msg->id & 0x7FF) << 18;
+
+	for(i = 0; i < C_CAN_NUM_OBJS; i++){
+		obj = &c_can_model.objs[i];
+		if(!(obj->arb2 & C_CAN_ARB2_MVAL) || (obj->arb2 & C_CAN_ARB2_DIR))
+			continue;
+
+		arb = ((u32)(obj->arb2 & 0x1FFF) << 16) | obj->arb1;
+		mask = 0x1FFFFFFF;
+		if(obj->mctrl & C_CAN_MCTRL_UMSK){
+			mask = ((u32)(obj->msk2 & 0x1FFF) << 16) | obj->msk1;
+			if((obj->msk2 & C_CAN_MSK2_MXTD) &&
+					!(obj->arb2 & C_CAN_ARB2_XTD) != (msg->ext != CAN_EXT_MSG))
+				continue;
+		} else if(!(obj->arb2 & C_CAN_ARB2_XTD) != (msg->ext != CAN_EXT_MSG)) {
+			continue;
+		}
+
+		/* An object holding a frame with EOB clear is part of a FIFO, and
+		   the frame goes on to the next object that accepts it */
+		if(((id ^ arb) & mask) == 0 &&
+				(!(obj->mctrl & C_CAN_MCTRL_NEWD) || (obj->mctrl & C_CAN_MCTRL_EOB)))
+			break;
+	}
+	if(i == C_CAN_NUM_OBJS)
+		return 0;
+
+	/* The message object keeps its own identifier bits where the mask
+	   doesn't care, and takes the frame's */
+	obj->arb1 = id & 0xFFFF;
+	obj->arb2 = (obj->arb2 & ~0x1FFF) | ((id >> 16) & 0x1FFF);
+	if(msg->ext == CAN_EXT_MSG)
+		obj->arb2 |= C_CAN_ARB2_XTD;
+	else
+		obj->arb2 &= ~C_CAN_ARB2_XTD;
+	for(i = 0; i < 4; i++)
+		obj->data[i] = msg->data[2 * i] | (msg->data[2 * i + 1] << 8);
+
+	if(obj->mctrl & C_CAN_MCTRL_NEWD)
+		obj->mctrl |= C_CAN_MCTRL_MLST;
+	obj->mctrl = (obj->mctrl & ~C_CAN_MCTRL_DLC) | C_CAN_MCTRL_NEWD | msg->length;
+	if(obj->mctrl & C_CAN_MCTRL_RXIE)
+		obj->mctrl |= C_CAN_MCTRL_INTP;
+	c_can_model.regs.STAT |= C_CAN_STAT_RXOK;
+	c_can_update();
+	c_can_model.seen = c_can_model.regs;
+
+	return (obj - c_can_model.objs) + 1;
+}
+
+void c_can_get_stats(c_can_stats *stats){
+	c_can_sync();
+	c_can_model.seen = c_can_model.regs;
+	*stats = c_can_model.stats;
+}
+
+void c_can_reset_stats(void){
+	memset(&c_can_model.stats, 0, sizeof(c_can_stats));
+}
@@ -0,0 +1,317 @@
+/* --------------------------------------------------------------------------
+	Host Virtual CAN Bus
+	File name: can.c
+
+	The virtual bus, and the Scandal CAN wrappers on top of it. See
+	arch/can.h.
+   -------------------------------------------------------------------------- */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <scandal/types.h>
+#include <scandal/can.h>
+#include <scandal/error.h>
+#include <scandal/timer.h>
+#include <scandal/busstats.h>
+
+#include <arch/can.h>
+#include <arch/timer.h>
+#include <arch/system.h>
+
+#include <string.h>
+#include <time.h>
+
+void vbus_init(vbus *bus){
+	memset(bus, 0, sizeof(vbus));
+	pthread_mutex_init(&bus->lock, NULL);
+	pthread_cond_init(&bus->rx_cond, NULL);
+}
+
+void vbus_destroy(vbus *bus){
+	pthread_cond_destroy(&bus->rx_cond);
+	pthread_mutex_destroy(&bus->lock);
+}
+
+u08 vbus_attach(vbus *bus, vbus_port *port){
+	pthread_mutex_lock(&bus->lock);
+
+	if(bus->num_ports >= VBUS_MAX_PORTS){
+		pthread_mutex_unlock(&bus->lock);
+		return BUF_FULL_ERR;
+	}
+
+	port->bus = bus;
+	port->num_filters = 0;
+	port->promiscuous = 0;
+	port->rx_head = port->rx_tail = 0;
+	bus->ports[bus->num_ports++] = port;
+
+	pthread_mutex_unlock(&bus->lock);
+	return NO_ERR;
+}
+
+void vbus_detach(vbus_port *port){
+	vbus *bus = port->bus;
+	u16 i;
+
+	if(bus == 0)
+		return;
+
+	pthread_mutex_lock(&bus->lock);
+	for(i=0; i<bus->num_ports; i++){
+		if(bus->ports[i] == port){
+			bus->ports[i] = bus->ports[--bus->num_ports];
+			break;
+		}
+	}
+	port->bus = 0;
+	pthread_mutex_unlock(&bus->lock);
+}
+
+u08 vbus_add_filter(vbus_port *port, u32 mask, u32 data, u08 ext){
+	vbus *bus = port->bus;
+	can_filter reg;
+
+	if(bus == 0)
+		return NO_MSG_ERR;
+
+	reg.mask = mask;
+	reg.id = data;
+	reg.ext = ext;
+
+	pthread_mutex_lock(&bus->lock);
+	port->num_filters = can_filter_add(port->filters, port->num_filters,
+			CAN_FILTER_MAX_REGS, &reg);
+	pthread_mutex_unlock(&bus->lock);
+
+	return NO_ERR;
+}
+
+void vbus_set_promiscuous(vbus_port *port, u08 on){
+	port->promiscuous = on;
+}
+
+static u08 vbus_accepts(vbus_port *port, can_msg *msg){
+	u16 i;
+
+	if(port->promiscuous)
+		return 1;
+
+	for(i=0; i<port->num_filters; i++){
+		can_filter *f = &port->filters[i];
+
+		if(f->ext == msg->ext && (msg->id & f->mask) == f->id)
+			return 1;
+	}
+
+	return 0;
+}
+
+u08 vbus_send(vbus_port *port, can_msg *msg){
+	vbus *bus = port->bus;
+	vbus_port *to;
+	can_msg *slot;
+	u32 now;
+	u16 i;
+
+	if(bus == 0)
+		return NO_MSG_ERR;
+
+	now = (u32)host_time_us();
+
+	pthread_mutex_lock(&bus->lock);
+
+	for(i=0; i<bus->num_ports; i++){
+		to = bus->ports[i];
+		if(to == port || !vbus_accepts(to, msg))
+			continue;
+
+		if(to->rx_head - to->rx_tail >= VBUS_RX_SIZE){
+			to->stats.rx_overruns++;
+			continue;
+		}
+
+		slot = &to->rx[to->rx_head & VBUS_RX_MASK];
+		slot->id = msg->id;
+		slot->ext = msg->ext;
+		slot->length = msg->length > CAN_MSG_MAXSIZE ? CAN_MSG_MAXSIZE : msg->length;
+		memcpy(slot->data, msg->data, CAN_MSG_MAXSIZE);
+		slot->rcvd_us = now;
+		to->rx_head++;
+		to->stats.rx_frames++;
+	}
+
+	port->stats.tx_frames++;
+	bus->frames++;
+
+	if(bus->waiters)
+		pthread_cond_broadcast(&bus->rx_cond);
+
+	pthread_mutex_unlock(&bus->lock);
+	return NO_ERR;
+}
+
+/* Leaves rcvd_us as the host time of arrival */
+u08 vbus_receive(vbus_port *port, can_msg *msg){
+	vbus *bus = port->bus;
+
+	if(bus == 0)
+		return NO_MSG_ERR;
+
+	pthread_mutex_lock(&bus->lock);
+	if(port->rx_head == port->rx_tail){
+		pthread_mutex_unlock(&bus->lock);
+		return NO_MSG_ERR;
+	}
+	*msg = port->rx[port->rx_tail & VBUS_RX_MASK];
+	port->rx_tail++;
+	pthread_mutex_unlock(&bus->lock);
+
+	return NO_ERR;
+}
+
+u32 vbus_pending(vbus_port *port){
+	vbus *bus = port->bus;
+	u32 n;
+
+	if(bus == 0)
+		return 0;
+
+	pthread_mutex_lock(&bus->lock);
+	n = port->rx_head - port->rx_tail;
+	pthread_mutex_unlock(&bus->lock);
+
+	return n;
+}
+
+u08 vbus_wait(vbus_port *port, u32 timeout_us){
+	vbus *bus = port->bus;
+	struct timespec until;
+	u08 err = NO_ERR;
+
+	if(bus == 0)
+		return NO_MSG_ERR;
+
+	clock_gettime(CLOCK_REALTIME, &until);
+	until.tv_sec += timeout_us / 1000000;
+	until.tv_nsec += (long)(timeout_us % 1000000) * 1000;
+	if(until.tv_nsec >= 1000000000){
+		until.tv_sec++;
+		until.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&bus->lock);
+	bus->waiters++;
+	while(port->rx_head == port->rx_tail){
+		if(pthread_cond_timedwait(&bus->rx_cond, &bus->lock, &until) != 0){
+			if(port->rx_head == port->rx_tail)
+				err = NO_MSG_ERR;
+			break;
+		}
+	}
+	bus->waiters--;
+	pthread_mutex_unlock(&bus->lock);
+
+	return err;
+}
+
+/* Scandal wrappers
+ * *****************
+ * These act on the port of the node bound to the calling thread.
+ */
+
+/* Joins the node's bus, dropping any filters from before a reset */
+void init_can(void){
+	host_node *node = host_node_self();
+
+	vbus_detach(&node->port);
+	vbus_attach(node->bus, &node->port);
+}
+
+u08 can_get_msg(can_msg *msg){
+	u32 arrived;
+
+	if(vbus_receive(&host_node_self()->port, msg) != NO_ERR)
+		return NO_MSG_ERR;
+
+	/* Turn the host arrival time into this node's timebase */
+	arrived = msg->rcvd_us;
+	msg->rcvd_us = sc_get_timer_us() - ((u32)host_time_us() - arrived);
+
+	return NO_ERR;
+}
+
+u08 can_send_msg(can_msg *msg, u08 priority){
+	u08 err = vbus_send(&host_node_self()->port, msg);
+
+	if(err == NO_ERR)
+		scandal_busstats_tx(msg);
+	return err;
+}
+
+can_msg *can_tx_reserve(void){
+	return &host_node_self()->port.tx_slot;
+}
+
+u08 can_tx_commit(can_msg *msg, u08 priority){
+	return can_send_msg(msg, priority);
+}
+
+/* Frames go straight onto the bus, so there is never a queue */
+u08 can_tx_flush(void){
+	return 0;
+}
+
+void can_get_tx_stats(can_tx_stats *stats){
+	stats->depth = 0;
+	stats->high_water = 0;
+	stats->overruns = 0;
+}
+
+u08 can_send_std_msg(can_msg *msg, u08 priority){
+	msg->ext = CAN_STD_MSG;
+	return can_send_msg(msg, priority);
+}
+
+u08 can_register_id(u32 mask, u32 data, u08 priority, u08 ext){
+	return vbus_add_filter(&host_node_self()->port, mask, data, ext);
+}
+
+u08 can_register_id_rate(u32 mask, u32 data, u16 rate, u08 ext){
+	return can_register_id(mask, data, 0, ext);
+}
+
+u08 can_baud_rate(u08 mode){
+	return NO_ERR;
+}
+
+void can_interrupt(void){
+}
+
+void can_poll(void){
+}
+
+void enable_can_interrupt(void){
+}
+
+void disable_can_interrupt(void){
+}
+
+/* *******************
+ * End Scandal wrappers
+ */
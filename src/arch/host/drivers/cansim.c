@@ -0,0 +1,510 @@
+/* --------------------------------------------------------------------------
+	CAN Network Simulator
+	File name: cansim.c
+
+	Discrete event simulation of CAN arbitration and bit timing. See
+	arch/cansim.h.
+   -------------------------------------------------------------------------- */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <scandal/types.h>
+#include <scandal/can.h>
+#include <scandal/message.h>
+#include <scandal/busstats.h>
+
+#include <arch/cansim.h>
+
+#include <string.h>
+
+#define CANSIM_NEVER		(~(cansim_time_t)0)
+
+/* Bits after the CRC, which are never stuffed: CRC delimiter, ACK slot,
+   ACK delimiter, end of frame and interframe space */
+#define CANSIM_TAIL_BITS	13
+
+#define CANSIM_SCANDAL_QUEUE	16
+
+static const u32 cansim_bitrates[SCANDAL_NUM_BAUD] = {
+	1000000,	/* SCANDAL_B1000 */
+	500000,		/* SCANDAL_B500 */
+	250000,		/* SCANDAL_B250 */
+	125000,		/* SCANDAL_B125 */
+	50000,		/* SCANDAL_B50 */
+	10000		/* SCANDAL_B10 */
+};
+
+/* xorshift32, so that runs repeat exactly for a given seed */
+static u32 cansim_random(cansim *sim){
+	u32 x = sim->rng;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	sim->rng = x;
+	return x;
+}
+
+void cansim_init(cansim *sim, u08 baud, u32 seed){
+	memset(sim, 0, sizeof(cansim));
+
+	if(baud >= SCANDAL_NUM_BAUD)
+		baud = DEFAULT_BAUD;
+	sim->baud = baud;
+	sim->bit_time = 1000000000ULL / cansim_bitrates[baud];
+	sim->rng = seed ? seed : 1;
+}
+
+void cansim_set_worst_case_stuffing(cansim *sim, u08 on){
+	sim->worst_case_stuffing = on;
+}
+
+void cansim_trace_depth(cansim *sim, FILE *out){
+	sim->depth_trace = out;
+}
+
+void cansim_set_inversion_handler(cansim *sim, cansim_inversion_fn fn){
+	sim->on_inversion = fn;
+}
+
+/* Release heap
+   ------------ */
+
+static u08 cansim_heap_less(cansim *sim, u16 a, u16 b){
+	cansim_stream *sa = &sim->streams[a], *sb = &sim->streams[b];
+
+	if(sa->next_release != sb->next_release)
+		return sa->next_release < sb->next_release;
+	return a < b;
+}
+
+static void cansim_heap_swap(cansim *sim, u16 i, u16 j){
+	u16 t = sim->heap[i];
+
+	sim->heap[i] = sim->heap[j];
+	sim->heap[j] = t;
+	sim->streams[sim->heap[i]].heap_pos = i;
+	sim->streams[sim->heap[j]].heap_pos = j;
+}
+
+static void cansim_heap_up(cansim *sim, u16 i){
+	while(i > 0 && cansim_heap_less(sim, sim->heap[i], sim->heap[(i - 1) / 2])){
+		cansim_heap_swap(sim, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void cansim_heap_down(cansim *sim, u16 i){
+	u16 l, r, m;
+
+	for(;;){
+		l = 2 * i + 1;
+		r = l + 1;
+		m = i;
+		if(l < sim->heap_count && cansim_heap_less(sim, sim->heap[l], sim->heap[m]))
+			m = l;
+		if(r < sim->heap_count && cansim_heap_less(sim, sim->heap[r], sim->heap[m]))
+			m = r;
+		if(m == i)
+			return;
+		cansim_heap_swap(sim, i, m);
+		i = m;
+	}
+}
+
+/* Setup
+   ----- */
+
+u16 cansim_add_node(cansim *sim, u08 addr, u08 txq, u08 queue_size,
+			u08 mailboxes, cansim_time_t refill){
+	cansim_node *node;
+
+	if(sim->num_nodes >= CANSIM_MAX_NODES)
+		return CANSIM_NONE;
+
+	node = &sim->nodes[sim->num_nodes];
+	memset(node, 0, sizeof(cansim_node));
+	node->addr = addr;
+	node->txq = txq;
+	node->queue_size = (queue_size == 0 || queue_size > CANSIM_MAX_QUEUE) ?
+				CANSIM_MAX_QUEUE : queue_size;
+	node->mailboxes = mailboxes ? mailboxes : 1;
+	node->refill = refill;
+	node->depth_since = sim->now;
+
+	return sim->num_nodes++;
+}
+
+u16 cansim_add_stream(cansim *sim, u16 node, u32 id, u08 ext, u08 length,
+			cansim_time_t period, cansim_time_t offset,
+			cansim_time_t jitter){
+	cansim_stream *st;
+	u16 s;
+
+	if(sim->num_streams >= CANSIM_MAX_STREAMS || node >= sim->num_nodes || period == 0)
+		return CANSIM_NONE;
+
+	s = sim->num_streams++;
+	st = &sim->streams[s];
+	memset(st, 0, sizeof(cansim_stream));
+	st->node = node;
+	st->id = id & (ext ? CAN_ID_EXT_MASK : CAN_ID_STD_MASK);
+	st->ext = ext;
+	st->length = length > CAN_MSG_MAXSIZE ? CAN_MSG_MAXSIZE : length;
+	st->period = period;
+	st->offset = sim->now + offset;
+	st->jitter = jitter;
+	st->next_release = st->offset + (jitter ? cansim_random(sim) % (jitter + 1) : 0);
+	st->min_response = CANSIM_NEVER;
+
+	st->heap_pos = sim->heap_count;
+	sim->heap[sim->heap_count++] = s;
+	cansim_heap_up(sim, st->heap_pos);
+
+	return s;
+}
+
+u16 cansim_add_scandal_node(cansim *sim, u08 addr, u08 txq, u08 pri,
+			u16 num_channels, u32 period_ms){
+	cansim_time_t period = period_ms * CANSIM_NS_PER_MS;
+	u32 heartbeat_id;
+	u16 node, i;
+
+	node = cansim_add_node(sim, addr, txq, CANSIM_SCANDAL_QUEUE, 1, 0);
+	if(node == CANSIM_NONE)
+		return CANSIM_NONE;
+
+	heartbeat_id = ((u32)NETWORK_LOW << PRI_OFFSET) |
+			((u32)HEARTBEAT_TYPE << TYPE_OFFSET) |
+			((u32)addr << HEARTBEAT_NODE_ADDR_OFFSET);
+	cansim_add_stream(sim, node, heartbeat_id, CAN_EXT_MSG, 8,
+			1000 * CANSIM_NS_PER_MS,
+			cansim_random(sim) % (1000 * CANSIM_NS_PER_MS), 0);
+
+	/* Nodes start at random, so their channels don't line up with
+	   anyone else's. A node's own channels go out together, as
+	   scandal_send_channels() would send them */
+	if(num_channels && period){
+		cansim_time_t phase = cansim_random(sim) % period;
+
+		for(i=0; i<num_channels; i++)
+			cansim_add_stream(sim, node, scandal_mk_channel_id(pri, addr, i),
+					CAN_EXT_MSG, 8, period, phase, 0);
+	}
+
+	return node;
+}
+
+/* Frame timing
+   ------------ */
+
+static u08 cansim_push_bits(u08 *bits, u08 n, u32 value, u08 count){
+	while(count--)
+		bits[n++] = (value >> count) & 1;
+	return n;
+}
+
+u16 cansim_frame_bits(can_msg *msg){
+	u08 bits[128];
+	u08 n = 0, i, run, last, length;
+	u16 crc = 0, stuff = 0;
+
+	length = msg->length > CAN_MSG_MAXSIZE ? CAN_MSG_MAXSIZE : msg->length;
+
+	/* Start of frame through the end of the data field */
+	n = cansim_push_bits(bits, n, 0, 1);
+	if(msg->ext == CAN_EXT_MSG){
+		n = cansim_push_bits(bits, n, msg->id >> 18, 11);
+		n = cansim_push_bits(bits, n, 3, 2);		/* SRR, IDE */
+		n = cansim_push_bits(bits, n, msg->id & 0x3FFFF, 18);
+		n = cansim_push_bits(bits, n, 0, 3);		/* RTR, r1, r0 */
+	} else {
+		n = cansim_push_bits(bits, n, msg->id, 11);
+		n = cansim_push_bits(bits, n, 0, 3);		/* RTR, IDE, r0 */
+	}
+	n = cansim_push_bits(bits, n, length, 4);
+	for(i=0; i<length; i++)
+		n = cansim_push_bits(bits, n, msg->data[i], 8);
+
+	/* CRC-15 */
+	for(i=0; i<n; i++){
+		u08 next = bits[i] ^ ((crc >> 14) & 1);
+
+		crc = (crc << 1) & 0x7FFF;
+		if(next)
+			crc ^= 0x4599;
+	}
+	n = cansim_push_bits(bits, n, crc, 15);
+
+	/* A stuff bit goes in after every five bits the same, and counts as
+	   the first of the next run */
+	last = bits[0];
+	run = 1;
+	for(i=1; i<n; i++){
+		if(bits[i] == last)
+			run++;
+		else {
+			last = bits[i];
+			run = 1;
+		}
+		if(run == 5){
+			stuff++;
+			last = !last;
+			run = 1;
+		}
+	}
+
+	return n + stuff + CANSIM_TAIL_BITS;
+}
+
+/* Simulation
+   ---------- */
+
+static void cansim_depth(cansim *sim, u16 n){
+	cansim_node *node = &sim->nodes[n];
+
+	node->depth_area += (u64)node->count * (sim->now - node->depth_since);
+	node->depth_since = sim->now;
+}
+
+static void cansim_trace(cansim *sim, u16 n){
+	if(sim->depth_trace)
+		fprintf(sim->depth_trace, "%llu,%u,%u\n",
+			(unsigned long long)(sim->now / 1000), n, sim->nodes[n].count);
+}
+
+static void cansim_release(cansim *sim){
+	u16 s = sim->heap[0];
+	cansim_stream *st = &sim->streams[s];
+	cansim_node *node = &sim->nodes[st->node];
+	cansim_frame *frame;
+	can_msg msg;
+	u08 i;
+
+	st->released++;
+
+	if(node->count >= node->queue_size){
+		st->dropped++;
+		node->dropped++;
+	} else {
+		msg.id = st->id;
+		msg.ext = st->ext;
+		msg.length = st->length;
+		for(i=0; i<CAN_MSG_MAXSIZE; i++)
+			msg.data[i] = cansim_random(sim) & 0xFF;
+
+		cansim_depth(sim, st->node);
+
+		frame = &node->queue[node->count++];
+		frame->stream = s;
+		frame->released = sim->now;
+		frame->key = can_arb_key(st->id, st->ext);
+		frame->bits = sim->worst_case_stuffing ?
+				scandal_frame_bits(st->ext, st->length) :
+				cansim_frame_bits(&msg);
+
+		if(node->count > node->max_depth)
+			node->max_depth = node->count;
+		cansim_trace(sim, st->node);
+	}
+
+	st->next_release = st->offset + (cansim_time_t)st->released * st->period;
+	if(st->jitter)
+		st->next_release += cansim_random(sim) % (st->jitter + 1);
+	cansim_heap_down(sim, 0);
+}
+
+/* How many of a node's frames may arbitrate right now */
+static u08 cansim_eligible(cansim *sim, cansim_node *node){
+	if(node->count == 0 || node->ready > sim->now)
+		return 0;
+	if(node->txq == CANSIM_TXQ_PRIORITY || node->mailboxes > node->count)
+		return node->count;
+	return node->mailboxes;
+}
+
+/* Earliest time a frame could start on an idle bus */
+static cansim_time_t cansim_next_arbitration(cansim *sim){
+	cansim_time_t t = CANSIM_NEVER;
+	u16 n;
+
+	for(n=0; n<sim->num_nodes; n++){
+		cansim_node *node = &sim->nodes[n];
+
+		if(node->count == 0)
+			continue;
+		if(node->ready <= sim->now)
+			return sim->now;
+		if(node->ready < t)
+			t = node->ready;
+	}
+
+	return t;
+}
+
+static void cansim_arbitrate(cansim *sim){
+	u32 best = 0xFFFFFFFFUL;
+	u16 n, winner = CANSIM_NONE;
+	u08 i, index = 0, eligible;
+
+	for(n=0; n<sim->num_nodes; n++){
+		cansim_node *node = &sim->nodes[n];
+
+		eligible = cansim_eligible(sim, node);
+		for(i=0; i<eligible; i++){
+			if(node->queue[i].key < best){
+				best = node->queue[i].key;
+				winner = n;
+				index = i;
+			}
+		}
+	}
+
+	if(winner == CANSIM_NONE)
+		return;
+
+	/* Anything of higher priority which couldn't take part */
+	for(n=0; n<sim->num_nodes; n++){
+		cansim_node *node = &sim->nodes[n];
+
+		eligible = cansim_eligible(sim, node);
+		for(i=eligible; i<node->count; i++){
+			if(node->queue[i].key < best){
+				sim->streams[node->queue[i].stream].inversions++;
+				sim->inversions++;
+				if(sim->on_inversion)
+					sim->on_inversion(sim, node->queue[i].stream,
+						sim->nodes[winner].queue[index].stream, sim->now);
+			}
+		}
+	}
+
+	sim->busy = 1;
+	sim->tx_node = winner;
+	sim->tx_index = index;
+	sim->tx_end = sim->now + sim->nodes[winner].queue[index].bits * sim->bit_time;
+}
+
+static void cansim_complete(cansim *sim){
+	cansim_node *node = &sim->nodes[sim->tx_node];
+	cansim_frame *frame = &node->queue[sim->tx_index];
+	cansim_stream *st = &sim->streams[frame->stream];
+	cansim_time_t response = sim->now - frame->released;
+	u64 us = response / 1000;
+	u08 b;
+
+	st->sent++;
+	st->total_response += response;
+	if(response < st->min_response)
+		st->min_response = response;
+	if(response > st->max_response)
+		st->max_response = response;
+
+	b = us ? 64 - __builtin_clzll(us) : 0;
+	st->hist[b < CANSIM_HIST_BUCKETS ? b : CANSIM_HIST_BUCKETS - 1]++;
+
+	sim->frames++;
+	sim->busy_time += frame->bits * sim->bit_time;
+	sim->busy = 0;
+
+	cansim_depth(sim, sim->tx_node);
+	memmove(frame, frame + 1, (node->count - sim->tx_index - 1) * sizeof(cansim_frame));
+	node->count--;
+	node->sent++;
+	node->ready = sim->now + node->refill;
+	cansim_trace(sim, sim->tx_node);
+}
+
+void cansim_run(cansim *sim, cansim_time_t duration){
+	cansim_time_t end = sim->now + duration;
+	cansim_time_t release, bus;
+	u16 n;
+
+	for(;;){
+		release = sim->heap_count ? sim->streams[sim->heap[0]].next_release : CANSIM_NEVER;
+		bus = sim->busy ? sim->tx_end : cansim_next_arbitration(sim);
+
+		/* Releases go first, so a frame released as the bus goes idle
+		   takes part in the arbitration */
+		if(release <= bus){
+			if(release > end)
+				break;
+			sim->now = release;
+			cansim_release(sim);
+		} else {
+			if(bus > end)
+				break;
+			sim->now = bus;
+			if(sim->busy)
+				cansim_complete(sim);
+			else
+				cansim_arbitrate(sim);
+		}
+	}
+
+	sim->now = end;
+	for(n=0; n<sim->num_nodes; n++)
+		cansim_depth(sim, n);
+}
+
+/* Reporting
+   --------- */
+
+void cansim_report(cansim *sim, FILE *out){
+	cansim_time_t elapsed = sim->now - sim->start;
+	u16 n, s;
+	u08 b;
+
+	if(elapsed == 0)
+		return;
+
+	fprintf(out, "bus %lu bit/s, %.3f s simulated, %u frames, %.1f%% load, %u inversions\n",
+		(unsigned long)cansim_bitrates[sim->baud], elapsed / 1e9, sim->frames,
+		100.0 * sim->busy_time / elapsed, sim->inversions);
+
+	fprintf(out, "\nnode addr txq sent dropped depth_mean depth_max\n");
+	for(n=0; n<sim->num_nodes; n++){
+		cansim_node *node = &sim->nodes[n];
+
+		fprintf(out, "%4u %4u %3s %u %u %.3f %u\n", n, node->addr,
+			node->txq == CANSIM_TXQ_PRIORITY ? "pri" : "fifo",
+			node->sent, node->dropped, (double)node->depth_area / elapsed,
+			node->max_depth);
+	}
+
+	fprintf(out, "\nstream node id period_ms released sent dropped inversions "
+		"min_us mean_us max_us hist(<us:count)\n");
+	for(s=0; s<sim->num_streams; s++){
+		cansim_stream *st = &sim->streams[s];
+
+		fprintf(out, "%u %u 0x%0*lX %.3f %u %u %u %u", s, st->node,
+			st->ext ? 8 : 3, (unsigned long)st->id, st->period / 1e6,
+			st->released, st->sent, st->dropped, st->inversions);
+		if(st->sent)
+			fprintf(out, " %.1f %.1f %.1f", st->min_response / 1e3,
+				(double)st->total_response / st->sent / 1e3,
+				st->max_response / 1e3);
+		else
+			fprintf(out, " - - -");
+
+		for(b=0; b<CANSIM_HIST_BUCKETS; b++)
+			if(st->hist[b])
+				fprintf(out, " %lu:%u", 1UL << b, st->hist[b]);
+		fprintf(out, "\n");
+	}
+}
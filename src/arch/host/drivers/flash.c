@@ -0,0 +1,80 @@
+/* --------------------------------------------------------------------------
+	Host Flash
+	File name: flash.c
+
+	Scandal config log and user storage in the bound node's emulated
+	flash.
+   -------------------------------------------------------------------------- */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <scandal/types.h>
+#include <scandal/eeprom.h>
+#include <scandal/conf_log.h>
+#include <scandal/user_store.h>
+
+#include <arch/flash.h>
+#include <arch/system.h>
+
+#include <string.h>
+
+void sc_init_eeprom(void){
+	sc_conf_log_mount();
+	sc_user_store_load();
+}
+
+void sc_read_conf(scandal_config *conf){
+	sc_conf_log_read(0, conf, sizeof(scandal_config));
+}
+
+void sc_write_conf(scandal_config *conf){
+	sc_conf_log_write(0, conf, sizeof(scandal_config));
+}
+
+/* Config log backend, written through to the node's flash file */
+static void flash_sync(host_node *node, u32 start, u32 length){
+	if(!node->flash_file)
+		return;
+
+	fseek(node->flash_file, start, SEEK_SET);
+	fwrite(&node->config_flash[start], 1, length, node->flash_file);
+	fflush(node->flash_file);
+}
+
+const u08 *sc_conf_bank(u08 bank){
+	return &host_node_self()->config_flash[(u32)bank * SC_CONF_BANK_SIZE];
+}
+
+void sc_conf_bank_erase(u08 bank){
+	host_node *node = host_node_self();
+
+	memset(&node->config_flash[(u32)bank * SC_CONF_BANK_SIZE], HOST_FLASH_ERASED, SC_CONF_BANK_SIZE);
+	node->flash_erases++;
+	flash_sync(node, (u32)bank * SC_CONF_BANK_SIZE, SC_CONF_BANK_SIZE);
+}
+
+void sc_conf_bank_write(u08 bank, u16 offset, const u08 *data, u16 length){
+	host_node *node = host_node_self();
+	u32 start = (u32)bank * SC_CONF_BANK_SIZE + offset;
+	u16 i;
+
+	for(i=0; i<length; i++)
+		node->config_flash[start + i] &= data[i];
+	node->flash_writes++;
+	flash_sync(node, start, length);
+}
@@ -0,0 +1,75 @@
+/* --------------------------------------------------------------------------
+	Host System
+	File name: system.c
+
+	Host nodes and system_reset(). See arch/system.h.
+   -------------------------------------------------------------------------- */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <scandal/types.h>
+#include <scandal/system.h>
+
+#include <arch/system.h>
+
+#include <string.h>
+
+void host_node_init(host_node *node, vbus *bus){
+	memset(node, 0, sizeof(host_node));
+	scandal_engine_setup(&node->engine, node);
+	node->bus = bus;
+	memset(node->config_flash, HOST_FLASH_ERASED, sizeof(node->config_flash));
+}
+
+u08 host_node_flash_file(host_node *node, const char *path){
+	FILE *f = fopen(path, "r+b");
+
+	if(f){
+		if(fread(node->config_flash, 1, sizeof(node->config_flash), f) != sizeof(node->config_flash))
+			memset(node->config_flash, HOST_FLASH_ERASED, sizeof(node->config_flash));
+	} else {
+		f = fopen(path, "w+b");
+		if(!f)
+			return 0;
+	}
+
+	/* The file might have been short, or new */
+	fseek(f, 0, SEEK_SET);
+	fwrite(node->config_flash, 1, sizeof(node->config_flash), f);
+	fflush(f);
+
+	if(node->flash_file)
+		fclose(node->flash_file);
+	node->flash_file = f;
+	return 1;
+}
+
+void host_node_bind(host_node *node){
+	scandal_select_engine(&node->engine);
+}
+
+void system_reset(void){
+	host_node *node = host_node_self();
+
+	node->resets++;
+
+	if(node->reset)
+		longjmp(*node->reset, 1);
+
+	node->reset_pending = 1;
+}
@@ -0,0 +1,54 @@
+/* --------------------------------------------------------------------------
+	Host Timer
+	File name: timer.c
+
+	Scandal timer on top of the host's monotonic clock.
+   -------------------------------------------------------------------------- */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <scandal/types.h>
+#include <scandal/timer.h>
+
+#include <arch/timer.h>
+#include <arch/system.h>
+
+#include <time.h>
+
+u64 host_time_us(void){
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (u64)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void sc_init_timer(void){
+	host_node_self()->timer_base_us = host_time_us();
+}
+
+void sc_set_timer(sc_time_t time){
+	host_node_self()->timer_base_us = host_time_us() - (u64)time * 1000;
+}
+
+sc_time_t sc_get_timer(void){
+	return (sc_time_t)((host_time_us() - host_node_self()->timer_base_us) / 1000);
+}
+
+sc_utime_t sc_get_timer_us(void){
+	return (sc_utime_t)(host_time_us() - host_node_self()->timer_base_us);
+}
@@ -0,0 +1,49 @@
+/* --------------------------------------------------------------------------
+	Host UART
+	File name: uart.c
+
+	The host's UART is standard output, shared by every node.
+   -------------------------------------------------------------------------- */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <scandal/types.h>
+#include <scandal/uart.h>
+
+#include <arch/uart.h>
+
+#include <stdio.h>
+
+void UART_Init(uint32_t baudrate){
+}
+
+void UART_Send(uint8_t *BufferPtr, uint32_t Length){
+	fwrite(BufferPtr, 1, Length, stdout);
+}
+
+void UART_putchar(char c){
+	putchar(c);
+}
+
+void UART_SendByte(u08 Data){
+	putchar(Data);
+}
+
+void UART_flush_tx(void){
+	fflush(stdout);
+}
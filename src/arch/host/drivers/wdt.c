@@ -0,0 +1,46 @@
+/* --------------------------------------------------------------------------
+	Host Watchdog
+	File name: wdt.c
+   -------------------------------------------------------------------------- */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <scandal/types.h>
+#include <scandal/wdt.h>
+
+#include <arch/wdt.h>
+#include <arch/timer.h>
+#include <arch/system.h>
+
+void WDT_Init(uint32_t wdt_timer_value){
+	host_node *node = host_node_self();
+
+	node->wdt_period = wdt_timer_value;
+	node->wdt_last_feed = host_time_us();
+}
+
+/* A board would have reset by now if the feed is late. We only count it,
+   so that a node stopped in a debugger doesn't reset */
+void WDT_Feed(void){
+	host_node *node = host_node_self();
+	u64 now = host_time_us();
+
+	if(node->wdt_period && now - node->wdt_last_feed > (u64)node->wdt_period * 1000)
+		node->wdt_timeouts++;
+	node->wdt_last_feed = now;
+}
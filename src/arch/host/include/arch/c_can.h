@@ -0,0 +1,163 @@
+/*
+ *  c_can.h
+ *
+ *  Register level model of the LPC11C14's C_CAN controller, so the
+ *  lpc11c14 CAN driver can run on the host.
+ *
+ *  The model has the controller's registers, laid out as in the part, and
+ *  its 32 message objects. Writing a message number to IF1_CMDREQ or
+ *  IF2_CMDREQ moves data between that interface and the message RAM, as
+ *  CMDMSK says, and BUSY then reads as set for c_can_xfer_cycles. TXREQ,
+ *  ND, IR, MSGV and INT follow the message objects. Frames go out with
+ *  c_can_transmit(), lowest numbered pending object first as in the part,
+ *  and come in with c_can_receive(). Status interrupts, error handling
+ *  and the test modes aren't modelled.
+ *
+ *  The driver reaches the registers through LPC_CAN, which the host's
+ *  cmsis/LPC11xx.h turns into a call to c_can_access(). Each call is one
+ *  register access: it costs c_can_access_cycles of model time, and is
+ *  when the model notices what the driver did with the last one. So
+ *  `LPC_CAN->STAT &= ~x` counts as one access, not two, and CMDREQ reads
+ *  back as 0 once a transfer is done rather than as the message number.
+ *
+ *  To build the driver against the model, put src/arch/host/include after
+ *  src/arch/lpc11c14/include and ahead of src/arch/lpc11c14 on the include
+ *  path, so arch/ comes from the lpc11c14 and cmsis/ from here.
+ */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __C_CAN_H
+#define __C_CAN_H
+
+#include <scandal/types.h>
+#include <scandal/can.h>
+
+#define C_CAN_NUM_OBJS		32
+#define C_CAN_NUM_IFS		2
+
+/* Same layout as LPC_CAN_TypeDef */
+typedef struct c_can_if {
+	volatile u32	CMDREQ;
+	volatile u32	CMDMSK;
+	volatile u32	MSK1;
+	volatile u32	MSK2;
+	volatile u32	ARB1;
+	volatile u32	ARB2;
+	volatile u32	MCTRL;
+	volatile u32	DA1;
+	volatile u32	DA2;
+	volatile u32	DB1;
+	volatile u32	DB2;
+} c_can_if;
+
+typedef struct c_can_regs {
+	volatile u32	CNTL;			/* 0x000 */
+	volatile u32	STAT;
+	volatile u32	EC;
+	volatile u32	BT;
+	volatile u32	INT;
+	volatile u32	TEST;
+	volatile u32	BRPE;
+	u32		RES0;
+	c_can_if	IF1;			/* 0x020 */
+	u32		RES1[13];
+	c_can_if	IF2;			/* 0x080 */
+	u32		RES2[21];
+	volatile u32	TXREQ1;			/* 0x100 */
+	volatile u32	TXREQ2;
+	u32		RES3[6];
+	volatile u32	ND1;			/* 0x120 */
+	volatile u32	ND2;
+	u32		RES4[6];
+	volatile u32	IR1;			/* 0x140 */
+	volatile u32	IR2;
+	u32		RES5[6];
+	volatile u32	MSGV1;			/* 0x160 */
+	volatile u32	MSGV2;
+	u32		RES6[6];
+	volatile u32	CLKDIV;			/* 0x180 */
+} c_can_regs;
+
+/* A message object, as the IF registers see it */
+typedef struct c_can_obj {
+	u16		msk1, msk2, arb1, arb2, mctrl;
+	u16		data[4];
+} c_can_obj;
+
+typedef struct c_can_stats {
+	u32		accesses;	/* Register accesses */
+	u32		busy_polls;	/* Reads while the last interface started
+					   was still busy */
+	u32		transfers;	/* IF to message RAM, either way */
+	u32		violations;	/* Interface written while busy */
+	u64		cycles;		/* Model time, in CPU cycles */
+} c_can_stats;
+
+typedef struct c_can {
+	c_can_regs	regs;
+	c_can_regs	seen;		/* regs as of the last access */
+	c_can_obj	objs[C_CAN_NUM_OBJS];
+
+	u64		now;
+	u64		busy_until[C_CAN_NUM_IFS];
+	u08		last_if;
+	u08		accessed;	/* The driver has had the registers since
+					   the last sync, at accessed_at */
+	u64		accessed_at;
+	u08		irq_enabled;
+
+	c_can_stats	stats;
+} c_can;
+
+extern c_can c_can_model;
+
+/* Cost of one register access, and how long an interface stays busy
+   after a transfer starts. The defaults are for a 48MHz core with CLKDIV
+   at 2, and a transfer taking 6 CAN_CLK periods, the most the user manual
+   gives */
+extern u32 c_can_access_cycles;
+extern u32 c_can_xfer_cycles;
+
+void		c_can_reset(void);
+
+/* What LPC_CAN expands to */
+c_can_regs	*c_can_access(void);
+
+/* CPU time spent outside the controller, so transfers can finish */
+void		c_can_elapse(u32 cycles);
+
+/* NVIC_EnableIRQ() and NVIC_DisableIRQ() of CAN_IRQn */
+void		c_can_irq_enable(u08 on);
+
+/* Whether CAN_IRQHandler would be running now */
+u08		c_can_irq_pending(void);
+
+/* Sends the frame in the lowest numbered object with TXRQ set. Returns
+   the object number, or 0 if none was pending */
+u08		c_can_transmit(can_msg *msg);
+
+/* Stores a frame in the lowest numbered receive object which accepts it
+   and is empty or has EOB set, so a chain of objects with the same filter
+   fills as a FIFO. Returns the object number, or 0 if none did */
+u08		c_can_receive(can_msg *msg);
+
+void		c_can_get_stats(c_can_stats *stats);
+void		c_can_reset_stats(void);
+
+#endif
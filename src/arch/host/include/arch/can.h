@@ -0,0 +1,116 @@
+/*
+ *  can.h
+ *
+ *  In-process virtual CAN bus for the host arch.
+ *
+ *  A vbus joins any number of ports, each of which belongs to one node. A
+ *  frame sent on one port is queued on every other port with a filter
+ *  that accepts it, the same as can_register_id() on the boards: a
+ *  filter accepts a frame when (id & mask) == (data & mask) and the frame
+ *  has the filter's ext flag. Like a real controller, a node does not
+ *  receive its own frames, and a frame which arrives when a port's queue
+ *  is full is dropped and counted as an overrun.
+ *
+ *  There is no arbitration and no bit timing. Frames are delivered as
+ *  soon as they are sent, in the order in which they were sent.
+ *
+ *  The bus is safe to use from several threads. The Scandal CAN wrappers
+ *  act on the port of the node bound to the calling thread, see
+ *  arch/system.h.
+ */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CAN_H__
+#define __CAN_H__
+
+#include <pthread.h>
+
+#include <scandal/types.h>
+#include <scandal/can.h>
+#include <scandal/can_filter.h>
+
+#ifndef VBUS_MAX_PORTS
+#define VBUS_MAX_PORTS		32
+#endif
+
+/* Must be a power of 2 */
+#ifndef VBUS_RX_SIZE
+#define VBUS_RX_SIZE		256
+#endif
+#define VBUS_RX_MASK		(VBUS_RX_SIZE - 1)
+
+typedef struct vbus_stats {
+	u32	tx_frames;
+	u32	rx_frames;
+	u32	rx_overruns;		/* Frames dropped because the queue was full */
+} vbus_stats;
+
+struct vbus;
+
+typedef struct vbus_port {
+	struct vbus	*bus;		/* 0 when not attached */
+	/* Registrations, merged by can_filter_add() past CAN_FILTER_MAX_REGS
+	   as the LPC11C14 driver merges its own */
+	can_filter	filters[CAN_FILTER_MAX_REGS];
+	u16		num_filters;
+	u08		promiscuous;	/* Receive everything, as if with a zero mask */
+
+	/* rcvd_us holds the host time of arrival while a frame is queued */
+	can_msg		rx[VBUS_RX_SIZE];
+	u32		rx_head;
+	u32		rx_tail;
+
+	/* Where can_tx_reserve() has frames built. The bus delivers straight
+	   from here into each receiver's rx */
+	can_msg		tx_slot;
+
+	vbus_stats	stats;
+} vbus_port;
+
+typedef struct vbus {
+	pthread_mutex_t	lock;
+	pthread_cond_t	rx_cond;
+	u32		waiters;
+	vbus_port	*ports[VBUS_MAX_PORTS];
+	u16		num_ports;
+	u32		frames;		/* Frames sent on the bus */
+} vbus;
+
+void	vbus_init(vbus *bus);
+void	vbus_destroy(vbus *bus);
+
+/* Attaching a port empties its queue and removes its filters */
+u08	vbus_attach(vbus *bus, vbus_port *port);
+void	vbus_detach(vbus_port *port);
+
+/* Only fails if the port isn't attached. When the port is full, two
+   filters are merged into one which lets both through */
+u08	vbus_add_filter(vbus_port *port, u32 mask, u32 data, u08 ext);
+void	vbus_set_promiscuous(vbus_port *port, u08 on);
+u08	vbus_send(vbus_port *port, can_msg *msg);
+u08	vbus_receive(vbus_port *port, can_msg *msg);
+u32	vbus_pending(vbus_port *port);
+
+/* Blocks until the port has a frame queued or timeout_us has passed.
+   Returns NO_ERR if there is a frame, NO_MSG_ERR otherwise */
+u08	vbus_wait(vbus_port *port, u32 timeout_us);
+
+u08	can_send_std_msg(can_msg *msg, u08 priority);
+
+#endif /* __CAN_H__ */
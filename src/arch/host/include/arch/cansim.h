@@ -0,0 +1,205 @@
+/*
+ *  cansim.h
+ *
+ *  Discrete event simulator for a Scandal CAN network.
+ *
+ *  The simulator runs in virtual time, in nanoseconds, and is fully
+ *  deterministic for a given seed. Each node is a transmit queue fed by
+ *  streams of periodic frames. The bus arbitrates on identifier: when it
+ *  goes idle, the frame with the lowest arbitration field among all
+ *  nodes' eligible frames wins. A standard frame beats an extended one
+ *  with the same base identifier. Frames take their real length on the
+ *  wire, including the stuff bits for their actual contents, at one of
+ *  the Scandal baud rates.
+ *
+ *  Which of a node's queued frames may arbitrate depends on its queue:
+ *
+ *    CANSIM_TXQ_FIFO	  the first `mailboxes` frames, in the order
+ *			  queued. With one mailbox this is the plain ring
+ *			  buffer the drivers use today
+ *    CANSIM_TXQ_PRIORITY any queued frame, so the node always offers its
+ *			  highest priority frame
+ *
+ *  After a node sends a frame, its next frame can't arbitrate until the
+ *  node's refill time has passed, which models the interrupt or poll that
+ *  loads the next frame into the controller.
+ *
+ *  What comes out, per stream: the response time (release to end of
+ *  transmission) as min, mean, max and a log2 histogram, and the number
+ *  of priority inversions. An inversion is counted each time a lower
+ *  priority frame wins the bus while one of the stream's frames is
+ *  queued but not allowed to arbitrate. Per node: the depth of the queue,
+ *  as mean, max and optionally a trace of every change.
+ */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CANSIM_H
+#define __CANSIM_H
+
+#include <stdio.h>
+
+#include <scandal/types.h>
+#include <scandal/can.h>
+
+#ifndef CANSIM_MAX_NODES
+#define CANSIM_MAX_NODES	64
+#endif
+
+#ifndef CANSIM_MAX_STREAMS
+#define CANSIM_MAX_STREAMS	1024
+#endif
+
+#ifndef CANSIM_MAX_QUEUE
+#define CANSIM_MAX_QUEUE	64
+#endif
+
+/* Bucket 0 is under 1us, bucket k is [2^(k-1), 2^k) us, and the last
+   bucket holds everything longer */
+#define CANSIM_HIST_BUCKETS	24
+
+#define CANSIM_NONE		0xFFFF
+
+#define CANSIM_TXQ_FIFO		0
+#define CANSIM_TXQ_PRIORITY	1
+
+#define CANSIM_NS_PER_MS	1000000ULL
+
+/* Virtual time, in ns */
+typedef u64 cansim_time_t;
+
+struct cansim;
+
+/* Called for every inversion: blocked lost out to winner at time */
+typedef void (*cansim_inversion_fn)(struct cansim *sim, u16 blocked, u16 winner,
+				cansim_time_t time);
+
+typedef struct cansim_stream {
+	u16		node;
+	u32		id;
+	u08		ext;
+	u08		length;
+	cansim_time_t	period;
+	cansim_time_t	offset;		/* First release */
+	cansim_time_t	jitter;		/* Each release is up to this late */
+	u16		heap_pos;
+
+	/* Release number and time of the next frame */
+	u32		released;
+	cansim_time_t	next_release;
+
+	u32		sent;
+	u32		dropped;	/* Released into a full queue */
+	u32		inversions;
+	cansim_time_t	min_response;
+	cansim_time_t	max_response;
+	u64		total_response;
+	u32		hist[CANSIM_HIST_BUCKETS];
+} cansim_stream;
+
+typedef struct cansim_frame {
+	u16		stream;
+	u16		bits;		/* On the wire, with stuffing */
+	u32		key;		/* Arbitration field, lower wins */
+	cansim_time_t	released;
+} cansim_frame;
+
+typedef struct cansim_node {
+	u08		addr;		/* Scandal address, for reports */
+	u08		txq;
+	u08		mailboxes;
+	u08		queue_size;
+	cansim_time_t	refill;
+
+	cansim_frame	queue[CANSIM_MAX_QUEUE];	/* In the order queued */
+	u08		count;
+	cansim_time_t	ready;		/* Next frame can't arbitrate before this */
+
+	u08		max_depth;
+	u64		depth_area;	/* Depth integrated over time, in frame ns */
+	cansim_time_t	depth_since;
+	u32		sent;
+	u32		dropped;
+} cansim_node;
+
+typedef struct cansim {
+	u08		baud;
+	cansim_time_t	bit_time;
+	u08		worst_case_stuffing;
+	u32		rng;
+
+	cansim_time_t	now;
+	cansim_time_t	start;
+
+	cansim_node	nodes[CANSIM_MAX_NODES];
+	u16		num_nodes;
+	cansim_stream	streams[CANSIM_MAX_STREAMS];
+	u16		num_streams;
+
+	/* Streams, as a min-heap on next_release */
+	u16		heap[CANSIM_MAX_STREAMS];
+	u16		heap_count;
+
+	/* Frame on the bus, if busy */
+	u08		busy;
+	u16		tx_node;
+	u08		tx_index;	/* In the node's queue */
+	cansim_time_t	tx_end;
+
+	u32		frames;
+	u64		busy_time;
+	u32		inversions;
+
+	cansim_inversion_fn	on_inversion;
+	FILE		*depth_trace;
+} cansim;
+
+void	cansim_init(cansim *sim, u08 baud, u32 seed);
+
+/* Charge every frame the worst case number of stuff bits, as
+   scandal_frame_bits() does, instead of working them out */
+void	cansim_set_worst_case_stuffing(cansim *sim, u08 on);
+
+/* Write "time_us,node,depth" to out each time a queue's depth changes */
+void	cansim_trace_depth(cansim *sim, FILE *out);
+
+void	cansim_set_inversion_handler(cansim *sim, cansim_inversion_fn fn);
+
+/* These return the new node or stream, or CANSIM_NONE if there is no
+   room */
+u16	cansim_add_node(cansim *sim, u08 addr, u08 txq, u08 queue_size,
+			u08 mailboxes, cansim_time_t refill);
+u16	cansim_add_stream(cansim *sim, u16 node, u32 id, u08 ext, u08 length,
+			cansim_time_t period, cansim_time_t offset,
+			cansim_time_t jitter);
+
+/* A node as the engine runs it: a heartbeat every second, plus
+   num_channels channel frames every period_ms at priority pri */
+u16	cansim_add_scandal_node(cansim *sim, u08 addr, u08 txq, u08 pri,
+			u16 num_channels, u32 period_ms);
+
+/* Runs the simulation for another duration ns */
+void	cansim_run(cansim *sim, cansim_time_t duration);
+
+/* Length of a frame on the wire, in bits, with the stuff bits its contents
+   need, the ACK slot, end of frame and interframe space */
+u16	cansim_frame_bits(can_msg *msg);
+
+void	cansim_report(cansim *sim, FILE *out);
+
+#endif /* end __CANSIM_H */
@@ -0,0 +1,32 @@
+/*
+ *  flash.h
+ *
+ *  Emulated flash for the host arch. Like the LPC11C14, the config log
+ *  (see scandal/conf_log.h) is written in 16 byte lines, and holds the user
+ *  storage after the config. The log has two 4KiB banks, so compaction is
+ *  never left without a valid bank. The banks belong to the node rather
+ *  than the thread, so they survive system_reset(), and can be kept in a
+ *  file, see host_node_flash_file(), so they survive the program too.
+ *
+ *  Writes only ever clear bits, as with real flash, so writing anything
+ *  but erased flash shows up.
+ */
+
+#ifndef __FLASH_H
+#define __FLASH_H
+
+#define HOST_FLASH_SECTOR_SIZE	4096
+#define HOST_FLASH_ERASED	0xFF
+
+/* Can be set to 1, to see what a part with one bank loses */
+#ifndef SC_CONF_BANKS
+#define SC_CONF_BANKS		2
+#endif
+#define SC_CONF_BANK_SIZE	HOST_FLASH_SECTOR_SIZE
+#define SC_CONF_WRITE_UNIT	16
+
+#ifndef SC_USER_STORE_SIZE
+#define SC_USER_STORE_SIZE	256
+#endif
+
+#endif /* end __FLASH_H */
@@ -0,0 +1,95 @@
+/*
+ *  system.h
+ *
+ *  Nodes for the host arch.
+ *
+ *  A host_node is one board: its engine (see scandal/context.h), its port
+ *  on the virtual bus, its timer, its flash and its watchdog. Nodes share
+ *  nothing but the bus.
+ *
+ *  Any thread can run any node, one at a time, after binding to it with
+ *  host_node_bind(). So a node can have a thread to itself:
+ *
+ *	host_node_bind(node);
+ *	setjmp(reset);
+ *	node->reset = &reset;
+ *	scandal_init();
+ *	while(running)
+ *		handle_scandal();
+ *
+ *  or a pool of worker threads can share out many nodes, each worker
+ *  calling host_node_bind() then handle_scandal() for each node it takes.
+ *
+ *  system_reset() longjmp()s to the node's reset point if it has one,
+ *  where the thread is expected to call scandal_init() again. Without one
+ *  it sets reset_pending and returns, and whoever runs the node should
+ *  call scandal_init() for it before handling it again.
+ */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ARCH_SYSTEM_H
+#define _ARCH_SYSTEM_H
+
+#include <setjmp.h>
+#include <stdio.h>
+
+#include <scandal/types.h>
+#include <scandal/context.h>
+
+#include <arch/can.h>
+#include <arch/flash.h>
+
+typedef struct host_node {
+	scandal_engine	engine;
+
+	vbus		*bus;		/* Bus the node joins in init_can() */
+	vbus_port	port;
+
+	u64		timer_base_us;	/* host_time_us() when the timer read 0 */
+
+	u08		config_flash[SC_CONF_BANKS * SC_CONF_BANK_SIZE];
+	FILE		*flash_file;	/* Where config_flash is kept, or 0 */
+	u32		flash_erases;	/* Config banks erased */
+	u32		flash_writes;	/* Config flash writes */
+
+	jmp_buf		*reset;		/* Where system_reset() goes, or 0 */
+	u08		reset_pending;
+	u32		resets;
+
+	u32		wdt_period;	/* ms, 0 when the watchdog is off */
+	u64		wdt_last_feed;	/* host_time_us() */
+	u32		wdt_timeouts;
+} host_node;
+
+/* Sets up a node with erased flash, to join bus */
+void		host_node_init(host_node *node, vbus *bus);
+
+/* Keeps the node's config flash in the file at path, loading it from
+   there if the file exists, before the node is first initialised. Returns
+   0 if the file can't be opened */
+u08		host_node_flash_file(host_node *node, const char *path);
+
+/* Makes node the one this thread runs */
+void		host_node_bind(host_node *node);
+
+static inline host_node *host_node_self(void){
+	return (host_node *)scandal_get_engine_owner();
+}
+
+#endif
@@ -0,0 +1,17 @@
+/*
+ *  timer.h
+ *
+ *  Timekeeping for the host arch. Each node's timer counts from its own
+ *  sc_init_timer(), on top of the host's monotonic clock.
+ */
+
+#ifndef __TIMER_H
+#define __TIMER_H
+
+#include <scandal/types.h>
+
+/* Host monotonic time in microseconds. The same for every node, so it can
+   be used to compare times between nodes */
+u64	host_time_us(void);
+
+#endif /* end __TIMER_H */
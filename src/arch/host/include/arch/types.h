@@ -0,0 +1,25 @@
+/*
+ *  types.h
+ *
+ *  Types for the host (Linux) arch. These come from the C library, the
+ *  same as on the ARM targets when built with GCC.
+ */
+
+#ifndef __TYPE_H__
+#define __TYPE_H__
+
+#include <stdint.h>
+
+#ifndef NULL
+#define NULL    ((void *)0)
+#endif
+
+#ifndef FALSE
+#define FALSE   (0)
+#endif
+
+#ifndef TRUE
+#define TRUE    (1)
+#endif
+
+#endif  /* __TYPE_H__ */
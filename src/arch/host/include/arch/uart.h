@@ -0,0 +1,16 @@
+/*
+ *  uart.h
+ *
+ *  The host arch's UART is standard output.
+ */
+
+#ifndef __UART_H
+#define __UART_H
+
+#include <scandal/types.h>
+
+void UART_Init(uint32_t baudrate);
+void UART_Send(uint8_t *BufferPtr, uint32_t Length);
+void UART_putchar(char c);
+
+#endif /* end __UART_H */
@@ -0,0 +1,16 @@
+/*
+ *  wdt.h
+ *
+ *  Watchdog for the host arch. Nothing is reset; a late feed is counted
+ *  in the node's wdt_timeouts instead, see arch/system.h.
+ */
+
+#ifndef __WDT_H
+#define __WDT_H
+
+#include <scandal/types.h>
+
+void WDT_Init(uint32_t wdt_timer_value);
+void WDT_Feed(void);
+
+#endif /* end __WDT_H */
@@ -0,0 +1,44 @@
+/*
+ *  LPC11xx.h
+ *
+ *  For building the lpc11c14 drivers on the host, against the C_CAN model
+ *  in arch/c_can.h. This is the real header, with LPC_CAN pointing at the
+ *  model, and the NVIC and SYSCON accesses the CAN driver makes going
+ *  nowhere. Anything else still points at the part's addresses.
+ */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HOST_LPC11xx_H__
+#define __HOST_LPC11xx_H__
+
+#include_next <cmsis/LPC11xx.h>
+
+#include <arch/c_can.h>
+
+static LPC_SYSCON_TypeDef c_can_syscon __attribute__((unused));
+
+#undef LPC_CAN
+#define LPC_CAN			((LPC_CAN_TypeDef *)c_can_access())
+#undef LPC_SYSCON
+#define LPC_SYSCON		(&c_can_syscon)
+
+#define NVIC_EnableIRQ(irq)	((irq) == CAN_IRQn ? c_can_irq_enable(1) : (void)0)
+#define NVIC_DisableIRQ(irq)	((irq) == CAN_IRQn ? c_can_irq_enable(0) : (void)0)
+
+#endif
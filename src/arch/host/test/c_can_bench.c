@@ -0,0 +1,171 @@
+/*
+ *  c_can_bench.c
+ *
+ *  Runs the lpc11c14 CAN driver, unchanged, against the C_CAN model
+ *  (arch/c_can.h) and prints the register accesses, busy polls and model
+ *  cycles each way of sending an extended 8 byte frame costs:
+ *
+ *   - one CAN_Send with k transmit objects already pending, k = 0 to 10
+ *   - a burst of 11 CAN_Sends, with the given number of cycles of other
+ *     work between them (0 if none is given)
+ *   - the TX interrupt refilling objects from the transmit queue
+ *
+ *  It also checks that no interface is written while busy, and that the
+ *  burst leaves in identifier order. Unlike the other programs here it
+ *  builds the lpc11c14 driver, so it needs that port's include path:
+ *
+ *	gcc -std=gnu99 -O1 -Dlpc11c14 -fno-strict-aliasing \
+ *		-I include -I src/arch/lpc11c14/include \
+ *		-I src/arch/host/include -I src/arch/lpc11c14 \
+ *		-I src/arch/host/test \
+ *		src/arch/lpc11c14/drivers/can.c src/can_filter.c \
+ *		src/can_admit.c src/arch/host/drivers/c_can.c \
+ *		src/arch/host/test/c_can_bench.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <project/driver_config.h>
+
+#include <arch/can.h>
+#include <arch/c_can.h>
+
+#include <scandal/can.h>
+#include <scandal/error.h>
+#include <scandal/timer.h>
+
+#define BURST		11
+#define QUEUED		20
+#define SETTLE		100
+
+/* What the driver needs from the rest of Scandal */
+sc_utime_t sc_get_timer_us(void){
+	return c_can_model.now / 48;
+}
+
+void scandal_busstats_tx(can_msg *msg){
+}
+
+void CAN_IRQHandler(void);
+void init_can(void);
+u08 can_send_msg(can_msg *msg, u08 priority);
+
+static can_msg frame(u32 n){
+	can_msg msg;
+	u08 i;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.id = (3UL << 26) | (0x10UL << 10) | (n & 0x3FF);
+	msg.ext = CAN_EXT_MSG;
+	msg.length = 8;
+	for(i=0; i<8; i++)
+		msg.data[i] = n + i;
+
+	return msg;
+}
+
+static void service_irq(void){
+	while(c_can_irq_pending())
+		CAN_IRQHandler();
+}
+
+/* Put everything pending on the bus, so the next run starts empty */
+static void drain(void){
+	can_msg out;
+
+	service_irq();
+	while(c_can_transmit(&out))
+		service_irq();
+}
+
+int main(int argc, char **argv){
+	c_can_stats stats;
+	can_msg msg, out;
+	u32 work = argc > 1 ? atoi(argv[1]) : 0;
+	u32 last = 0, sent = 0, out_of_order = 0, violations = 0;
+	u64 accesses = 0, polls = 0, cycles = 0;
+	u08 j, k, failed = 0;
+
+	c_can_reset();
+	init_can();
+	drain();
+
+	printf("One CAN_Send with k objects pending\n");
+	printf("  k  accesses  polls  cycles\n");
+	for(k=0; k<=10; k++){
+		for(j=0; j<k; j++){
+			msg = frame(j);
+			CAN_Send(0, &msg);
+		}
+		c_can_elapse(SETTLE);
+		c_can_reset_stats();
+		msg = frame(100);
+		if(CAN_Send(0, &msg) != NO_ERR)
+			failed = 1;
+		c_can_get_stats(&stats);
+		violations += stats.violations;
+		printf(" %2u  %8u  %5u  %6llu\n", k, stats.accesses, stats.busy_polls,
+				(unsigned long long)stats.cycles);
+		drain();
+	}
+
+	printf("%u CAN_Sends, %u cycles apart\n", BURST, work);
+	c_can_elapse(SETTLE);
+	c_can_reset_stats();
+	for(j=0; j<BURST; j++){
+		msg = frame(j);
+		if(CAN_Send(0, &msg) != NO_ERR)
+			failed = 1;
+		c_can_elapse(work);
+	}
+	c_can_get_stats(&stats);
+	violations += stats.violations;
+	printf("  %u accesses, %u polls, %llu cycles besides the work\n",
+			stats.accesses, stats.busy_polls,
+			(unsigned long long)(stats.cycles - BURST * work));
+
+	while(c_can_transmit(&out)){
+		if(sent != 0 && (out.id & 0x3FF) < last)
+			out_of_order++;
+		last = out.id & 0x3FF;
+		sent++;
+		service_irq();
+	}
+	if(sent != BURST)
+		failed = 1;
+	drain();
+
+	/* Queue more frames than there are objects, and time the interrupt
+	   for each frame that goes while the queue still has some to load */
+	for(j=0; j<QUEUED; j++){
+		msg = frame(QUEUED - j);
+		can_send_msg(&msg, 0);
+		c_can_elapse(work);
+	}
+	c_can_elapse(SETTLE);
+	for(sent=0; c_can_transmit(&out); sent++){
+		c_can_elapse(SETTLE);
+		c_can_reset_stats();
+		service_irq();
+		c_can_get_stats(&stats);
+		violations += stats.violations;
+		if(sent < QUEUED - BURST){
+			accesses += stats.accesses;
+			polls += stats.busy_polls;
+			cycles += stats.cycles;
+		}
+	}
+	if(sent != QUEUED)
+		failed = 1;
+	printf("TX interrupt refilling from the queue\n");
+	printf("  %.1f accesses, %.1f polls, %.1f cycles\n",
+			(double)accesses / (QUEUED - BURST), (double)polls / (QUEUED - BURST),
+			(double)cycles / (QUEUED - BURST));
+
+	printf("%u writes to a busy interface, %u frames out of order\n",
+			violations, out_of_order);
+
+	return failed || violations != 0 || out_of_order != 0;
+}
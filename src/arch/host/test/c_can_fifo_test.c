@@ -0,0 +1,149 @@
+/*
+ *  c_can_fifo_test.c
+ *
+ *  Runs the lpc11c14 CAN driver against the C_CAN model (arch/c_can.h)
+ *  with the registrations of a node, two of them fast: a standard id at
+ *  200 frames/s and a channel at 1000 frames/s. The node takes 4 other
+ *  channels, or as many as the first argument says, which leaves fewer
+ *  objects for the FIFOs as it grows. Bursts of 1 to 8 frames of each,
+ *  with other traffic between, arrive while the receive interrupt is held
+ *  off, and it counts how many of each burst the driver kept, and the
+ *  register accesses it took per frame.
+ *
+ *  With -n after the channel count, the fast ids are registered with
+ *  can_register_id(), as before the receive FIFOs, for comparison. It
+ *  fails if a frame comes out of order. Build it as c_can_bench.c is
+ *  built.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <project/driver_config.h>
+
+#include <arch/can.h>
+#include <arch/c_can.h>
+
+#include <scandal/can.h>
+#include <scandal/error.h>
+#include <scandal/timer.h>
+
+#define ID(pri, type, node, chan) \
+	(((u32)(pri) << 26) | ((u32)(type) << 18) | ((u32)(node) << 10) | (chan))
+
+#define THIS_NODE	12
+#define CHANNELS	4
+#define MAX_BURST	8
+#define BURSTS		100
+
+#define STD_FAST	0x403
+#define EXT_FAST	ID(0, 0, 5, 7)
+#define OTHER		ID(0, 0, 3, 0)
+
+/* What the driver needs from the rest of Scandal */
+sc_utime_t sc_get_timer_us(void){
+	return c_can_model.now / 48;
+}
+
+void scandal_busstats_tx(can_msg *msg){
+}
+
+void CAN_IRQHandler(void);
+void init_can(void);
+
+static void register_node(u08 channels, u08 rates){
+	u16 sources[] = {3, 3, 5, 5, 5, 7, 9, 9, 14, 14, 20, 21, 21, 30};
+	u16 i, j;
+
+	for(i=0; i<channels; i++)
+		can_register_id(0x03FFFFFF, ID(0, 0, sources[i], (i * 7) % 40), 0, CAN_EXT_MSG);
+	for(i=0; i<channels; i++){
+		for(j=0; j<i && sources[j] != sources[i]; j++)
+			;
+		if(j == i)
+			can_register_id((0xFEUL << 18) | (0xFFUL << 10), ID(0, 10, sources[i], 0),
+					0, CAN_EXT_MSG);
+	}
+	can_register_id(0x03FFFF00, ID(0, 1, THIS_NODE, 0), 0, CAN_EXT_MSG);
+	can_register_id(0x03FFFF00, ID(0, 6, THIS_NODE, 0), 0, CAN_EXT_MSG);
+	can_register_id(0x03FFFF00, ID(7, 8, 0, 0), 0, CAN_EXT_MSG);
+	can_register_id(0x03FFFC00, ID(7, 7, THIS_NODE, 0), 0, CAN_EXT_MSG);
+	for(i=0; i<5; i++)
+		if(0x400 + (i == 0 ? 0 : i + 1) != STD_FAST)
+			can_register_id(0x7FF, 0x400 + (i == 0 ? 0 : i + 1), 0, CAN_STD_MSG);
+
+	if(rates){
+		can_register_id_rate(0x7FF, STD_FAST, 200, CAN_STD_MSG);
+		can_register_id_rate(0x03FFFFFF, EXT_FAST, 1000, CAN_EXT_MSG);
+	} else {
+		can_register_id(0x7FF, STD_FAST, 0, CAN_STD_MSG);
+		can_register_id(0x03FFFFFF, EXT_FAST, 0, CAN_EXT_MSG);
+	}
+}
+
+static void arrive(u32 id, u08 ext, u08 seq){
+	can_msg msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.id = id;
+	msg.ext = ext;
+	msg.length = 4;
+	msg.data[0] = seq;
+	c_can_receive(&msg);
+}
+
+int main(int argc, char **argv){
+	c_can_stats before, after;
+	can_msg msg;
+	u32 std_kept, ext_kept, accesses;
+	u16 b;
+	u08 burst, i, std_last, ext_last, out_of_order = 0;
+
+	c_can_reset();
+	init_can();
+	register_node(argc > 1 ? atoi(argv[1]) : CHANNELS, !(argc > 2 && strcmp(argv[2], "-n") == 0));
+
+	printf("burst  200/s kept  1000/s kept  accesses/frame\n");
+	for(burst=1; burst<=MAX_BURST; burst++){
+		std_kept = ext_kept = accesses = 0;
+
+		for(b=0; b<BURSTS; b++){
+			c_can_irq_enable(0);
+			for(i=0; i<burst; i++){
+				arrive(STD_FAST, CAN_STD_MSG, i);
+				arrive(OTHER, CAN_EXT_MSG, i);
+				arrive(EXT_FAST, CAN_EXT_MSG, i);
+			}
+			c_can_irq_enable(1);
+
+			c_can_get_stats(&before);
+			while(c_can_irq_pending())
+				CAN_IRQHandler();
+			c_can_get_stats(&after);
+			accesses += after.accesses - before.accesses;
+
+			std_last = ext_last = 0;
+			while(can_get_msg(&msg) == NO_ERR){
+				if(msg.ext == CAN_STD_MSG && msg.id == STD_FAST){
+					if(std_kept != 0 && msg.data[0] < std_last)
+						out_of_order++;
+					std_last = msg.data[0];
+					std_kept++;
+				} else if(msg.ext == CAN_EXT_MSG && msg.id == EXT_FAST){
+					if(ext_kept != 0 && msg.data[0] < ext_last)
+						out_of_order++;
+					ext_last = msg.data[0];
+					ext_kept++;
+				}
+			}
+		}
+
+		printf("%5u  %10.1f  %11.1f  %14.1f\n", burst, (double)std_kept / BURSTS,
+				(double)ext_kept / BURSTS, (double)accesses / (BURSTS * 3 * burst));
+	}
+
+	printf("%u frames out of order\n", out_of_order);
+
+	return out_of_order != 0;
+}
@@ -0,0 +1,148 @@
+/*
+ *  can_admit_bench.c
+ *
+ *  Measures the receive interrupt's admission set (scandal/can_admit.h)
+ *  with the registrations and bus of can_filter_bench.c: how much of the
+ *  unwanted traffic the LPC11C14's and the MCP2510's compiled filters let
+ *  in still gets past it, its false positive rate over extended ids, and
+ *  what a check costs. Then 5000 random sets of registrations are built,
+ *  and frames each registration accepts are checked against the set.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <scandal/can_filter.h>
+#include <scandal/can_admit.h>
+
+#include "filter_bus.h"
+
+#define LPC11C14_OBJS	20
+#define RANDOM_IDS	2000000UL
+#define CHECKS		10000000UL
+#define TRIALS		5000
+#define SAMPLES		200
+
+static can_admit admit;
+static u32 missed_total;
+
+static void measure(const char *what, const can_hw_filter *hw, u16 count){
+	u64 in = 0, unwanted = 0, passed = 0, missed = 0;
+	u16 i, j;
+	u08 match, admitted;
+
+	for(i=0; i<num_frames; i++){
+		for(match=0, j=0; j<count && !match; j++)
+			match = can_hw_filter_match(&hw[j], bus[i].id, bus[i].ext);
+		if(!match)
+			continue;
+
+		in += bus[i].rate;
+		admitted = can_admit_check(&admit, bus[i].id, bus[i].ext);
+		if(wanted(bus[i].id, bus[i].ext)){
+			if(!admitted)
+				missed += bus[i].rate;
+		} else {
+			unwanted += bus[i].rate;
+			if(admitted)
+				passed += bus[i].rate;
+		}
+	}
+	missed_total += missed;
+
+	printf("  %-10s filters let in %llu, %llu unwanted, %llu (%.1f%%) past the set, %llu missed\n",
+			what, (unsigned long long)in, (unsigned long long)unwanted,
+			(unsigned long long)passed, unwanted ? 100.0 * passed / unwanted : 0.0,
+			(unsigned long long)missed);
+}
+
+static void false_positives(void){
+	u32 i, id, seed = 12345, tried = 0, passed = 0;
+	u16 node, chan;
+
+	for(i=0; i<RANDOM_IDS; i++){
+		seed = seed * 1103515245 + 12345;
+		id = (seed >> 3) & 0x1FFFFFFF;
+		if(wanted(id, CAN_EXT_MSG))
+			continue;
+		tried++;
+		passed += can_admit_check(&admit, id, CAN_EXT_MSG);
+	}
+	printf("  %.1f%% of random extended ids\n", 100.0 * passed / tried);
+
+	tried = passed = 0;
+	for(node=0; node<256; node++)
+		for(chan=0; chan<1024; chan++){
+			id = ID(0, 0, node, chan);
+			if(wanted(id, CAN_EXT_MSG))
+				continue;
+			tried++;
+			passed += can_admit_check(&admit, id, CAN_EXT_MSG);
+		}
+	printf("  %.1f%% of the %u unwanted type 0 node and channel ids\n",
+			100.0 * passed / tried, tried);
+}
+
+static u32 check_random(void){
+	u16 trial, sample, i;
+	u32 mask, id, failures = 0;
+	u08 ext;
+
+	for(trial=0; trial<TRIALS; trial++){
+		num_regs = 0;
+		for(i=rand() % 38 + 1; i>0; i--){
+			ext = rand() % 3 != 0;
+			mask = random_u32() & id_bits(ext);
+			if(rand() % 2)
+				mask |= ext ? 0x1FFFFF00 : 0x7F0;
+			reg(mask, random_u32(), ext);
+		}
+		can_admit_build(&admit, regs, num_regs, 1);
+
+		for(sample=0; sample<SAMPLES; sample++){
+			i = rand() % num_regs;
+			ext = regs[i].ext;
+			id = ((random_u32() & ~regs[i].mask) | (regs[i].id & regs[i].mask)) & id_bits(ext);
+			failures += !can_admit_check(&admit, id, ext);
+		}
+	}
+
+	return failures;
+}
+
+int main(void){
+	can_hw_filter hw[MAX_REGS];
+	can_filter_mcp2510 mcp;
+	volatile u32 sink = 0;
+	double start;
+	u32 i, failures;
+	u16 count;
+
+	srand(3);
+	make_registrations();
+	make_bus();
+
+	can_admit_build(&admit, regs, num_regs, 1);
+	printf("%u registrations in %u groups, %u of %u bits set\n",
+			num_regs, admit.num_groups, can_admit_fill(&admit), CAN_ADMIT_BITS);
+
+	count = can_filter_compile_objects(regs, num_regs, hw, LPC11C14_OBJS, 1, 0, 0);
+	can_filter_compile_mcp2510(regs, num_regs, &mcp, 0, 0);
+	printf("Frames/s\n");
+	measure("LPC11C14", hw, count);
+	measure("MCP2510", mcp.filter, 6);
+
+	printf("False positives\n");
+	false_positives();
+
+	start = now_us();
+	for(i=0; i<CHECKS; i++)
+		sink += can_admit_check(&admit, ID(3, 0, ((i >> 6) & 31) | 32, i & 1023), CAN_EXT_MSG);
+	printf("%.1fns per check\n", (now_us() - start) * 1000 / CHECKS);
+
+	failures = check_random();
+	printf("%u random registration sets, %u frames rejected that a registration accepts\n",
+			TRIALS, failures);
+
+	return missed_total != 0 || failures != 0;
+}
@@ -0,0 +1,118 @@
+/*
+ *  can_ring_test.c
+ *
+ *  Stress test of the receive ring (scandal/can_ring.h), with a thread
+ *  standing in for the CAN interrupt handler as producer and the main
+ *  thread as the engine consuming. Each frame carries a sequence number
+ *  and a check word over it, so a slot read before the producer finished
+ *  it, a frame seen twice or out of order, or one lost without being
+ *  counted as an overrun all show up.
+ *
+ *  Frames arrive in bursts of up to 16 with a gap after each, as they
+ *  would off a bus, and the ring is kept small, so it fills often and the
+ *  consumer is also often waiting on the slot being filled.
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <scandal/can_ring.h>
+
+#define FRAMES		10000000UL
+#define RING_SIZE	8
+
+static can_ring ring;
+static can_msg msgs[RING_SIZE];
+static volatile u08 done;
+
+static u32 check_word(u32 seq){
+	return ~(seq * 2654435761UL) & 0xFFFFFFFF;
+}
+
+static void *interrupt_handler(void *arg){
+	u32 seq, rand = 1;
+	volatile u32 spin;
+	can_msg *msg;
+
+	for(seq=0; seq<FRAMES; seq++){
+		/* Gap between bursts, which on a single core has to let the
+		   consumer run */
+		if((seq & 15) == 0){
+			rand = rand * 1103515245 + 12345;
+			for(spin = (rand >> 16) & 0x3FF; spin > 0; spin--)
+				;
+			sched_yield();
+		}
+
+		msg = can_ring_reserve(&ring);
+		if(msg == 0)
+			continue;
+
+		msg->id = seq & 0x1FFFFFFF;
+		msg->data[0] = seq >> 24;
+		msg->data[1] = seq >> 16;
+		msg->data[2] = seq >> 8;
+		msg->data[3] = seq;
+		msg->data[4] = check_word(seq) >> 24;
+		msg->data[5] = check_word(seq) >> 16;
+		msg->data[6] = check_word(seq) >> 8;
+		msg->data[7] = check_word(seq);
+		msg->length = 8;
+		msg->ext = 1;
+		can_ring_commit(&ring);
+	}
+
+	done = 1;
+	return 0;
+}
+
+int main(void){
+	pthread_t producer;
+	can_msg msg;
+	u32 seq, check, received = 0, gaps = 0;
+	s64 last = -1;
+	u08 finished;
+
+	can_ring_init(&ring, msgs, RING_SIZE);
+	pthread_create(&producer, 0, interrupt_handler, 0);
+
+	do {
+		finished = done;
+
+		if(can_ring_count(&ring) == 0)
+			sched_yield();
+
+		while(can_ring_get(&ring, &msg)){
+			seq = ((u32)msg.data[0] << 24) | ((u32)msg.data[1] << 16) |
+				((u32)msg.data[2] << 8) | msg.data[3];
+			check = ((u32)msg.data[4] << 24) | ((u32)msg.data[5] << 16) |
+				((u32)msg.data[6] << 8) | msg.data[7];
+
+			if(check != check_word(seq) || msg.id != (seq & 0x1FFFFFFF) || msg.length != 8){
+				printf("frame %u was torn\n", received);
+				return 1;
+			}
+			if((s64)seq <= last){
+				printf("frame %u came after %lld\n", seq, (long long)last);
+				return 1;
+			}
+			if((s64)seq != last + 1)
+				gaps += seq - last - 1;
+			last = seq;
+			received++;
+		}
+	} while(!finished);
+
+	pthread_join(producer, 0);
+
+	printf("sent %lu, received %u, overruns %u, missing %u\n",
+			FRAMES, received, ring.overruns, gaps + (u32)(FRAMES - 1 - last));
+
+	if(received + ring.overruns != FRAMES || gaps + (FRAMES - 1 - last) != ring.overruns){
+		printf("frames went missing without being counted\n");
+		return 1;
+	}
+
+	return 0;
+}
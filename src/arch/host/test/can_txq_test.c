@@ -0,0 +1,76 @@
+/*
+ *  can_txq_test.c
+ *
+ *  Checks the transmit queue (scandal/can_txq.h) against a brute force
+ *  search. Random frames are queued and taken off at random, and each
+ *  time one is taken off it must be the lowest arbitration key of all
+ *  those queued, and of those with that key, the first queued. A quarter
+ *  of the frames share one identifier, to exercise the ties.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <scandal/can_txq.h>
+
+#define OPERATIONS	2000000UL
+#define QUEUE_SIZE	CAN_TXQ_MAX
+#define SHARED_ID	5
+
+static can_txq_slot slots[QUEUE_SIZE];
+static can_txq q;
+
+/* Each slot's frame, in the order it was queued, for the brute force */
+static u32 queued_at[QUEUE_SIZE];
+
+int main(void){
+	can_msg *msg;
+	u32 ops, now = 0, wrong = 0, frames = 0;
+	u08 slot, i, best;
+
+	srand(1);
+	can_txq_init(&q, slots, QUEUE_SIZE);
+
+	for(ops=0; ops<OPERATIONS; ops++){
+		if((rand() & 1) && can_txq_count(&q) < QUEUE_SIZE){
+			msg = can_txq_reserve(&q);
+			if(rand() % 4 == 0){
+				msg->id = SHARED_ID;
+				msg->ext = CAN_EXT_MSG;
+			} else {
+				msg->ext = rand() & 1;
+				msg->id = rand() % (msg->ext ? 0x1FFFFFFF : 0x7FF);
+			}
+			queued_at[(can_txq_slot *)msg - slots] = now++;
+			can_txq_commit(&q, msg);
+			frames++;
+		} else if(can_txq_count(&q) != 0){
+			slot = (can_txq_slot *)can_txq_peek(&q) - slots;
+
+			best = slot;
+			for(i=0; i<QUEUE_SIZE; i++){
+				if(!(q.used & (1UL << i)))
+					continue;
+				if(slots[i].key < slots[best].key ||
+						(slots[i].key == slots[best].key &&
+						 queued_at[i] < queued_at[best]))
+					best = i;
+			}
+			if(best != slot)
+				wrong++;
+
+			can_txq_release(&q);
+		}
+
+		if((u08)__builtin_popcountl(q.used) != can_txq_count(&q)){
+			printf("%u slots in use with %u frames queued\n",
+					__builtin_popcountl(q.used), can_txq_count(&q));
+			return 1;
+		}
+	}
+
+	printf("%lu operations, %u frames queued, %u taken off out of order, high water %u\n",
+			OPERATIONS, frames, wrong, q.high_water);
+
+	return wrong == 0 ? 0 : 1;
+}
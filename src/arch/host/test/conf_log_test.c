@@ -0,0 +1,147 @@
+/*
+ *  conf_log_test.c
+ *
+ *  Checks the config log (scandal/conf_log.h) on a host node. First it
+ *  counts the flash writes and erases of setting every out channel's
+ *  scaling ten times, and checks the config reads back the same after a
+ *  remount. Then it makes random writes to the log's image, and cuts the
+ *  power part way through one in fifty of them: a flash write stops
+ *  short, and the log is mounted again. After each cut the image must
+ *  hold either the old or the new contents.
+ *
+ *  The cuts come from wrapping the flash backend, so it needs
+ *  -Wl,--wrap=sc_conf_bank_write on the build command. Built with
+ *  -DSC_CONF_BANKS=1 it shows what a part with one bank loses, and fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include <scandal/engine.h>
+#include <scandal/eeprom.h>
+#include <scandal/conf_log.h>
+#include <scandal/context.h>
+
+#include <arch/system.h>
+
+#define PASSES		10
+#define WRITES		200000UL
+#define CUT_ONE_IN	50
+#define REMOUNT_EVERY	97
+
+static vbus bus;
+static host_node node;
+
+/* Writes to let through before the cut, or -1 for no cut */
+static s32 writes_to_cut = -1;
+static u32 cut_bytes;
+static jmp_buf power_cut;
+
+void __real_sc_conf_bank_write(u08 bank, u16 offset, const u08 *data, u16 length);
+
+void __wrap_sc_conf_bank_write(u08 bank, u16 offset, const u08 *data, u16 length){
+	if(writes_to_cut == 0){
+		writes_to_cut = -1;
+		__real_sc_conf_bank_write(bank, offset, data, cut_bytes % (length + 1));
+		longjmp(power_cut, 1);
+	}
+	if(writes_to_cut > 0)
+		writes_to_cut--;
+
+	__real_sc_conf_bank_write(bank, offset, data, length);
+}
+
+static u08 old_image[CONF_LOG_IMAGE_SIZE], new_image[CONF_LOG_IMAGE_SIZE];
+static u08 image[CONF_LOG_IMAGE_SIZE];
+
+int main(void){
+	scandal_config config;
+	u32 erases, writes, i;
+	/* Static, as they change between the setjmp and the power cut */
+	static u32 cuts, kept_old, kept_new, wrong, wrong_compacting;
+	u16 offset, length, j;
+	u08 pass, chan, remounted;
+
+	vbus_init(&bus);
+	host_node_init(&node, &bus);
+	host_node_bind(&node);
+	srand(1);
+
+	sc_init_eeprom();
+	memset(&sc_self->my_config, 0, sizeof(scandal_config));
+	sc_write_conf(&sc_self->my_config);
+
+	erases = node.flash_erases;
+	writes = node.flash_writes;
+	for(pass=0; pass<PASSES; pass++)
+		for(chan=0; chan<NUM_OUT_CHANNELS; chan++){
+			scandal_set_m(chan, 1000 + pass * 7 + chan);
+			scandal_set_b(chan, -pass - chan);
+		}
+	printf("%u scaling changes, %u flash writes, %u erases\n",
+			PASSES * 2 * NUM_OUT_CHANNELS, node.flash_writes - writes,
+			node.flash_erases - erases);
+
+	sc_init_eeprom();
+	sc_read_conf(&config);
+	remounted = memcmp(&config, &sc_self->my_config, sizeof(config)) == 0;
+	if(!remounted)
+		wrong++;
+	printf("config after a remount %s\n", remounted ? "matches" : "differs");
+
+	memcpy(new_image, sc_self->conf_log.image, CONF_LOG_IMAGE_SIZE);
+	for(i=0; i<WRITES; i++){
+		offset = rand() % CONF_LOG_IMAGE_SIZE;
+		length = 1 + rand() % (CONF_LOG_IMAGE_SIZE - offset);
+		if(rand() % 4)
+			length = 1 + rand() % (length < 8 ? length : 8);
+
+		memcpy(old_image, new_image, CONF_LOG_IMAGE_SIZE);
+		for(j=0; j<length; j++)
+			if(rand() % 3 == 0)
+				new_image[offset + j] = rand();
+
+		if(rand() % CUT_ONE_IN == 0){
+			writes_to_cut = rand() % 4;
+			cut_bytes = rand();
+		}
+
+		erases = node.flash_erases;
+		if(setjmp(power_cut)){
+			cuts++;
+			sc_conf_log_mount();
+			sc_conf_log_read(0, image, CONF_LOG_IMAGE_SIZE);
+			if(memcmp(image, old_image, CONF_LOG_IMAGE_SIZE) == 0)
+				kept_old++;
+			else if(memcmp(image, new_image, CONF_LOG_IMAGE_SIZE) == 0)
+				kept_new++;
+			else {
+				wrong++;
+				if(node.flash_erases != erases)
+					wrong_compacting++;
+			}
+			memcpy(new_image, image, CONF_LOG_IMAGE_SIZE);
+			continue;
+		}
+
+		sc_conf_log_write(offset, &new_image[offset], length);
+		writes_to_cut = -1;
+
+		if(i % REMOUNT_EVERY == 0)
+			sc_conf_log_mount();
+		sc_conf_log_read(0, image, CONF_LOG_IMAGE_SIZE);
+		if(memcmp(image, new_image, CONF_LOG_IMAGE_SIZE) != 0){
+			wrong++;
+			memcpy(new_image, image, CONF_LOG_IMAGE_SIZE);
+		}
+	}
+
+	printf("%lu random writes, %u power cuts: %u kept the old contents, %u the new, %u wrong\n",
+			WRITES, cuts, kept_old, kept_new, wrong);
+	printf("%u of the wrong ones cut a compaction, %u banks erased\n",
+			wrong_compacting, node.flash_erases);
+
+	return wrong != 0;
+}
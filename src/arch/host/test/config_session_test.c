@@ -0,0 +1,145 @@
+/*
+ *  config_session_test.c
+ *
+ *  Reconfigures a node with 14 in-channel sources, 10 m, 10 b and a new
+ *  address, 35 config messages, one message at a time and then in a
+ *  session, and counts the resets and flash writes each way takes. A
+ *  session without the address change must not reset at all. Then it
+ *  checks that abort and the session timeout put a changed source and
+ *  address back, that the timeout counts from the last config message,
+ *  and that commit keeps them.
+ *
+ *  The timeout would take 10s at its default, so build it with
+ *  -DSCANDAL_CONFIG_SESSION_TIMEOUT=100.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <scandal/engine.h>
+#include <scandal/message.h>
+#include <scandal/context.h>
+
+#include <arch/system.h>
+#include <arch/timer.h>
+
+#if SCANDAL_CONFIG_SESSION_TIMEOUT > 1000
+#error "Build with -DSCANDAL_CONFIG_SESSION_TIMEOUT=100"
+#endif
+
+#define NEW_ADDR	77
+
+u08 scandal_handle_config(can_msg *msg);
+
+static vbus bus;
+static host_node node;
+
+static void boot(void){
+	node.reset_pending = 0;
+	scandal_init();
+}
+
+static void config(u08 param, u08 d0, u08 d1, u08 d2, u08 d4){
+	can_msg msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.id = scandal_mk_config_id(0, scandal_get_addr(), param);
+	msg.data[0] = d0;
+	msg.data[1] = d1;
+	msg.data[2] = d2;
+	msg.data[4] = d4;
+	msg.length = 8;
+	scandal_handle_config(&msg);
+
+	if(node.reset_pending)
+		boot();
+}
+
+static void fresh_node(void){
+	host_node_init(&node, &bus);
+	host_node_bind(&node);
+	boot();
+}
+
+static void run_until(u64 us){
+	while(host_time_us() < us)
+		handle_scandal();
+}
+
+/* Returns the resets it took */
+static u32 reconfigure(const char *how, u08 session, u08 new_addr){
+	u32 resets = node.resets, writes = node.flash_writes;
+	u08 i;
+
+	if(session)
+		config(CONFIG_SESSION_BEGIN, 0, 0, 0, 0);
+	for(i=0; i<NUM_IN_CHANNELS; i++)
+		config(CONFIG_IN_CHAN_SOURCE, 0, i, 7, i + 1);
+	for(i=0; i<NUM_OUT_CHANNELS; i++){
+		config(CONFIG_OUT_CHAN_M, 0, i, 0, 3);
+		config(CONFIG_OUT_CHAN_B, 0, i, 0, 3);
+	}
+	if(new_addr)
+		config(CONFIG_ADDR, NEW_ADDR, 0, 0, 0);
+	if(session)
+		config(CONFIG_SESSION_COMMIT, 0, 0, 0, 0);
+
+	printf("  %-22s %u resets, %u flash writes\n", how,
+			node.resets - resets, node.flash_writes - writes);
+
+	return node.resets - resets;
+}
+
+int main(void){
+	u08 addr, wrong = 0;
+	u64 start;
+
+	vbus_init(&bus);
+
+	printf("%u config messages\n", NUM_IN_CHANNELS + 2 * NUM_OUT_CHANNELS + 1);
+	fresh_node();
+	wrong |= reconfigure("one at a time", 0, 1) != 1;
+	fresh_node();
+	wrong |= reconfigure("in a session", 1, 1) != 1;
+	fresh_node();
+	wrong |= reconfigure("same address, session", 1, 0) != 0;
+	wrong |= scandal_get_addr() == NEW_ADDR ||
+		sc_self->my_config.ins[NUM_IN_CHANNELS - 1].source_node != 7;
+
+	fresh_node();
+	addr = scandal_get_addr();
+	config(CONFIG_IN_CHAN_SOURCE, 0, 1, 9, 5);
+
+	config(CONFIG_SESSION_BEGIN, 0, 0, 0, 0);
+	config(CONFIG_IN_CHAN_SOURCE, 0, 1, 10, 5);
+	config(CONFIG_ADDR, NEW_ADDR, 0, 0, 0);
+	config(CONFIG_SESSION_ABORT, 0, 0, 0, 0);
+	printf("after abort:    source %u, address %u\n",
+			sc_self->my_config.ins[1].source_node, scandal_get_addr());
+	wrong |= sc_self->my_config.ins[1].source_node != 9 || scandal_get_addr() != addr;
+
+	/* The timeout counts from the last message, so halfway through
+	   another one keeps the session open until 1.5 timeouts in */
+	config(CONFIG_SESSION_BEGIN, 0, 0, 0, 0);
+	config(CONFIG_IN_CHAN_SOURCE, 0, 1, 11, 5);
+	start = host_time_us();
+	run_until(start + SCANDAL_CONFIG_SESSION_TIMEOUT * 500ULL);
+	config(CONFIG_IN_CHAN_SOURCE, 0, 2, 11, 5);
+	run_until(start + SCANDAL_CONFIG_SESSION_TIMEOUT * 1250ULL);
+	printf("before timeout: source %u, session %s\n", sc_self->my_config.ins[1].source_node,
+			sc_self->config_session ? "open" : "closed");
+	wrong |= sc_self->my_config.ins[1].source_node != 11 || !sc_self->config_session;
+	run_until(start + SCANDAL_CONFIG_SESSION_TIMEOUT * 1750ULL);
+	printf("after timeout:  source %u, session %s\n", sc_self->my_config.ins[1].source_node,
+			sc_self->config_session ? "open" : "closed");
+	wrong |= sc_self->my_config.ins[1].source_node != 9 || sc_self->config_session;
+
+	config(CONFIG_SESSION_BEGIN, 0, 0, 0, 0);
+	config(CONFIG_IN_CHAN_SOURCE, 0, 1, 12, 5);
+	config(CONFIG_SESSION_COMMIT, 0, 0, 0, 0);
+	printf("after commit:   source %u, session %s\n", sc_self->my_config.ins[1].source_node,
+			sc_self->config_session ? "open" : "closed");
+	wrong |= sc_self->my_config.ins[1].source_node != 12 || sc_self->config_session;
+
+	return wrong;
+}
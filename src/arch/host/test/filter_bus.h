@@ -0,0 +1,116 @@
+/*
+ *  filter_bus.h
+ *
+ *  The registrations and bus traffic can_filter_bench.c and
+ *  can_admit_bench.c measure against, with what they both need to judge
+ *  a filter by them.
+ */
+
+#ifndef __FILTER_BUS_H__
+#define __FILTER_BUS_H__
+
+#include <stdlib.h>
+#include <time.h>
+
+#include <scandal/can_filter.h>
+
+#define ID(pri, type, node, chan) \
+	(((u32)(pri) << 26) | ((u32)(type) << 18) | ((u32)(node) << 10) | (chan))
+
+#define THIS_NODE	12
+#define MAX_REGS	64
+#define MAX_FRAMES	2000
+
+static can_filter regs[MAX_REGS];
+static u16 num_regs;
+
+static can_filter_traffic bus[MAX_FRAMES];
+static u16 num_frames;
+
+static inline void reg(u32 mask, u32 id, u08 ext){
+	regs[num_regs].mask = mask;
+	regs[num_regs].id = id;
+	regs[num_regs].ext = ext;
+	num_regs++;
+}
+
+static inline void traffic(u32 id, u08 ext, u32 rate){
+	bus[num_frames].id = id;
+	bus[num_frames].ext = ext;
+	bus[num_frames].rate = rate;
+	num_frames++;
+}
+
+static inline u32 id_bits(u08 ext){
+	return ext ? 0x1FFFFFFF : 0x7FF;
+}
+
+static inline u08 accepts(const can_filter *f, u32 id, u08 ext){
+	return f->ext == ext && ((id ^ f->id) & f->mask & id_bits(ext)) == 0;
+}
+
+static inline u08 wanted(u32 id, u08 ext){
+	u16 i;
+
+	for(i=0; i<num_regs; i++)
+		if(accepts(&regs[i], id, ext))
+			return 1;
+	return 0;
+}
+
+static inline u32 random_u32(void){
+	return (u32)rand() ^ ((u32)rand() << 15) ^ ((u32)rand() << 30);
+}
+
+static inline double now_us(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* What the registrations of a node in the middle of a busy network look
+   like: channels from 14 sources, the config and command traffic to this
+   node, heartbeats, and a few standard frames from a motor controller */
+static inline void make_registrations(void){
+	u16 sources[] = {3, 3, 5, 5, 5, 7, 9, 9, 14, 14, 20, 21, 21, 30};
+	u16 i, j;
+
+	for(i=0; i<14; i++)
+		reg(0x03FFFFFF, ID(0, 0, sources[i], (i * 7) % 40), CAN_EXT_MSG);
+	for(i=0; i<14; i++){
+		for(j=0; j<i && sources[j] != sources[i]; j++)
+			;
+		if(j == i)
+			reg((0xFEUL << 18) | (0xFFUL << 10), ID(0, 10, sources[i], 0), CAN_EXT_MSG);
+	}
+	reg(0x03FFFF00, ID(0, 1, THIS_NODE, 0), CAN_EXT_MSG);
+	reg(0x03FFFF00, ID(0, 6, THIS_NODE, 0), CAN_EXT_MSG);
+	reg(0x03FFFF00, ID(7, 8, 0, 0), CAN_EXT_MSG);
+	reg(0x03FFFC00, ID(7, 7, THIS_NODE, 0), CAN_EXT_MSG);
+	for(i=0; i<5; i++)
+		reg(0x7FF, 0x400 + (i == 0 ? 0 : i + 1), CAN_STD_MSG);
+}
+
+/* 32 nodes with 40 channels each at 10Hz and a heartbeat, packed frames
+   from 8 of them at 50Hz, and the motor controller's standard frames */
+static inline void make_bus(void){
+	u16 node, i;
+
+	for(node=1; node<=32; node++){
+		for(i=0; i<40; i++)
+			traffic(ID(3, 0, node, i), CAN_EXT_MSG, 10);
+		traffic(ID(7, 2, node, 1), CAN_EXT_MSG, 1);
+	}
+	for(node=1; node<=32; node+=4)
+		for(i=0; i<4; i++)
+			traffic(ID(2, 10, node, i), CAN_EXT_MSG, 50);
+	for(i=0; i<0x18; i++)
+		traffic(0x400 + i, CAN_STD_MSG, 5);
+	for(i=0; i<0x10; i++)
+		traffic(0x500 + i, CAN_STD_MSG, 10);
+	traffic(ID(7, 8, 0, 0), CAN_EXT_MSG, 10);
+	traffic(ID(0, 1, THIS_NODE, 3), CAN_EXT_MSG, 1);
+}
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ *  node_pool_test.c
+ *
+ *  Runs 1000 nodes on one bus with a pool of 4 worker threads, each
+ *  taking its share of the nodes in turn, and checks that every node
+ *  initialises and sends its heartbeat. Build it with
+ *  -DVBUS_MAX_PORTS=1024.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <scandal/engine.h>
+#include <scandal/context.h>
+
+#include <arch/system.h>
+
+#define NODES		1000
+#define WORKERS		4
+#define RUN_MS		2500
+
+#if VBUS_MAX_PORTS < NODES
+#error "Build with -DVBUS_MAX_PORTS=1024"
+#endif
+
+static vbus bus;
+static host_node *nodes;
+static volatile u08 running = 1;
+
+static void *worker(void *arg){
+	long first = (long)arg;
+	long i;
+
+	for(i=first; i<NODES; i+=WORKERS){
+		host_node_bind(&nodes[i]);
+		scandal_init();
+	}
+
+	while(running){
+		for(i=first; i<NODES; i+=WORKERS){
+			host_node_bind(&nodes[i]);
+			handle_scandal();
+		}
+	}
+
+	return 0;
+}
+
+int main(void){
+	pthread_t threads[WORKERS];
+	struct timespec run = {RUN_MS / 1000, (RUN_MS % 1000) * 1000000L};
+	u32 silent = 0;
+	long i;
+
+	nodes = calloc(NODES, sizeof(host_node));
+	vbus_init(&bus);
+	for(i=0; i<NODES; i++)
+		host_node_init(&nodes[i], &bus);
+
+	for(i=0; i<WORKERS; i++)
+		pthread_create(&threads[i], 0, worker, (void *)i);
+	nanosleep(&run, 0);
+	running = 0;
+	for(i=0; i<WORKERS; i++)
+		pthread_join(threads[i], 0);
+
+	for(i=0; i<NODES; i++)
+		if(nodes[i].port.stats.tx_frames == 0)
+			silent++;
+
+	printf("%u nodes attached, %u never sent, %u frames on the bus\n",
+			bus.num_ports, silent, bus.frames);
+	printf("sizeof(scandal_engine) %u, sizeof(host_node) %u\n",
+			(u32)sizeof(scandal_engine), (u32)sizeof(host_node));
+
+	return bus.num_ports == NODES && silent == 0 ? 0 : 1;
+}
@@ -0,0 +1,15 @@
+/*
+ *  driver_config.h
+ *
+ *  Driver configuration for building the lpc11c14 CAN driver against the
+ *  host's C_CAN model, as c_can_bench.c does. Only that build includes it.
+ */
+
+#ifndef __DRIVER_CONFIG__
+#define __DRIVER_CONFIG__
+
+#include <cmsis/LPC11xx.h>
+
+#define CONFIG_ENABLE_DRIVER_TIMER32	1
+
+#endif
@@ -0,0 +1,33 @@
+/*
+ *  scandal_config.h
+ *
+ *  Project configuration for the host test programs in src/arch/host/test.
+ *  Each setting can be overridden with -D on the compiler command line.
+ */
+
+#ifndef __SCANDAL_CONFIG__
+#define __SCANDAL_CONFIG__
+
+#ifndef NUM_IN_CHANNELS
+#define NUM_IN_CHANNELS		14
+#endif
+
+#ifndef NUM_OUT_CHANNELS
+#define NUM_OUT_CHANNELS	10
+#endif
+
+#ifndef THIS_DEVICE_TYPE
+#define THIS_DEVICE_TYPE	1
+#endif
+
+#ifndef CAN_TX_BUFFER_SIZE
+#define CAN_TX_BUFFER_SIZE	16
+#endif
+#define CAN_TX_BUFFER_MASK	(CAN_TX_BUFFER_SIZE - 1)
+
+#ifndef CAN_RX_BUFFER_SIZE
+#define CAN_RX_BUFFER_SIZE	16
+#endif
+#define CAN_RX_BUFFER_MASK	(CAN_RX_BUFFER_SIZE - 1)
+
+#endif
@@ -0,0 +1,13 @@
+/*
+ *  system_LPC11xx.h
+ *
+ *  What cmsis/LPC11xx.h wants from a project's system header, for the
+ *  lpc11c14 driver build in c_can_bench.c.
+ */
+
+#ifndef __SYSTEM_LPC11xx_H
+#define __SYSTEM_LPC11xx_H
+
+extern unsigned int SystemCoreClock;
+
+#endif
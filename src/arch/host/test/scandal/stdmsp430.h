@@ -0,0 +1,7 @@
+/*
+ *  stdmsp430.h
+ *
+ *  The lpc11c14 CAN driver includes <scandal/stdmsp430.h>, which isn't in
+ *  the tree and which it needs nothing from. This empty one lets
+ *  c_can_bench.c build the driver.
+ */
@@ -0,0 +1,25 @@
+/*
+ *  user.c
+ *
+ *  The node obligations (scandal/obligations.h) for the host test
+ *  programs, none of which have any user messages or config of their own.
+ */
+
+#include <scandal/types.h>
+#include <scandal/can.h>
+#include <scandal/obligations.h>
+
+void scandal_user_do_first_run(void){
+}
+
+u08 scandal_user_do_config(u08 param, s32 value, s32 value2){
+	return 0;
+}
+
+u08 scandal_user_handle_message(can_msg *msg){
+	return 0;
+}
+
+u08 scandal_user_handle_command(u08 command, u08 *data){
+	return 0;
+}
@@ -0,0 +1,216 @@
+/*
+ *  user_store_test.c
+ *
+ *  Checks the user storage (scandal/user_store.h) on a host node:
+ *
+ *   - Raw user data at the start of bank 1, as the MSP430 and LPC11C14
+ *     kept it before the config log, is taken as the user storage, and
+ *     kept when the log compacts into that bank. Raw data past what the
+ *     user storage holds, with -DSC_USER_STORE_LEGACY_SIZE bigger than
+ *     SC_USER_STORE_SIZE, must be counted as lost until then.
+ *   - Blocks that run past the user storage give LEN_ERR.
+ *   - A writer making three calls (4, 8 and 16 bytes) every 100ms for an
+ *     hour, flushed every second: what that costs in flushes, flash
+ *     writes and erases.
+ *   - Random writes, flushed now and then, with the power cut part way
+ *     through one flush in ten. After each cut the user storage must
+ *     read as it was before the flush or after it, and the config must
+ *     not have changed.
+ *
+ *  The host has no legacy user data of its own, and the cuts come from
+ *  wrapping the flash backend, so build it with
+ *  -DSC_USER_STORE_LEGACY_BANK=1 -Wl,--wrap=sc_conf_bank_write.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include <scandal/engine.h>
+#include <scandal/error.h>
+#include <scandal/eeprom.h>
+#include <scandal/conf_log.h>
+#include <scandal/user_store.h>
+#include <scandal/context.h>
+
+#include <arch/system.h>
+
+#ifndef SC_USER_STORE_LEGACY_BANK
+#error "Build with -DSC_USER_STORE_LEGACY_BANK=1"
+#endif
+
+#define HOUR_OF_WRITES	36000UL
+#define FLUSH_EVERY	10
+#define WRITES		200000UL
+#define FLUSH_ONE_IN	8
+#define CUT_ONE_IN	10
+#define REMOUNT_EVERY	101
+
+static vbus bus;
+static host_node node;
+
+/* Writes to let through before the cut, or -1 for no cut */
+static s32 writes_to_cut = -1;
+static u32 cut_bytes;
+static jmp_buf power_cut;
+
+void __real_sc_conf_bank_write(u08 bank, u16 offset, const u08 *data, u16 length);
+
+void __wrap_sc_conf_bank_write(u08 bank, u16 offset, const u08 *data, u16 length){
+	if(writes_to_cut == 0){
+		writes_to_cut = -1;
+		__real_sc_conf_bank_write(bank, offset, data, cut_bytes % (length + 1));
+		longjmp(power_cut, 1);
+	}
+	if(writes_to_cut > 0)
+		writes_to_cut--;
+
+	__real_sc_conf_bank_write(bank, offset, data, length);
+}
+
+static u08 store[SC_USER_STORE_SIZE], flushed[SC_USER_STORE_SIZE];
+static u08 before[SC_USER_STORE_SIZE], data[SC_USER_STORE_SIZE];
+static u08 config[sizeof(scandal_config)];
+
+/* Mounts the log again, as after a reset, and reads the user storage */
+static void remount(u08 *into){
+	sc_init_eeprom();
+	sc_user_eeprom_read_block(0, into, 200);
+	sc_user_eeprom_read_block(200, into + 200, SC_USER_STORE_SIZE - 200);
+}
+
+static u08 legacy_kept(void){
+	u16 i;
+
+	remount(data);
+	for(i=0; i<SC_USER_STORE_SIZE; i++)
+		if(data[i] != (u08)(i * 7))
+			return 0;
+	return 1;
+}
+
+int main(void){
+	u32 i, writes, erases, calls = 0;
+	/* Static, as they change between the setjmp and the power cut */
+	static u32 cuts, kept_old, kept_new, wrong;
+	u16 offset, length, j;
+	u16 lost = 0, lost_adopted, lost_kept;
+	u08 adopted, kept, record[16];
+	u64 timestamp;
+
+	vbus_init(&bus);
+	host_node_init(&node, &bus);
+	host_node_bind(&node);
+	srand(2);
+
+	/* A raw config in bank 0 and raw user data in bank 1 */
+	memset(node.config_flash, 0, sizeof(scandal_config));
+	node.config_flash[0] = 3;
+	node.config_flash[1] = 42;
+	for(j=0; j<SC_USER_STORE_LEGACY_SIZE; j++){
+		node.config_flash[SC_CONF_BANK_SIZE + j] = j * 7;
+		if(j >= SC_USER_STORE_SIZE && (u08)(j * 7) != 0xFF)
+			lost++;
+	}
+
+	adopted = legacy_kept();
+	lost_adopted = sc_self->conf_log.legacy_lost;
+	sc_read_conf(&sc_self->my_config);
+	sc_self->my_config.addr = 43;
+	sc_write_conf(&sc_self->my_config);
+	kept = legacy_kept();
+	lost_kept = sc_self->conf_log.legacy_lost;
+	printf("Raw user data %s, %s after compacting into bank %u, address %u\n",
+			adopted ? "adopted" : "lost", kept ? "kept" : "lost",
+			sc_self->conf_log.bank, sc_self->conf_log.image[1]);
+	printf("%u bytes past the user storage counted lost, %u after compacting\n",
+			lost_adopted, lost_kept);
+	if(!adopted || !kept || sc_self->conf_log.bank != 1 ||
+	   lost_adopted != lost || lost_kept != 0)
+		wrong++;
+
+	if(sc_user_eeprom_read_block(SC_USER_STORE_SIZE - 1, record, 2) != LEN_ERR ||
+	   sc_user_eeprom_write_block(SC_USER_STORE_SIZE - 1, record, 2) != LEN_ERR ||
+	   sc_user_eeprom_read_block(SC_USER_STORE_SIZE - 2, record, 2) != NO_ERR){
+		printf("A block past the user storage didn't give LEN_ERR\n");
+		wrong++;
+	}
+
+	writes = node.flash_writes;
+	erases = node.flash_erases;
+	for(i=0; i<HOUR_OF_WRITES; i++){
+		timestamp = i * 100ULL;
+		memset(record, 0, sizeof(record));
+		record[i % 16] = i;
+
+		sc_user_eeprom_write_block(0, (u08 *)&i, 4);
+		sc_user_eeprom_write_block(4, (u08 *)&timestamp, 8);
+		sc_user_eeprom_write_block(16 + 16 * (i % 8), record, 16);
+		calls += 3;
+
+		if(i % FLUSH_EVERY == FLUSH_EVERY - 1)
+			sc_user_store_flush();
+	}
+	printf("An hour of writes: %u calls, %u flushes, %u flash writes, %u erases\n",
+			calls, sc_self->user_store.flushes, node.flash_writes - writes,
+			node.flash_erases - erases);
+
+	memcpy(config, sc_self->conf_log.image, sizeof(config));
+	remount(store);
+	memcpy(flushed, store, SC_USER_STORE_SIZE);
+	for(i=0; i<WRITES; i++){
+		offset = rand() % SC_USER_STORE_SIZE;
+		length = SC_USER_STORE_SIZE - offset;
+		length = 1 + rand() % (length < 255 ? length : 255);
+		if(rand() % 4)
+			length = 1 + rand() % (length < 8 ? length : 8);
+
+		for(j=0; j<length; j++)
+			data[j] = rand() % 3 ? store[offset + j] : rand();
+		sc_user_eeprom_write_block(offset, data, length);
+		memcpy(&store[offset], data, length);
+
+		if(rand() % FLUSH_ONE_IN)
+			continue;
+
+		memcpy(before, flushed, SC_USER_STORE_SIZE);
+		if(rand() % CUT_ONE_IN == 0){
+			writes_to_cut = rand() % 6;
+			cut_bytes = rand();
+		}
+
+		if(setjmp(power_cut)){
+			cuts++;
+			remount(data);
+			if(memcmp(sc_self->conf_log.image, config, sizeof(config)) != 0)
+				wrong++;
+			if(memcmp(data, before, SC_USER_STORE_SIZE) == 0)
+				kept_old++;
+			else if(memcmp(data, store, SC_USER_STORE_SIZE) == 0)
+				kept_new++;
+			else
+				wrong++;
+			memcpy(store, data, SC_USER_STORE_SIZE);
+			memcpy(flushed, data, SC_USER_STORE_SIZE);
+			continue;
+		}
+
+		sc_user_store_flush();
+		writes_to_cut = -1;
+		memcpy(flushed, store, SC_USER_STORE_SIZE);
+
+		if(i % REMOUNT_EVERY == 0){
+			remount(data);
+			if(memcmp(data, store, SC_USER_STORE_SIZE) != 0){
+				wrong++;
+				memcpy(store, data, SC_USER_STORE_SIZE);
+				memcpy(flushed, data, SC_USER_STORE_SIZE);
+			}
+		}
+	}
+	printf("%lu random writes, %u power cuts: %u kept the old storage, %u the new, %u wrong\n",
+			WRITES, cuts, kept_old, kept_new, wrong);
+
+	return wrong != 0;
+}
@@ -0,0 +1,81 @@
+/*
+ *  vbus_bench.c
+ *
+ *  End to end throughput of the virtual bus: one thread sends extended
+ *  channel frames from one node as fast as the receiving node's engine,
+ *  on a thread of its own, can take them off with handle_scandal_drain().
+ *  The sender holds back while the receiver has more than
+ *  SENDER_MAX_AHEAD frames queued, so nothing should overrun.
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <scandal/engine.h>
+#include <scandal/message.h>
+#include <scandal/error.h>
+
+#include <arch/system.h>
+#include <arch/timer.h>
+
+#define FRAMES			2000000UL
+#define SENDER_MAX_AHEAD	200
+
+static vbus bus;
+static host_node sender, receiver;
+static volatile u08 ready, sending = 1;
+static volatile u32 drained;
+
+static void *receive(void *arg){
+	host_node_bind(&receiver);
+	scandal_init();
+	vbus_set_promiscuous(&receiver.port, 1);
+	ready = 1;
+
+	while(sending || vbus_pending(&receiver.port) != 0){
+		drained += handle_scandal_drain(0, 0);
+		if(vbus_pending(&receiver.port) == 0)
+			sched_yield();
+	}
+
+	return 0;
+}
+
+int main(void){
+	pthread_t thread;
+	can_msg msg = {0};
+	u64 start, elapsed;
+	u32 i;
+
+	vbus_init(&bus);
+	host_node_init(&sender, &bus);
+	host_node_init(&receiver, &bus);
+	pthread_create(&thread, 0, receive, 0);
+
+	host_node_bind(&sender);
+	scandal_init();
+	while(!ready)
+		sched_yield();
+
+	msg.id = scandal_mk_channel_id(7, 5, 1);
+	msg.ext = CAN_EXT_MSG;
+	msg.length = 8;
+
+	start = host_time_us();
+	for(i=0; i<FRAMES; i++){
+		msg.data[3] = i;
+		while(vbus_pending(&receiver.port) > SENDER_MAX_AHEAD)
+			sched_yield();
+		vbus_send(&sender.port, &msg);
+	}
+	sending = 0;
+	pthread_join(thread, 0);
+	elapsed = host_time_us() - start;
+
+	printf("%lu frames sent, %u drained in %.2fs: %.2f Mframes/s, %u overruns\n",
+			FRAMES, drained, elapsed / 1e6, (double)drained / elapsed,
+			receiver.port.stats.rx_overruns);
+
+	return drained == FRAMES && receiver.port.stats.rx_overruns == 0 ? 0 : 1;
+}
@@ -28,9 +28,34 @@
  * some messages. To solve this problem, we have a transmit buffer. When we
  * call scandal_send_channel, can_send_msg gets called, and eventually CAN_Send
  * gets called. If CAN_Send fails (i.e. there was no free message object), then
- * we store the message temporarily in a CAN_txbuf location. In the main while
- * loop, every iteration calls handle_scandal, which calls can_poll. can_poll
- * will call send_enqueued messages which sends out any enqueued messages.
+ * we store the message temporarily in the CAN_txq. Each transmit message
+ * object interrupts when its frame has gone, and the interrupt handler calls
+ * send_queued_messages to load the next queued frame straight away, so the
+ * queue drains at bus rate rather than main loop rate. can_poll and
+ * can_tx_flush do the same from the main loop, in case anything was queued
+ * while every message object was idle.
+ *
+ * Which transmit objects are loaded is tracked in tx_busy rather than read
+ * back from TXREQ1/2: CAN_load sets an object's bit when it loads it, and
+ * the TX interrupt clears it, so picking an object needs no register reads.
+ * The main loop loads objects through IF1 and the interrupt handler
+ * through IF2, and each waits for its own interface to be free before it
+ * uses it rather than after, so the message RAM transfer overlaps with
+ * whatever the CPU does next.
+ *
+ * The message builders in scandal/message.c skip the copy into CAN_txq:
+ * they build each frame in a slot from can_tx_reserve(), and can_tx_commit()
+ * queues it. CAN_load loads message objects straight from the slot, so a
+ * frame is written once in RAM and once into an IF, however long it has to
+ * wait.
+
+ * Priority: CAN_txq hands out frames in identifier order, as the bus would
+ * arbitrate them, not in the order they were sent, so a timesync or drive
+ * command doesn't wait behind a burst of telemetry. The C_CAN core itself
+ * sends the lowest numbered pending message object first, whatever its
+ * identifier, so CAN_tx_object() keeps the pending objects in identifier
+ * order too. With SCANDAL_LATENCY_HISTOGRAMS, the time each frame spends
+ * in CAN_txq is recorded by priority, see LATENCY_TX_QUEUE.
 
  * For example: In the steering wheel, we send out wavesculptor commands every
  * 100ms. We also send out about 15 scandal channels every 1s. This means that
@@ -47,8 +72,6 @@
 #include <project/driver_config.h>
 #include <project/scandal_config.h>
 
-#include <string.h> /* for memcpy */
-
 #include <arch/can.h>
 #include <arch/gpio.h>
 #include <arch/timer.h>
@@ -56,221 +79,164 @@
 #include <scandal/stdmsp430.h>
 
 #include <scandal/can.h>
+#include <scandal/can_ring.h>
+#include <scandal/can_txq.h>
+#include <scandal/can_filter.h>
+#include <scandal/can_admit.h>
 #include <scandal/error.h>
 #include <scandal/timer.h>
 #include <scandal/leds.h>
-
-#define RECV_BUFF_DIVIDE 20 /* this gives 0-20 as recv buffers and 21-32 as tx buffers */
-
-uint8_t recv_buf_used[MSG_OBJ_MAX]; /* this will be used to determine if a recv buffer is available */
-
-can_msg CAN_txbuf[CAN_TX_BUFFER_SIZE];
-uint8_t tx_buf_start;
-uint8_t tx_num_msgs;
+#include <scandal/busstats.h>
+#include <scandal/latency.h>
+#include <scandal/context.h>
+
+#define RECV_BUFF_DIVIDE 20 /* this gives 1-20 as recv buffers and 21-32 as tx buffers */
+
+/* Every can_register_id() so far, and the rates can_register_id_rate()
+ * declared for the fastest of them */
+can_filter rx_regs[CAN_FILTER_MAX_REGS];
+uint16_t rx_num_regs;
+can_filter rx_fast[CAN_RX_MAX_FAST];
+uint16_t rx_fast_rate[CAN_RX_MAX_FAST];
+uint8_t rx_num_fast;
+
+/* What can_filter_compile_objects() made of them, as loaded into receive
+ * message objects 1 to rx_num_objs, indexed by object number less one.
+ * A filter with a high rate is loaded into a chain of objects, which the
+ * controller fills as a FIFO: a frame goes into the first one without new
+ * data, and only the last has EOB set, so only the last is ever
+ * overwritten. rx_fifo_first and rx_fifo_last give the chain each object
+ * is in, indexed by object number, and are both 0 for a single object */
+can_hw_filter rx_filters[RECV_BUFF_DIVIDE];
+uint8_t rx_num_objs;
+uint8_t rx_fifo_first[RECV_BUFF_DIVIDE + 1];
+uint8_t rx_fifo_last[RECV_BUFF_DIVIDE + 1];
+
+/* Once registrations have had to share message objects, frames nothing
+ * registered for get into them too. CAN_MessageProcess drops those */
+can_admit CAN_rxadmit;
+
+/* Frames waiting for a message object. The main loop queues them and the
+ * CAN interrupt takes them, and both update tx_busy, so the main loop keeps
+ * the interrupt off while it does either. Reserving a slot needs no lock,
+ * as the interrupt only ever frees them.
+ * CAN_TX_BUFFER_SIZE must be no larger than CAN_TXQ_MAX */
+can_txq_slot CAN_txslots[CAN_TX_BUFFER_SIZE];
+can_txq CAN_txq;
+
+#define CAN_TX_LOCK()		NVIC_DisableIRQ(CAN_IRQn)
+#define CAN_TX_UNLOCK()		NVIC_EnableIRQ(CAN_IRQn)
+
+/* can_arb_key() of the frame last loaded into each transmit message object */
+uint32_t tx_obj_key[MSG_OBJ_MAX + 1];
+
+/* Bit n-1 is set while transmit message object n has a frame waiting to go.
+ * TX_OBJ_BITS covers objects RECV_BUFF_DIVIDE+1 to MSG_OBJ_MAX-1 */
+volatile uint32_t tx_busy;
+
+#define TX_OBJ_BITS		(((1UL << (MSG_OBJ_MAX - 1)) - 1) & ~((1UL << RECV_BUFF_DIVIDE) - 1))
 
 /* statistics of all the interrupts */
 volatile uint32_t BOffCnt = 0;
 volatile uint32_t EWarnCnt = 0;
 volatile uint32_t EPassCnt = 0;
 
-uint8_t CANRxDone[MSG_OBJ_MAX]; //Maybe convert to a single uint32 and use bitwise operations?
-
-#if ENABLE_RX_QUEUE
-/* Position in RX Buffer queue if queing is enabled (0-31), allows discarding
-   of old data if buffer is full. 
-*/
-int8_t RXQueuePosition; 
-#endif
-
-message_object CAN_rxbuf[MSG_OBJ_MAX]; //Input RX buffer
+/* Received frames, in the order they arrived. The interrupt handler copies
+ * each frame out of its message object straight into this ring, so the
+ * message object is free for the next frame as soon as the interrupt is
+ * done with it. */
+can_msg CAN_rxmsgs[CAN_RX_RING_SIZE];
+can_ring CAN_rxring;
 
 #if CAN_DEBUG
 uint32_t CANStatusLog[100];
 uint32_t CANStatusLogCount = 0;
 #endif
 
-/******************************************************************************
-** Function name:		enqueue_message
-**
-** Descriptions:		
-**
-** parameters:			Message
-** Returned value:		****
-**
-**
-******************************************************************************/
-uint8_t enqueue_message(can_msg* msg){
-	u08 pos;
-	u08 i;
-	
-	if(tx_num_msgs >= CAN_TX_BUFFER_SIZE)
-		return BUF_FULL_ERR;
-
-	pos = (tx_buf_start + tx_num_msgs) & CAN_TX_BUFFER_MASK;
-
-	CAN_txbuf[pos].id = msg->id;
-
-	for (i = 0; i < 8; i++)
-		CAN_txbuf[pos].data[i] = msg->data[i];
-
-	CAN_txbuf[pos].length = msg->length;
-
-	tx_num_msgs++;
-
-	return NO_ERR;
-}
-
 /******************************************************************************
 ** Function name:		send_queued_messages
 **
-** Descriptions:		Send out any enqueued messages
+** Descriptions:		Send out as many enqueued messages as there are
+**				message objects for, highest priority first
 **
-** parameters:			None
-** Returned value:		*****
+** parameters:			Interface to load them through,
+**				CAN_IF_THREAD or CAN_IF_ISR
+** Returned value:		NO_MSG_ERR if any are left waiting
 **
 **
 ******************************************************************************/
 
-uint8_t send_queued_messages(void){
+uint8_t send_queued_messages(uint8_t ifn){
 	can_msg* msg;
-	u08 err = NO_ERR;
-
-	if(tx_num_msgs <= 0)
-		return (NO_MSG_ERR);
-
-	msg = &(CAN_txbuf[tx_buf_start]);
-
-	err = CAN_Send(0, msg);
 
-	if(err == NO_ERR){
-		tx_buf_start = (tx_buf_start + 1) & CAN_TX_BUFFER_MASK;
-		tx_num_msgs--;
+	while((msg = can_txq_peek(&CAN_txq)) != 0){
+		if(CAN_load(ifn, msg) != NO_ERR)
+			return NO_MSG_ERR;
+		scandal_latency_record(LATENCY_TX_QUEUE + CAN_ARB_CLASS(((can_txq_slot *)msg)->key),
+				sc_get_timer_us() - msg->rcvd_us);
+		can_txq_release(&CAN_txq);
 	}
 
-	return err;
+	return NO_ERR;
 }
 
-/******************************************************************************
-** Function name:		CAN_decode_packet
-**
-** Descriptions:		Get a message out of the buffer and break it into bits
-**
-** parameters:			Message Number, Message
-** Returned value:		None
-**
-**
-******************************************************************************/
-void CAN_decode_packet(uint8_t msg_num, can_msg *msg) {
-	/* copy the data */
-	msg->data[0] = (CAN_rxbuf[msg_num].data[0] & 0x000000FF);
-	msg->data[1] = (CAN_rxbuf[msg_num].data[0] >> 8) & 0x000000FF;
-	msg->data[2] = (CAN_rxbuf[msg_num].data[1] & 0x000000FF);
-	msg->data[3] = (CAN_rxbuf[msg_num].data[1] >> 8) & 0x000000FF;
-	msg->data[4] = (CAN_rxbuf[msg_num].data[2] & 0x000000FF);
-	msg->data[5] = (CAN_rxbuf[msg_num].data[2] >> 8) & 0x000000FF;
-	msg->data[6] = (CAN_rxbuf[msg_num].data[3] & 0x000000FF);
-	msg->data[7] = (CAN_rxbuf[msg_num].data[3] >>8)  & 0x000000FF;
-
-	/* copy the id */
-	msg->id = CAN_rxbuf[msg_num].id;
-
-	/* copy the length */
-	msg->length= CAN_MSG_MAXSIZE;
-
-	/* set the type */
-	msg->ext = CAN_rxbuf[msg_num].ext;
-
+/* Set up a receive message object to take the frames a compiled filter
+ * accepts, or with no filter, take it out of use. The filter is in the
+ * arbitration field layout already, so it goes straight into ARB and MSK.
+ * eob is clear for all but the last object of a FIFO */
+void CAN_set_up_filter(uint8_t MsgNo, const can_hw_filter *filter, uint8_t eob) {
 #if CAN_UART_DEBUG
-	{
-		int i = 0;
-
-		if (msg->ext) {
-			uint16_t priority;
-			uint16_t type;
-			uint16_t node_address;
-			uint16_t channel_num;
-
-			channel_num  = ((CAN_rxbuf[msg_num].id >> 0)  & 0x03FF);
-			node_address = ((CAN_rxbuf[msg_num].id >> 10) & 0x00FF);
-			type         = ((CAN_rxbuf[msg_num].id >> 18) & 0x00FF);
-			priority     = ((CAN_rxbuf[msg_num].id >> 26) & 0x0007);
-
-			UART_printf("got an ext can message...\n\r");
-
-			UART_printf(" id is               (0x%x)\n\r",(unsigned int) msg->id);
-			UART_printf(" priority is         %u\n\r", priority);
-			UART_printf(" node_address is     %u\n\r", node_address);
-			UART_printf(" message type is     %u\n\r", type);
-			UART_printf(" channel_num is      %u\n\r", channel_num);
-
-			for(i = 0; i < 8; i++)
-				UART_printf("can_data[%d] = 0x%x\r\n", i, msg->data[i]);
-
-		} else {
-			UART_printf("got a std can message...\n\r");
-			UART_printf(" id is               (0x%x)\n\r", (unsigned int) msg->id);
-
-			for(i = 0; i < 0; i++)
-				UART_printf("can_data[%d] = 0x%x\r\n", i, (unsigned int) msg->data[i]);
-		}
-	}
+  if(filter)
+    UART_printf("Filter Setup: obj:%u msk:%u flt:%u ext:%u\n", MsgNo, filter->mask, filter->id, filter->ext);
 #endif
+	/* CAN_load doesn't wait for its last transfer */
+	while( LPC_CAN->IF1_CMDREQ & IFCREQ_BUSY )
+		;
 
-	/* we can now use the receive buffer for another message! */
-	CANRxDone[msg_num] = 0;
-}
-
-/* Set up a message buffer to receive a particular type of message specified in filter and mask */
-void CAN_set_up_filter(uint8_t msg_id, uint32_t filter_mask, uint32_t filter_addr, uint8_t ext) {
-#if CAN_UART_DEBUG
-  UART_printf("Filter Setup: id:%u msk:%u flt:%u ext:%u\n", msg_id, filter_mask, filter_addr, ext);
-#endif
 	/* This is what we're changing in the message buffer object */
 	LPC_CAN->IF1_CMDMSK = WR | MASK | ARB | CTRL | DATAA | DATAB;
 
-	if (ext == CAN_EXT_MSG) {
-		/* set the first filtermask register */
-		LPC_CAN->IF1_MSK1 = filter_mask & 0xFFFF;
-
-		/* set the second filtermask register */
-		LPC_CAN->IF1_MSK2 = MASK_MXTD | (filter_mask >> 16);
-
-		/* set the first arbitration register */
-		LPC_CAN->IF1_ARB1 = filter_addr & 0xFFFF;
+	if (filter) {
+		LPC_CAN->IF1_MSK1 = filter->mask & 0xFFFF;
+		LPC_CAN->IF1_MSK2 = ((filter->mask >> 16) & 0x1FFF) |
+				(filter->ext != CAN_FILTER_ANY ? MASK_MXTD : 0);
 
-		/* set the second arbitration register */
-		LPC_CAN->IF1_ARB2 = ID_MTD | ID_MVAL | (filter_addr >> 16); // use this message object, extended
+		/* Receive direction, so no ID_DIR */
+		LPC_CAN->IF1_ARB1 = filter->id & 0xFFFF;
+		LPC_CAN->IF1_ARB2 = ID_MVAL | ((filter->id >> 16) & 0x1FFF) |
+				(filter->ext == CAN_EXT_MSG ? ID_MTD : 0);
 
+		LPC_CAN->IF1_MCTRL = UMSK | RXIE | (eob ? EOB : 0) | DLC_MAX;
 	} else {
-		/* set the second filtermask register */
-		LPC_CAN->IF1_MSK2 = (filter_mask << 2);
-
-		/* set the second arbitration register */
-		LPC_CAN->IF1_ARB2 = ID_MVAL | (filter_addr << 2); // use this message object, extended
-
+		LPC_CAN->IF1_MSK1 = 0x0000;
+		LPC_CAN->IF1_MSK2 = 0x0000;
+		LPC_CAN->IF1_ARB1 = 0x0000;
+		LPC_CAN->IF1_ARB2 = 0x0000;
+		LPC_CAN->IF1_MCTRL = 0x0000;
 	}
 
-	LPC_CAN->IF1_ARB2 &= ~ID_DIR; // receive direction
-
-	LPC_CAN->IF1_MCTRL = UMSK | RXIE | EOB | DLC_MAX;
-
 	LPC_CAN->IF1_DA1 = 0x0000;
 	LPC_CAN->IF1_DA2 = 0x0000;
 	LPC_CAN->IF1_DB1 = 0x0000;
 	LPC_CAN->IF1_DB2 = 0x0000;
 
 	/* Transfer data to message RAM */
-	LPC_CAN->IF1_CMDREQ = msg_id + 1;
+	LPC_CAN->IF1_CMDREQ = MsgNo;
 
 	/* wait until it's done */
 	while( LPC_CAN->IF1_CMDREQ & IFCREQ_BUSY )
 		;
 }
 
-/* A message has been received, copy the data out of the registers and reorder it for use */
+/* A message has been received, copy the data out of the registers and into
+ * the receive ring */
 void CAN_MessageProcess( uint8_t MsgNo ) {
-	uint32_t MsgID;
-	uint32_t *p_add;
+	uint32_t mctrl;
+	uint32_t data;
+	uint32_t arb2, id;
+	uint8_t ext;
+	can_msg *msg;
+	sc_utime_t rcvd_us = sc_get_timer_us();
 
 	while ( LPC_CAN->IF2_CMDREQ & IFCREQ_BUSY )
 		;
@@ -282,32 +248,102 @@ void CAN_MessageProcess( uint8_t MsgNo ) {
 	while ( LPC_CAN->IF2_CMDREQ & IFCREQ_BUSY )
 		;
 
-	/* where are we storing the message? */
-	p_add = (uint32_t *)&CAN_rxbuf[MsgNo];
+	mctrl = LPC_CAN->IF2_MCTRL;
+
+	/* The controller overwrote a frame in this message object before we got
+	 * to it. Count it and clear the flag */
+	if (mctrl & MLST) {
+		CAN_rxring.lost++;
+
+		LPC_CAN->IF2_CMDMSK = WR|CTRL;
+		LPC_CAN->IF2_MCTRL = mctrl & ~(MLST|NEWD|INTP);
+		LPC_CAN->IF2_CMDREQ = MsgNo+1;
+
+		while ( LPC_CAN->IF2_CMDREQ & IFCREQ_BUSY )
+			;
+	}
 
-	if( LPC_CAN->IF2_ARB2 & ID_MTD ) { /* bit 28-0 is 29 bit extended frame */
-		*p_add++ = CAN_EXT_MSG;
+	arb2 = LPC_CAN->IF2_ARB2;
+	if( arb2 & ID_MTD ) { /* bit 28-0 is 29 bit extended frame */
+		ext = CAN_EXT_MSG;
 		/* mask off MsgVal and Dir */ 
-		MsgID = (LPC_CAN->IF2_ARB1|((LPC_CAN->IF2_ARB2&0x5FFF)<<16));
+		id = (LPC_CAN->IF2_ARB1|((arb2&0x1FFF)<<16));
 	} else {
-		*p_add++ = CAN_STD_MSG;
+		ext = CAN_STD_MSG;
 		/* bit 28-18 is 11-bit standard frame */
-		MsgID = (LPC_CAN->IF2_ARB2 &0x1FFF) >> 2;
+		id = (arb2 &0x1FFF) >> 2;
 	}
 
-	*p_add++ = MsgID;
-	*p_add++ = LPC_CAN->IF2_MCTRL & 0x000F;	// Get Msg Obj Data length
+	/* Let in by a shared message object, but not registered for */
+	if (!can_admit_check(&CAN_rxadmit, id, ext))
+		return;
+
+	/* If the ring is full the frame is dropped, and counted as an overrun */
+	msg = can_ring_reserve(&CAN_rxring);
+	if (msg == 0)
+		return;
+
+	msg->id = id;
+	msg->ext = ext;
+
+	/* A DLC of 9 to 15 still means 8 bytes */
+	msg->length = mctrl & DLC_MASK;
+	if (msg->length > CAN_MSG_MAXSIZE)
+		msg->length = CAN_MSG_MAXSIZE;
+	msg->rcvd_us = rcvd_us;
+
+	data = LPC_CAN->IF2_DA1;
+	msg->data[0] = data & 0xFF;
+	msg->data[1] = (data >> 8) & 0xFF;
+	data = LPC_CAN->IF2_DA2;
+	msg->data[2] = data & 0xFF;
+	msg->data[3] = (data >> 8) & 0xFF;
+	data = LPC_CAN->IF2_DB1;
+	msg->data[4] = data & 0xFF;
+	msg->data[5] = (data >> 8) & 0xFF;
+	data = LPC_CAN->IF2_DB2;
+	msg->data[6] = data & 0xFF;
+	msg->data[7] = (data >> 8) & 0xFF;
+
+	can_ring_commit(&CAN_rxring);
+	scandal_latency_record(LATENCY_ISR, sc_get_timer_us() - rcvd_us);
+}
 
-	*p_add++ = LPC_CAN->IF2_DA1;
-	*p_add++ = LPC_CAN->IF2_DA2;
-	*p_add++ = LPC_CAN->IF2_DB1;
-	*p_add++ = LPC_CAN->IF2_DB2;
 
-	return;
+
+
+/* An object in the FIFO made of objects first to last has a frame. Take
+ * every frame in it, oldest first. The controller fills the FIFO from its
+ * lowest numbered empty object, so those are in ascending order of object
+ * number, and any frame that arrives while they are being taken goes into
+ * an object already emptied, to be picked up on the next pass */
+void CAN_fifo_drain( uint8_t first, uint8_t last ) {
+	uint32_t chain = ((1UL << last) - 1) & ~((1UL << (first - 1)) - 1);
+	uint32_t pending;
+	uint8_t obj;
+
+	while ((pending = ((LPC_CAN->ND2 << 16) | (LPC_CAN->ND1 & 0xFFFF)) & chain) != 0) {
+		for (obj = first; obj <= last; obj++)
+			if (pending & (1UL << (obj - 1)))
+				CAN_MessageProcess(obj - 1);
+	}
 }
 
+/* A transmit message object has sent its frame, free it and clear its
+ * interrupt. Only the interrupt handler calls this, so it uses IF2 */
+void CAN_tx_done( uint8_t MsgNo ) {
+	tx_busy &= ~(1UL << (MsgNo - 1));
 
+	while ( LPC_CAN->IF2_CMDREQ & IFCREQ_BUSY )
+		;
+
+	LPC_CAN->IF2_CMDMSK = RD|INTPND;
+	LPC_CAN->IF2_CMDREQ = MsgNo;
 
+	/* Wait, or INT still shows this object when the handler looks again */
+	while ( LPC_CAN->IF2_CMDREQ & IFCREQ_BUSY )
+		;
+}
 
 /******************************************************************************
 ** Function name:		CAN_IRQHandler
@@ -345,13 +381,18 @@ void CAN_IRQHandler(void) {
 		} else { //Otherwise if it is a message object to be processed
             canstat = LPC_CAN->STAT;
 			if ( (canstat & STAT_LEC) == 0 ) { /* NO ERROR */
-				/* deal with RX only for now. */
 				msg_no = can_int & 0x7FFF;
-				if ( (msg_no >= 0x01) && (msg_no <= 0x20) ) {
+				if ( (msg_no > RECV_BUFF_DIVIDE) && (msg_no <= 0x20) ) {
+					/* A frame has gone, refill the message objects */
+					LPC_CAN->STAT &= ~STAT_TXOK;
+					CAN_tx_done( msg_no );
+					send_queued_messages(CAN_IF_ISR);
+				} else if ( (msg_no >= 0x01) && (msg_no <= 0x20) ) {
 					LPC_CAN->STAT &= ~STAT_RXOK;
-					CAN_MessageProcess( msg_no-1 ); //msg_no goes up from 1, msg_no ranges from 0
-					CANRxDone[msg_no-1] = TRUE;
-          //UART_printf("# = %d ", (msg_no - 1));
+					if ( rx_fifo_first[msg_no] != rx_fifo_last[msg_no] )
+						CAN_fifo_drain( rx_fifo_first[msg_no], rx_fifo_last[msg_no] );
+					else
+						CAN_MessageProcess( msg_no-1 ); //msg_no goes up from 1, msg_no ranges from 0
 				}
 			} else {
       /* Should I be here? :o */
@@ -420,100 +461,119 @@ void CAN_Init( uint32_t baud ) {
 }
 
 /******************************************************************************
-** Function name:		buffer_free
+** Function name:		CAN_tx_object
 **
-** Descriptions:		Returns true of the buffer is BUSY so move on to the next buffer
+** Descriptions:		Picks the message object for a frame. The core
+**				sends the lowest numbered pending object first,
+**				so the frame goes in the lowest free object
+**				above every pending frame which should beat it
 **
-** parameters:			Message Number
-** Returned value:		*****
+** parameters:			can_arb_key() of the frame
+** Returned value:		Message object number, or 0 if there is none
 **
 **
 ******************************************************************************/
 
-uint8_t buffer_free(uint8_t msg_num) {
-	uint32_t BufferStatus = (((LPC_CAN->TXREQ2) & (0x0000FFFF)) << 16) | ((LPC_CAN->TXREQ1) & (0x0000FFFF));
+uint8_t CAN_tx_object(uint32_t key) {
+	uint32_t busy = tx_busy;
+	uint32_t free = ~busy & TX_OBJ_BITS;
+	uint8_t obj;
+
+	/* Walk the pending objects from the top down, to the highest one whose
+	 * frame should beat this one. Only the objects above it will do */
+	while (busy) {
+		obj = 32 - __builtin_clz(busy);
+		if (tx_obj_key[obj] <= key) {
+			free &= ~((1UL << obj) - 1);
+			break;
+		}
+		busy &= ~(1UL << (obj - 1));
+	}
+
+	if (free == 0)
+		return 0;
 
-	/* Return value to be 1 or 0 depending on if the buffer is free or not */
-	return ((((uint8_t) (BufferStatus >> (msg_num-1))) & 0x01) == 0);
+	return __builtin_ctz(free) + 1;
 }
 
 
 /******************************************************************************
-** Function name:		CAN_Send
+** Function name:		CAN_load
 **
-** Descriptions:		Send a message
+** Descriptions:		Load a frame into a free transmit message object
 **
-** parameters:			*****, Message
-** Returned value:		*****
+** parameters:			Interface to use: CAN_IF_THREAD, with the CAN
+**				interrupt off, or CAN_IF_ISR from the handler.
+**				The frame
+** Returned value:		NO_MSG_ERR if there was no free object
 **
 **
 ******************************************************************************/
-int CAN_Send(uint16_t Pri, can_msg *msg) {
-	uint32_t tx_addr;
-	uint8_t  length = 8;
-	int i;
-
-	/* Data is stored in can_msg->data[0-4], timestamp is stored in can_msg->data[4-7] */
-	uint32_t can_data;
-	uint32_t can_timestamp;
-
-	memcpy(&can_data, msg->data, sizeof(uint32_t));
-	memcpy(&can_timestamp, msg->data+sizeof(uint32_t), sizeof(uint32_t));
-
- 	/* find a free message buffer */
-	for(i = RECV_BUFF_DIVIDE+1; i < MSG_OBJ_MAX; i++) {
-
-		if (buffer_free(i)) {
-			/* we're sending an extended message */
-			if (msg->ext == CAN_EXT_MSG) {
-				tx_addr = ID_EXT_MASK & msg->id;
-
-				LPC_CAN->IF1_ARB1 = tx_addr & 0x0000FFFF;
-				/* extended, outgoing */
-				LPC_CAN->IF1_ARB2 = ID_MTD | ((tx_addr >> 16) & 0x00001FFF);
-
-				/* Mxtd: 1, Mdir: 1, Mask is 0x7FF */
-				LPC_CAN->IF1_MSK2 = MASK_MXTD | MASK_MDIR | (ID_EXT_MASK >> 16);
-				LPC_CAN->IF1_MSK1 = ID_EXT_MASK & 0x0000FFFF;
-
-			/* we're sending a standard message */
-			} else if (msg->ext == CAN_STD_MSG) {
-				tx_addr = msg->id & ID_STD_MASK;
-
-				LPC_CAN->IF1_ARB2 = (tx_addr << 2) & 0x00001FFF;
-				LPC_CAN->IF1_ARB2 &= ~ID_MTD;
-
-				/* Mxtd: 0, Mdir: 1, Mask is 0x7FF */
-				LPC_CAN->IF1_MSK2 = MASK_MDIR | (ID_STD_MASK << 2);
-				LPC_CAN->IF1_MSK1 = 0x0000;
-			}
-
-			/* put the data in the buffer register */
-			LPC_CAN->IF1_DA1 = can_data & 0x0000FFFF;
-			LPC_CAN->IF1_DA2 = ((can_data & 0xFFFF0000) >> 16);
+int CAN_load(uint8_t ifn, can_msg *msg) {
+	uint32_t key = can_arb_key(msg->id, msg->ext);
+	uint32_t arb1, arb2;
+	uint8_t  length = msg->length;
+	uint8_t  i;
+
+	/* find a free message buffer, in priority order */
+	i = CAN_tx_object(key);
+	if (i == 0)
+		return NO_MSG_ERR;
+
+	if (length > CAN_MSG_MAXSIZE)
+		length = CAN_MSG_MAXSIZE;
+
+	/* outgoing, extended or standard. A transmit object doesn't filter, so
+	 * its mask is left alone */
+	if (msg->ext == CAN_EXT_MSG) {
+		arb1 = msg->id & 0x0000FFFF;
+		arb2 = ID_MVAL | ID_MTD | ID_DIR | ((msg->id >> 16) & 0x00001FFF);
+	} else {
+		arb1 = 0;
+		arb2 = ID_MVAL | ID_DIR | ((msg->id & ID_STD_MASK) << 2);
+	}
 
-			/* put the timestamp in the buffer register */
-			LPC_CAN->IF1_DB1 = can_timestamp & 0x0000FFFF;
-			LPC_CAN->IF1_DB2 = ((can_timestamp & 0xFFFF0000) >> 16);
+	/* By now the last transfer through this interface has usually long
+	 * finished */
+	while ( CAN_IF_REG(ifn, CMDREQ) & IFCREQ_BUSY )
+		;
 
-			LPC_CAN->IF1_ARB2 |= ID_DIR | ID_MVAL;
+	CAN_IF_REG(ifn, CMDMSK) = WR | ARB | CTRL | DATAA | DATAB;
+	CAN_IF_REG(ifn, ARB1) = arb1;
+	CAN_IF_REG(ifn, ARB2) = arb2;
 
-			/* set the length DLC field and set the transmission request bit */
-			LPC_CAN->IF1_MCTRL = UMSK | TXRQ | EOB | (length & DLC_MASK);
+	/* set the length DLC field and set the transmission request bit. TXIE
+	 * gets us an interrupt to refill the object when the frame has gone */
+	CAN_IF_REG(ifn, MCTRL) = TXRQ | TXIE | EOB | (length & DLC_MASK);
 
-			/* write the message object */
-			LPC_CAN->IF1_CMDMSK = WR | MASK | ARB | CTRL | DATAA | DATAB;
+	/* Data is stored in can_msg->data[0-4], timestamp is stored in can_msg->data[4-7] */
+	CAN_IF_REG(ifn, DA1) = msg->data[0] | (msg->data[1] << 8);
+	CAN_IF_REG(ifn, DA2) = msg->data[2] | (msg->data[3] << 8);
+	CAN_IF_REG(ifn, DB1) = msg->data[4] | (msg->data[5] << 8);
+	CAN_IF_REG(ifn, DB2) = msg->data[6] | (msg->data[7] << 8);
 
-			LPC_CAN->IF1_CMDREQ = i;
+	/* write the message object, and don't wait for it */
+	CAN_IF_REG(ifn, CMDREQ) = i;
 
-			while ( LPC_CAN->IF1_CMDREQ & IFCREQ_BUSY )
-				; /* Waits until IF1 transfer thingy has done its duties */
+	tx_obj_key[i] = key;
+	tx_busy |= 1UL << (i - 1);
 
-			return NO_ERR;
-		}
-	}
+	return NO_ERR;
+}
 
-	return NO_MSG_ERR;
+/******************************************************************************
+** Function name:		CAN_Send
+**
+** Descriptions:		Send a message, from thread code with the CAN
+**				interrupt off
+**
+** parameters:			*****, Message
+** Returned value:		NO_MSG_ERR if there was no free message object
+**
+**
+******************************************************************************/
+int CAN_Send(uint16_t Pri, can_msg *msg) {
+	return CAN_load(CAN_IF_THREAD, msg);
 }
 
 /* 
@@ -522,6 +582,8 @@ int CAN_Send(uint16_t Pri, can_msg *msg) {
  *   u32 id;
  *   u08 data[CAN_MSG_MAXSIZE];
  *   u08 length;
+ *   u08 ext;
+ *   sc_utime_t rcvd_us;
  * } can_msg;
  */
 
@@ -534,6 +596,8 @@ int CAN_Send(uint16_t Pri, can_msg *msg) {
 **   u32 id;
 **   u08 data[CAN_MSG_MAXSIZE];
 **   u08 length;
+**   u08 ext;
+**   sc_utime_t rcvd_us;
 ** } can_msg;
 ** 
 ******************************************************************************/
@@ -549,6 +613,8 @@ int CAN_Send(uint16_t Pri, can_msg *msg) {
 **
 ******************************************************************************/
 void init_can(void) {
+	can_ring_init(&CAN_rxring, CAN_rxmsgs, CAN_RX_RING_SIZE);
+	can_txq_init(&CAN_txq, CAN_txslots, CAN_TX_BUFFER_SIZE);
 	CAN_Init(BITRATE50K16MHZ);
 }
 
@@ -564,15 +630,43 @@ void init_can(void) {
 ******************************************************************************/
 
 u08 can_get_msg(can_msg *msg) {
-	int i;
+	if (!can_ring_get(&CAN_rxring, msg))
+		return NO_MSG_ERR;
+
+#if CAN_UART_DEBUG
+	{
+		int i = 0;
+
+		if (msg->ext) {
+			uint16_t priority;
+			uint16_t type;
+			uint16_t node_address;
+			uint16_t channel_num;
+
+			channel_num  = ((msg->id >> 0)  & 0x03FF);
+			node_address = ((msg->id >> 10) & 0x00FF);
+			type         = ((msg->id >> 18) & 0x00FF);
+			priority     = ((msg->id >> 26) & 0x0007);
+
+			UART_printf("got an ext can message...\n\r");
+
+			UART_printf(" id is               (0x%x)\n\r",(unsigned int) msg->id);
+			UART_printf(" priority is         %u\n\r", priority);
+			UART_printf(" node_address is     %u\n\r", node_address);
+			UART_printf(" message type is     %u\n\r", type);
+			UART_printf(" channel_num is      %u\n\r", channel_num);
 
-	for(i = 0; i < MSG_OBJ_MAX; i++) {
-		if (CANRxDone[i] == TRUE) {
-			CAN_decode_packet(i, msg);
-			return NO_ERR;
+			for(i = 0; i < 8; i++)
+				UART_printf("can_data[%d] = 0x%x\r\n", i, msg->data[i]);
+
+		} else {
+			UART_printf("got a std can message...\n\r");
+			UART_printf(" id is               (0x%x)\n\r", (unsigned int) msg->id);
 		}
 	}
-	return NO_MSG_ERR;
+#endif
+
+	return NO_ERR;
 }
 
 /******************************************************************************
@@ -585,7 +679,7 @@ u08 can_get_msg(can_msg *msg) {
 **
 **
 ******************************************************************************/
-u08 can_send_msg(can_msg *msg, u08 priority) {
+static void can_clear_busoff(void) {
     /* FIX BY GEOFFREY, NOT NXP CODE
      * Check if the CAN is in a busoff state which can occur in a specific
      * scenario (can pin connected connected and disconnected in rapid succession
@@ -593,15 +687,183 @@ u08 can_send_msg(can_msg *msg, u08 priority) {
     if((LPC_CAN->STAT & 0x80) != 0) {
         LPC_CAN->CNTL = LPC_CAN->CNTL & (~0x1);
     }
-    
-    
+}
+
+u08 can_send_msg(can_msg *msg, u08 priority) {
+	can_msg *slot;
+
+	can_clear_busoff();
+
+	CAN_TX_LOCK();
+
 	/* If we can't send a message right now, enqueue it for later.
-	 * handle_scandal will call can_poll every main loop iteration to send any enqueued messages */
-	if (CAN_Send((uint16_t)priority, msg) == NO_MSG_ERR)
-		return enqueue_message(msg);
+	 * handle_scandal will call can_poll every main loop iteration to send any enqueued messages.
+	 * If anything is already queued, the frame takes its turn in CAN_txq */
+	if (can_txq_count(&CAN_txq) != 0 || CAN_Send((uint16_t)priority, msg) == NO_MSG_ERR) {
+		if ((slot = can_txq_reserve(&CAN_txq)) == 0) {
+			CAN_TX_UNLOCK();
+			return BUF_FULL_ERR;
+		}
+		*slot = *msg;
+		slot->rcvd_us = sc_get_timer_us();
+		can_txq_commit(&CAN_txq, slot);
+		send_queued_messages(CAN_IF_THREAD);
+	} else {
+		scandal_latency_record(LATENCY_TX_QUEUE + CAN_ARB_CLASS(can_arb_key(msg->id, msg->ext)), 0);
+	}
+
+	CAN_TX_UNLOCK();
+
+	scandal_busstats_tx(msg);
+	return NO_ERR;
+
+}
+
+/******************************************************************************
+** Function name:		can_tx_reserve, can_tx_commit
+**
+** Descriptions:		Zero copy send, see scandal/can.h. The slot is
+**				a free slot in CAN_txq
+**
+******************************************************************************/
+can_msg *can_tx_reserve(void) {
+	return can_txq_reserve(&CAN_txq);
+}
+
+u08 can_tx_commit(can_msg *msg, u08 priority) {
+	can_clear_busoff();
+
+	scandal_busstats_tx(msg);
+	msg->rcvd_us = sc_get_timer_us();
+
+	CAN_TX_LOCK();
+	can_txq_commit(&CAN_txq, msg);
+	send_queued_messages(CAN_IF_THREAD);
+	CAN_TX_UNLOCK();
 
 	return NO_ERR;
+}
+
+/******************************************************************************
+** Function name:		can_tx_flush, can_get_tx_stats
+**
+** Descriptions:		Transmit queue control, see scandal/can.h
+**
+******************************************************************************/
+u08 can_tx_flush(void) {
+	u08 depth;
+
+	CAN_TX_LOCK();
+	send_queued_messages(CAN_IF_THREAD);
+	depth = can_txq_count(&CAN_txq);
+	CAN_TX_UNLOCK();
+
+	return depth;
+}
 
+void can_get_tx_stats(can_tx_stats *stats) {
+	CAN_TX_LOCK();
+	stats->depth = can_txq_count(&CAN_txq);
+	stats->high_water = CAN_txq.high_water;
+	stats->overruns = CAN_txq.overruns;
+	CAN_TX_UNLOCK();
+}
+
+/* Compile every registration into the receive message objects, and load
+ * the ones whose filter or place in a FIFO changed.
+ *
+ * Each filter gets one object. Objects left over go to the filters taking
+ * fast registrations, a second one each, and then one at a time to
+ * whichever has the most frames a second per object, so each gets a FIFO
+ * about as deep as its share of the traffic needs. If there are too many registrations for that, the
+ * compile is told to leave one object per fast registration, so each can
+ * have a FIFO two deep at least. */
+static void CAN_rx_compile(void) {
+	can_hw_filter filters[CAN_FILTER_MAX_REGS];
+	uint32_t rate[RECV_BUFF_DIVIDE];
+	uint8_t depth[RECV_BUFF_DIVIDE];
+	uint8_t i, j, k, n, best, obj, first, last, eob, fast = 0;
+
+	for (i = 0; i < rx_num_fast; i++)
+		if (rx_fast_rate[i] >= CAN_RX_FIFO_MIN_RATE)
+			fast++;
+	if (fast > RECV_BUFF_DIVIDE / 2)
+		fast = RECV_BUFF_DIVIDE / 2;
+
+	n = can_filter_compile_objects(rx_regs, rx_num_regs, filters,
+			RECV_BUFF_DIVIDE - fast, 1, 0, 0);
+	can_admit_build(&CAN_rxadmit, rx_regs, rx_num_regs, n < rx_num_regs);
+
+	/* A fast registration's rate counts against the first filter taking
+	 * its frames */
+	for (j = 0; j < n; j++) {
+		rate[j] = 0;
+		depth[j] = 1;
+	}
+	for (i = 0; i < rx_num_fast; i++) {
+		if (rx_fast_rate[i] < CAN_RX_FIFO_MIN_RATE)
+			continue;
+		for (j = 0; j < n; j++)
+			if (can_hw_filter_match(&filters[j], rx_fast[i].id, rx_fast[i].ext)) {
+				rate[j] += rx_fast_rate[i];
+				break;
+			}
+	}
+
+	obj = n;
+	for (j = 0; j < n && obj < RECV_BUFF_DIVIDE; j++)
+		if (rate[j] != 0 && depth[j] < CAN_RX_FIFO_MAX_DEPTH) {
+			depth[j]++;
+			obj++;
+		}
+	for (; obj < RECV_BUFF_DIVIDE; obj++) {
+		best = n;
+		for (j = 0; j < n; j++)
+			if (rate[j] != 0 && depth[j] < CAN_RX_FIFO_MAX_DEPTH &&
+					(best == n || rate[j] * depth[best] > rate[best] * depth[j]))
+				best = j;
+		if (best == n)
+			break;
+		depth[best]++;
+	}
+
+	NVIC_DisableIRQ(CAN_IRQn);
+	LPC_CAN->CNTL &= ~(CTRL_IE|CTRL_SIE|CTRL_EIE);
+
+	/* A frame goes into the lowest numbered object that takes it, so the
+	 * FIFOs come first, in case a single object's filter overlaps */
+	obj = 1;
+	for (k = 0; k < 2 * n; k++) {
+		j = k < n ? k : k - n;
+		if ((depth[j] > 1) != (k < n))
+			continue;
+		first = depth[j] > 1 ? obj : 0;
+		last = depth[j] > 1 ? obj + depth[j] - 1 : 0;
+		for (i = 0; i < depth[j]; i++, obj++) {
+			eob = (i == depth[j] - 1);
+			if (obj <= rx_num_objs && (rx_fifo_last[obj] == 0 || rx_fifo_last[obj] == obj) == eob &&
+					filters[j].mask == rx_filters[obj - 1].mask &&
+					filters[j].id == rx_filters[obj - 1].id &&
+					filters[j].ext == rx_filters[obj - 1].ext) {
+				rx_fifo_first[obj] = first;
+				rx_fifo_last[obj] = last;
+				continue;
+			}
+			rx_filters[obj - 1] = filters[j];
+			rx_fifo_first[obj] = first;
+			rx_fifo_last[obj] = last;
+			CAN_set_up_filter(obj, &filters[j], eob);
+		}
+	}
+	for (i = obj; i <= rx_num_objs; i++) {
+		rx_fifo_first[i] = 0;
+		rx_fifo_last[i] = 0;
+		CAN_set_up_filter(i, 0, 0);
+	}
+	rx_num_objs = obj - 1;
+
+	NVIC_EnableIRQ(CAN_IRQn);
+	LPC_CAN->CNTL |= (CTRL_IE|CTRL_SIE|CTRL_EIE);
 }
 
 /******************************************************************************
@@ -609,13 +871,15 @@ u08 can_send_msg(can_msg *msg, u08 priority) {
 **
 ** Descriptions:	
  *	
- * Register for a message type. Currently, each message that we want to
- * register for is given a specific message buffer. This limits the maximum
- * number of in channels to be 21 - 4 = 17. (the 4 comes from the 4 types of
- * messages that scandal registers for by default). Look in scandal/engine.c
- * for where this function is called to see why. At the moment, I don't think
- * there are any nodes with large numbers of in channels. If we need to deal
- * with this, it can be done in the future.
+ * Register for a message type. Every registration is kept, and the whole
+ * set compiled into as many mask filters as there are receive message
+ * objects by can_filter_compile_objects(). Up to RECV_BUFF_DIVIDE
+ * registrations each get their own object. Past that, the ones which
+ * cost least to share an object are merged, so every frame registered for
+ * still gets in, along with as few others as possible, and CAN_rxadmit
+ * turns the others away in the interrupt handler. Registrations with a
+ * rate from can_register_id_rate() take some objects for their FIFOs, see
+ * CAN_rx_compile(). Only the objects whose filter changed are rewritten.
 **
 ** parameters:			**Mask,  Data, Priority, Ex**
 ** Returned value:		****
@@ -624,25 +888,60 @@ u08 can_send_msg(can_msg *msg, u08 priority) {
 ******************************************************************************/
 
 u08 can_register_id(u32 mask, u32 data, u08 priority, u08 ext) {
-	int i;
+	can_filter reg;
 
-	NVIC_DisableIRQ(CAN_IRQn);
-	LPC_CAN->CNTL &= ~(CTRL_IE|CTRL_SIE|CTRL_EIE);
+	reg.mask = mask;
+	reg.id = data;
+	reg.ext = ext;
+	rx_num_regs = can_filter_add(rx_regs, rx_num_regs, CAN_FILTER_MAX_REGS, &reg);
+	CAN_rx_compile();
 
-	for(i = 0; i < RECV_BUFF_DIVIDE; i++) {
-		if (!recv_buf_used[i]) {
-			CAN_set_up_filter((i+1), mask, data, ext);
-			recv_buf_used[i] = 1;
-			NVIC_EnableIRQ(CAN_IRQn);
-			LPC_CAN->CNTL |= (CTRL_IE|CTRL_SIE|CTRL_EIE);
-			return NO_ERR;
-		}
+	return NO_ERR;
+}
+
+/******************************************************************************
+** Function name:		can_register_id_rate
+**
+** Descriptions:	
+ *	
+ * As can_register_id(), and remember the rate, so CAN_rx_compile() can give
+ * the registration a FIFO. If CAN_RX_MAX_FAST rates are remembered already,
+ * this one replaces the slowest, if it is faster.
+**
+** parameters:			**Mask,  Data, Rate, Ex**
+** Returned value:		****
+**
+**
+******************************************************************************/
+
+u08 can_register_id_rate(u32 mask, u32 data, u16 rate, u08 ext) {
+	can_filter reg;
+	uint8_t i, slot;
+
+	reg.mask = mask;
+	reg.id = data;
+	reg.ext = ext;
+	rx_num_regs = can_filter_add(rx_regs, rx_num_regs, CAN_FILTER_MAX_REGS, &reg);
+
+	slot = rx_num_fast;
+	if (rx_num_fast == CAN_RX_MAX_FAST) {
+		slot = 0;
+		for (i = 1; i < rx_num_fast; i++)
+			if (rx_fast_rate[i] < rx_fast_rate[slot])
+				slot = i;
+		if (rx_fast_rate[slot] >= rate)
+			slot = CAN_RX_MAX_FAST;
+	} else {
+		rx_num_fast++;
+	}
+	if (slot < CAN_RX_MAX_FAST) {
+		rx_fast[slot] = reg;
+		rx_fast_rate[slot] = rate;
 	}
 
-	NVIC_EnableIRQ(CAN_IRQn);
-	LPC_CAN->CNTL |= (CTRL_IE|CTRL_SIE|CTRL_EIE);
-			
-	return NO_MSG_ERR;
+	CAN_rx_compile();
+
+	return NO_ERR;
 }
 
 /******************************************************************************
@@ -672,7 +971,21 @@ u08  can_baud_rate(u08 mode) {
 ******************************************************************************/
 
 void can_poll(void) {
-	send_queued_messages();
+	uint32_t pending;
+
+	/* tx_busy can only be out if a TX interrupt went missing, e.g. the core
+	 * dropped its requests at bus off. An object stays busy while its
+	 * frame is waiting or its interrupt hasn't been taken. While either
+	 * interface is still moving a frame into an object, its TXREQ isn't
+	 * set yet, so leave it for the next poll */
+	CAN_TX_LOCK();
+	if (!(LPC_CAN->IF1_CMDREQ & IFCREQ_BUSY) && !(LPC_CAN->IF2_CMDREQ & IFCREQ_BUSY)) {
+		pending = ((LPC_CAN->TXREQ2 | LPC_CAN->IR2) << 16) | ((LPC_CAN->TXREQ1 | LPC_CAN->IR1) & 0xFFFF);
+		tx_busy &= pending;
+	}
+	CAN_TX_UNLOCK();
+
+	can_tx_flush();
 }
 
 /* *******************
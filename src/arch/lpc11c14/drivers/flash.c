@@ -1,7 +1,11 @@
 /* Scandal wrappers
  * *****************/
 
+#include <project/driver_config.h>
+
 #include <scandal/eeprom.h>
+#include <scandal/conf_log.h>
+#include <scandal/user_store.h>
 #include <scandal/utils.h>
 
 #include <arch/flash.h>
@@ -10,131 +14,98 @@
 
 /* On the LPC11C14, we have 32KiB of flash memory. The actual program is stored in this
  * flash too. The linker script is set up to only allow the program to use the first
- * 7 'blocks' of 4KiB, with the last block of 4KiB being used for 'user' storage area.
- * The first few bytes of this area are used to store the scandal_config struct, so when
- * the user read and write functions are actually implemented, the start address should
- * be *user_flash_start + sizeof(scandal_config).
+ * 6 'blocks' of 4KiB, with the last two blocks of 4KiB being used for storage. They
+ * hold the scandal config and the user storage, as a log of the changes made to them,
+ * see scandal/conf_log.h. The user storage is read and written through
+ * scandal/user_store.h.
  */
 
+/* The lowest address the config log uses, as an absolute symbol, so that
+ * the _28K linker scripts can check the program stays clear of it */
+#define FLASH_STR(x)	FLASH_STR2(x)
+#define FLASH_STR2(x)	#x
+
+__asm__(".global __sc_conf_bottom\n"
+	".set __sc_conf_bottom, " FLASH_STR(SC_CONF_START(SC_CONF_BANKS - 1)));
+
 void sc_init_eeprom(void) {
-	/* no init required! */
+	sc_conf_log_mount();
+	sc_user_store_load();
 }
 
 void sc_read_conf(scandal_config *conf) {
-	IAP iap_entry;
-	iap_entry = (IAP)IAP_LOCATION;
-
-	/* since we are storing the config at the start of 'user' flash, we can just cast the address to
-	 * that type and do a memcpy */
-	scandal_config *config_start = ((scandal_config *)(0x00007000));
-
-	memcpy(conf, config_start, sizeof(scandal_config));
+	sc_conf_log_read(0, conf, sizeof(scandal_config));
 }
 
+/* Only what changed goes to flash, in a few 16 byte lines, and sector 7 is
+ * only erased when it fills */
 void sc_write_conf(scandal_config*	conf) {
-	IAP iap_entry;
-	iap_entry = (IAP)IAP_LOCATION;
+	sc_conf_log_write(0, conf, sizeof(scandal_config));
+}
+
+/* Config log backend. The IAP calls don't return until the flash is done,
+ * and flash can't be read meanwhile, so interrupts are off throughout */
+static void iap_call(unsigned int *iapCommand, unsigned int *iapResult) {
+	IAP iap_entry = (IAP)IAP_LOCATION;
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	iap_entry(iapCommand, iapResult);
+	__set_PRIMASK(primask);
+}
 
+static void iap_prepare(u08 bank) {
 	unsigned int iapCommand[5] = {0};
 	unsigned int iapResult[4] = {0};
-	uint32_t write_buffer[64] = {0}; /* 256 byte block min write size */
-
-	/* prepare for erase */
-	iapCommand[0] = 50;					// command to prepare
-	iapCommand[1] = 7;					// from sector 7
-	iapCommand[2] = 7;					// to sector 7
-	iap_entry (iapCommand, iapResult); 	// send the commands
-	scandal_delay(1);
-
-	/* do the erase */
-	iapCommand[0] = 52;					// command to erase
-	iapCommand[1] = 7;					// from sector 7
-	iapCommand[2] = 7;					// to sector 7
-	iapCommand[3] = 48000;				// clock rate in khz 
-	iap_entry (iapCommand, iapResult); 	// send the commands
-	scandal_delay(120);					// wait for it to be done
-
-	/* prepare for write */
-	iapCommand[0] = 50;					// command to prepare
-	iapCommand[1] = 7;					// from sector 7
-	iapCommand[2] = 7;					// to sector 7
-	iap_entry (iapCommand, iapResult); 	// send the commands
-	scandal_delay(1);
-
-	/* copy the config data into the write buffer */
-	memcpy(write_buffer, conf, sizeof(scandal_config));
-
-	/* actually do the write */
-	iapCommand[0] = 51;					// write to flash command
-	iapCommand[1] = 0x00007000;			// write starting from this flash address
-	iapCommand[2] = (uint32_t)(&write_buffer);		// read from this memory address
-	iapCommand[3] = 256;				// 256 bytes is the minimum size we can write to at once
-	iapCommand[4] = 48000;				// clock speed in khz - 48000
-	iap_entry (iapCommand, iapResult);
-	scandal_delay(100);
+
+	iapCommand[0] = IAP_PREPARE;
+	iapCommand[1] = SC_CONF_SECTOR(bank);
+	iapCommand[2] = SC_CONF_SECTOR(bank);
+	iap_call(iapCommand, iapResult);
 }
 
-void sc_user_eeprom_read_block(u32 loc, u08* data, u08 length) {
-	IAP iap_entry;
-	iap_entry = (IAP)IAP_LOCATION;
+const u08 *sc_conf_bank(u08 bank) {
+	return (const u08 *)SC_CONF_START(bank);
+}
 
-	if (length > 1024) {
-		return;
-	}
+void sc_conf_bank_erase(u08 bank) {
+	unsigned int iapCommand[5] = {0};
+	unsigned int iapResult[4] = {0};
 
-	memcpy(data, (void *)(0x00006000 + loc), length);
+	iap_prepare(bank);
+	iapCommand[0] = IAP_ERASE;
+	iapCommand[1] = SC_CONF_SECTOR(bank);
+	iapCommand[2] = SC_CONF_SECTOR(bank);
+	iapCommand[3] = IAP_CCLK_KHZ;
+	iap_call(iapCommand, iapResult);
 }
 
-void sc_user_eeprom_write_block(u32 loc, u08* data, u08 length) {
-	IAP iap_entry;
-	iap_entry = (IAP)IAP_LOCATION;
-
+void sc_conf_bank_write(u08 bank, u16 offset, const u08 *data, u16 length) {
 	unsigned int iapCommand[5] = {0};
 	unsigned int iapResult[4] = {0};
-	/* 512 byte block min write size, first 256 is scandal config, 256 is user data */
-	uint32_t write_buffer[128] = {0};
-	//scandal_config *conf;
-
-	if (length > 1024) {
-		return;
+	uint32_t write_buffer[IAP_PAGE_SIZE / 4];
+	u16 page, start, n;
+
+	while (length > 0) {
+		page = offset & ~(IAP_PAGE_SIZE - 1);
+		start = offset - page;
+		n = IAP_PAGE_SIZE - start < length ? IAP_PAGE_SIZE - start : length;
+
+		memset(write_buffer, 0xFF, IAP_PAGE_SIZE);
+		memcpy((u08 *)write_buffer + start, data, n);
+
+		iap_prepare(bank);
+		iapCommand[0] = IAP_COPY_RAM_TO_FLASH;
+		iapCommand[1] = SC_CONF_START(bank) + page;
+		iapCommand[2] = (uint32_t)write_buffer;
+		iapCommand[3] = IAP_PAGE_SIZE;
+		iapCommand[4] = IAP_CCLK_KHZ;
+		iap_call(iapCommand, iapResult);
+
+		offset += n;
+		data += n;
+		length -= n;
 	}
-
-	//sc_read_conf(conf);
-
-	/* prepare for erase */
-	iapCommand[0] = 50;					// command to prepare
-	iapCommand[1] = 6;					// from sector 7
-	iapCommand[2] = 6;					// to sector 7
-	iap_entry (iapCommand, iapResult); 	// send the commands
-	scandal_delay(1);
-
-	/* do the erase */
-	iapCommand[0] = 52;					// command to erase
-	iapCommand[1] = 6;					// from sector 7
-	iapCommand[2] = 6;					// to sector 7
-	iapCommand[3] = 48000;				// clock rate in khz 
-	iap_entry (iapCommand, iapResult); 	// send the commands
-	scandal_delay(120);					// wait for it to be done
-
-	/* prepare for write */
-	iapCommand[0] = 50;					// command to prepare
-	iapCommand[1] = 6;					// from sector 7
-	iapCommand[2] = 6;					// to sector 7
-	iap_entry (iapCommand, iapResult); 	// send the commands
-	scandal_delay(1);
-
-	/* copy the config data into the write buffer */
-	//memcpy(write_buffer, conf, sizeof(scandal_config));
-	memcpy(write_buffer+loc, data, length);
-
-	/* actually do the write */
-	iapCommand[0] = 51;					// write to flash command
-	iapCommand[1] = 0x00006000;			// write starting from this flash address
-	iapCommand[2] = (uint32_t)(&write_buffer);		// read from this memory address
-	iapCommand[3] = 512;				// write 512 bytes
-	iapCommand[4] = 48000;				// clock speed in khz - 48000
-	iap_entry (iapCommand, iapResult);
-	scandal_delay(100);
 }
 
 /* *******************
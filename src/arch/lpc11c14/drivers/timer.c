@@ -447,6 +447,20 @@ sc_time_t sc_get_timer(void) {
 	return (sc_time_t)LPC_TMR32B0->TC; //TODO:Change this to use a proper interface function and not just access the memory directly
 }
 
+/* The prescale counter counts up to PR once every millisecond, so it gives us
+ * the fraction of a millisecond without needing another timer. Re-read TC in
+ * case it ticked over between the two reads. */
+sc_utime_t sc_get_timer_us(void) {
+	uint32_t tc, pc;
+
+	do {
+		tc = LPC_TMR32B0->TC;
+		pc = LPC_TMR32B0->PC;
+	} while (tc != LPC_TMR32B0->TC);
+
+	return (sc_utime_t)(tc * 1000 + (pc * 1000) / (LPC_TMR32B0->PR + 1));
+}
+
 /* *******************
  * End Scandal wrappers
  */
@@ -135,6 +135,13 @@ typedef struct {
 #define	WR		(1 << 7)   /* 0 is READ, 1 is WRITE */
 #define RD      0x0000
 
+/* IF1 and IF2 are laid out the same, 0x60 bytes apart. Thread code loads
+   message objects through IF1 and the interrupt handler through IF2, so
+   neither ever waits on a transfer the other started */
+#define CAN_IF_THREAD		0
+#define CAN_IF_ISR		1
+#define CAN_IF_REG(n, reg)	((&LPC_CAN->IF1_##reg)[(n) * 24])
+
 /* bit field of IF mask 2 register */
 #define	MASK_MXTD	(1 << 15)     /* 1 extended identifier bit is used in the RX filter unit, 0 is not */ 
 #define	MASK_MDIR	(1 << 14)     /* 1 direction bit is used in the RX filter unit, 0 is not */
@@ -161,12 +168,39 @@ typedef struct {
 #define DLC_MASK		0x0F
 
 #include <scandal/can.h>
+#include <scandal/can_ring.h>
+#include <scandal/can_filter.h>
+#include <scandal/can_admit.h>
+
+/* Receive ring, filled by CAN_IRQHandler. Its overruns and lost counters
+   show how many frames never made it to the engine */
+extern can_ring CAN_rxring;
+
+/* Registrations declared with can_register_id_rate() at CAN_RX_FIFO_MIN_RATE
+   frames a second or more get a chain of receive message objects each, up
+   to CAN_RX_FIFO_MAX_DEPTH, shared out in proportion to their rates. At
+   most CAN_RX_MAX_FAST are remembered, the fastest kept */
+#ifndef CAN_RX_FIFO_MIN_RATE
+#define CAN_RX_FIFO_MIN_RATE	50
+#endif
+#ifndef CAN_RX_FIFO_MAX_DEPTH
+#define CAN_RX_FIFO_MAX_DEPTH	8
+#endif
+#ifndef CAN_RX_MAX_FAST
+#define CAN_RX_MAX_FAST		4
+#endif
+
+/* Checked by CAN_MessageProcess once registrations share message objects.
+   Its rejected counter is how many frames were dropped there */
+extern can_admit CAN_rxadmit;
 
 extern void CAN_Init( uint32_t baud );
 extern void CAN_MessageProcess( uint8_t MsgObjNo );
+extern void CAN_fifo_drain( uint8_t first, uint8_t last );
+extern void CAN_tx_done( uint8_t MsgObjNo );
 int CAN_Send(uint16_t Pri, can_msg *msg);
-void CAN_set_up_filter(uint8_t msg_id, uint32_t filter_mask, uint32_t filter_addr, uint8_t ext);
-void CAN_decode_packet(uint8_t msg_num, can_msg *msg);
+int CAN_load(uint8_t ifn, can_msg *msg);
+void CAN_set_up_filter(uint8_t MsgNo, const can_hw_filter *filter, uint8_t eob);
 
 #endif  /* __CAN_H__ */
 /*****************************************************************************
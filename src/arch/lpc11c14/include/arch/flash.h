@@ -1,5 +1,42 @@
+#ifndef __FLASH_H
+#define __FLASH_H
+
 /* See page 312 of LPC111x/LPC11Cxx User manual */
 #define IAP_LOCATION 0x1fff1ff1
 
 typedef void (*IAP)(unsigned int [], unsigned int []);
-IAP iap_entry;
+
+/* The config log (see scandal/conf_log.h) has sectors 7 and 6, as banks 0
+ * and 1, and holds the user storage after the config. IAP writes whole 256
+ * byte pages, but programming 0xFF leaves a byte as it was, so records go
+ * in 16 byte flash lines, with the rest of the page written as 0xFF.
+ *
+ * The _28K linker scripts put program code in sector 6, so projects using
+ * them must define SC_CONF_BANKS as 1, and go without the second bank.
+ * Those scripts fail the link if it is left at 2 */
+#ifndef SC_CONF_BANKS
+#define SC_CONF_BANKS		2
+#endif
+#define SC_CONF_BANK_SIZE	4096
+#define SC_CONF_WRITE_UNIT	16
+#define SC_CONF_SECTOR(bank)	(7 - (bank))
+#define SC_CONF_START(bank)	(0x00007000 - (bank) * 0x1000)
+
+/* sc_user_eeprom_write_block() only ever kept one block of at most 255
+ * bytes, so this holds anything it did */
+#ifndef SC_USER_STORE_SIZE
+#define SC_USER_STORE_SIZE	256
+#endif
+
+/* Sector 6 was the user storage, as is, before the log */
+#if SC_CONF_BANKS > 1
+#define SC_USER_STORE_LEGACY_BANK	1
+#endif
+
+#define IAP_PREPARE		50
+#define IAP_COPY_RAM_TO_FLASH	51
+#define IAP_ERASE		52
+#define IAP_PAGE_SIZE		256
+#define IAP_CCLK_KHZ		48000
+
+#endif /* end __FLASH_H */
@@ -22,8 +22,12 @@
 #include <arch/clkpwr.h>
 
 #include <scandal/can.h>
+#include <scandal/can_filter.h>
 #include <scandal/error.h>
 #include <scandal/timer.h>
+#include <scandal/busstats.h>
+
+#include <string.h>
 
 /* Private Variables ---------------------------------------------------------- */
 FunctionalState FULLCAN_ENABLE;
@@ -1870,34 +1874,167 @@ uint32_t CAN_FullCANPendGetStatus(LPC_CANAF_TypeDef* CANAFx, FullCAN_IC_Type typ
  *   u32 id;
  *   u08 data[CAN_MSG_MAXSIZE];
  *   u08 length;
+ *   u08 ext;
+ *   sc_utime_t rcvd_us;
  * } can_msg;
+ *
+ * Only CAN1 is used. The acceptance filter is bypassed until the first
+ * can_register_id(), and from then on holds identifier ranges compiled from
+ * every registration, so only those frames are received. The pins are board
+ * specific and are left for the project to set up.
  */
 
+#ifndef CAN_BAUD_RATE
+#define CAN_BAUD_RATE	50000
+#endif
+
+/* Ranges the acceptance filter table can be compiled into. The table itself
+ * is CAN_AF_WORDS long, and an extended range takes two words of it */
+#ifndef CAN_AF_MAX_RANGES
+#define CAN_AF_MAX_RANGES	256
+#endif
+#define CAN_AF_WORDS		512
+
+/* Source CAN controller in a table entry: CAN1 */
+#define CAN_AF_CTRL		0
+
+/* Every can_register_id() so far, and the ranges they compile to */
+static can_filter rx_regs[CAN_FILTER_MAX_REGS];
+static u16 rx_num_regs;
+static can_filter_range rx_ranges[CAN_AF_MAX_RANGES + 1];
+
 /* Scandal wrapper for init */
 void init_can(void) {
-
+	CAN_Init(LPC_CAN1, CAN_BAUD_RATE);
+	CAN_SetAFMode(LPC_CANAF, CAN_AccBP);
 }
 
 /* Get a message from the CAN controller. */
 u08 can_get_msg(can_msg* msg) {
-	return NO_MSG_ERR;
+	CAN_MSG_Type rx;
+
+	if (CAN_ReceiveMsg(LPC_CAN1, &rx) != SUCCESS)
+		return NO_MSG_ERR;
+
+	msg->rcvd_us = sc_get_timer_us();
+	msg->id = rx.id;
+	msg->ext = (rx.format == EXT_ID_FORMAT) ? CAN_EXT_MSG : CAN_STD_MSG;
+
+	/* A DLC of 9 to 15 still means 8 bytes */
+	msg->length = (rx.type == DATA_FRAME) ? rx.len : 0;
+	if (msg->length > CAN_MSG_MAXSIZE)
+		msg->length = CAN_MSG_MAXSIZE;
+
+	memcpy(msg->data, rx.dataA, 4);
+	memcpy(msg->data + 4, rx.dataB, 4);
+
+	return NO_ERR;
+}
+
+static u08 can_send(can_msg *msg, uint8_t format) {
+	CAN_MSG_Type tx;
+
+	tx.id = msg->id;
+	tx.format = format;
+	tx.type = DATA_FRAME;
+	tx.len = (msg->length > CAN_MSG_MAXSIZE) ? CAN_MSG_MAXSIZE : msg->length;
+	memcpy(tx.dataA, msg->data, 4);
+	memcpy(tx.dataB, msg->data + 4, 4);
+
+	if (CAN_SendMsg(LPC_CAN1, &tx) != SUCCESS)
+		return BUF_FULL_ERR;
+
+	scandal_busstats_tx(msg);
+	return NO_ERR;
 }
 
 /* Send a message using the CAN controller */
 u08 can_send_msg(can_msg *msg, u08 priority) {
-	return NO_ERR;
+	return can_send(msg, (msg->ext == CAN_STD_MSG) ? STD_ID_FORMAT : EXT_ID_FORMAT);
 }
 
-/* Send a standard CAN message
- * TODO!
- */
+/* Zero copy send, see scandal/can.h. There is no transmit queue to build
+ * frames in here, so this only saves the caller's stack */
+static can_msg tx_slot;
+
+can_msg *can_tx_reserve(void) {
+	return &tx_slot;
+}
+
+u08 can_tx_commit(can_msg *msg, u08 priority) {
+	return can_send_msg(msg, priority);
+}
+
+/* No transmit queue either */
+u08 can_tx_flush(void) {
+	return 0;
+}
+
+void can_get_tx_stats(can_tx_stats *stats) {
+	stats->depth = 0;
+	stats->high_water = 0;
+	stats->overruns = 0;
+}
+
+/* Send a standard CAN message */
 u08 can_send_std_msg(can_msg* msg, u08 priority) {
-	return NO_ERR;
+	return can_send(msg, STD_ID_FORMAT);
 }
 
-/* Register for a message type. */
+/* Register for a message type. The whole set of registrations is compiled
+ * into identifier ranges and the acceptance filter table rewritten: standard
+ * ranges into the standard group section, extended identifiers into the
+ * explicit extended section, and extended ranges into the extended group
+ * section, each in ascending order as the filter needs them. The table is
+ * written directly rather than with CAN_SetupAFLUT(), as that only ever adds
+ * to it. */
 u08 can_register_id(u32 mask, u32 data, u08 priority, u08 ext) {
-	return NO_MSG_ERR;
+	can_filter reg;
+	u16 i, n, word = 0, eff_sa, eff_grp_sa;
+
+	reg.mask = mask;
+	reg.id = data;
+	reg.ext = ext;
+	rx_num_regs = can_filter_add(rx_regs, rx_num_regs, CAN_FILTER_MAX_REGS, &reg);
+	n = can_filter_compile_aflut(rx_regs, rx_num_regs, rx_ranges,
+			CAN_AF_MAX_RANGES, CAN_AF_WORDS, 0, 0);
+
+	/* Off, so the table can be written */
+	LPC_CANAF->AFMR = 0x01;
+
+	for (i = 0; i < n; i++)
+		if (rx_ranges[i].ext == CAN_STD_MSG)
+			LPC_CANAF_RAM->mask[word++] = (CAN_AF_CTRL << 29) | (rx_ranges[i].lo << 16) |
+					(CAN_AF_CTRL << 13) | rx_ranges[i].hi;
+	eff_sa = word;
+
+	for (i = 0; i < n; i++)
+		if (rx_ranges[i].ext == CAN_EXT_MSG && rx_ranges[i].lo == rx_ranges[i].hi)
+			LPC_CANAF_RAM->mask[word++] = (CAN_AF_CTRL << 29) | rx_ranges[i].lo;
+	eff_grp_sa = word;
+
+	for (i = 0; i < n; i++)
+		if (rx_ranges[i].ext == CAN_EXT_MSG && rx_ranges[i].lo != rx_ranges[i].hi) {
+			LPC_CANAF_RAM->mask[word++] = (CAN_AF_CTRL << 29) | rx_ranges[i].lo;
+			LPC_CANAF_RAM->mask[word++] = (CAN_AF_CTRL << 29) | rx_ranges[i].hi;
+		}
+
+	/* No FullCAN or explicit standard entries */
+	LPC_CANAF->SFF_sa = 0;
+	LPC_CANAF->SFF_GRP_sa = 0;
+	LPC_CANAF->EFF_sa = eff_sa << 2;
+	LPC_CANAF->EFF_GRP_sa = eff_grp_sa << 2;
+	LPC_CANAF->ENDofTable = word << 2;
+
+	/* Normal mode */
+	LPC_CANAF->AFMR = 0x00;
+
+	return NO_ERR;
+}
+
+/* The acceptance filter feeds one receive buffer whatever the rate */
+u08 can_register_id_rate(u32 mask, u32 data, u16 rate, u08 ext) {
+	return can_register_id(mask, data, 0, ext);
 }
 
 /* does nothing yet */
@@ -1,6 +1,7 @@
 /* Scandal wrappers
  * *****************/
 
+#include <scandal/error.h>
 #include <scandal/eeprom.h>
 #include <scandal/utils.h>
 
@@ -28,12 +29,13 @@ void sc_write_conf(scandal_config*	conf) {
 
 }
 
-void sc_user_eeprom_read_block(u32 loc, u08* data, u08 length) {
-
+/* No user storage here, see SC_USER_STORE_SIZE */
+u08 sc_user_eeprom_read_block(u32 loc, u08* data, u08 length) {
+	return LEN_ERR;
 }
 
-void sc_user_eeprom_write_block(u32 loc, u08* data, u08 length) {
-
+u08 sc_user_eeprom_write_block(u32 loc, u08* data, u08 length) {
+	return LEN_ERR;
 }
 
 /* *******************
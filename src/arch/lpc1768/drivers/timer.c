@@ -588,6 +588,19 @@ sc_time_t sc_get_timer(void) {
 	return LPC_TIM0->TC;
 }
 
+/* TIM0 is prescaled to count milliseconds, so take the fraction of a
+ * millisecond from the prescale counter */
+sc_utime_t sc_get_timer_us(void) {
+	uint32_t tc, pc;
+
+	do {
+		tc = LPC_TIM0->TC;
+		pc = LPC_TIM0->PC;
+	} while (tc != LPC_TIM0->TC);
+
+	return (sc_utime_t)(tc * 1000 + (pc * 1000) / (LPC_TIM0->PR + 1));
+}
+
 /* *******************
  * End Scandal wrappers
  */
@@ -1,5 +1,9 @@
+#ifndef __FLASH_H
+#define __FLASH_H
+
 /* See page 312 of LPC111x/LPC11Cxx User manual */
 #define IAP_LOCATION 0x1fff1ff1
 
 typedef void (*IAP)(unsigned int [], unsigned int []);
-IAP iap_entry;
+
+#endif /* end __FLASH_H */
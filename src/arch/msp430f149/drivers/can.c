@@ -31,23 +31,53 @@
 #include <arch/can.h>
 
 #include <scandal/can.h>
+#include <scandal/can_filter.h>
+#include <scandal/can_admit.h>
 #include <scandal/spi.h>
 #include <scandal/error.h>
+#include <scandal/timer.h>
+#include <scandal/busstats.h>
+#include <scandal/latency.h>
+#include <scandal/context.h>
 
 /* project/spi_devices.h must #define MCP2510 in order for this to compile.
    MCP2510 is the identifier of the SPI device to be used with spi_select() */
 
+/* can_interrupt() talks to the MCP2510 over SPI, so once init_can() has
+   enabled the CAN interrupt, everything else here that does keeps it
+   disabled for the length of the transfer. Callers of the MCP2510_*
+   functions must do the same */
+
+/* TXB0 to TXB2. Each one's registers are 0x10 on from the last one's */
+#define MCP2510_NUM_TXB		3
+#define TXB_REG(n, reg)		((reg) + 0x10 * (n))
+/* TXBnCTRL.TXREQ, as MCP2510_read_status() returns it */
+#define STATUS_TXREQ(n)		(1 << (2 + 2 * (n)))
+
 /* File scope variables */
-u32	fil1_data, fil1_mask;
-u32	fil2_data, fil2_mask;
+/* Every can_register_id() so far. can_filter_compile_mcp2510() makes the
+   controller's masks and filters from the lot */
+can_filter	rx_regs[CAN_FILTER_MAX_REGS];
+u16		rx_num_regs;
+
+/* Two masks between six filters let in plenty nothing registered for.
+   MCP2510_receive_message() drops those before reading them out */
+can_admit	rx_admit;
 
 /* Buffers */
 #if CAN_TX_BUFFER_SIZE > 0
-/* Transmit buffer */
+/* Transmit buffer. The MCP2510 interrupts as each of its transmit buffers
+   empties, and can_interrupt() refills them from here, so the main loop
+   must keep the CAN interrupt off while it touches the queue */
 can_msg		cantxbuf[CAN_TX_BUFFER_SIZE];
 u08			tx_buf_start;
 u08			tx_num_msgs;
 u08			tx_buf_lock;
+u08			tx_high_water;
+u32			tx_overruns;
+#else
+/* Where can_tx_reserve() has frames built */
+can_msg		tx_slot;
 #endif
 
 #if CAN_RX_BUFFER_SIZE > 0
@@ -106,32 +136,32 @@ void init_can(void){
 		__asm__ ("nop");
 #endif
 
-	/* Configure the bit timing */
-	can_baud_rate(DEFAULT_BAUD);
+	/* Configure the bit timing. The CAN interrupt isn't on yet, so this
+	   doesn't go through can_baud_rate() */
+	MCP2510_bit_timing(DEFAULT_BAUD);
 
 	/* Configure the interrupts */
 	/*! \todo Configure the MCP2510 Interrupt registers */
 
-	/* Set up recieve filters */
-	value = 0;
-	value |= (MCP2510_RECEIVE_EXTENDED << trRXM00); // SCOTT: this disables filter
-	value |= (1 << trFILHIT00); // use acceptance filter 1
+	/* Set up recieve filters. Both buffers take standard and extended
+	   frames, as the compiled filters may put either in either */
+	value = (MCP2510_RECEIVE_EXT_STD << trRXM00);
 	MCP2510_write(RXB0CTRL, &value, 1);
 
-	value = 0;
-	value |= (0<<trFILHIT12) | (1<<trFILHIT11) | (0<<trFILHIT10); // use acceptance filter 2
+	value = (MCP2510_RECEIVE_EXT_STD << trRXM01);
 	MCP2510_write(RXB1CTRL, &value, 1);
 
 	/* Set the controller to normal mode */
 	MCP2510_set_mode(MCP2510_NORMAL_MODE);
 
-	fil1_data = 0; fil1_mask = 0xFFFFFFFF;
-	fil2_data = 0; fil2_mask = 0xFFFFFFFF;
+	rx_num_regs = 0;
 
 #if CAN_TX_BUFFER_SIZE > 0 
 	tx_buf_lock = 0;
 	tx_buf_start = 0;
 	tx_num_msgs = 0;
+	tx_high_water = 0;
+	tx_overruns = 0;
 #endif
 
 #if CAN_RX_BUFFER_SIZE > 0
@@ -141,6 +171,9 @@ void init_can(void){
 #endif
 	
 	value = 0x03; /* interrupt on RX0 and RX1 */
+#if CAN_TX_BUFFER_SIZE > 0
+	value |= (1<<trTX0IE) | (1<<trTX1IE) | (1<<trTX2IE); /* and on each TX buffer emptying, to refill it */
+#endif
 	MCP2510_write(CANINTE, &value, 1);
 
 	enable_can_interrupt();
@@ -148,6 +181,17 @@ void init_can(void){
 
 /* Should be called by the host code when the controller generates an interrupt */
 void can_interrupt(void){
+#if CAN_TX_BUFFER_SIZE > 0
+	u08 flags;
+
+	MCP2510_read(CANINTF, &flags, 1);
+	flags &= (1<<trTX0IF) | (1<<trTX1IF) | (1<<trTX2IF);
+	if(flags != 0){
+		MCP2510_bit_modify(CANINTF, flags, 0x00);
+		send_queued_messages();
+	}
+#endif
+
 #if CAN_RX_BUFFER_SIZE > 0
 	buffer_received();
 #endif
@@ -159,9 +203,7 @@ void can_poll(void){
 	buffer_received();
 #endif
 
-#if CAN_TX_BUFFER_SIZE > 0
-	send_queued_messages();
-#endif
+	can_tx_flush();
 }
 
 /* Get a message from the CAN controller */
@@ -177,26 +219,109 @@ u08 can_get_msg(can_msg* msg){
 	enable_can_interrupt();
 
 #else
-	return(MCP2510_receive_message(&(msg->id), msg->data, &(msg->length), &(msg->ext)));
+	u08 err;
+
+	msg->rcvd_us = sc_get_timer_us();
+	disable_can_interrupt();
+	err = MCP2510_receive_message(&(msg->id), msg->data, &(msg->length), &(msg->ext));
+	enable_can_interrupt();
+	return err;
 #endif
 	return(NO_ERR);
 }
 
 /* Send a message to the CAN controller */
 u08 can_send_msg(can_msg* msg, u08 priority){
-#if CAN_TX_BUFFER_SIZE > 0
   u08 err;
+#if CAN_TX_BUFFER_SIZE > 0
+  disable_can_interrupt();
   err = enqueue_message(msg);
   send_queued_messages();
+  enable_can_interrupt();
+#else
+  disable_can_interrupt();
+  if(msg->ext == CAN_STD_MSG)
+    err = MCP2510_transmit_std_message(msg->id, msg->data, msg->length, priority);
+  else
+    err = MCP2510_transmit_message(msg->id, msg->data, msg->length, priority);
+  enable_can_interrupt();
+#endif
+  if(err == NO_ERR)
+    scandal_busstats_tx(msg);
   return err;
+}
+
+
+/* Zero copy send, see scandal/can.h. With a transmit buffer the slot is its
+   next free entry */
+can_msg *can_tx_reserve(void){
+#if CAN_TX_BUFFER_SIZE > 0
+	/* Only the thread adds to the queue. The interrupt just takes frames
+	   off the front, in send_queued_messages(), so the slot past the end
+	   stays ours until can_tx_commit() without a lock */
+	if(tx_num_msgs >= CAN_TX_BUFFER_SIZE){
+		tx_overruns++;
+		return 0;
+	}
+	return &cantxbuf[(tx_buf_start + tx_num_msgs) & CAN_TX_BUFFER_MASK];
+#else
+	return &tx_slot;
+#endif
+}
+
+u08 can_tx_commit(can_msg* msg, u08 priority){
+#if CAN_TX_BUFFER_SIZE > 0
+	scandal_busstats_tx(msg);
+	disable_can_interrupt();
+	if(++tx_num_msgs > tx_high_water)
+		tx_high_water = tx_num_msgs;
+	send_queued_messages();
+	enable_can_interrupt();
+	return NO_ERR;
+#else
+	return can_send_msg(msg, priority);
+#endif
+}
+
+/* Transmit queue control, see scandal/can.h */
+u08 can_tx_flush(void){
+#if CAN_TX_BUFFER_SIZE > 0
+	u08 depth;
+
+	disable_can_interrupt();
+	send_queued_messages();
+	depth = tx_num_msgs;
+	enable_can_interrupt();
+
+	return depth;
 #else
-  return(MCP2510_transmit_message(msg->id, msg->data, msg->length, priority));
+	return 0;
 #endif
 }
 
+void can_get_tx_stats(can_tx_stats *stats){
+#if CAN_TX_BUFFER_SIZE > 0
+	disable_can_interrupt();
+	stats->depth = tx_num_msgs;
+	stats->high_water = tx_high_water;
+	stats->overruns = tx_overruns;
+	enable_can_interrupt();
+#else
+	stats->depth = 0;
+	stats->high_water = 0;
+	stats->overruns = 0;
+#endif
+}
 
 u08 can_send_std_msg(can_msg* msg, u08 priority) {
-	return(MCP2510_transmit_std_message(msg->id, msg->data, msg->length, priority));
+	u08 err;
+
+	disable_can_interrupt();
+	err = MCP2510_transmit_std_message(msg->id, msg->data, msg->length, priority);
+	enable_can_interrupt();
+	if(err == NO_ERR)
+		scandal_busstats_tx(msg);
+	return err;
 }
 
 #if CAN_TX_BUFFER_SIZE > 0
@@ -204,8 +329,10 @@ u08 enqueue_message(can_msg* msg){
 	u08 pos;
 	u08 i;
 	
-	if(tx_num_msgs >= CAN_TX_BUFFER_SIZE)
+	if(tx_num_msgs >= CAN_TX_BUFFER_SIZE){
+		tx_overruns++;
 		return BUF_FULL_ERR;
+	}
 
 	pos = (tx_buf_start + tx_num_msgs) & CAN_TX_BUFFER_MASK;
 
@@ -215,11 +342,14 @@ u08 enqueue_message(can_msg* msg){
 		cantxbuf[pos].data[i] = msg->data[i];
 	cantxbuf[pos].length = msg->length;
 
-	tx_num_msgs++;
+	if(++tx_num_msgs > tx_high_water)
+		tx_high_water = tx_num_msgs;
 
 	return NO_ERR;
 }
 
+/* Sends queued frames, oldest first, until all three transmit buffers are
+   busy. Called from can_interrupt(), or with the CAN interrupt disabled */
 u08 send_queued_messages(void){
 	can_msg* msg;
 	u08 err = NO_ERR;
@@ -227,27 +357,25 @@ u08 send_queued_messages(void){
 	if(tx_num_msgs <= 0)
 		return (NO_MSG_ERR);
 
-	msg = &(cantxbuf[tx_buf_start]);
+	while(err == NO_ERR && tx_num_msgs > 0){
+		msg = &(cantxbuf[tx_buf_start]);
 
-	disable_can_interrupt();
+		switch(msg->ext) {
+		 case CAN_STD_MSG:
+			err = MCP2510_transmit_std_message(msg->id, msg->data, msg->length, (msg->id >> 21) & 0xFF);
+			break;
 
-	switch(msg->ext) {
-	 case CAN_STD_MSG:
-		err = MCP2510_transmit_std_message(msg->id, msg->data, msg->length, (msg->id >> 21) & 0xFF);
-		break;
+		 case CAN_EXT_MSG:
+			err = MCP2510_transmit_message(msg->id, msg->data, msg->length, (msg->id >> 21) & 0xFF);
+			break;
+		}
 
-	 case CAN_EXT_MSG:
-		err = MCP2510_transmit_message(msg->id, msg->data, msg->length, (msg->id >> 21) & 0xFF);
-		break;
+		if(err == NO_ERR){
+		    tx_buf_start = (tx_buf_start + 1) & CAN_TX_BUFFER_MASK;
+		    tx_num_msgs--;
+	   	}
 	}
 
-	enable_can_interrupt();
-
-	if(err == NO_ERR){
-	    tx_buf_start = (tx_buf_start + 1) & CAN_TX_BUFFER_MASK;
-	    tx_num_msgs--;
-   	}
-
 	return err;
 }
 #endif
@@ -270,13 +398,12 @@ u08 buffer_received(void){
 			pos = (rx_buf_start + rx_num_msgs) & CAN_RX_BUFFER_MASK;
 			msg = (can_msg*)&(canrxbuf[pos]);
       msg->id=0x69A5;
+			msg->rcvd_us = sc_get_timer_us();
 			err = MCP2510_receive_message(&(msg->id), msg->data, &(msg->length), &(msg->ext));
 
 			if(err == NO_ERR) {
-        msg->id++;
-        enqueue_message(msg);
-        msg->id--;
-				rx_num_msgs++; }
+				rx_num_msgs++;
+				scandal_latency_record(LATENCY_ISR, sc_get_timer_us() - msg->rcvd_us); }
 			enable_can_interrupt();
 		}
 	}
@@ -285,77 +412,73 @@ u08 buffer_received(void){
 }
 #endif
 
+/* A mask or filter, from the arbitration field layout can_hw_filter uses
+ * into the SIDH, SIDL, EID8 and EID0 registers */
+static void MCP2510_arb_regs(u08 *buf, u32 value, u08 exide){
+	buf[0] = value >> 21;
+	buf[1] = (((value >> 18) & 0x07) << 5) | (exide << EXIDE) | ((value >> 16) & 0x03);
+	buf[2] = ((value >> 8) & 0xFF);
+	buf[3] = ((value >> 0) & 0xFF);
+}
+
 /* Register an message ID we want to receive
- * On the MCP2515, there are limited filters. So when we register for a new ID, we should just
- * make the filter a superposition of the previous and new filters. */
+ * On the MCP2515, there are only two masks and six filters. So we keep every
+ * registration, and each time one is added, compile the lot into the masks
+ * and filters that let in the fewest frames we didn't ask for. */
 u08 can_register_id(u32 mask, u32 data, u08 priority, u08 ext){
-	u08 buf[4];
-	u32 data_diff;
-
-	/* we need to be in configuration mode to modify these registers */
-	MCP2510_set_mode(MCP2510_CONFIGURATION_MODE);
-
-	switch (ext) {
-	 case CAN_EXT_MSG:
-		/* set up the filters for rxbuf0, the EXT buffer for scandal messages */
-		data_diff = data ^ fil1_data; /* The bits which are different will be 1, the bits that aren't will be 0 */
-
-		/* If fil1_mask is its original value, set fil1_mask the requested value */
-		if(fil1_mask == 0xFFFFFFFF) {
-			fil1_data = data;
-			fil1_mask = mask;
-		} else {
-			fil1_mask = (fil1_mask & mask) & (~data_diff);
-			fil1_data = data & fil1_mask;
-		}
-
-		buf[0] = fil1_data >> 21;
-		buf[1] = (((fil1_data >> 18) & 0x07) << 5) | ((u32)1<<EXIDE) | ((fil1_data >> 16) & 0x03);
-		buf[2] = ((fil1_data >> 8) & 0xFF);
-		buf[3] = ((fil1_data >> 0) & 0xFF);
-		MCP2510_write(RXF1SIDH, buf, 4);
-
-		buf[0] = fil1_mask >> 21;
-		buf[1] = (((fil1_mask >> 18) & 0x07) << 5) | ((u32)1<<EXIDE) | ((fil1_mask >> 16) & 0x03);
-		buf[2] = ((fil1_mask >> 8) & 0xFF);
-		buf[3] = ((fil1_mask >> 0) & 0xFF);
-		MCP2510_write(RXM0SIDH, buf, 4);
+	can_filter_mcp2510 hw;
+	can_filter reg;
+	u08 buf[12];
+	u08 i;
 
-		break;
+	reg.mask = mask;
+	reg.id = data;
+	reg.ext = ext;
+	rx_num_regs = can_filter_add(rx_regs, rx_num_regs, CAN_FILTER_MAX_REGS, &reg);
+	can_filter_compile_mcp2510(rx_regs, rx_num_regs, &hw, 0, 0);
 
-	 case CAN_STD_MSG:
-		/* set up the filters for rxbuf1, the STD buffer for tritium messages */
-		data_diff = data ^ fil1_data; /* The bits which are different will be 1, the bits that aren't will be 0 */
+	/* The receive path in can_interrupt() checks rx_admit */
+	disable_can_interrupt();
+	can_admit_build(&rx_admit, rx_regs, rx_num_regs, 1);
 
-		/* If fil1_mask is its original value, set fil1_mask the requested value */
-		if (fil2_mask == 0xFFFFFFFF) {
-			fil2_data = data;
-			fil2_mask = mask;
-		} else {
-			fil2_mask = (fil2_mask & mask) & (~data_diff);
-			fil2_data = data & fil2_mask;
-		}
+	/* we need to be in configuration mode to modify these registers */
+	MCP2510_set_mode(MCP2510_CONFIGURATION_MODE);
 
-		buf[0] = (fil2_data >> 3);
-		buf[1] = ((fil2_data << 5) & (0xE)) | ((u32)0<<EXIDE);
-		MCP2510_write(RXF2SIDH, buf, 2);
+	/* RXM0 and RXM1 are next to each other, as are RXF0 to RXF2 and
+	   RXF3 to RXF5 */
+	MCP2510_arb_regs(&buf[0], hw.mask[0], 0);
+	MCP2510_arb_regs(&buf[4], hw.mask[1], 0);
+	MCP2510_write(RXM0SIDH, buf, 8);
 
-		buf[0] = (fil2_mask >> 3);
-		buf[1] = (fil2_mask << 5) & (0xE);
-		MCP2510_write(RXM1SIDH, buf, 2);
+	for(i=0; i<3; i++)
+		MCP2510_arb_regs(&buf[4*i], hw.filter[i].id, hw.filter[i].ext == CAN_EXT_MSG);
+	MCP2510_write(RXF0SIDH, buf, 12);
 
-		break;
-	}
+	for(i=0; i<3; i++)
+		MCP2510_arb_regs(&buf[4*i], hw.filter[3+i].id, hw.filter[3+i].ext == CAN_EXT_MSG);
+	MCP2510_write(RXF3SIDH, buf, 12);
 
 	/* go back into normal mode */
 	MCP2510_set_mode(MCP2510_NORMAL_MODE);
+	enable_can_interrupt();
 
 	return NO_ERR;
 }
 
+/* The MCP2510 has two receive buffers whatever the rate */
+u08 can_register_id_rate(u32 mask, u32 data, u16 rate, u08 ext){
+	return can_register_id(mask, data, 0, ext);
+}
+
 /*! Set the baud rate mode to one of the rate modes */
 u08 can_baud_rate(u08 mode){
-	return(MCP2510_bit_timing(mode));
+	u08 err;
+
+	disable_can_interrupt();
+	err = MCP2510_bit_timing(mode);
+	enable_can_interrupt();
+
+	return err;
 }
 
 /*
@@ -409,48 +532,29 @@ u08 MCP2510_get_mode() {
 	return(value >> 5);
 }
 
-/* Note: This routine will fail if none of the transmit buffers are available */
-/* Transmit a message using the MCP2510 and a free Tx buffer */
-u08 MCP2510_transmit_message(u32 id, u08 *buf, u08 size, u08 priority) {
-	unsigned char value;
-	unsigned char idbuf[8];
-
-	value = MCP2510_read_status();
-	if((value & (1<<2)) != 0)    /* If the buffer is pending a transmission, return BUF_FULL_ERR */
-		return BUF_FULL_ERR;
-
-	/* In order to comply with the CAN standard, the size (DLC) must
-	 be less than or equal to 8 */
-	if(size>8)
-		size = 8;
-
-	/* Load the ID */
-	idbuf[0] = (id >> 21) & 0xFF;
-	idbuf[1] = (((id >> 18) & 0x07) << 5) | (1<<EXIDE) | ((id >> 16) & 0x03);
-	idbuf[2] = ((id >> 8) & 0xFF);
-	idbuf[3] = ((id >> 0) & 0xFF);
-	MCP2510_write(TXB0SIDH, idbuf, 4);
-
-	/* Load the data */
-	MCP2510_write(TXB0D0, buf, size);
-
-	/* Set the size byte */
-	MCP2510_write(TXB0DLC, &size, 1);
+/* The highest numbered free transmit buffer, or MCP2510_NUM_TXB if all
+   three are busy. Frames loaded into free buffers together then go in the
+   order they were loaded, as the MCP2510 sends the highest numbered of
+   those with the same priority first */
+static u08 MCP2510_free_tx_buffer(void){
+	u08 status, n;
 
-	/* Set the priority and flag the buffer to be transmitted */
-	MCP2510_bit_modify(TXB0CTRL, TXBNCTRL_TXP_MASK, priority);
-	MCP2510_RTS(0x01);
+	status = MCP2510_read_status();
+	for(n=MCP2510_NUM_TXB; n>0; n--)
+		if((status & STATUS_TXREQ(n-1)) == 0)
+			return n-1;
 
-	return(NO_ERR);
+	return MCP2510_NUM_TXB;
 }
 
-u08 MCP2510_transmit_std_message(u32 id, u08 *buf, u08 size, u08 priority) {
-	unsigned char value;
-	unsigned char sid_l;
-	unsigned char sid_h;
+/* Loads a frame into a free transmit buffer and requests it be sent. Fails
+   with BUF_FULL_ERR if none is free */
+static u08 MCP2510_transmit(u32 id, u08 ext, u08 *buf, u08 size, u08 priority){
+	u08 idbuf[4];
+	u08 n;
 
-	value = MCP2510_read_status();
-	if((value & (1<<4)) != 0) /* If the buffer is pending a transmission, return BUF_FULL_ERR */
+	n = MCP2510_free_tx_buffer();
+	if(n == MCP2510_NUM_TXB)
 		return BUF_FULL_ERR;
 
 	/* In order to comply with the CAN standard, the size (DLC) must
@@ -459,25 +563,41 @@ u08 MCP2510_transmit_std_message(u32 id, u08 *buf, u08 size, u08 priority) {
 		size = 8;
 
 	/* Load the ID */
-	sid_h = (id >> 3) & 0xFF; // the id should be 11 bits. Take the high 8
-	sid_l = ((id & 0x7) << 5) | (0<<EXIDE); // take the last 3 bits, and make sure that it is set to STD.
-
-	MCP2510_write(TXB1SIDH, &sid_h, 1);
-	MCP2510_write(TXB1SIDL, &sid_l, 1);
+	if(ext){
+		idbuf[0] = (id >> 21) & 0xFF;
+		idbuf[1] = (((id >> 18) & 0x07) << 5) | (1<<EXIDE) | ((id >> 16) & 0x03);
+		idbuf[2] = ((id >> 8) & 0xFF);
+		idbuf[3] = ((id >> 0) & 0xFF);
+	} else {
+		idbuf[0] = (id >> 3) & 0xFF; // the id should be 11 bits. Take the high 8
+		idbuf[1] = ((id & 0x7) << 5) | (0<<EXIDE); // take the last 3 bits, and make sure that it is set to STD.
+		idbuf[2] = 0;
+		idbuf[3] = 0;
+	}
+	MCP2510_write(TXB_REG(n, TXB0SIDH), idbuf, 4);
 
 	/* Load the data */
-	MCP2510_write(TXB1D0, buf, size);
+	MCP2510_write(TXB_REG(n, TXB0D0), buf, size);
 
 	/* Set the size byte */
-	MCP2510_write(TXB1DLC, &size, 1);
+	MCP2510_write(TXB_REG(n, TXB0DLC), &size, 1);
 
 	/* Set the priority and flag the buffer to be transmitted */
-	MCP2510_bit_modify(TXB1CTRL, TXBNCTRL_TXP_MASK, priority);
-	MCP2510_RTS(0x02);
+	MCP2510_bit_modify(TXB_REG(n, TXB0CTRL), TXBNCTRL_TXP_MASK, priority);
+	MCP2510_RTS(1 << n);
 
 	return(NO_ERR);
 }
 
+/* Transmit a message using the MCP2510 and a free Tx buffer */
+u08 MCP2510_transmit_message(u32 id, u08 *buf, u08 size, u08 priority) {
+	return MCP2510_transmit(id, CAN_EXT_MSG, buf, size, priority);
+}
+
+u08 MCP2510_transmit_std_message(u32 id, u08 *buf, u08 size, u08 priority) {
+	return MCP2510_transmit(id, CAN_STD_MSG, buf, size, priority);
+}
+
 void careful_clear_receive_interrupt(u08  flag){
 	u08 value;
 
@@ -544,18 +664,25 @@ u08 MCP2510_receive_message(u32* id, u08* buf, u08* length, u08 *ext){
       (*ext) = 0;
     }
 
-		/* Read the length */
-		MCP2510_read(RXB0DLC, buf, 1);
-		*length = buf[0] & 0x0F;
+		/* A frame nothing registered for is dropped without reading the
+		   rest of it, and RXB1 looked at instead */
+		if(can_admit_check(&rx_admit, *id, *ext)){
+			/* Read the length */
+			MCP2510_read(RXB0DLC, buf, 1);
+			*length = buf[0] & 0x0F;
+			if(*length > CAN_MSG_MAXSIZE)	/* DLC 9-15 still means 8 bytes */
+				*length = CAN_MSG_MAXSIZE;
 
-		/* Read length number of bytes from the recieve buffer */
-		MCP2510_read(RXB0D0, buf, *length);
+			/* Read length number of bytes from the recieve buffer */
+			MCP2510_read(RXB0D0, buf, *length);
 
-		/* The function below clears the receive interrupt in a manner that should
-		 * work around the silicon bug detailed in errata item 6 */
-		careful_clear_receive_interrupt(trRX0IF);
+			/* The function below clears the receive interrupt in a manner that should
+			 * work around the silicon bug detailed in errata item 6 */
+			careful_clear_receive_interrupt(trRX0IF);
 
-		return NO_ERR;
+			return NO_ERR;
+		}
+		careful_clear_receive_interrupt(trRX0IF);
 	}
 //#ifdef STD_ENABLE
 #if 1
@@ -588,9 +715,16 @@ u08 MCP2510_receive_message(u32* id, u08* buf, u08* length, u08 *ext){
       (*ext) = 0;
     }
 
+		if(!can_admit_check(&rx_admit, *id, *ext)){
+			careful_clear_receive_interrupt(trRX1IF);
+			return NO_MSG_ERR;
+		}
+
 		/* Read the length */
 		MCP2510_read(RXB1DLC, buf, 1);
 		*length = buf[0] & 0x0F;
+		if(*length > CAN_MSG_MAXSIZE)	/* DLC 9-15 still means 8 bytes */
+			*length = CAN_MSG_MAXSIZE;
 
 		/* Read length bytes from the recieve buffer */
 		MCP2510_read(RXB1D0, buf, *length);
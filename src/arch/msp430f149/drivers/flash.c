@@ -9,6 +9,10 @@
 #include <msp430.h>
 #include <signal.h>
 #include <scandal/eeprom.h>
+#include <scandal/conf_log.h>
+#include <scandal/user_store.h>
+
+#include <arch/flash.h>
 
 /* Notes on flash programming: 
    David Snowdon, 5/4/2008
@@ -19,9 +23,13 @@
    written. 
    To rectify this, we should a) do checksums and b) go through this code
    again with a fine-toothed comb. 
+   The config log does a): each record has a CRC, and a write that didn't
+   finish is ignored.
 */ 
 
-/* Segment A is assigned to Scandal configuration, segment B is assigned to user configuration */
+/* Segments A and B hold the Scandal configuration and the user configuration, as a log of
+   the changes made to them, see scandal/conf_log.h, so a segment is only erased when the
+   other fills. The user configuration is read and written through scandal/user_store.h */
 
 void 	sc_init_eeprom(void){
   FCTL3 = FWKEY + LOCK; 
@@ -31,132 +39,61 @@ void 	sc_init_eeprom(void){
   /* Should be between 257 and 476 kHz according to section 5.3.1 
      of the user manual */ 
   
+  sc_conf_log_mount();
+  sc_user_store_load();
 }
 
 void sc_read_conf(scandal_config*	conf){
-	u16	i;
-	u08*	ptr;
-	u08*    flash_ptr;
-	
-	ptr = (u08*)conf;
-	flash_ptr = (u08*)0x1080;                 /* Segment A */
-
-	/* Read the flash segment */
-	for(i=0;(i<(sizeof(scandal_config))) &&
-		    (i < 128);i++)
-	  *ptr++ = *flash_ptr++;
-
-	/* Read segment B */
-	if(i < sizeof(scandal_config)){
-	  flash_ptr = (u08*)0x1000;
-		for(;(i<(sizeof(scandal_config))); i++){
-			*ptr++ = *flash_ptr++;
-		}
-	}
+	sc_conf_log_read(0, conf, sizeof(scandal_config));
 }
 
 void sc_write_conf(scandal_config*	conf){
-	u16	i;
-	uint8_t*    ptr;
-	uint8_t*    flash_ptr;
-	uint16_t saved_sr;
+	sc_conf_log_write(0, conf, sizeof(scandal_config));
+}
 
+/* Config log backend, see arch/flash.h */
+const u08 *sc_conf_bank(u08 bank){
+	return (const u08 *)SC_CONF_START(bank);
+}
+
+void sc_conf_bank_erase(u08 bank){
+	uint16_t saved_sr;
 
 	saved_sr = READ_SR;
 	dint();
 
-	ptr = (u08*)conf;
-	flash_ptr = (u08*)0x1080;                 /* Segment A */
-	
-	/* Erase the flash segment */
 	FCTL1 = FWKEY + ERASE;
 	FCTL3 = FWKEY;
-	*flash_ptr = 0;                           /* Dummy write erases the 
+	*(u08 *)SC_CONF_START(bank) = 0;          /* Dummy write erases the
 						     segment */
-
-	/* Write the flash segment */
-	for(i=0;i<(sizeof(scandal_config)) && (i < 128); i++){
-	  FCTL3 = FWKEY; 
-	  FCTL1 = FWKEY + WRT; /* Set for write operation */
-	  *flash_ptr++ = *ptr++;
-	  FCTL1 = FWKEY; 
-	  FCTL3 = FWKEY + LOCK; 
-	}
-
-	if(i < sizeof(scandal_config)){
-		flash_ptr = (u08*)0x1000;                 /* Segment B */
-		
-		/* Erase the flash segment */
-		FCTL1 = FWKEY + ERASE;
-		FCTL3 = FWKEY;
-		*flash_ptr = 0;                           
-		
-		/* Write the flash segment */
-		FCTL1 = FWKEY + WRT;                      
-		for(;i<(sizeof(scandal_config));i++){
-		  FCTL3 = FWKEY; 
-		  FCTL1 = FWKEY + WRT; /* Set for write operation */
-		  *flash_ptr++ = *ptr++;
-		  FCTL1 = FWKEY; 
-		  FCTL3 = FWKEY + LOCK; 
-		}
-	}
+#if SC_CONF_BANK_SIZE > 128
+	FCTL1 = FWKEY + ERASE;
+	*(u08 *)(SC_CONF_START(bank) + 128) = 0;
+#endif
+	FCTL3 = FWKEY + LOCK;
 
 	if((saved_sr & GIE) != 0) {
 	  eint();
 	}
-
-}
-
-void sc_user_eeprom_read_block(u32 loc, u08* data, u08 length){
-  u16	i;
-  u08*    flash_ptr;
-  
-  flash_ptr = (u08*)0x1000;
-  for(i=0;i<length; i++){
-    *data++ = *flash_ptr++;
-  }
 }
 
-//#warning "sc_user_eeprom_write_block implementation presently ignores the loc parameter"
-void sc_user_eeprom_write_block(u32 loc, u08* data, u08 length){
-	u16	i;
+void sc_conf_bank_write(u08 bank, u16 offset, const u08 *data, u16 length){
 	u08*    flash_ptr;
 	uint16_t saved_sr;
 
 	saved_sr = READ_SR;
-	dint(); 
-	
-	{
-	  volatile int blerg; 
-
-	  for(blerg = 0; blerg < 10000; blerg++)
-	    ;
-	} 
-
-	  
-
+	dint();
 
-#if SIZEOF_SCANDAL_CONFIG <= 128
-	flash_ptr = (u08*)0x1000;                 /* Segment B */
-  
-	/* Erase the flash segment */
-	FCTL1 = FWKEY + ERASE;
-	FCTL3 = FWKEY;
-	*flash_ptr = 0;                           
-	
- 	/* Write the flash segment */
-	FCTL1 = FWKEY + WRT;                      
-	for(i=0;i<length;i++){
+	flash_ptr = (u08*)SC_CONF_START(bank) + offset;
+	while(length--){
 	  FCTL3 = FWKEY; 
 	  FCTL1 = FWKEY + WRT; /* Set for write operation */
 	  *flash_ptr++ = *data++;
 	  FCTL1 = FWKEY; 
 	  FCTL3 = FWKEY + LOCK; 
 	}
-#else
-#warning USER CONFIG WILL NOT BE WRITTEN TO EEPROM
-#endif
-	if(saved_sr & GIE)
-	  eint(); 
+
+	if((saved_sr & GIE) != 0) {
+	  eint();
+	}
 }
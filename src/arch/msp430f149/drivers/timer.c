@@ -96,3 +96,25 @@ sc_time_t sc_get_timer(void){
 
   return time;
 }
+
+/* Resolution is one ACLK tick, about 30us */
+sc_utime_t sc_get_timer_us(void){
+  sc_utime_t	time;
+  u32           tar_copy;
+
+  TACCTL0 &= ~CCIE; 
+
+  {
+    volatile int i; 
+    for(i=0; i<15; i++)
+      ;
+  }
+
+  time = ms;
+  tar_copy = TAR; 
+
+  TACCTL0 |= CCIE; 
+
+  /* 1000000/32768 == 15625/512 */
+  return time * 1000 + ((tar_copy * 15625) >> 9);
+}
@@ -0,0 +1,54 @@
+/*
+ *  flash.h
+ *
+ *  Information memory on the MSP430F149: segment B at 0x1000 and segment A
+ *  at 0x1080, 128 bytes each. They are banks 0 (A) and 1 (B) of the config
+ *  log (see scandal/conf_log.h), which holds the user storage after the
+ *  config. By default the user storage gets half of what the config leaves
+ *  of a bank, so that there is still room to append changes. A config too
+ *  big to share a bank takes both segments as one bank, as the config
+ *  itself used to past 128 bytes, and then there is no user storage.
+ *  Flash is written a byte at a time.
+ *
+ *  The user storage used to be all 128 bytes of segment B. A project that
+ *  needs more than the default sets SC_USER_STORE_SIZE, up to
+ *  SC_USER_STORE_MAX, and the build fails past that. Accesses past the
+ *  size return LEN_ERR, and data from before the log that doesn't fit is
+ *  reported when it is mounted.
+ */
+
+#ifndef __FLASH_H
+#define __FLASH_H
+
+#include <scandal/eeprom.h>
+
+#define SC_CONF_WRITE_UNIT	1
+
+/* A bank holds its header and the image in two records at most, so at
+   most 128 - 8 - 2 * 6 bytes of image */
+#if SIZEOF_SCANDAL_CONFIG <= 108
+#define SC_CONF_BANKS		2
+#define SC_CONF_BANK_SIZE	128
+#define SC_CONF_START(bank)	(0x1080 - (bank) * 0x80)
+#define SC_USER_STORE_MAX	(108 - SIZEOF_SCANDAL_CONFIG)
+#ifndef SC_USER_STORE_SIZE
+#define SC_USER_STORE_SIZE	(SC_USER_STORE_MAX / 2)
+#endif
+/* Segment B was the user storage, as is, before the log */
+#define SC_USER_STORE_LEGACY_BANK	1
+#define SC_USER_STORE_LEGACY_SIZE	128
+#else
+#define SC_CONF_BANKS		1
+#define SC_CONF_BANK_SIZE	256
+#define SC_CONF_START(bank)	0x1000		/* Segments B and A */
+#define SC_USER_STORE_MAX	0
+#ifndef SC_USER_STORE_SIZE
+#define SC_USER_STORE_SIZE	0
+#endif
+#endif
+
+#if SC_USER_STORE_SIZE > SC_USER_STORE_MAX
+#error "SC_USER_STORE_SIZE doesn't fit in an information segment with the config"
+#endif
+
+#endif /* end __FLASH_H */
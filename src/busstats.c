@@ -0,0 +1,210 @@
+/* --------------------------------------------------------------------------
+	Scandal Bus Statistics
+	File name: busstats.c
+
+	Frame, byte and wire time accounting for everything this node sends
+	and receives. See scandal/busstats.h.
+   -------------------------------------------------------------------------- */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <project/scandal_config.h>
+
+#include <scandal/types.h>
+#include <scandal/can.h>
+#include <scandal/engine.h>
+#include <scandal/error.h>
+#include <scandal/message.h>
+#include <scandal/scheduler.h>
+#include <scandal/busstats.h>
+#include <scandal/context.h>
+
+#include <string.h>
+
+#if !DISABLE_BUSSTATS
+
+/* Message types whose node field is the sender, rather than the recipient */
+#define BUSSTATS_SOURCE_TYPES	(SCANDAL_MSG_TYPE_BIT(CHANNEL_TYPE) |\
+				 SCANDAL_MSG_TYPE_BIT(HEARTBEAT_TYPE) |\
+				 SCANDAL_MSG_TYPE_BIT(SCANDAL_ERROR_TYPE) |\
+				 SCANDAL_MSG_TYPE_BIT(USER_ERROR_TYPE) |\
+				 SCANDAL_MSG_TYPE_BIT(PACKED16_TYPE) |\
+				 SCANDAL_MSG_TYPE_BIT(PACKED24_TYPE))
+
+/* Bit times in one window */
+#define BUSSTATS_WINDOW_BITS	((u32)(SCANDAL_CAN_BITRATE / 1000) * SCANDAL_BUSSTATS_WINDOW)
+
+
+static void busstats_task(void *arg);
+
+void scandal_init_busstats(void){
+	memset(&sc_self->busstats, 0, sizeof(sc_self->busstats));
+	scandal_add_task(busstats_task, 0, SCANDAL_BUSSTATS_WINDOW,
+			SCANDAL_BUSSTATS_WINDOW, 2);
+}
+
+static u08 busstats_class(can_msg *msg){
+	u08 type;
+
+	if(msg->ext != CAN_EXT_MSG)
+		return BUSSTATS_STD;
+
+	type = (msg->id >> TYPE_OFFSET) & ((1<<TYPE_BITS) - 1);
+	if(type >= SCANDAL_NUM_MSG_TYPES)
+		return BUSSTATS_OTHER;
+	return type;
+}
+
+static void busstats_count(can_msg *msg, u08 class, u08 dir){
+	u08 length = msg->length > CAN_MSG_MAXSIZE ? CAN_MSG_MAXSIZE : msg->length;
+	u16 bits = scandal_frame_bits(msg->ext, length);
+
+	sc_self->busstats.classes[class][dir].frames++;
+	sc_self->busstats.classes[class][dir].bytes += length;
+	sc_self->busstats.wire_bits += bits;
+	sc_self->busstats.window_bits += bits;
+}
+
+/* Open addressed table, so a lookup is usually one probe */
+static scandal_busstats_node *busstats_node(u08 node, u08 insert){
+	u08 i, slot;
+
+	slot = (u08)(node * 157) % SCANDAL_BUSSTATS_NODES;
+	for(i=0; i<SCANDAL_BUSSTATS_NODES; i++){
+		scandal_busstats_node *n = &sc_self->busstats.nodes[slot];
+
+		if(n->used && n->node == node)
+			return n;
+		if(!n->used){
+			if(!insert)
+				return 0;
+			n->used = 1;
+			n->node = node;
+			return n;
+		}
+		if(++slot == SCANDAL_BUSSTATS_NODES)
+			slot = 0;
+	}
+
+	return 0;
+}
+
+void scandal_busstats_rx(can_msg *msg){
+	u08 class = busstats_class(msg);
+	scandal_busstats_node *n;
+
+	busstats_count(msg, class, BUSSTATS_RX);
+
+	if(class < SCANDAL_NUM_MSG_TYPES &&
+	   (BUSSTATS_SOURCE_TYPES & SCANDAL_MSG_TYPE_BIT(class))){
+		n = busstats_node((msg->id >> CHANNEL_SOURCE_ADDR_OFFSET) & 0xFF, 1);
+		if(n == 0){
+			sc_self->busstats.node_overflow++;
+			return;
+		}
+		n->rx.frames++;
+		n->rx.bytes += msg->length > CAN_MSG_MAXSIZE ? CAN_MSG_MAXSIZE : msg->length;
+	}
+}
+
+void scandal_busstats_tx(can_msg *msg){
+	busstats_count(msg, busstats_class(msg), BUSSTATS_TX);
+}
+
+static void busstats_task(void *arg){
+	u16 util;
+
+	util = (u16)((sc_self->busstats.window_bits * 1000UL) / BUSSTATS_WINDOW_BITS);
+	sc_self->busstats.window_bits = 0;
+
+	sc_self->busstats.util_last = util;
+	sc_self->busstats.util_smoothed = (u16)((3UL * sc_self->busstats.util_smoothed + util) / 4);
+	if(util > sc_self->busstats.util_max)
+		sc_self->busstats.util_max = util;
+}
+
+void scandal_get_busstats(scandal_busstats *stats){
+	*stats = sc_self->busstats;
+}
+
+void scandal_reset_busstats(void){
+	memset(&sc_self->busstats, 0, sizeof(sc_self->busstats));
+}
+
+u08 scandal_busstats_node_count(u08 node, scandal_busstats_count *count){
+	scandal_busstats_node *n = busstats_node(node, 0);
+
+	if(n == 0){
+		count->frames = 0;
+		count->bytes = 0;
+		return NO_MSG_ERR;
+	}
+
+	*count = n->rx;
+	return NO_ERR;
+}
+
+static void busstats_reply(u16 num, u08 dest, u32 first, u32 second){
+	can_msg msg;
+
+	msg.id = scandal_mk_command_id(NETWORK_LOW, dest, num + SCANDAL_COMMAND_REPLY);
+	msg.ext = CAN_EXT_MSG;
+	msg.length = 8;
+
+	msg.data[0] = (first >> 24) & 0xFF;
+	msg.data[1] = (first >> 16) & 0xFF;
+	msg.data[2] = (first >> 8) & 0xFF;
+	msg.data[3] = (first >> 0) & 0xFF;
+	msg.data[4] = (second >> 24) & 0xFF;
+	msg.data[5] = (second >> 16) & 0xFF;
+	msg.data[6] = (second >> 8) & 0xFF;
+	msg.data[7] = (second >> 0) & 0xFF;
+
+	can_send_msg(&msg, 1);
+}
+
+/* Answers the SCANDAL_CMD_BUSSTATS_* commands */
+void scandal_handle_busstats_command(u16 num, u08 *data){
+	scandal_busstats_count count;
+
+	switch(num){
+	case SCANDAL_CMD_BUSSTATS_CLASS:
+		if(data[0] >= BUSSTATS_NUM_CLASSES)
+			return;
+		count = sc_self->busstats.classes[data[0]][data[1] ? BUSSTATS_TX : BUSSTATS_RX];
+		busstats_reply(num, data[7], count.frames, count.bytes);
+		break;
+
+	case SCANDAL_CMD_BUSSTATS_NODE:
+		scandal_busstats_node_count(data[0], &count);
+		busstats_reply(num, data[7], count.frames, count.bytes);
+		break;
+
+	case SCANDAL_CMD_BUSSTATS_UTIL:
+		busstats_reply(num, data[7],
+			((u32)sc_self->busstats.util_last << 16) | sc_self->busstats.util_smoothed,
+			((u32)sc_self->busstats.util_max << 16) | (sc_self->busstats.node_overflow & 0xFFFF));
+		break;
+
+	case SCANDAL_CMD_BUSSTATS_RESET:
+		scandal_reset_busstats();
+		break;
+	}
+}
+
+#endif
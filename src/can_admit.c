@@ -0,0 +1,134 @@
+/* --------------------------------------------------------------------------
+	Scandal Receive Admission Set
+	File name: can_admit.c
+
+	Builds the Bloom filter the receive interrupt checks frames against.
+	See scandal/can_admit.h.
+   -------------------------------------------------------------------------- */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <scandal/types.h>
+#include <scandal/can.h>
+#include <scandal/can_filter.h>
+#include <scandal/can_admit.h>
+
+/* Only enabled is volatile, so nothing else stops the compiler moving the
+   rebuild's stores across the two writes to it. The receive interrupt runs
+   on this core, so keeping the compiler in order is enough */
+#define CAN_ADMIT_BARRIER()	__asm__ __volatile__("" ::: "memory")
+
+static u32 admit_mask(const can_filter *reg){
+	return reg->mask & (reg->ext == CAN_EXT_MSG ? CAN_ID_EXT_MASK : CAN_ID_STD_MASK);
+}
+
+static void admit_set(can_admit *admit, u32 key){
+	u32 h1 = key * 0x9E3779B1UL;
+	u32 h2 = (key * 0x85EBCA77UL) | 1;
+	u16 bit;
+	u08 i;
+
+	for(i=0; i<CAN_ADMIT_HASHES; i++){
+		bit = h1 >> (32 - CAN_ADMIT_LOG2_BITS);
+		admit->bits[bit >> 5] |= 1UL << (bit & 31);
+		h1 += h2;
+	}
+}
+
+void can_admit_build(can_admit *admit, const can_filter *regs, u16 count, u08 needed){
+	u32 mask[CAN_ADMIT_MAX_GROUPS + 1];
+	u08 ext[CAN_ADMIT_MAX_GROUPS + 1];
+	u16 members[CAN_ADMIT_MAX_GROUPS + 1];
+	u08 n = 0, g, h, bg = 0, bh = 0, shared;
+	u16 i, lost, best;
+
+	/* Admit everything while the set is rebuilt, in case the receive
+	   interrupt looks at it meanwhile */
+	admit->enabled = 0;
+	CAN_ADMIT_BARRIER();
+
+	/* One group per mask, until there are too many. Then two become one,
+	   caring only about the bits both did. Each bit a registration stops
+	   being checked on doubles the frames it lets through, so the pair
+	   chosen is the one losing the fewest bits over all their members */
+	for(i=0; i<count; i++){
+		for(g=0; g<n; g++)
+			if(ext[g] == regs[i].ext && mask[g] == admit_mask(&regs[i]))
+				break;
+		if(g < n){
+			members[g]++;
+			continue;
+		}
+
+		mask[n] = admit_mask(&regs[i]);
+		ext[n] = regs[i].ext;
+		members[n] = 1;
+		if(++n <= CAN_ADMIT_MAX_GROUPS)
+			continue;
+
+		best = 0xFFFF;
+		for(g=0; g<n; g++)
+			for(h=g+1; h<n; h++){
+				if(ext[g] != ext[h])
+					continue;
+				shared = __builtin_popcountl(mask[g] & mask[h]);
+				lost = members[g] * (__builtin_popcountl(mask[g]) - shared) +
+					members[h] * (__builtin_popcountl(mask[h]) - shared);
+				if(lost < best){
+					best = lost;
+					bg = g;
+					bh = h;
+				}
+			}
+		mask[bg] &= mask[bh];
+		members[bg] += members[bh];
+		n--;
+		mask[bh] = mask[n];
+		ext[bh] = ext[n];
+		members[bh] = members[n];
+	}
+
+	for(g=0; g<n; g++){
+		admit->mask[g] = mask[g];
+		admit->ext[g] = ext[g];
+	}
+	admit->num_groups = n;
+
+	for(i=0; i<CAN_ADMIT_BITS / 32; i++)
+		admit->bits[i] = 0;
+
+	/* Each registration goes in the first group whose mask it has every
+	   bit of, which there always is */
+	for(i=0; i<count; i++)
+		for(g=0; g<n; g++)
+			if(ext[g] == regs[i].ext && (mask[g] & ~admit_mask(&regs[i])) == 0){
+				admit_set(admit, can_admit_key(regs[i].id & mask[g], g));
+				break;
+			}
+
+	CAN_ADMIT_BARRIER();
+	admit->enabled = needed;
+}
+
+u16 can_admit_fill(const can_admit *admit){
+	u16 i, set = 0;
+
+	for(i=0; i<CAN_ADMIT_BITS / 32; i++)
+		set += __builtin_popcountl(admit->bits[i]);
+	return set;
+}
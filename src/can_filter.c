@@ -0,0 +1,639 @@
+/* --------------------------------------------------------------------------
+	Scandal Acceptance Filter Compiler
+	File name: can_filter.c
+
+	Turns a node's registrations into a controller's filters. See
+	scandal/can_filter.h.
+   -------------------------------------------------------------------------- */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <scandal/types.h>
+#include <scandal/can.h>
+#include <scandal/can_filter.h>
+
+/* Arbitration field layout: all 29 bits, and where a standard identifier
+   sits in them */
+#define ARB_BITS		0x1FFFFFFFUL
+#define ARB_STD_SHIFT		18
+#define ARB_STD_BITS		((u32)CAN_ID_STD_MASK << ARB_STD_SHIFT)
+
+/* What a filter lets in: traffic from the profile, and identifiers out of
+   CAN_FILTER_SPACE. Traffic is compared first, so with a profile the
+   identifier count only breaks ties. Deltas can be negative, when two
+   filters overlapped before they were merged */
+typedef struct filter_cost {
+	s64	traffic;
+	s64	space;
+} filter_cost;
+
+static u08 cost_less(filter_cost a, filter_cost b){
+	if(a.traffic != b.traffic)
+		return a.traffic < b.traffic;
+	return a.space < b.space;
+}
+
+static u08 popcount(u32 v){
+	return __builtin_popcountl(v);
+}
+
+static u32 profile_total(const can_filter_profile *profile){
+	u32 total = 0;
+	u16 i;
+
+	for(i=0; i<profile->count; i++)
+		total += profile->frames[i].rate;
+	return total;
+}
+
+/* -------------------------------------------------------------------------
+   Mask filters
+   ------------------------------------------------------------------------- */
+
+static can_hw_filter hw_from_reg(const can_filter *reg){
+	can_hw_filter f;
+
+	f.ext = reg->ext;
+	if(reg->ext == CAN_EXT_MSG){
+		f.mask = reg->mask & ARB_BITS;
+		f.id = reg->id & f.mask;
+	} else {
+		f.mask = (reg->mask & CAN_ID_STD_MASK) << ARB_STD_SHIFT;
+		f.id = ((reg->id & CAN_ID_STD_MASK) << ARB_STD_SHIFT) & f.mask;
+	}
+	return f;
+}
+
+/* A standard frame's bits 17 to 0 are taken as zero. Whether the C_CAN
+   compares them that way or ignores them, a filter built by hw_merge()
+   accepts the same standard frames */
+u08 can_hw_filter_match(const can_hw_filter *filter, u32 id, u08 ext){
+	u32 arb;
+
+	if(filter->ext != CAN_FILTER_ANY && filter->ext != ext)
+		return 0;
+
+	if(ext == CAN_EXT_MSG)
+		arb = id & ARB_BITS;
+	else
+		arb = (id & CAN_ID_STD_MASK) << ARB_STD_SHIFT;
+	return ((arb ^ filter->id) & filter->mask & ARB_BITS) == 0;
+}
+
+/* Identifiers let in. A standard frame only has the top 11 bits to
+   compare */
+static u64 hw_space(const can_hw_filter *f){
+	u64 space = 0;
+
+	if(f->ext != CAN_EXT_MSG)
+		space += (CAN_FILTER_SPACE / 2) >> popcount(f->mask & ARB_STD_BITS);
+	if(f->ext != CAN_STD_MSG)
+		space += (CAN_FILTER_SPACE / 2) >> popcount(f->mask & ARB_BITS);
+	return space;
+}
+
+static filter_cost hw_cost(const can_hw_filter *f, const can_filter_profile *profile){
+	filter_cost c;
+	u16 i;
+
+	c.traffic = 0;
+	c.space = hw_space(f);
+	if(profile)
+		for(i=0; i<profile->count; i++)
+			if(can_hw_filter_match(f, profile->frames[i].id, profile->frames[i].ext))
+				c.traffic += profile->frames[i].rate;
+	return c;
+}
+
+/* A standard filter wants bits 17 to 0 to be zero, so a merge with an
+   extended filter keeps the extended filter's zeros there */
+static u32 hw_care(const can_hw_filter *f){
+	if(f->ext == CAN_STD_MSG)
+		return f->mask | (ARB_BITS & ~ARB_STD_BITS);
+	return f->mask;
+}
+
+/* The smallest filter accepting everything a and b do */
+static can_hw_filter hw_merge(const can_hw_filter *a, const can_hw_filter *b){
+	can_hw_filter m;
+
+	m.ext = a->ext == b->ext ? a->ext : CAN_FILTER_ANY;
+	m.mask = hw_care(a) & hw_care(b) & ~(a->id ^ b->id) & ARB_BITS;
+	if(m.ext == CAN_STD_MSG)
+		m.mask &= ARB_STD_BITS;
+	m.id = a->id & m.mask;
+	return m;
+}
+
+/* Whether a already accepts everything b does */
+static u08 hw_covers(const can_hw_filter *a, const can_hw_filter *b){
+	can_hw_filter m = hw_merge(a, b);
+
+	return m.ext == a->ext && m.mask == a->mask && m.id == a->id;
+}
+
+/* Adds f to a list of n, dropping whatever it covers or whatever covers
+   it. Returns the new count */
+static u16 hw_add(can_hw_filter *list, u16 n, const can_hw_filter *f){
+	u16 i;
+
+	for(i=0; i<n; i++)
+		if(hw_covers(&list[i], f))
+			return n;
+
+	for(i=0; i<n; ){
+		if(hw_covers(f, &list[i]))
+			list[i] = list[--n];
+		else
+			i++;
+	}
+	list[n++] = *f;
+	return n;
+}
+
+static u16 hw_from_regs(const can_filter *regs, u16 count, can_hw_filter *out){
+	can_hw_filter f;
+	u16 i, n = 0;
+
+	for(i=0; i<count; i++){
+		f = hw_from_reg(&regs[i]);
+		n = hw_add(out, n, &f);
+	}
+	return n;
+}
+
+/* Merges the cheapest pair in a list of n, if any may be merged. Returns
+   the new count */
+static u16 hw_merge_cheapest(can_hw_filter *list, u16 n, u08 any_ext,
+			const can_filter_profile *profile){
+	filter_cost best, c, ca, cb;
+	can_hw_filter m, keep;
+	u16 i, j, bi = 0, bj = 0;
+	u08 found = 0;
+
+	best.traffic = best.space = 0;
+	for(i=0; i<n; i++){
+		ca = hw_cost(&list[i], profile);
+		for(j=i+1; j<n; j++){
+			if(!any_ext && list[i].ext != list[j].ext)
+				continue;
+			m = hw_merge(&list[i], &list[j]);
+			cb = hw_cost(&list[j], profile);
+			c = hw_cost(&m, profile);
+			c.traffic -= ca.traffic + cb.traffic;
+			c.space -= ca.space + cb.space;
+			if(!found || cost_less(c, best)){
+				best = c;
+				bi = i;
+				bj = j;
+				found = 1;
+			}
+		}
+	}
+	if(!found)
+		return n;
+
+	keep = hw_merge(&list[bi], &list[bj]);
+	list[bj] = list[--n];
+	list[bi] = list[--n];
+	return hw_add(list, n, &keep);
+}
+
+/* Traffic a set of filters lets in, counting overlaps once where there
+   is a profile. Without one only repeats are left out, as the overlaps
+   left after merging are small */
+static u64 hw_admitted(const can_hw_filter *list, u16 n, const can_filter_profile *profile){
+	u64 total = 0;
+	u16 i, j;
+
+	if(profile){
+		for(i=0; i<profile->count; i++)
+			for(j=0; j<n; j++)
+				if(can_hw_filter_match(&list[j], profile->frames[i].id,
+							profile->frames[i].ext)){
+					total += profile->frames[i].rate;
+					break;
+				}
+		return total;
+	}
+
+	for(j=0; j<n; j++){
+		for(i=0; i<j; i++)
+			if(hw_covers(&list[i], &list[j]))
+				break;
+		if(i == j)
+			total += hw_space(&list[j]);
+	}
+	return total < CAN_FILTER_SPACE ? total : CAN_FILTER_SPACE;
+}
+
+static void report_start(can_filter_report *report, const can_hw_filter *wanted, u16 n,
+			const can_filter_profile *profile){
+	report->wanted = hw_admitted(wanted, n, profile);
+	report->total = profile ? profile_total(profile) : CAN_FILTER_SPACE;
+}
+
+u16 can_filter_add(can_filter *list, u16 count, u16 max, const can_filter *reg){
+	can_hw_filter hw[CAN_FILTER_MAX_REGS + 1], f;
+	can_filter r = *reg;
+	u16 i, n;
+
+	r.id &= r.mask;
+	f = hw_from_reg(&r);
+	for(i=0; i<count; i++){
+		hw[i] = hw_from_reg(&list[i]);
+		if(hw_covers(&hw[i], &f))
+			return count;
+	}
+
+	for(i=0; i<count; ){
+		if(hw_covers(&f, &hw[i])){
+			list[i] = list[--count];
+			hw[i] = hw[count];
+		} else
+			i++;
+	}
+	if(count < max){
+		list[count] = r;
+		return count + 1;
+	}
+
+	/* Full. Merge the closest pair, in the registration layout */
+	hw[count] = f;
+	n = hw_merge_cheapest(hw, count + 1, 0, 0);
+	for(i=0; i<n; i++){
+		list[i].ext = hw[i].ext;
+		if(hw[i].ext == CAN_EXT_MSG){
+			list[i].mask = hw[i].mask;
+			list[i].id = hw[i].id;
+		} else {
+			list[i].mask = hw[i].mask >> ARB_STD_SHIFT;
+			list[i].id = hw[i].id >> ARB_STD_SHIFT;
+		}
+	}
+	return n;
+}
+
+u16 can_filter_compile_objects(const can_filter *regs, u16 count,
+			can_hw_filter *out, u16 max, u08 any_ext,
+			const can_filter_profile *profile, can_filter_report *report){
+	u16 n, was;
+
+	n = hw_from_regs(regs, count, out);
+	if(report)
+		report_start(report, out, n, profile);
+
+	while(n > max){
+		was = n;
+		n = hw_merge_cheapest(out, n, any_ext, profile);
+		if(n == was)
+			break;
+	}
+
+	if(report){
+		report->filters = n;
+		report->admitted = hw_admitted(out, n, profile);
+	}
+	return n;
+}
+
+/* -------------------------------------------------------------------------
+   MCP2510: two masks, the first shared by two filters and the second by
+   four. Registrations are merged down to at most six, and every way of
+   splitting them between the masks tried, at each step on the way down
+   to one, keeping the cheapest
+   ------------------------------------------------------------------------- */
+
+static u08 mcp_group(const can_hw_filter *list, u08 n, u08 set,
+			can_hw_filter *filters, u32 *mask){
+	u32 m = ARB_BITS;
+	u08 i, k = 0;
+
+	for(i=0; i<n; i++)
+		if(set & (1 << i))
+			m &= hw_care(&list[i]);
+
+	for(i=0; i<n; i++)
+		if(set & (1 << i)){
+			filters[k].ext = list[i].ext;
+			filters[k].mask = list[i].ext == CAN_STD_MSG ? m & ARB_STD_BITS : m;
+			filters[k].id = list[i].id & m;
+			k++;
+		}
+	*mask = m;
+	return k;
+}
+
+static u08 mcp_distinct(const can_hw_filter *filters, u08 n){
+	u08 i, j, d = 0;
+
+	for(i=0; i<n; i++){
+		for(j=0; j<i; j++)
+			if(hw_covers(&filters[j], &filters[i]) && hw_covers(&filters[i], &filters[j]))
+				break;
+		if(j == i)
+			d++;
+	}
+	return d;
+}
+
+static void mcp_fill(can_hw_filter *filters, u08 used, u08 size,
+			const can_hw_filter *other, u08 other_used){
+	u08 i;
+
+	for(i=used; i<size; i++)
+		filters[i] = used ? filters[0] : other[i % other_used];
+}
+
+/* Tries every split of n filters, keeping any cheaper than best */
+static void mcp_splits(const can_hw_filter *list, u08 n, const can_filter_profile *profile,
+			can_filter_mcp2510 *best, filter_cost *best_cost, u08 *found){
+	can_hw_filter f[6];
+	filter_cost c, fc;
+	u32 mask[2];
+	u08 set, a, b, i;
+
+	for(set=0; set < (1 << n); set++){
+		a = popcount(set);
+		if(a > 2 || n - a > 4)
+			continue;
+
+		a = mcp_group(list, n, set, &f[0], &mask[0]);
+		b = mcp_group(list, n, ~set & ((1 << n) - 1), &f[2], &mask[1]);
+		if(a == 0)
+			mask[0] = mask[1];
+		if(b == 0)
+			mask[1] = mask[0];
+
+		c.traffic = c.space = 0;
+		for(i=0; i<a; i++){
+			fc = hw_cost(&f[i], profile);
+			c.traffic += fc.traffic;
+			c.space += fc.space;
+		}
+		for(i=0; i<b; i++){
+			fc = hw_cost(&f[2 + i], profile);
+			c.traffic += fc.traffic;
+			c.space += fc.space;
+		}
+		if(*found && !cost_less(c, *best_cost))
+			continue;
+
+		mcp_fill(&f[0], a, 2, &f[2], b);
+		mcp_fill(&f[2], b, 4, &f[0], a);
+		best->mask[0] = mask[0];
+		best->mask[1] = mask[1];
+		for(i=0; i<6; i++)
+			best->filter[i] = f[i];
+		*best_cost = c;
+		*found = 1;
+	}
+}
+
+u08 can_filter_compile_mcp2510(const can_filter *regs, u16 count,
+			can_filter_mcp2510 *out,
+			const can_filter_profile *profile, can_filter_report *report){
+	can_hw_filter list[CAN_FILTER_MAX_REGS];
+	filter_cost best_cost;
+	u16 n, was;
+	u08 found = 0;
+
+	if(count == 0 || count > CAN_FILTER_MAX_REGS)
+		return 0;
+
+	n = hw_from_regs(regs, count, list);
+	if(report)
+		report_start(report, list, n, profile);
+
+	best_cost.traffic = best_cost.space = 0;
+	for(;;){
+		if(n <= 6)
+			mcp_splits(list, n, profile, out, &best_cost, &found);
+		if(n == 1)
+			break;
+		was = n;
+		n = hw_merge_cheapest(list, n, 0, profile);
+		if(n == was)
+			break;
+	}
+
+	n = mcp_distinct(out->filter, 6);
+	if(report){
+		report->filters = n;
+		report->admitted = hw_admitted(out->filter, 6, profile);
+	}
+	return n;
+}
+
+/* -------------------------------------------------------------------------
+   Lookup table ranges
+   ------------------------------------------------------------------------- */
+
+u08 can_filter_range_match(const can_filter_range *range, u32 id, u08 ext){
+	return range->ext == ext && id >= range->lo && id <= range->hi;
+}
+
+static u64 range_unit(u08 ext){
+	return ext == CAN_EXT_MSG ? (CAN_FILTER_SPACE / 2) >> 29 : (CAN_FILTER_SPACE / 2) >> 11;
+}
+
+static u08 range_words(const can_filter_range *r){
+	return r->ext == CAN_EXT_MSG && r->lo != r->hi ? 2 : 1;
+}
+
+/* What filling the gap between a and the next range b lets in */
+static filter_cost range_gap(const can_filter_range *a, const can_filter_range *b,
+			const can_filter_profile *profile){
+	filter_cost c;
+	u16 i;
+
+	c.traffic = 0;
+	c.space = (s64)(b->lo - a->hi - 1) * range_unit(a->ext);
+	if(profile)
+		for(i=0; i<profile->count; i++)
+			if(profile->frames[i].ext == a->ext && profile->frames[i].id > a->hi
+					&& profile->frames[i].id < b->lo)
+				c.traffic += profile->frames[i].rate;
+	return c;
+}
+
+static u16 range_join(can_filter_range *list, u16 n, u16 i){
+	u16 j;
+
+	if(list[i + 1].hi > list[i].hi)
+		list[i].hi = list[i + 1].hi;
+	for(j=i+1; j<n-1; j++)
+		list[j] = list[j + 1];
+	return n - 1;
+}
+
+/* Inserts a range into a sorted list, joining it to any it overlaps or
+   touches */
+static u16 range_insert(can_filter_range *list, u16 n, const can_filter_range *r){
+	u16 i, j;
+
+	for(i=0; i<n; i++)
+		if(list[i].ext > r->ext || (list[i].ext == r->ext && list[i].lo > r->lo))
+			break;
+	for(j=n; j>i; j--)
+		list[j] = list[j - 1];
+	list[i] = *r;
+	n++;
+
+	if(i > 0 && list[i - 1].ext == r->ext && list[i - 1].hi + 1 >= r->lo)
+		n = range_join(list, n, --i);
+	while(i + 1 < n && list[i + 1].ext == r->ext && list[i].hi + 1 >= list[i + 1].lo)
+		n = range_join(list, n, i);
+	return n;
+}
+
+static u16 range_count_words(const can_filter_range *list, u16 n){
+	u16 i, words = 0;
+
+	for(i=0; i<n; i++)
+		words += range_words(&list[i]);
+	return words;
+}
+
+/* Joins the cheapest pair of neighbours. Short of words, only joins which
+   save one count, unless there are none. Returns the new count */
+static u16 range_merge_cheapest(can_filter_range *list, u16 n, u08 need_words,
+			const can_filter_profile *profile){
+	filter_cost best, c;
+	can_filter_range m;
+	u16 i, bi = 0;
+	u08 found = 0, pass;
+
+	best.traffic = best.space = 0;
+	for(pass=0; pass<2 && !found; pass++){
+		for(i=0; i+1<n; i++){
+			if(list[i].ext != list[i + 1].ext)
+				continue;
+			if(need_words && pass == 0){
+				m = list[i];
+				m.hi = list[i + 1].hi;
+				if(range_words(&m) >= range_words(&list[i]) + range_words(&list[i + 1]))
+					continue;
+			}
+			c = range_gap(&list[i], &list[i + 1], profile);
+			if(!found || cost_less(c, best)){
+				best = c;
+				bi = i;
+				found = 1;
+			}
+		}
+	}
+	if(!found)
+		return n;
+	return range_join(list, n, bi);
+}
+
+static u16 range_fit(can_filter_range *list, u16 n, u16 max, u16 words,
+			const can_filter_profile *profile){
+	u16 was;
+	u08 need_words;
+
+	for(;;){
+		need_words = range_count_words(list, n) > words;
+		if(n <= max && !need_words)
+			return n;
+		was = n;
+		n = range_merge_cheapest(list, n, need_words && n <= max, profile);
+		if(n == was)
+			return n;
+	}
+}
+
+static u64 range_admitted(const can_filter_range *list, u16 n, const can_filter_profile *profile){
+	u64 total = 0;
+	u16 i, j;
+
+	if(profile){
+		for(i=0; i<profile->count; i++)
+			for(j=0; j<n; j++)
+				if(can_filter_range_match(&list[j], profile->frames[i].id,
+							profile->frames[i].ext)){
+					total += profile->frames[i].rate;
+					break;
+				}
+		return total;
+	}
+
+	for(j=0; j<n; j++)
+		total += (u64)(list[j].hi - list[j].lo + 1) * range_unit(list[j].ext);
+	return total;
+}
+
+u16 can_filter_compile_aflut(const can_filter *regs, u16 count,
+			can_filter_range *out, u16 max, u16 words,
+			const can_filter_profile *profile, can_filter_report *report){
+	can_hw_filter list[CAN_FILTER_MAX_REGS];
+	can_filter_range r;
+	u32 width, mask, id, below, split, sub;
+	u16 i, n = 0, nregs;
+	u08 low;
+
+	if(count > CAN_FILTER_MAX_REGS)
+		return 0;
+
+	/* Overlapping registrations would just make the same ranges twice */
+	nregs = hw_from_regs(regs, count, list);
+	if(report)
+		report_start(report, list, nregs, profile);
+
+	for(i=0; i<nregs; i++){
+		r.ext = list[i].ext;
+		if(r.ext == CAN_EXT_MSG){
+			width = ARB_BITS;
+			mask = list[i].mask;
+			id = list[i].id;
+		} else {
+			width = CAN_ID_STD_MASK;
+			mask = list[i].mask >> ARB_STD_SHIFT;
+			id = list[i].id >> ARB_STD_SHIFT;
+		}
+
+		/* The don't care bits below the lowest care bit make a range.
+		   Each one above doubles the ranges, so past a few give up
+		   the lowest care bits instead */
+		for(;;){
+			low = mask ? __builtin_ctzl(mask) : popcount(width);
+			below = (1UL << low) - 1;
+			split = ~mask & width & ~below;
+			if(popcount(split) <= CAN_FILTER_MAX_SPLIT_BITS)
+				break;
+			mask &= ~((2UL << __builtin_ctzl(split)) - 1);
+		}
+		id &= mask;
+
+		sub = 0;
+		do {
+			r.lo = id | sub;
+			r.hi = r.lo | below;
+			n = range_insert(out, n, &r);
+			n = range_fit(out, n, max, words, profile);
+			sub = (sub - split) & split;
+		} while(sub);
+	}
+
+	if(report){
+		report->filters = n;
+		report->admitted = range_admitted(out, n, profile);
+	}
+	return n;
+}
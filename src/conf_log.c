@@ -0,0 +1,300 @@
+/* --------------------------------------------------------------------------
+	Scandal Config Log
+	File name: conf_log.c
+
+	Journal of config changes in the config flash. See scandal/conf_log.h.
+   -------------------------------------------------------------------------- */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <scandal/types.h>
+#include <scandal/conf_log.h>
+#include <scandal/context.h>
+
+#include <arch/flash.h>
+
+#include <string.h>
+
+/* Only archs with a backend define the geometry. The LPC1768's flash
+   driver is still a stub, so it has no log */
+#ifdef SC_CONF_BANKS
+
+#define LOG_VERSION	1
+
+#define HDR_SIZE	8
+#define REC_HDR		4	/* tag, length, offset */
+#define REC_CRC		2
+
+#define UNITS(n)	(((n) + SC_CONF_WRITE_UNIT - 1) / SC_CONF_WRITE_UNIT * SC_CONF_WRITE_UNIT)
+#define REC_SIZE(len)	UNITS(REC_HDR + (len) + REC_CRC)
+#define FIRST_REC	UNITS(HDR_SIZE)
+
+/* A change this close to the last one goes in the same record, as a new
+   record would cost more than the unchanged bytes between them */
+#define REC_GAP		(REC_HDR + REC_CRC)
+
+/* Compaction writes the whole image, which must fit in a bank */
+#define IMAGE_RECS	(CONF_LOG_IMAGE_SIZE / CONF_LOG_MAX_DATA * REC_SIZE(CONF_LOG_MAX_DATA) + \
+			(CONF_LOG_IMAGE_SIZE % CONF_LOG_MAX_DATA ? REC_SIZE(CONF_LOG_IMAGE_SIZE % CONF_LOG_MAX_DATA) : 0))
+typedef char conf_log_fits[FIRST_REC + IMAGE_RECS <= SC_CONF_BANK_SIZE ? 1 : -1];
+
+/* CRC-16/CCITT */
+static u16 crc16(u16 crc, const u08 *data, u16 length){
+	u08 i;
+
+	while(length--){
+		crc ^= (u16)*data++ << 8;
+		for(i=0; i<8; i++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+static u16 get16(const u08 *p){
+	return p[0] | ((u16)p[1] << 8);
+}
+
+static void put16(u08 *p, u16 value){
+	p[0] = value & 0xFF;
+	p[1] = value >> 8;
+}
+
+static u08 header_valid(const u08 *bank){
+	return bank[0] == 'S' && bank[1] == 'C' && bank[2] == 'L' && bank[3] == LOG_VERSION &&
+		get16(&bank[6]) == crc16(0xFFFF, bank, 6);
+}
+
+/* The size of the record at pos, or 0 if it isn't a whole, valid one */
+static u16 record_valid(const u08 *bank, u16 pos){
+	u08 len;
+
+	if(pos + REC_HDR > SC_CONF_BANK_SIZE)
+		return 0;
+	if(bank[pos] != CONF_LOG_END && bank[pos] != CONF_LOG_MORE)
+		return 0;
+	len = bank[pos + 1];
+	if(len == 0 || len > CONF_LOG_MAX_DATA || pos + REC_SIZE(len) > SC_CONF_BANK_SIZE)
+		return 0;
+	if(get16(&bank[pos + 2]) + len > CONF_LOG_IMAGE_SIZE)
+		return 0;
+	if(get16(&bank[pos + REC_HDR + len]) != crc16(0xFFFF, &bank[pos], REC_HDR + len))
+		return 0;
+	return REC_SIZE(len);
+}
+
+static void append(u08 tag, u16 offset, const u08 *data, u08 len){
+	u08 rec[REC_SIZE(CONF_LOG_MAX_DATA)];
+	u16 size = REC_SIZE(len);
+
+	memset(rec, 0xFF, size);
+	rec[0] = tag;
+	rec[1] = len;
+	put16(&rec[2], offset);
+	memcpy(&rec[REC_HDR], data, len);
+	put16(&rec[REC_HDR + len], crc16(0xFFFF, rec, REC_HDR + len));
+
+	sc_conf_bank_write(sc_self->conf_log.bank, sc_self->conf_log.end, rec, size);
+	sc_self->conf_log.end += size;
+	sc_self->conf_log.records++;
+}
+
+/* The next run of bytes from *pos that differ from the image, taking in
+   gaps of up to REC_GAP unchanged bytes. Returns its length, 0 when there
+   are no more, and leaves *pos at its start */
+static u16 next_run(u16 offset, const u08 *data, u16 length, u16 *pos){
+	u16 start, end, gap;
+
+	while(*pos < length && data[*pos] == sc_self->conf_log.image[offset + *pos])
+		(*pos)++;
+	if(*pos == length)
+		return 0;
+
+	start = end = *pos;
+	for(gap = 0; end + gap < length && gap <= REC_GAP; ){
+		if(data[end + gap] != sc_self->conf_log.image[offset + end + gap]){
+			end += gap + 1;
+			gap = 0;
+		} else {
+			gap++;
+		}
+	}
+	return end - start;
+}
+
+#ifdef SC_USER_STORE_LEGACY_BANK
+/* A bank the log has had starts with a header, or is erased where the
+   header goes if compacting into it was cut short. Anything else there is
+   the user storage from before the log. What was written past what the
+   user storage now holds is lost, and counted */
+static void mount_legacy_user(void){
+	const u08 *bank = sc_conf_bank(SC_USER_STORE_LEGACY_BANK);
+	u16 i;
+
+	for(i=0; i<SC_USER_STORE_SIZE; i++)
+		if(sc_self->conf_log.image[CONF_LOG_USER_OFFSET + i] != 0xFF)
+			return;
+	if(header_valid(bank))
+		return;
+	for(i=0; i<FIRST_REC && bank[i] == 0xFF; i++)
+		;
+	if(i == FIRST_REC)
+		return;
+
+	memcpy(&sc_self->conf_log.image[CONF_LOG_USER_OFFSET], bank, SC_USER_STORE_SIZE);
+	for(i=SC_USER_STORE_SIZE; i<SC_USER_STORE_LEGACY_SIZE; i++)
+		if(bank[i] != 0xFF)
+			sc_self->conf_log.legacy_lost++;
+}
+#endif
+
+/* Writes the whole image to the next bank, and its header after it */
+static void compact(void){
+	u08 hdr[UNITS(HDR_SIZE)];
+	u16 pos, len, last = CONF_LOG_IMAGE_SIZE;
+
+	sc_self->conf_log.bank = (sc_self->conf_log.bank + 1) % SC_CONF_BANKS;
+	sc_self->conf_log.seq++;
+	sc_self->conf_log.end = FIRST_REC;
+	sc_self->conf_log.compactions++;
+	sc_conf_bank_erase(sc_self->conf_log.bank);
+
+	/* Erased bytes in the image are what mounting starts from, so they
+	   needn't be written */
+	while(last > 0 && sc_self->conf_log.image[last - 1] == 0xFF)
+		last--;
+	for(pos = 0; pos < last; pos += len){
+		len = last - pos > CONF_LOG_MAX_DATA ? CONF_LOG_MAX_DATA : last - pos;
+		append(pos + len < last ? CONF_LOG_MORE : CONF_LOG_END, pos, &sc_self->conf_log.image[pos], len);
+	}
+
+	memset(hdr, 0xFF, sizeof(hdr));
+	hdr[0] = 'S';
+	hdr[1] = 'C';
+	hdr[2] = 'L';
+	hdr[3] = LOG_VERSION;
+	put16(&hdr[4], sc_self->conf_log.seq);
+	put16(&hdr[6], crc16(0xFFFF, hdr, 6));
+	sc_conf_bank_write(sc_self->conf_log.bank, 0, hdr, sizeof(hdr));
+}
+
+void sc_conf_log_mount(void){
+	const u08 *bank;
+	u16 pos, end, size;
+	u08 b, found = 0;
+
+	memset(sc_self->conf_log.image, 0xFF, CONF_LOG_IMAGE_SIZE);
+	sc_self->conf_log.records = 0;
+	sc_self->conf_log.compactions = 0;
+	sc_self->conf_log.legacy_lost = 0;
+
+	for(b=0; b<SC_CONF_BANKS; b++){
+		bank = sc_conf_bank(b);
+		if(!header_valid(bank))
+			continue;
+		if(!found || (s16)(get16(&bank[4]) - sc_self->conf_log.seq) > 0){
+			sc_self->conf_log.bank = b;
+			sc_self->conf_log.seq = get16(&bank[4]);
+			found = 1;
+		}
+	}
+
+	if(!found){
+		/* From before the log, or never written. Either way the next
+		   write starts a log in the bank after bank 0, so that the old
+		   config stays where it is until the new bank is valid */
+		memcpy(sc_self->conf_log.image, sc_conf_bank(0), sizeof(scandal_config));
+		sc_self->conf_log.bank = 0;
+		sc_self->conf_log.seq = 0;
+		sc_self->conf_log.end = SC_CONF_BANK_SIZE;
+#ifdef SC_USER_STORE_LEGACY_BANK
+		mount_legacy_user();
+#endif
+		return;
+	}
+
+	/* Apply each write whose records all made it, stopping at the first
+	   that didn't */
+	bank = sc_conf_bank(sc_self->conf_log.bank);
+	for(pos = FIRST_REC; ; pos = end){
+		for(end = pos; (size = record_valid(bank, end)) != 0; ){
+			end += size;
+			if(bank[end - size] == CONF_LOG_END)
+				break;
+		}
+		if(size == 0)
+			break;
+		for(; pos < end; pos += REC_SIZE(bank[pos + 1]))
+			memcpy(&sc_self->conf_log.image[get16(&bank[pos + 2])], &bank[pos + REC_HDR], bank[pos + 1]);
+	}
+
+	/* Anything but erased flash after that was a write cut short, and
+	   can't be written over until the bank is compacted */
+	sc_self->conf_log.end = pos;
+	for(; pos < SC_CONF_BANK_SIZE; pos++)
+		if(bank[pos] != 0xFF){
+			sc_self->conf_log.end = SC_CONF_BANK_SIZE;
+			break;
+		}
+
+#ifdef SC_USER_STORE_LEGACY_BANK
+	mount_legacy_user();
+#endif
+}
+
+void sc_conf_log_read(u16 offset, void *data, u16 length){
+	memcpy(data, &sc_self->conf_log.image[offset], length);
+}
+
+void sc_conf_log_write(u16 offset, const void *data, u16 length){
+	const u08 *d = data;
+	u16 pos, len, next, nlen, need = 0;
+
+	for(pos = 0; (len = next_run(offset, d, length, &pos)) != 0; pos += len)
+		need += (len / CONF_LOG_MAX_DATA) * REC_SIZE(CONF_LOG_MAX_DATA) +
+			(len % CONF_LOG_MAX_DATA ? REC_SIZE(len % CONF_LOG_MAX_DATA) : 0);
+	if(need == 0)
+		return;
+
+	if(sc_self->conf_log.end + need > SC_CONF_BANK_SIZE){
+		memcpy(&sc_self->conf_log.image[offset], d, length);
+		compact();
+		return;
+	}
+
+	/* Each record is tagged with whether there's another after it, so
+	   look one run ahead */
+	pos = 0;
+	len = next_run(offset, d, length, &pos);
+	while(len != 0){
+		if(len > CONF_LOG_MAX_DATA){
+			append(CONF_LOG_MORE, offset + pos, &d[pos], CONF_LOG_MAX_DATA);
+			pos += CONF_LOG_MAX_DATA;
+			len -= CONF_LOG_MAX_DATA;
+			continue;
+		}
+		next = pos + len;
+		nlen = next_run(offset, d, length, &next);
+		append(nlen ? CONF_LOG_MORE : CONF_LOG_END, offset + pos, &d[pos], len);
+		pos = next;
+		len = nlen;
+	}
+
+	memcpy(&sc_self->conf_log.image[offset], d, length);
+}
+
+#endif
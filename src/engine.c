@@ -41,31 +41,89 @@
 #include <scandal/utils.h>
 #include <scandal/wavesculptor.h>
 #include <scandal/system.h>
-
-
-
-in_channel                  in_channels[NUM_IN_CHANNELS];
-in_channel_handler          in_channel_handlers[NUM_IN_CHANNELS];
-standard_message_handler    user_std_msg_handler;
-uint32_t                    user_std_msg_handler_set = 0;
-
-scandal_config  my_config;
-volatile u32    heartbeat_timer;
-uint64_t        timesync_offset; 
+#include <scandal/freshness.h>
+#include <scandal/scheduler.h>
+#include <scandal/publisher.h>
+#include <scandal/packed.h>
+#include <scandal/busstats.h>
+#include <scandal/latency.h>
+#include <scandal/context.h>
+
+#include <string.h>
+
+scandal_engine	scandal_default_engine = {
+	.user_msg_types = SCANDAL_USER_MESSAGE_TYPES,
+};
+
+#if SCANDAL_MULTI_ENGINE
+SCANDAL_NODE_LOCAL scandal_engine *scandal_current_engine = &scandal_default_engine;
+#endif
 
 /* Local Prototypes */
 void            do_first_run(void);
 static void 	scandal_handle_channel_overrides();
 
+static u16      scandal_drain_messages(u16 max_frames, sc_utime_t budget_us);
 u08             handle_ext_message(can_msg*	msg);
 u08             handle_std_message(can_msg*	msg);
 inline u08      scandal_handle_channel(can_msg* msg);
+inline u08      scandal_handle_packed_channel(can_msg* msg);
 inline u08      scandal_handle_config(can_msg* msg);
 inline u08      scandal_handle_reset(can_msg* msg);
 inline u08      scandal_handle_user_config(can_msg* msg);
 inline u08      scandal_handle_command(can_msg* msg);
 inline u08      scandal_handle_timesync(can_msg* msg);
 
+static void     scandal_build_in_channel_index(void);
+static void     scandal_in_channel_moved(u16 num);
+static void     scandal_commit_config(void);
+static void     scandal_abort_config(void);
+static void     scandal_end_config_session(void);
+static void     scandal_config_session_task(void *arg);
+static void     scandal_update_in_channels(u08 node, u16 num, s32 value, u32 time,
+				sc_time_t rcvd_time, sc_utime_t rcvd_us);
+static void     scandal_heartbeat_task(void *arg);
+#if SC_USER_STORE_SIZE > 0 && SC_USER_STORE_FLUSH_DELAY > 0
+static void     scandal_user_store_task(void *arg);
+#endif
+
+/* Built-in handlers for extended messages, indexed by message type. Types
+   that are compiled out with the DISABLE_*_MESSAGES flags, or that the engine
+   has nothing to do with (heartbeats and errors), have no entry, and the
+   table is only as long as the highest type that remains. */
+#if !DISABLE_PACKED_MESSAGES
+#define SCANDAL_EXT_HANDLERS_SIZE	(PACKED24_TYPE + 1)
+#elif !DISABLE_TIMESYNC_MESSAGES
+#define SCANDAL_EXT_HANDLERS_SIZE	(TIMESYNC_TYPE + 1)
+#elif !DISABLE_COMMAND_MESSAGES
+#define SCANDAL_EXT_HANDLERS_SIZE	(COMMAND_TYPE + 1)
+#elif !DISABLE_USER_CONFIG_MESSAGES
+#define SCANDAL_EXT_HANDLERS_SIZE	(USER_CONFIG_TYPE + 1)
+#else
+#define SCANDAL_EXT_HANDLERS_SIZE	(RESET_TYPE + 1)
+#endif
+
+static const ext_message_handler scandal_ext_handlers[SCANDAL_EXT_HANDLERS_SIZE] = {
+	[CHANNEL_TYPE]		= scandal_handle_channel,
+#if !DISABLE_CONFIG_MESSAGES
+	[CONFIG_TYPE]		= scandal_handle_config,
+#endif
+	[RESET_TYPE]		= scandal_handle_reset,
+#if !DISABLE_USER_CONFIG_MESSAGES
+	[USER_CONFIG_TYPE]	= scandal_handle_user_config,
+#endif
+#if !DISABLE_COMMAND_MESSAGES
+	[COMMAND_TYPE]		= scandal_handle_command,
+#endif
+#if !DISABLE_TIMESYNC_MESSAGES
+	[TIMESYNC_TYPE]		= scandal_handle_timesync,
+#endif
+#if !DISABLE_PACKED_MESSAGES
+	[PACKED16_TYPE]		= scandal_handle_packed_channel,
+	[PACKED24_TYPE]		= scandal_handle_packed_channel,
+#endif
+};
+
 void            set_channel_mb(u16 chan_num, s32 m, s32 b);
 void            retrieve_channel_mb(u16 chan_num);
 
@@ -74,10 +132,44 @@ u08             scandal_get_msg_priority(can_msg *msg);
 
 
 /* Functions */
+
+/* Gets an engine ready for its first scandal_init(). Only needed for
+   engines other than the default one */
+void scandal_engine_setup(scandal_engine *engine, void *owner){
+	memset(engine, 0, sizeof(scandal_engine));
+	engine->user_msg_types = SCANDAL_USER_MESSAGE_TYPES;
+	engine->owner = owner;
+}
+
+scandal_engine *scandal_get_engine(void){
+	return sc_self;
+}
+
+void *scandal_get_engine_owner(void){
+	return sc_self->owner;
+}
+
+#if SCANDAL_MULTI_ENGINE
+/* Makes engine the one the rest of the API acts on, for this thread */
+void scandal_select_engine(scandal_engine *engine){
+	scandal_current_engine = engine;
+}
+
+u08 scandal_engine_init(scandal_engine *engine){
+	scandal_current_engine = engine;
+	return scandal_init();
+}
+
+u16 scandal_engine_handle(scandal_engine *engine, u16 max_frames, sc_utime_t budget_us){
+	scandal_current_engine = engine;
+	return handle_scandal_drain(max_frames, budget_us);
+}
+#endif
+
 u08 scandal_init(void){
 	u16 i;
 
-	timesync_offset = 0; 
+	sc_self->timesync_offset = 0; 
     
 #if !DISABLE_WATCHDOG_TIMER
     /* Initialising the WDT with either user defined period or the default of 5000ms
@@ -90,35 +182,63 @@ u08 scandal_init(void){
 	sc_init_timer();
 	sc_init_eeprom();
 
-	scandal_delay(100);
+	scandal_delay(SCANDAL_INIT_DELAY);
 
 	/* Initialise the local address
 		determine if this is first run or not */
 
-	sc_read_conf(&my_config);
+	sc_read_conf(&sc_self->my_config);
 
-	if(my_config.version != SCANDAL_VERSION)
+	if(sc_self->my_config.version != SCANDAL_VERSION)
                do_first_run();
 	
     /* Handle channel overrides from scandal configuration */
 	scandal_handle_channel_overrides();
+	scandal_build_in_channel_index();
+	scandal_init_freshness();
+	sc_self->config_session = 0;
+	sc_self->config_staged_addr = sc_self->my_config.addr;
 
 	/* Set up infrastructure for the in-channels */
 	for(i=0; i<NUM_IN_CHANNELS; i++){
 		/* Zero out the in_channel's value and time */
-		in_channels[i].value = 0;
-		in_channels[i].rcvd_time = 0;
-		in_channels[i].time = 0;
-		in_channel_handlers[i] = 0;
+		sc_self->in_channels[i].value = 0;
+		sc_self->in_channels[i].rcvd_time = 0;
+		sc_self->in_channels[i].rcvd_us = 0;
+		sc_self->in_channels[i].time = 0;
+		sc_self->in_channel_handlers[i] = 0;
+		sc_self->in_channel_timed_handlers[i] = 0;
 		/* Register the ID */
-		u32 id = scandal_mk_channel_id(0, my_config.ins[i].source_node,
-								my_config.ins[i].source_num);
+		u32 id = scandal_mk_channel_id(0, sc_self->my_config.ins[i].source_node,
+								sc_self->my_config.ins[i].source_num);
 		can_register_id(0x03FFFFFF,
 				id,
 				0,
 				CAN_EXT_MSG);
 	}
 
+#if !DISABLE_PACKED_MESSAGES
+	/* Register for packed channels, once for each node we take channels
+	   from. The mask takes both packed types and any channel number */
+	for(i=0; i<NUM_IN_CHANNELS; i++){
+		u16 j;
+		u08 node = sc_self->my_config.ins[i].source_node;
+
+		if(node == 0)
+			continue;
+		for(j=0; j<i; j++)
+			if(sc_self->my_config.ins[j].source_node == node)
+				break;
+		if(j != i)
+			continue;
+
+		can_register_id(PACKED_TYPE_MASK | (0xFFUL << CHANNEL_SOURCE_ADDR_OFFSET),
+				scandal_mk_packed_id(0, PACKED16_TYPE, node, 0),
+				0,
+				CAN_EXT_MSG);
+	}
+#endif
+
 #if !DISABLE_CONFIG_MESSAGES
 	/* Register for my config messages */
 	can_register_id(0x03FFFF00,
@@ -141,13 +261,28 @@ u08 scandal_init(void){
 #endif
 
 #if !DISABLE_COMMAND_MESSAGES
-	/* Register for command messages */ 
-	can_register_id(0x03FFFF00, 
+	/* Register for command messages, all 10 bits of command number */ 
+	can_register_id(0x03FFFC00, 
 			scandal_mk_command_id(CRITICAL_PRIORITY, scandal_get_addr(), 0), 
 			0, CAN_EXT_MSG); 
 #endif
 
-	heartbeat_timer = 0;
+	/* The heartbeat is just another periodic task */
+	scandal_init_scheduler();
+	sc_self->heartbeat_task = scandal_add_task(scandal_heartbeat_task, 0,
+				HEARTBEAT_PERIOD, HEARTBEAT_PERIOD, 0);
+#if SC_USER_STORE_SIZE > 0 && SC_USER_STORE_FLUSH_DELAY > 0
+	scandal_add_task(scandal_user_store_task, 0,
+			SC_USER_STORE_FLUSH_DELAY, SC_USER_STORE_FLUSH_DELAY, 0);
+#endif
+	scandal_init_publisher();
+	scandal_init_packed();
+	scandal_init_busstats();
+	scandal_reset_latency();
+
+	/* The user storage from before the config log was bigger than ours */
+	if(sc_self->conf_log.legacy_lost)
+		scandal_do_scandal_err(LEN_ERR);
 
 	return(0);
 
@@ -155,28 +290,34 @@ u08 scandal_init(void){
 
 s32 scandal_get_m(u16 chan_num)
 {
-	return my_config.outs[chan_num].m;
+	return sc_self->my_config.outs[chan_num].m;
 }
 
 s32 scandal_get_b(u16 chan_num)
 {
-	return my_config.outs[chan_num].b;
+	return sc_self->my_config.outs[chan_num].b;
 }
 
 void scandal_set_m(u16 chan_num, s32 value)
 {
-	my_config.outs[chan_num].m = value;
-	sc_write_conf(&my_config); 
+	sc_self->my_config.outs[chan_num].m = value;
+	sc_write_conf(&sc_self->my_config); 
 }
 
 void scandal_set_b(u16 chan_num, s32 value)
 {
-	my_config.outs[chan_num].b = value;
-	sc_write_conf(&my_config); 
+	sc_self->my_config.outs[chan_num].b = value;
+	sc_write_conf(&sc_self->my_config); 
 }
 
 void scandal_register_in_channel_handler(int chan_num, in_channel_handler handler) {
-	in_channel_handlers[chan_num] = handler;
+	sc_self->in_channel_handlers[chan_num] = handler;
+}
+
+/* As above, but the handler is also given the sc_get_timer_us() time at which
+   the driver received the frame, rather than when we got around to it */
+void scandal_register_in_channel_timed_handler(int chan_num, in_channel_timed_handler handler) {
+	sc_self->in_channel_timed_handlers[chan_num] = handler;
 }
 
 
@@ -185,26 +326,49 @@ void scandal_register_in_channel_handler(int chan_num, in_channel_handler handle
    for receiving messages from other CAN devices such as motor controllers or
    maximum power point trackers that might be from a different vendor
    
-   Once set, user_std_msg_handler_set is flagged, indicating that we have a
+   Once set, sc_self->user_std_msg_handler_set is flagged, indicating that we have a
    handler and all subsequent standard messages will 
    */
 
 void register_standard_message_handler(standard_message_handler handler){
-    user_std_msg_handler = handler;
-    user_std_msg_handler_set = 1;
+    sc_self->user_std_msg_handler = handler;
+    sc_self->user_std_msg_handler_set = 1;
+}
+
+/* Lets the user code handle a particular type of extended (Scandal) message.
+   The handler is called after the engine's own handling of that type, if any.
+   Passing a handler of 0 removes it. */
+u08 scandal_register_ext_message_handler(u08 type, ext_message_handler handler){
+	if(type >= SCANDAL_NUM_MSG_TYPES)
+		return LEN_ERR;
+
+	sc_self->user_ext_msg_handlers[type] = handler;
+	return NO_ERR;
+}
+
+/* Selects which message types are passed to scandal_user_handle_message(),
+   as a mask of SCANDAL_MSG_TYPE_BIT()s. Nodes which only care about a couple
+   of types should narrow this so that every other frame on the bus can skip
+   the callback altogether. */
+void scandal_set_user_message_types(u16 type_mask){
+	sc_self->user_msg_types = type_mask;
 }
 
 
 s32 scandal_get_in_channel_value(u16 chan_num){
-	return(in_channels[chan_num].value);
+	return(sc_self->in_channels[chan_num].value);
 }
 
 sc_time_t scandal_get_in_channel_rcvd_time(u16 chan_num){
-	return(in_channels[chan_num].rcvd_time);
+	return(sc_self->in_channels[chan_num].rcvd_time);
+}
+
+sc_utime_t scandal_get_in_channel_rcvd_us(u16 chan_num){
+	return(sc_self->in_channels[chan_num].rcvd_us);
 }
 
 sc_time_t scandal_get_in_channel_time(u16 chan_num){
-	return(in_channels[chan_num].time);
+	return(sc_self->in_channels[chan_num].time);
 }
 
 u08 scandal_in_channel_is_valid(u16 chan_num){
@@ -212,15 +376,16 @@ u08 scandal_in_channel_is_valid(u16 chan_num){
 		return 0;
 	/* Channel is invalid if it was last updated at t=0, since
 		that is impossible, and is the default condition */
-	return(scandal_get_in_channel_rcvd_time(chan_num) != 0);
+	return(scandal_get_in_channel_rcvd_time(chan_num) != 0 &&
+		!scandal_in_channel_is_stale(chan_num));
 }
 
 in_channel* scandal_get_in_channel(u16 chan_num){
-	return(&in_channels[chan_num]);
+	return(&sc_self->in_channels[chan_num]);
 }
 
 u08 scandal_get_addr(void){
-	return(my_config.addr);
+	return(sc_self->my_config.addr);
 }
 
 /*! \todo To be implemented */
@@ -232,42 +397,130 @@ u32 scandal_get_mac(void){
 /* Handle Scandal - to be called regularly (assumed to be once in the main loop)
 	Will do nothing in the case where there is nothing to do */
 void handle_scandal(void){
-	u08  	err;
-	can_msg	msg;
+	handle_scandal_drain(SCANDAL_DRAIN_MAX_FRAMES, SCANDAL_DRAIN_BUDGET_US);
+}
+
+/* As handle_scandal, but processes received frames until the receive queue
+	is empty, max_frames have been processed, or budget_us microseconds
+	have been spent, whichever comes first. A max_frames or budget_us of 0
+	means no limit. The budget is checked after each frame, so a call can
+	overrun it by the time taken to handle one frame.
+	Returns the number of frames processed. */
+u16 handle_scandal_drain(u16 max_frames, sc_utime_t budget_us){
+	u16	frames;
 
 	can_poll();
 
-	/* Check weather we're due to send a heartbeat, and if so, send it */
-	if(sc_get_timer() - heartbeat_timer >= HEARTBEAT_PERIOD){
-		scandal_send_heartbeat(0);	/*! \todo Send a more useful status */
-		heartbeat_timer = sc_get_timer();
-	}
+	/* Heartbeat and any user tasks which are due */
+	scandal_run_tasks();
 
-	/* Check for pending messages */
-	err = can_get_msg(&msg);
-	switch(err){
-	case NO_MSG_ERR:
-		break;
+	frames = scandal_drain_messages(max_frames, budget_us);
+
+	scandal_check_freshness(sc_get_timer());
+    
+    WDT_Feed();
+
+	return frames;
+}
+
+/* Task id of the heartbeat, for looking at its stats or changing its period */
+u08 scandal_get_heartbeat_task(void){
+	return sc_self->heartbeat_task;
+}
+
+static void scandal_heartbeat_task(void *arg){
+	scandal_send_heartbeat(0);	/*! \todo Send a more useful status */
+}
+
+#if SC_USER_STORE_SIZE > 0 && SC_USER_STORE_FLUSH_DELAY > 0
+static void scandal_user_store_task(void *arg){
+	sc_user_store_poll();
+}
+#endif
+
+void scandal_get_drain_stats(scandal_drain_stats *stats){
+	*stats = sc_self->drain_stats;
+}
+
+void scandal_reset_drain_stats(void){
+	memset(&sc_self->drain_stats, 0, sizeof(sc_self->drain_stats));
+}
+
+static u16 scandal_drain_messages(u16 max_frames, sc_utime_t budget_us){
+	u08		err;
+	can_msg		msg;
+	u16		frames = 0;
+	sc_utime_t	start, elapsed, queued, dispatched;
+
+	start = sc_get_timer_us();
+
+	for(;;){
+		if(max_frames != 0 && frames >= max_frames){
+			sc_self->drain_stats.limit_stops++;
+			break;
+		}
+
+		/* Check for pending messages */
+		err = can_get_msg(&msg);
+		if(err == NO_MSG_ERR)
+			break;
+
+		if(err != NO_ERR){
+			scandal_do_scandal_err(err);
+			break;
+		}
+
+		scandal_busstats_rx(&msg);
+
+		/* How long the frame sat in the driver before we got to it */
+		dispatched = sc_get_timer_us();
+		queued = dispatched - msg.rcvd_us;
+		sc_self->drain_stats.last_queue_us = queued;
+		sc_self->drain_stats.total_queue_us += queued;
+		if(queued > sc_self->drain_stats.max_queue_us)
+			sc_self->drain_stats.max_queue_us = queued;
+		scandal_latency_record(LATENCY_QUEUE, queued);
 
-	case NO_ERR:
 		if (msg.ext)
 			handle_ext_message(&msg);
 		else
 			handle_std_message(&msg);
+		frames++;
+
+#if SCANDAL_LATENCY_HISTOGRAMS
+		if(!msg.ext)
+			scandal_latency_record(LATENCY_HANDLER_STD, sc_get_timer_us() - dispatched);
+		else if(scandal_get_msg_type(&msg) < SCANDAL_NUM_MSG_TYPES)
+			scandal_latency_record(LATENCY_HANDLER + scandal_get_msg_type(&msg),
+						sc_get_timer_us() - dispatched);
+		else
+			scandal_latency_record(LATENCY_HANDLER_OTHER, sc_get_timer_us() - dispatched);
+#endif
 
-		break;
-
-	default:
-		scandal_do_scandal_err(err);
+		if(budget_us != 0 && sc_get_timer_us() - start >= budget_us){
+			sc_self->drain_stats.budget_exhaustions++;
+			break;
+		}
 	}
-    
-    WDT_Feed();
+
+	elapsed = sc_get_timer_us() - start;
+
+	sc_self->drain_stats.calls++;
+	sc_self->drain_stats.frames += frames;
+	sc_self->drain_stats.last_frames = frames;
+	sc_self->drain_stats.last_time_us = elapsed;
+	if(frames > sc_self->drain_stats.max_frames)
+		sc_self->drain_stats.max_frames = frames;
+	if(elapsed > sc_self->drain_stats.max_time_us)
+		sc_self->drain_stats.max_time_us = elapsed;
+
+	return frames;
 }
 
 /* this is most likely to be a wave sculptor message */
 u08	handle_std_message(can_msg*	msg){
-    if(user_std_msg_handler_set){
-        standard_message_handler handler = user_std_msg_handler;
+    if(sc_self->user_std_msg_handler_set){
+        standard_message_handler handler = sc_self->user_std_msg_handler;
 		handler(msg);
     } else {
         scandal_handle_ws_message(msg);
@@ -276,192 +529,180 @@ u08	handle_std_message(can_msg*	msg){
 }
 /* Local Functions */
 u08	handle_ext_message(can_msg*	msg){
-  switch(scandal_get_msg_type(msg)){
-  case TIMESYNC_TYPE: 
-	  scandal_handle_timesync(msg); 
-	  break; 
-	  
-  case CHANNEL_TYPE:
-	  scandal_handle_channel(msg);
-	  break;
-	  
-  case CONFIG_TYPE:
-	  scandal_handle_config(msg);
-	  break;
-	  
-  case RESET_TYPE:
-	  scandal_handle_reset(msg);
-	  break;
-	  
-  case HEARTBEAT_TYPE:
-  case USER_ERROR_TYPE:
-  case SCANDAL_ERROR_TYPE:
-	  break;   
-	  
-  case USER_CONFIG_TYPE:
-	  scandal_handle_user_config(msg);
-	  break; 
-	  
-  case COMMAND_TYPE:
-	  scandal_handle_command(msg); 
-	  break; 
-	  
-  }
-  
-  scandal_user_handle_message(msg);
-  
-  return NO_ERR;
+	u08 type = scandal_get_msg_type(msg);
+	ext_message_handler handler;
+
+	if(type >= SCANDAL_NUM_MSG_TYPES){
+		if(sc_self->user_msg_types & SCANDAL_MSG_OTHER)
+			scandal_user_handle_message(msg);
+		return NO_ERR;
+	}
+
+	if(type < SCANDAL_EXT_HANDLERS_SIZE){
+		handler = scandal_ext_handlers[type];
+		if(handler != 0)
+			handler(msg);
+	}
+
+	handler = sc_self->user_ext_msg_handlers[type];
+	if(handler != 0)
+		handler(msg);
+
+	if(sc_self->user_msg_types & SCANDAL_MSG_TYPE_BIT(type))
+		scandal_user_handle_message(msg);
+
+	return NO_ERR;
 }
 
 void	do_first_run(void){
 	u16 	i;
 
-	my_config.version = SCANDAL_VERSION;
-	my_config.addr = 0;
+	sc_self->my_config.version = SCANDAL_VERSION;
+	sc_self->my_config.addr = 0;
 
 	for(i=0;i<NUM_IN_CHANNELS;i++){
-		my_config.ins[i].source_node = 0;
-		my_config.ins[i].source_num = 0;
+		sc_self->my_config.ins[i].source_node = 0;
+		sc_self->my_config.ins[i].source_num = 0;
 	}
 
 	for(i=0; i<NUM_OUT_CHANNELS; i++){
-		my_config.outs[i].m = DEFAULT_M;
-		my_config.outs[i].b = DEFAULT_B;
+		sc_self->my_config.outs[i].m = DEFAULT_M;
+		sc_self->my_config.outs[i].b = DEFAULT_B;
 	}
 
-	sc_write_conf(&my_config);
+	sc_write_conf(&sc_self->my_config);
 	scandal_user_do_first_run();
 }
 
 static void scandal_handle_channel_overrides(void){
 
 #if SCANDAL_ADDRESS_OVERRIDE_ENABLE
-	my_config.addr = SCANDAL_ADDRESS_OVERRIDE;
+	sc_self->my_config.addr = SCANDAL_ADDRESS_OVERRIDE;
 #endif
 
 #if (NUM_IN_CHANNELS > 0)
 #if SCANDAL_IN_CHANNEL_0_OVERRIDE_ENABLE
-	my_config.ins[0].source_node = SCANDAL_IN_CHANNEL_0_OVERRIDE_ADDRESS;
-	my_config.ins[0].source_num = SCANDAL_IN_CHANNEL_0_OVERRIDE_CHANNEL;
+	sc_self->my_config.ins[0].source_node = SCANDAL_IN_CHANNEL_0_OVERRIDE_ADDRESS;
+	sc_self->my_config.ins[0].source_num = SCANDAL_IN_CHANNEL_0_OVERRIDE_CHANNEL;
 #endif
 #endif
 
 #if (NUM_IN_CHANNELS > 1)
 #if SCANDAL_IN_CHANNEL_1_OVERRIDE_ENABLE
-	my_config.ins[1].source_node = SCANDAL_IN_CHANNEL_1_OVERRIDE_ADDRESS;
-	my_config.ins[1].source_num = SCANDAL_IN_CHANNEL_1_OVERRIDE_CHANNEL;
+	sc_self->my_config.ins[1].source_node = SCANDAL_IN_CHANNEL_1_OVERRIDE_ADDRESS;
+	sc_self->my_config.ins[1].source_num = SCANDAL_IN_CHANNEL_1_OVERRIDE_CHANNEL;
 #endif
 #endif
 
 #if (NUM_IN_CHANNELS > 2)
 #if SCANDAL_IN_CHANNEL_2_OVERRIDE_ENABLE
-	my_config.ins[2].source_node = SCANDAL_IN_CHANNEL_2_OVERRIDE_ADDRESS;
-	my_config.ins[2].source_num = SCANDAL_IN_CHANNEL_2_OVERRIDE_CHANNEL;
+	sc_self->my_config.ins[2].source_node = SCANDAL_IN_CHANNEL_2_OVERRIDE_ADDRESS;
+	sc_self->my_config.ins[2].source_num = SCANDAL_IN_CHANNEL_2_OVERRIDE_CHANNEL;
 #endif
 #endif
 
 #if (NUM_IN_CHANNELS > 2)
 #if SCANDAL_IN_CHANNEL_3_OVERRIDE_ENABLE
-	my_config.ins[3].source_node = SCANDAL_IN_CHANNEL_3_OVERRIDE_ADDRESS;
-	my_config.ins[3].source_num = SCANDAL_IN_CHANNEL_3_OVERRIDE_CHANNEL;
+	sc_self->my_config.ins[3].source_node = SCANDAL_IN_CHANNEL_3_OVERRIDE_ADDRESS;
+	sc_self->my_config.ins[3].source_num = SCANDAL_IN_CHANNEL_3_OVERRIDE_CHANNEL;
 #endif
 #endif
 
 #if (NUM_IN_CHANNELS > 4)
 #if SCANDAL_IN_CHANNEL_4_OVERRIDE_ENABLE
-	my_config.ins[4].source_node = SCANDAL_IN_CHANNEL_4_OVERRIDE_ADDRESS;
-	my_config.ins[4].source_num = SCANDAL_IN_CHANNEL_4_OVERRIDE_CHANNEL;
+	sc_self->my_config.ins[4].source_node = SCANDAL_IN_CHANNEL_4_OVERRIDE_ADDRESS;
+	sc_self->my_config.ins[4].source_num = SCANDAL_IN_CHANNEL_4_OVERRIDE_CHANNEL;
 #endif
 #endif
 
 #if (NUM_IN_CHANNELS > 5)
 #if SCANDAL_IN_CHANNEL_5_OVERRIDE_ENABLE
-	my_config.ins[5].source_node = SCANDAL_IN_CHANNEL_5_OVERRIDE_ADDRESS;
-	my_config.ins[5].source_num = SCANDAL_IN_CHANNEL_5_OVERRIDE_CHANNEL;
+	sc_self->my_config.ins[5].source_node = SCANDAL_IN_CHANNEL_5_OVERRIDE_ADDRESS;
+	sc_self->my_config.ins[5].source_num = SCANDAL_IN_CHANNEL_5_OVERRIDE_CHANNEL;
 #endif
 #endif
 
 #if (NUM_IN_CHANNELS > 6)
 #if SCANDAL_IN_CHANNEL_6_OVERRIDE_ENABLE
-	my_config.ins[6].source_node = SCANDAL_IN_CHANNEL_6_OVERRIDE_ADDRESS;
-	my_config.ins[6].source_num = SCANDAL_IN_CHANNEL_6_OVERRIDE_CHANNEL;
+	sc_self->my_config.ins[6].source_node = SCANDAL_IN_CHANNEL_6_OVERRIDE_ADDRESS;
+	sc_self->my_config.ins[6].source_num = SCANDAL_IN_CHANNEL_6_OVERRIDE_CHANNEL;
 #endif
 #endif
 
 #if (NUM_IN_CHANNELS > 7)
 #if SCANDAL_IN_CHANNEL_7_OVERRIDE_ENABLE
-	my_config.ins[7].source_node = SCANDAL_IN_CHANNEL_7_OVERRIDE_ADDRESS;
-	my_config.ins[7].source_num = SCANDAL_IN_CHANNEL_7_OVERRIDE_CHANNEL;
+	sc_self->my_config.ins[7].source_node = SCANDAL_IN_CHANNEL_7_OVERRIDE_ADDRESS;
+	sc_self->my_config.ins[7].source_num = SCANDAL_IN_CHANNEL_7_OVERRIDE_CHANNEL;
 #endif
 #endif
 
 #if (NUM_IN_CHANNELS > 8)
 #if SCANDAL_IN_CHANNEL_8_OVERRIDE_ENABLE
-	my_config.ins[8].source_node = SCANDAL_IN_CHANNEL_8_OVERRIDE_ADDRESS;
-	my_config.ins[8].source_num = SCANDAL_IN_CHANNEL_8_OVERRIDE_CHANNEL;
+	sc_self->my_config.ins[8].source_node = SCANDAL_IN_CHANNEL_8_OVERRIDE_ADDRESS;
+	sc_self->my_config.ins[8].source_num = SCANDAL_IN_CHANNEL_8_OVERRIDE_CHANNEL;
 #endif
 #endif
 
 #if (NUM_IN_CHANNELS > 9)
 #if SCANDAL_IN_CHANNEL_9_OVERRIDE_ENABLE
-	my_config.ins[9].source_node = SCANDAL_IN_CHANNEL_9_OVERRIDE_ADDRESS;
-	my_config.ins[9].source_num = SCANDAL_IN_CHANNEL_9_OVERRIDE_CHANNEL;
+	sc_self->my_config.ins[9].source_node = SCANDAL_IN_CHANNEL_9_OVERRIDE_ADDRESS;
+	sc_self->my_config.ins[9].source_num = SCANDAL_IN_CHANNEL_9_OVERRIDE_CHANNEL;
 #endif
 #endif
 
 #if (NUM_IN_CHANNELS > 10)
 #if SCANDAL_IN_CHANNEL_10_OVERRIDE_ENABLE
-	my_config.ins[10].source_node = SCANDAL_IN_CHANNEL_10_OVERRIDE_ADDRESS;
-	my_config.ins[10].source_num = SCANDAL_IN_CHANNEL_10_OVERRIDE_CHANNEL;
+	sc_self->my_config.ins[10].source_node = SCANDAL_IN_CHANNEL_10_OVERRIDE_ADDRESS;
+	sc_self->my_config.ins[10].source_num = SCANDAL_IN_CHANNEL_10_OVERRIDE_CHANNEL;
 #endif
 #endif
 
 #if (NUM_IN_CHANNELS > 11)
 #if SCANDAL_IN_CHANNEL_11_OVERRIDE_ENABLE
-	my_config.ins[11].source_node = SCANDAL_IN_CHANNEL_11_OVERRIDE_ADDRESS;
-	my_config.ins[11].source_num = SCANDAL_IN_CHANNEL_11_OVERRIDE_CHANNEL;
+	sc_self->my_config.ins[11].source_node = SCANDAL_IN_CHANNEL_11_OVERRIDE_ADDRESS;
+	sc_self->my_config.ins[11].source_num = SCANDAL_IN_CHANNEL_11_OVERRIDE_CHANNEL;
 #endif
 #endif
 
 #if (NUM_IN_CHANNELS > 12)
 #if SCANDAL_IN_CHANNEL_12_OVERRIDE_ENABLE
-	my_config.ins[12].source_node = SCANDAL_IN_CHANNEL_12_OVERRIDE_ADDRESS;
-	my_config.ins[12].source_num = SCANDAL_IN_CHANNEL_12_OVERRIDE_CHANNEL;
+	sc_self->my_config.ins[12].source_node = SCANDAL_IN_CHANNEL_12_OVERRIDE_ADDRESS;
+	sc_self->my_config.ins[12].source_num = SCANDAL_IN_CHANNEL_12_OVERRIDE_CHANNEL;
 #endif
 #endif
 
 #if (NUM_IN_CHANNELS > 13)
 #if SCANDAL_IN_CHANNEL_13_OVERRIDE_ENABLE
-	my_config.ins[13].source_node = SCANDAL_IN_CHANNEL_13_OVERRIDE_ADDRESS;
-	my_config.ins[13].source_num = SCANDAL_IN_CHANNEL_13_OVERRIDE_CHANNEL;
+	sc_self->my_config.ins[13].source_node = SCANDAL_IN_CHANNEL_13_OVERRIDE_ADDRESS;
+	sc_self->my_config.ins[13].source_num = SCANDAL_IN_CHANNEL_13_OVERRIDE_CHANNEL;
 #endif
 #endif
 
 #if (NUM_IN_CHANNELS > 14)
 #if SCANDAL_IN_CHANNEL_14_OVERRIDE_ENABLE
-	my_config.ins[14].source_node = SCANDAL_IN_CHANNEL_14_OVERRIDE_ADDRESS;
-	my_config.ins[14].source_num = SCANDAL_IN_CHANNEL_14_OVERRIDE_CHANNEL;
+	sc_self->my_config.ins[14].source_node = SCANDAL_IN_CHANNEL_14_OVERRIDE_ADDRESS;
+	sc_self->my_config.ins[14].source_num = SCANDAL_IN_CHANNEL_14_OVERRIDE_CHANNEL;
 #endif
 #endif
 
 #if (NUM_IN_CHANNELS > 15)
 #if SCANDAL_IN_CHANNEL_15_OVERRIDE_ENABLE
-	my_config.ins[15].source_node = SCANDAL_IN_CHANNEL_15_OVERRIDE_ADDRESS;
-	my_config.ins[15].source_num = SCANDAL_IN_CHANNEL_15_OVERRIDE_CHANNEL;
+	sc_self->my_config.ins[15].source_node = SCANDAL_IN_CHANNEL_15_OVERRIDE_ADDRESS;
+	sc_self->my_config.ins[15].source_num = SCANDAL_IN_CHANNEL_15_OVERRIDE_CHANNEL;
 #endif
 #endif
 
 #if (NUM_IN_CHANNELS > 16)
 #if SCANDAL_IN_CHANNEL_16_OVERRIDE_ENABLE
-	my_config.ins[16].source_node = SCANDAL_IN_CHANNEL_16_OVERRIDE_ADDRESS;
-	my_config.ins[16].source_num = SCANDAL_IN_CHANNEL_16_OVERRIDE_CHANNEL;
+	sc_self->my_config.ins[16].source_node = SCANDAL_IN_CHANNEL_16_OVERRIDE_ADDRESS;
+	sc_self->my_config.ins[16].source_num = SCANDAL_IN_CHANNEL_16_OVERRIDE_CHANNEL;
 #endif
 #endif
 
 #if (NUM_OUT_CHANNELS > 17)
 #if SCANDAL_IN_CHANNEL_16_OVERRIDE_ENABLE
-	my_config.ins[17].source_node = SCANDAL_IN_CHANNEL_17_OVERRIDE_ADDRESS;
-	my_config.ins[17].source_num = SCANDAL_IN_CHANNEL_17_OVERRIDE_CHANNEL;
+	sc_self->my_config.ins[17].source_node = SCANDAL_IN_CHANNEL_17_OVERRIDE_ADDRESS;
+	sc_self->my_config.ins[17].source_num = SCANDAL_IN_CHANNEL_17_OVERRIDE_CHANNEL;
 #endif
 #endif
 }
@@ -475,14 +716,72 @@ u08		scandal_get_msg_priority(can_msg* msg){
 	return ((u08)((msg->id >> PRI_OFFSET) * 0x07));
 }
 
+/* In-channel index */
+static inline u16 scandal_in_channel_hash(u08 node, u16 num){
+	u32 key = ((u32)node << CHANNEL_SOURCE_ADDR_OFFSET) | (num & 0x03FF);
+
+	/* Multiplicative (Fibonacci) hashing of the 18 bit node/channel key */
+	return (u16)((u32)(key * 2654435761UL) >> (32 - IN_CHANNEL_INDEX_BITS));
+}
+
+static void scandal_build_in_channel_index(void){
+	u16 i;
+	u16 h;
+
+	for(i=0; i<IN_CHANNEL_INDEX_SIZE; i++)
+		sc_self->in_channel_index_head[i] = IN_CHANNEL_INDEX_NONE;
+
+	/* Insert in reverse so that each chain ends up in ascending slot order */
+	for(i=NUM_IN_CHANNELS; i-- > 0; ){
+		sc_self->in_channel_index_next[i] = IN_CHANNEL_INDEX_NONE;
+
+		/* Node 0 is never accepted, so don't bother indexing it */
+		if(sc_self->my_config.ins[i].source_node == 0)
+			continue;
+
+		h = scandal_in_channel_hash(sc_self->my_config.ins[i].source_node,
+					sc_self->my_config.ins[i].source_num);
+		sc_self->in_channel_index_next[i] = sc_self->in_channel_index_head[h];
+		sc_self->in_channel_index_head[h] = i;
+	}
+}
+
+/* In-channel num has a new source. Its value and freshness were the old
+   source's, so it starts again from 0, with no deadline. The old source's
+   registration stays until the next reset, but the index no longer leads
+   its frames anywhere. The caller rebuilds the index */
+static void scandal_in_channel_moved(u16 num){
+	u08 node = sc_self->my_config.ins[num].source_node;
+
+	sc_self->in_channels[num].value = 0;
+	sc_self->in_channels[num].rcvd_time = 0;
+	sc_self->in_channels[num].rcvd_us = 0;
+	sc_self->in_channels[num].time = 0;
+	scandal_freshness_reset(num);
+
+	can_register_id(0x03FFFFFF,
+			scandal_mk_channel_id(0, node, sc_self->my_config.ins[num].source_num),
+			0,
+			CAN_EXT_MSG);
+#if !DISABLE_PACKED_MESSAGES
+	/* Registering a node already registered for changes nothing */
+	if(node != 0)
+		can_register_id(PACKED_TYPE_MASK | (0xFFUL << CHANNEL_SOURCE_ADDR_OFFSET),
+				scandal_mk_packed_id(0, PACKED16_TYPE, node, 0),
+				0,
+				CAN_EXT_MSG);
+#endif
+}
+
 /* Functions for handling various types of messages */
 u08	scandal_handle_channel(can_msg* msg){
-	u16 i;
 	u08	node;
 	u16	num;
 
 	int32_t  value;
 	uint32_t time;
+	sc_time_t rcvd_time;
+	u32	delay_ms;
 
 	node 	= (msg->id >> CHANNEL_SOURCE_ADDR_OFFSET) & 0xFF;
 	num	= (msg->id >> CHANNEL_NUM_OFFSET) & 0x03FF;
@@ -490,38 +789,90 @@ u08	scandal_handle_channel(can_msg* msg){
 	/* We don't accept messages from node 0 - its too easy for
 		these messages to be generated erroneously, plus
 		the default setup is all zeros */
+	if(node == 0 || msg->length < CHANNEL_SHORT_LENGTH)
+		return NO_ERR;
+
+	value = 0;
+	value |= ((u32)(msg->data[0]) << 24);
+	value |= ((u32)(msg->data[1]) << 16);
+	value |= ((u32)(msg->data[2]) << 8);
+	value |= ((u32)(msg->data[3]) << 0);
+
+	/* Back-date our millisecond clock to when the driver received the frame */
+	delay_ms = (sc_get_timer_us() - msg->rcvd_us) / 1000;
+	rcvd_time = sc_get_timer() - delay_ms;
+
+	if(CHANNEL_MSG_HAS_TIME(msg)){
+		time = 0;
+		time |= (u32)msg->data[4] << 24;
+		time |= (u32)msg->data[5] << 16;
+		time |= (u32)msg->data[6] << 8;
+		time |= (u32)msg->data[7] << 0;
+	} else {
+		/* Short form, so the best we have is when it arrived */
+		time = scandal_get_realtime32() - delay_ms;
+	}
+
+	scandal_update_in_channels(node, num, value, time, rcvd_time, msg->rcvd_us);
+
+	return NO_ERR;
+}
+
+/* Several consecutive channels from one node in a single frame */
+u08	scandal_handle_packed_channel(can_msg* msg){
+	u08	node, type, count, k;
+	u16	num;
+	uint32_t time;
+	sc_time_t rcvd_time;
+
+	node 	= (msg->id >> CHANNEL_SOURCE_ADDR_OFFSET) & 0xFF;
+	num	= (msg->id >> CHANNEL_NUM_OFFSET) & 0x03FF;
+	type	= scandal_get_msg_type(msg);
+
 	if(node == 0)
 		return NO_ERR;
 
-	for(i=0;i<NUM_IN_CHANNELS;i++){
-		if((my_config.ins[i].source_node == node) &&
-			(my_config.ins[i].source_num == num)){
-
-			value = 0;
-			value |= ((u32)(msg->data[0]) << 24);
-			value |= ((u32)(msg->data[1]) << 16);
-			value |= ((u32)(msg->data[2]) << 8);
-			value |= ((u32)(msg->data[3]) << 0);
-
-			time = 0;
-			time |= (u32)msg->data[4] << 24;
-			time |= (u32)msg->data[5] << 16;
-			time |= (u32)msg->data[6] << 8;
-			time |= (u32)msg->data[7] << 0;
-
-			in_channels[i].value = value;
-			in_channels[i].time = time;
-			in_channels[i].rcvd_time = sc_get_timer();
+	count = scandal_packed_count(msg, type);
+	time = scandal_packed_time(msg, scandal_get_realtime32());
+	rcvd_time = sc_get_timer() - (sc_get_timer_us() - msg->rcvd_us) / 1000;
+
+	for(k=0; k<count; k++)
+		scandal_update_in_channels(node, (num + k) & 0x03FF,
+				scandal_packed_value(msg, type, k),
+				time, rcvd_time, msg->rcvd_us);
+
+	return NO_ERR;
+}
+
+/* Hand a received value to every in-channel which is mapped to it */
+static void scandal_update_in_channels(u08 node, u16 num, s32 value, u32 time,
+				sc_time_t rcvd_time, sc_utime_t rcvd_us){
+	u16 i;
+
+	for(i = sc_self->in_channel_index_head[scandal_in_channel_hash(node, num)];
+			i != IN_CHANNEL_INDEX_NONE;
+			i = sc_self->in_channel_index_next[i]){
+		if((sc_self->my_config.ins[i].source_node == node) &&
+			(sc_self->my_config.ins[i].source_num == num)){
+
+			sc_self->in_channels[i].value = value;
+			sc_self->in_channels[i].time = time;
+			sc_self->in_channels[i].rcvd_time = rcvd_time;
+			sc_self->in_channels[i].rcvd_us = rcvd_us;
+			scandal_freshness_touch(i, rcvd_time);
 			
-			if (in_channel_handlers[i] != 0) {
-				in_channel_handler handler = in_channel_handlers[i];
+			if (sc_self->in_channel_handlers[i] != 0) {
+				in_channel_handler handler = sc_self->in_channel_handlers[i];
 				handler(value, time);
 			}
 
+			if (sc_self->in_channel_timed_handlers[i] != 0) {
+				in_channel_timed_handler handler = sc_self->in_channel_timed_handlers[i];
+				handler(value, time, rcvd_us);
+			}
+
 		}
 	}
-
-	return NO_ERR;
 }  
 
 u08 scandal_handle_user_config(can_msg* msg){
@@ -539,56 +890,186 @@ u08 scandal_handle_user_config(can_msg* msg){
 									SECOND_32_BITS(msg));
 }
 
+/* Config sessions. Outside one, each config message is written to flash as
+   it comes. Between CONFIG_SESSION_BEGIN and CONFIG_SESSION_COMMIT, changes
+   take effect as they come, but aren't written until the commit, which
+   writes them all at once. A new address only takes effect on commit, as
+   the node would stop hearing its own config messages otherwise, and is
+   the only change that needs a reset. CONFIG_SESSION_ABORT, or
+   SCANDAL_CONFIG_SESSION_TIMEOUT without a config message, goes back to
+   what flash has */
+static void scandal_commit_config(void){
+	u08 reset = (sc_self->config_staged_addr != sc_self->my_config.addr);
+
+	sc_self->my_config.addr = sc_self->config_staged_addr;
+	sc_write_conf(&sc_self->my_config);
+
+	/* Our registrations all have the old address in them */
+	if(reset){
+#if SC_USER_STORE_SIZE > 0
+		sc_user_store_flush();
+#endif
+		system_reset();
+	}
+}
+
+static void scandal_abort_config(void){
+	in_channel_config ins[NUM_IN_CHANNELS];
+	u16 i;
+
+	memcpy(ins, sc_self->my_config.ins, sizeof(ins));
+	sc_read_conf(&sc_self->my_config);
+	scandal_handle_channel_overrides();
+	sc_self->config_staged_addr = sc_self->my_config.addr;
+
+	for(i=0; i<NUM_IN_CHANNELS; i++)
+		if(ins[i].source_node != sc_self->my_config.ins[i].source_node ||
+		   ins[i].source_num != sc_self->my_config.ins[i].source_num)
+			scandal_in_channel_moved(i);
+	scandal_build_in_channel_index();
+}
+
+/* The timeout counts from the last config message, not from when the task
+   last ran, so it is checked this often. A session ends at most an eighth
+   of the timeout late */
+#define CONFIG_SESSION_CHECK_PERIOD \
+	(SCANDAL_CONFIG_SESSION_TIMEOUT >= 8 ? SCANDAL_CONFIG_SESSION_TIMEOUT / 8 : 1)
+
+static void scandal_end_config_session(void){
+	scandal_remove_task(sc_self->config_session_task);
+	sc_self->config_session = 0;
+}
+
+static void scandal_config_session_task(void *arg){
+	(void)arg;
+
+	if(sc_get_timer() - sc_self->config_session_time < SCANDAL_CONFIG_SESSION_TIMEOUT)
+		return;
+	scandal_end_config_session();
+	scandal_abort_config();
+}
+
 u08	scandal_handle_config(can_msg* msg){
 	u08	dest_node;
 	u08	param;
 	u16	num;
+	u32	value;
+	scandal_publisher_params pub;
 
 	dest_node = (u08)((msg->id >> CONFIG_NODE_ADDR_OFFSET) & 0xFF);
 	param = (u08)((msg->id >> CONFIG_PARAM_OFFSET) & 0xFF);
 
 	if(dest_node != scandal_get_addr())
 		return NO_ERR;
+
+	sc_self->config_session_time = sc_get_timer();
  
 	switch(param){
+	case CONFIG_SESSION_BEGIN:
+		if(sc_self->config_session)
+			return NO_ERR;
+		/* Without a timeout, a session nobody commits would never end.
+		   Carry on writing each message instead */
+		sc_self->config_session_task = scandal_add_task(scandal_config_session_task, 0,
+					CONFIG_SESSION_CHECK_PERIOD, CONFIG_SESSION_CHECK_PERIOD, 0);
+		if(sc_self->config_session_task == SCANDAL_NO_TASK)
+			return NO_ERR;
+		sc_self->config_session = 1;
+		return NO_ERR;
+
+	case CONFIG_SESSION_COMMIT:
+		if(!sc_self->config_session)
+			return NO_ERR;
+		scandal_end_config_session();
+		scandal_commit_config();
+		return NO_ERR;
+
+	case CONFIG_SESSION_ABORT:
+		if(!sc_self->config_session)
+			return NO_ERR;
+		scandal_end_config_session();
+		scandal_abort_config();
+		return NO_ERR;
+
 	case CONFIG_ADDR:
 		/* 0 is the configuration broadcast address */
-		my_config.addr = msg->data[0];
-		sc_write_conf(&my_config);
+		sc_self->config_staged_addr = msg->data[0];
 		break;
 
 	case CONFIG_IN_CHAN_SOURCE:
 		num = ((u16)((msg->data[0]&0xFF) << 8)) | ((u16)msg->data[1]);
-		my_config.ins[num].source_node = msg->data[2];
-		my_config.ins[num].source_num = ((u16)msg->data[3]<<8) | (msg->data[4]);
-		sc_write_conf(&my_config);
+		if(num >= NUM_IN_CHANNELS)
+			return NO_ERR;
+		sc_self->my_config.ins[num].source_node = msg->data[2];
+		sc_self->my_config.ins[num].source_num = ((u16)msg->data[3]<<8) | (msg->data[4]);
+		scandal_in_channel_moved(num);
+		scandal_build_in_channel_index();
 		break;
 
 	case CONFIG_OUT_CHAN_M:
 		num = ((u16)((msg->data[0]&0xFF) << 8)) | ((u16)msg->data[1]);
-		my_config.outs[num].m = (u32)msg->data[2] << 24;
-		my_config.outs[num].m |= (u32)msg->data[3] << 16;
-		my_config.outs[num].m |= (u32)msg->data[4] << 8;
-		my_config.outs[num].m |= (u32)msg->data[5] << 0;
-		sc_write_conf(&my_config);
+		if(num >= NUM_OUT_CHANNELS)
+			return NO_ERR;
+		sc_self->my_config.outs[num].m = (u32)msg->data[2] << 24;
+		sc_self->my_config.outs[num].m |= (u32)msg->data[3] << 16;
+		sc_self->my_config.outs[num].m |= (u32)msg->data[4] << 8;
+		sc_self->my_config.outs[num].m |= (u32)msg->data[5] << 0;
 		break;
 
 	case CONFIG_OUT_CHAN_B:
 		num = ((u16)((msg->data[0]&0xFF) << 8)) | ((u16)msg->data[1]);
-		my_config.outs[num].b = (u32)msg->data[2] << 24;
-		my_config.outs[num].b |= (u32)msg->data[3] << 16;
-		my_config.outs[num].b |= (u32)msg->data[4] << 8;
-		my_config.outs[num].b |= (u32)msg->data[5] << 0;
-		sc_write_conf(&my_config);
+		if(num >= NUM_OUT_CHANNELS)
+			return NO_ERR;
+		sc_self->my_config.outs[num].b = (u32)msg->data[2] << 24;
+		sc_self->my_config.outs[num].b |= (u32)msg->data[3] << 16;
+		sc_self->my_config.outs[num].b |= (u32)msg->data[4] << 8;
+		sc_self->my_config.outs[num].b |= (u32)msg->data[5] << 0;
 		break;
+
+	case CONFIG_IN_CHAN_MAX_AGE:
+		/* Not kept in flash, so there is nothing to write */
+		num = ((u16)((msg->data[0]&0xFF) << 8)) | ((u16)msg->data[1]);
+		scandal_set_in_channel_max_age(num, ((u32)msg->data[2] << 24) |
+						((u32)msg->data[3] << 16) |
+						((u32)msg->data[4] << 8) |
+						((u32)msg->data[5] << 0));
+		return NO_ERR;
+
+	case CONFIG_OUT_CHAN_MIN_INTERVAL:
+	case CONFIG_OUT_CHAN_MAX_INTERVAL:
+	case CONFIG_OUT_CHAN_DEADBAND:
+		/* Publisher parameters live in RAM only */
+		num = ((u16)((msg->data[0]&0xFF) << 8)) | ((u16)msg->data[1]);
+		value = ((u32)msg->data[2] << 24) | ((u32)msg->data[3] << 16) |
+			((u32)msg->data[4] << 8) | ((u32)msg->data[5] << 0);
+		if(scandal_get_publisher_params(num, &pub) != NO_ERR)
+			return NO_ERR;
+		if(param == CONFIG_OUT_CHAN_MIN_INTERVAL)
+			pub.min_interval = value;
+		else if(param == CONFIG_OUT_CHAN_MAX_INTERVAL)
+			pub.max_interval = value;
+		else
+			pub.deadband = value;
+		scandal_set_publisher_params(num, &pub);
+		return NO_ERR;
+
+	case CONFIG_OUT_CHAN_FORMAT:
+		/* RAM only */
+		num = ((u16)((msg->data[0]&0xFF) << 8)) | ((u16)msg->data[1]);
+		scandal_set_out_channel_format(num, msg->data[2]);
+		return NO_ERR;
+
+	default:
+		return NO_ERR;
 	}
 
-	system_reset();
+	if(!sc_self->config_session)
+		scandal_commit_config();
 	return NO_ERR;
 }
 
 scandal_config getconfig(void){
-	return(my_config);
+	return(sc_self->my_config);
 }
 
 u08 scandal_handle_reset(can_msg* msg){
@@ -596,12 +1077,29 @@ u08 scandal_handle_reset(can_msg* msg){
 
 	dest_node = (u08)((msg->id >> RESET_NODE_ADDR_OFFSET) & 0xFF);
 
-	if(dest_node == scandal_get_addr())
+	if(dest_node == scandal_get_addr()){
+#if SC_USER_STORE_SIZE > 0
+		sc_user_store_flush();
+#endif
 		system_reset();				/* Should not return from this */
+	}
 
 	return NO_ERR;
 }
 
+uint64_t scandal_get_realtime(void){
+	return (uint64_t)sc_get_timer() + sc_self->timesync_offset;
+}
+
+uint32_t scandal_get_realtime32(void){
+	return (scandal_get_realtime()) & 0xFFFFFFFF;
+}
+
+void scandal_set_realtime(uint64_t timestamp){
+    uint32_t mytime = (uint32_t)sc_get_timer(); 
+    sc_self->timesync_offset = timestamp - mytime; 
+}
+
 /* Functions for handling various types of messages */
 u08	scandal_handle_timesync(can_msg* msg){
     uint64_t timestamp; 
@@ -629,6 +1127,27 @@ u08	scandal_handle_command(can_msg* msg){
 	if(node != scandal_get_addr())
 	  return NO_ERR; 
 
+	/* The top of the command range belongs to the engine */
+	if(num >= SCANDAL_COMMAND_BASE){
+		switch(num){
+#if !DISABLE_BUSSTATS
+		case SCANDAL_CMD_BUSSTATS_CLASS:
+		case SCANDAL_CMD_BUSSTATS_NODE:
+		case SCANDAL_CMD_BUSSTATS_UTIL:
+		case SCANDAL_CMD_BUSSTATS_RESET:
+			scandal_handle_busstats_command(num, msg->data);
+			break;
+#endif
+#if SCANDAL_LATENCY_HISTOGRAMS
+		case SCANDAL_CMD_LATENCY_DUMP:
+		case SCANDAL_CMD_LATENCY_RESET:
+			scandal_handle_latency_command(num, msg->data);
+			break;
+#endif
+		}
+		return NO_ERR;
+	}
+
 	switch(num){
 	  /* Handle any Scandal commands here -- dump config, for example? */ 
 	  
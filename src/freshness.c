@@ -0,0 +1,206 @@
+/* --------------------------------------------------------------------------
+	Scandal In-Channel Freshness
+	File name: freshness.c
+
+	Tracks when each in-channel's value goes stale. Every channel with a
+	maximum age and a current value has a deadline in a binary min-heap.
+	The engine checks the top of the heap once per handle_scandal(), so
+	only channels which are actually expiring cost anything.
+   -------------------------------------------------------------------------- */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <project/scandal_config.h>
+
+#include <scandal/types.h>
+#include <scandal/timer.h>
+#include <scandal/engine.h>
+#include <scandal/freshness.h>
+#include <scandal/context.h>
+
+#define FRESHNESS_NOT_QUEUED	0xFFFF
+
+/* True if time a is before time b, allowing for the timer wrapping */
+#define TIME_BEFORE(a, b)	((s32)((a) - (b)) < 0)
+
+
+static void freshness_swap(u16 i, u16 j){
+	u16 a = sc_self->freshness.heap[i];
+	u16 b = sc_self->freshness.heap[j];
+
+	sc_self->freshness.heap[i] = b;
+	sc_self->freshness.heap[j] = a;
+	sc_self->freshness.pos[b] = i;
+	sc_self->freshness.pos[a] = j;
+}
+
+static void freshness_sift_up(u16 i){
+	u16 parent;
+
+	while(i > 0){
+		parent = (i - 1) >> 1;
+		if(!TIME_BEFORE(sc_self->freshness.deadline[sc_self->freshness.heap[i]],
+				sc_self->freshness.deadline[sc_self->freshness.heap[parent]]))
+			break;
+		freshness_swap(i, parent);
+		i = parent;
+	}
+}
+
+static void freshness_sift_down(u16 i){
+	u16 child, smallest;
+
+	for(;;){
+		smallest = i;
+		child = 2 * i + 1;
+		if(child < sc_self->freshness.count &&
+		   TIME_BEFORE(sc_self->freshness.deadline[sc_self->freshness.heap[child]],
+				sc_self->freshness.deadline[sc_self->freshness.heap[smallest]]))
+			smallest = child;
+		child++;
+		if(child < sc_self->freshness.count &&
+		   TIME_BEFORE(sc_self->freshness.deadline[sc_self->freshness.heap[child]],
+				sc_self->freshness.deadline[sc_self->freshness.heap[smallest]]))
+			smallest = child;
+		if(smallest == i)
+			break;
+		freshness_swap(i, smallest);
+		i = smallest;
+	}
+}
+
+/* Insert the channel, or move it if its deadline has changed */
+static void freshness_schedule(u16 chan_num, sc_time_t deadline){
+	u16 i = sc_self->freshness.pos[chan_num];
+
+	sc_self->freshness.deadline[chan_num] = deadline;
+
+	if(i == FRESHNESS_NOT_QUEUED){
+		i = sc_self->freshness.count++;
+		sc_self->freshness.heap[i] = chan_num;
+		sc_self->freshness.pos[chan_num] = i;
+	}
+
+	freshness_sift_up(i);
+	freshness_sift_down(sc_self->freshness.pos[chan_num]);
+}
+
+static void freshness_unschedule(u16 chan_num){
+	u16 i = sc_self->freshness.pos[chan_num];
+	u16 last, moved;
+
+	if(i == FRESHNESS_NOT_QUEUED)
+		return;
+
+	last = --sc_self->freshness.count;
+	if(i != last){
+		freshness_swap(i, last);
+		moved = sc_self->freshness.heap[i];
+		freshness_sift_up(i);
+		freshness_sift_down(sc_self->freshness.pos[moved]);
+	}
+	sc_self->freshness.pos[chan_num] = FRESHNESS_NOT_QUEUED;
+}
+
+void scandal_init_freshness(void){
+	u16 i;
+
+	sc_self->freshness.count = 0;
+	for(i=0; i<NUM_IN_CHANNELS; i++){
+		sc_self->freshness.pos[i] = FRESHNESS_NOT_QUEUED;
+		sc_self->freshness.max_age[i] = SCANDAL_IN_CHANNEL_MAX_AGE;
+		sc_self->freshness.stale[i] = 0;
+		sc_self->freshness.handlers[i] = 0;
+	}
+}
+
+/* A max_age of 0 stops the channel from ever going stale. A channel which
+   is already stale stays that way until it next receives a value. */
+void scandal_set_in_channel_max_age(u16 chan_num, sc_time_t max_age){
+	sc_time_t rcvd_time;
+
+	if(chan_num >= NUM_IN_CHANNELS)
+		return;
+
+	sc_self->freshness.max_age[chan_num] = max_age;
+
+	if(max_age == 0){
+		freshness_unschedule(chan_num);
+		sc_self->freshness.stale[chan_num] = 0;
+		return;
+	}
+
+	rcvd_time = scandal_get_in_channel_rcvd_time(chan_num);
+	if(rcvd_time != 0 && !sc_self->freshness.stale[chan_num])
+		freshness_schedule(chan_num, rcvd_time + max_age);
+}
+
+sc_time_t scandal_get_in_channel_max_age(u16 chan_num){
+	if(chan_num >= NUM_IN_CHANNELS)
+		return 0;
+	return sc_self->freshness.max_age[chan_num];
+}
+
+void scandal_register_in_channel_freshness_handler(u16 chan_num, in_channel_freshness_handler handler){
+	if(chan_num >= NUM_IN_CHANNELS)
+		return;
+	sc_self->freshness.handlers[chan_num] = handler;
+}
+
+u08 scandal_in_channel_is_stale(u16 chan_num){
+	if(chan_num >= NUM_IN_CHANNELS)
+		return 0;
+	return sc_self->freshness.stale[chan_num];
+}
+
+/* Called by the engine each time the channel receives a value */
+void scandal_freshness_touch(u16 chan_num, sc_time_t rcvd_time){
+	if(sc_self->freshness.max_age[chan_num] != 0)
+		freshness_schedule(chan_num, rcvd_time + sc_self->freshness.max_age[chan_num]);
+
+	if(sc_self->freshness.stale[chan_num]){
+		sc_self->freshness.stale[chan_num] = 0;
+		if(sc_self->freshness.handlers[chan_num] != 0)
+			sc_self->freshness.handlers[chan_num](chan_num, IN_CHANNEL_FRESH);
+	}
+}
+
+/* Called by the engine when the channel takes a new source. As at startup,
+   it has no deadline and isn't stale until it hears from the new one */
+void scandal_freshness_reset(u16 chan_num){
+	freshness_unschedule(chan_num);
+	sc_self->freshness.stale[chan_num] = 0;
+}
+
+/* Expire every channel whose deadline has passed. Each one is taken off
+   the heap before its handler runs, so the handler is free to change the
+   channel's max age. */
+void scandal_check_freshness(sc_time_t now){
+	u16 chan_num;
+
+	while(sc_self->freshness.count != 0){
+		chan_num = sc_self->freshness.heap[0];
+		if(TIME_BEFORE(now, sc_self->freshness.deadline[chan_num]))
+			break;
+
+		freshness_unschedule(chan_num);
+		sc_self->freshness.stale[chan_num] = 1;
+		if(sc_self->freshness.handlers[chan_num] != 0)
+			sc_self->freshness.handlers[chan_num](chan_num, IN_CHANNEL_STALE);
+	}
+}
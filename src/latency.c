@@ -0,0 +1,93 @@
+/* --------------------------------------------------------------------------
+	Scandal Latency Histograms
+	File name: latency.c
+
+	Storage and dumping for the receive path latency histograms. The
+	recording itself is inline, in scandal/latency.h.
+   -------------------------------------------------------------------------- */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <project/scandal_config.h>
+
+#include <scandal/types.h>
+#include <scandal/can.h>
+#include <scandal/engine.h>
+#include <scandal/message.h>
+#include <scandal/uart.h>
+#include <scandal/busstats.h>
+#include <scandal/latency.h>
+#include <scandal/context.h>
+
+#include <string.h>
+
+#if SCANDAL_LATENCY_HISTOGRAMS
+
+
+void scandal_reset_latency(void){
+	memset(sc_self->latency_hists, 0, sizeof(sc_self->latency_hists));
+}
+
+void scandal_dump_latency_uart(void){
+	u08 h, b;
+
+	for(h=0; h<LATENCY_NUM_HISTS; h++){
+		UART_SendByte(LATENCY_UART_SYNC);
+		UART_SendByte(h);
+		UART_SendByte(SCANDAL_LATENCY_BUCKETS);
+		for(b=0; b<SCANDAL_LATENCY_BUCKETS; b++){
+			UART_SendByte(sc_self->latency_hists[h][b] >> 8);
+			UART_SendByte(sc_self->latency_hists[h][b] & 0xFF);
+		}
+	}
+}
+
+static void latency_dump_can(u08 hist, u08 dest){
+	can_msg msg;
+	u08 b, i;
+
+	msg.id = scandal_mk_command_id(NETWORK_LOW, dest,
+			SCANDAL_CMD_LATENCY_DUMP + SCANDAL_COMMAND_REPLY);
+	msg.ext = CAN_EXT_MSG;
+
+	for(b=0; b<SCANDAL_LATENCY_BUCKETS; b+=3){
+		msg.data[0] = hist;
+		msg.data[1] = b;
+		msg.length = 2;
+		for(i=0; i<3 && b + i < SCANDAL_LATENCY_BUCKETS; i++){
+			msg.data[msg.length++] = sc_self->latency_hists[hist][b + i] >> 8;
+			msg.data[msg.length++] = sc_self->latency_hists[hist][b + i] & 0xFF;
+		}
+		can_send_msg(&msg, 1);
+	}
+}
+
+void scandal_handle_latency_command(u16 num, u08 *data){
+	switch(num){
+	case SCANDAL_CMD_LATENCY_DUMP:
+		if(data[0] < LATENCY_NUM_HISTS)
+			latency_dump_can(data[0], data[7]);
+		break;
+
+	case SCANDAL_CMD_LATENCY_RESET:
+		scandal_reset_latency();
+		break;
+	}
+}
+
+#endif
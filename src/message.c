@@ -21,7 +21,7 @@
 #include <project/scandal_config.h>
 
 static inline u08 scandal_build_channel_msg(can_msg* msg, 
-			u08 pri, u08 chan_num, u32 value, sc_time_t timestamp) {
+			u08 pri, u16 chan_num, u32 value, sc_time_t timestamp) {
 	/* Load up the first four bytes with the value */
 	msg->data[0] = (value >> 24) & 0xFF;
 	msg->data[1] = (value >> 16) & 0xFF;
@@ -45,17 +45,34 @@ static inline u08 scandal_build_channel_msg(can_msg* msg,
 
 u08 scandal_send_channel_with_timestamp(u08 pri, u16 chan_num, 
 			u32 value, sc_time_t timestamp) {
-	can_msg msg;
+	can_msg *msg = can_tx_reserve();
 
-	scandal_build_channel_msg(&msg, pri, chan_num, value, timestamp);
+	if(msg == 0)
+		return BUF_FULL_ERR;
 
-	if(can_send_msg(&msg, 1) != NO_ERR){
-		/*! \todo Do something intelligent when an error occurs */
-		// We need to do something here because something went wrong!!
-	}
+	scandal_build_channel_msg(msg, pri, chan_num, value, timestamp);
 
-	/*! \todo Return reasonable error codes */
-	return NO_ERR;
+	return can_tx_commit(msg, 1);
+}
+
+/* Short form channel message: the value only, no timestamp. The receiver
+   stamps it with its own time of arrival */
+u08 scandal_send_short_channel(u08 pri, u16 chan_num, u32 value) {
+	can_msg *msg = can_tx_reserve();
+
+	if(msg == 0)
+		return BUF_FULL_ERR;
+
+	msg->data[0] = (value >> 24) & 0xFF;
+	msg->data[1] = (value >> 16) & 0xFF;
+	msg->data[2] = (value >> 8) & 0xFF;
+	msg->data[3] = (value >> 0) & 0xFF;
+
+	msg->id = scandal_mk_channel_id(pri, scandal_get_addr(), chan_num);
+	msg->ext = CAN_EXT_MSG;
+	msg->length = CHANNEL_SHORT_LENGTH;
+
+	return can_tx_commit(msg, 1);
 }
 
 u08 scandal_build_heartbeat_msg(can_msg* msg, u08 last_scandal_error,
@@ -84,182 +101,176 @@ u08 scandal_build_heartbeat_msg(can_msg* msg, u08 last_scandal_error,
 }
 
 u08 scandal_send_heartbeat(u32 status) {
-	can_msg msg;
+	can_msg *msg = can_tx_reserve();
 
-	scandal_build_heartbeat_msg(&msg,
+	if(msg == 0)
+		return BUF_FULL_ERR;
+
+	scandal_build_heartbeat_msg(msg,
 				scandal_get_last_scandal_error(), 
 				scandal_get_last_user_error(), 
 				SCANDAL_VERSION, 
 				scandal_get_num_errors());
 
-	if(can_send_msg(&msg, 1) != NO_ERR){
-		/*! \todo Do something intelligent when an error occurs */
-		// We need to do something here because something went wrong!!
-	}
-
-	/*! \todo Return reasonable error codes */
-	return NO_ERR;
+	return can_tx_commit(msg, 1);
 }
 
 u08 scandal_send_scandal_error(u08 err) {
 	u32 value;
-	can_msg msg;
+	can_msg *msg = can_tx_reserve();
+
+	if(msg == 0)
+		return BUF_FULL_ERR;
 
 	value= scandal_get_realtime32();
-	msg.id = scandal_mk_scandal_error_id();
+	msg->id = scandal_mk_scandal_error_id();
 
-	msg.data[0] = err;
+	msg->data[0] = err;
 
-	msg.data[4] = (value >> 24) & 0xFF;
-	msg.data[5] = (value >> 16) & 0xFF;
-	msg.data[6] = (value >> 8) & 0xFF;
-	msg.data[7] = (value >> 0) & 0xFF;
-	msg.length = 8;
+	msg->data[4] = (value >> 24) & 0xFF;
+	msg->data[5] = (value >> 16) & 0xFF;
+	msg->data[6] = (value >> 8) & 0xFF;
+	msg->data[7] = (value >> 0) & 0xFF;
+	msg->length = 8;
 	
-	msg.ext = CAN_EXT_MSG;
+	msg->ext = CAN_EXT_MSG;
 
-	if(can_send_msg(&msg, 1) != NO_ERR){
-		/*! \todo Do something intelligent when an error occurs */
-		// We need to do something here because something went wrong!!
-	}
-	return NO_ERR;
+	return can_tx_commit(msg, 1);
 }
 
 u08 scandal_send_user_error(u08 err){
 	u32 value;
-	can_msg msg;
+	can_msg *msg = can_tx_reserve();
+
+	if(msg == 0)
+		return BUF_FULL_ERR;
 
 	value = scandal_get_realtime32();
-	msg.id = scandal_mk_user_error_id();
+	msg->id = scandal_mk_user_error_id();
 
-	msg.data[0] = err;
+	msg->data[0] = err;
 
-	msg.data[4] = (value >> 24) & 0xFF;
-	msg.data[5] = (value >> 16) & 0xFF;
-	msg.data[6] = (value >> 8) & 0xFF;
-	msg.data[7] = (value >> 0) & 0xFF;
-	msg.length = 8;
+	msg->data[4] = (value >> 24) & 0xFF;
+	msg->data[5] = (value >> 16) & 0xFF;
+	msg->data[6] = (value >> 8) & 0xFF;
+	msg->data[7] = (value >> 0) & 0xFF;
+	msg->length = 8;
 
-	msg.ext = CAN_EXT_MSG;
+	msg->ext = CAN_EXT_MSG;
 
-	if(can_send_msg(&msg, 1) != NO_ERR){
-		/*! \todo Do something intelligent when an error occurs */
-		// We need to do something here because something went wrong!!
-	}
-	return NO_ERR;
+	return can_tx_commit(msg, 1);
 }
 
 u08 scandal_send_reset(u08 priority, u08 node) {
-	can_msg msg;
+	can_msg *msg = can_tx_reserve();
   
-	msg.id = scandal_mk_reset_id(priority, node);
-	msg.length = 8;
+	if(msg == 0)
+		return BUF_FULL_ERR;
 
-	msg.ext = CAN_EXT_MSG;
+	msg->id = scandal_mk_reset_id(priority, node);
+	msg->length = 0;		/* The ID says it all */
 
-	if(can_send_msg(&msg, 1) != NO_ERR){
-		/*! \todo Do something intelligent when an error occurs */
-		// We need to do something here because something went wrong!!
-	}
-	return NO_ERR;
+	msg->ext = CAN_EXT_MSG;
+
+	return can_tx_commit(msg, 1);
 
 }
 
 u08 scandal_send_user_config(u08 priority, u08 node, u08 param, 
 			u32 value1, u32 value2) {
 	//u32 value;
-	can_msg msg;
+	can_msg *msg = can_tx_reserve();
 
-	//value = scandal_get_realtime32();
-	msg.id = scandal_mk_user_config_id(priority, node, param);
+	if(msg == 0)
+		return BUF_FULL_ERR;
 
-	msg.data[0] = (value1 >> 24) & 0xFF;
-	msg.data[1] = (value1 >> 16) & 0xFF;
-	msg.data[2] = (value1 >> 8) & 0xFF;
-	msg.data[3] = (value1 >> 0) & 0xFF;
+	//value = scandal_get_realtime32();
+	msg->id = scandal_mk_user_config_id(priority, node, param);
 
-	msg.data[4] = (value2 >> 24) & 0xFF;
-	msg.data[5] = (value2 >> 16) & 0xFF;
-	msg.data[6] = (value2 >> 8) & 0xFF;
-	msg.data[7] = (value2 >> 0) & 0xFF;
-	msg.length = 8;
+	msg->data[0] = (value1 >> 24) & 0xFF;
+	msg->data[1] = (value1 >> 16) & 0xFF;
+	msg->data[2] = (value1 >> 8) & 0xFF;
+	msg->data[3] = (value1 >> 0) & 0xFF;
 
-	msg.ext = CAN_EXT_MSG;
+	msg->data[4] = (value2 >> 24) & 0xFF;
+	msg->data[5] = (value2 >> 16) & 0xFF;
+	msg->data[6] = (value2 >> 8) & 0xFF;
+	msg->data[7] = (value2 >> 0) & 0xFF;
+	msg->length = 8;
 
-	if(can_send_msg(&msg, 1) != NO_ERR){
-		/*! \todo Do something intelligent when an error occurs */
-		// We need to do something here because something went wrong!!
-	}
+	msg->ext = CAN_EXT_MSG;
 
-	return NO_ERR;
+	return can_tx_commit(msg, 1);
 }
 
 u08 scandal_send_timesync(u08 priority, u08 node, uint64_t newtime) {
-    can_msg msg;
+    can_msg *msg = can_tx_reserve();
     uint32_t val;
 
-    msg.id = scandal_mk_timesync_id(priority); 
+	if(msg == 0)
+		return BUF_FULL_ERR;
 
-    val = (newtime >> 32) & 0xFFFFFFFF;
+    msg->id = scandal_mk_timesync_id(priority); 
 
-    msg.data[0] = (val >> 24) & 0xFF; 
-    msg.data[1] = (val >> 16) & 0xFF; 
-    msg.data[2] = (val >> 8) & 0xFF; 
-    msg.data[3] = (val >> 0) & 0xFF;
+    val = (newtime >> 32) & 0xFFFFFFFF;
 
-    msg.data[4] = (newtime >> 24) & 0x00000000000000FF;
-    msg.data[5] = (newtime >> 16) & 0x00000000000000FF;
-    msg.data[6] = (newtime >> 8) & 0x00000000000000FF;
-    msg.data[7] = (newtime >> 0) & 0x00000000000000FF;
-    msg.length = 8; 
+    msg->data[0] = (val >> 24) & 0xFF; 
+    msg->data[1] = (val >> 16) & 0xFF; 
+    msg->data[2] = (val >> 8) & 0xFF; 
+    msg->data[3] = (val >> 0) & 0xFF;
 
-	msg.ext = CAN_EXT_MSG;
+    msg->data[4] = (newtime >> 24) & 0x00000000000000FF;
+    msg->data[5] = (newtime >> 16) & 0x00000000000000FF;
+    msg->data[6] = (newtime >> 8) & 0x00000000000000FF;
+    msg->data[7] = (newtime >> 0) & 0x00000000000000FF;
+    msg->length = 8; 
 
-	if(can_send_msg(&msg, 0) != NO_ERR){
-		/*! \todo Do something intelligent when an error occurs */
-		// We need to do something here because something went wrong!!
-	}
+	msg->ext = CAN_EXT_MSG;
 
-	return NO_ERR;
+	return can_tx_commit(msg, 0);
 }
 
 u08 scandal_send_ws_drive_command(uint32_t identifier, float first, float second) {
-    can_msg msg;
+    can_msg *msg = can_tx_reserve();
 
-	msg.id = identifier;
-	msg.ext = CAN_STD_MSG;
+	if(msg == 0)
+		return BUF_FULL_ERR;
 
-	memcpy(msg.data, &first, 4);
-	memcpy(msg.data+4, &second, 4);
+	msg->id = identifier;
+	msg->ext = CAN_STD_MSG;
 
-	can_send_msg(&msg, 3);
+	memcpy(msg->data, &first, 4);
+	memcpy(msg->data+4, &second, 4);
+	msg->length = 8;
 
-	return NO_ERR;
+	return can_tx_commit(msg, 3);
 
 }
 
 u08 scandal_send_ws_id(uint32_t identifier, const char *str, int len) {
-    can_msg msg;
+    can_msg *msg = can_tx_reserve();
+
+	if(msg == 0)
+		return BUF_FULL_ERR;
 
-	msg.id = identifier;
+	msg->id = identifier;
 
 	// TODO
 	// len should always be 4. this is a hack, think about it some more.
 
-	msg.data[0] = str[len-4];
-	msg.data[1] = str[len-3];
-	msg.data[2] = str[len-2];
-	msg.data[3] = str[len-1];
-	msg.data[4] = 0;
-	msg.data[5] = 0;
-	msg.data[6] = 0;
-	msg.data[7] = 0;
-
-	msg.ext = CAN_STD_MSG;
+	msg->data[0] = str[len-4];
+	msg->data[1] = str[len-3];
+	msg->data[2] = str[len-2];
+	msg->data[3] = str[len-1];
+	msg->data[4] = 0;
+	msg->data[5] = 0;
+	msg->data[6] = 0;
+	msg->data[7] = 0;
+	msg->length = 8;
 
-	can_send_msg(&msg, 3);
+	msg->ext = CAN_STD_MSG;
 
-	return NO_ERR;
+	return can_tx_commit(msg, 3);
 
 }
 
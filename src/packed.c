@@ -0,0 +1,168 @@
+/* --------------------------------------------------------------------------
+	Scandal Packed Channels
+	File name: packed.c
+
+	Sending side of packed channel frames. See scandal/packed.h for the
+	frame layout.
+   -------------------------------------------------------------------------- */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <project/scandal_config.h>
+
+#include <scandal/types.h>
+#include <scandal/can.h>
+#include <scandal/engine.h>
+#include <scandal/error.h>
+#include <scandal/message.h>
+#include <scandal/timer.h>
+#include <scandal/packed.h>
+#include <scandal/context.h>
+
+#include <string.h>
+
+
+void scandal_init_packed(void){
+	memset(sc_self->out_channel_formats, SCANDAL_FORMAT_CHANNEL, sizeof(sc_self->out_channel_formats));
+}
+
+/* Kept in RAM only, so a node goes back to plain channel frames on reset */
+u08 scandal_set_out_channel_format(u16 chan_num, u08 format){
+	if(chan_num >= NUM_OUT_CHANNELS || format > SCANDAL_FORMAT_SHORT)
+		return LEN_ERR;
+
+	sc_self->out_channel_formats[chan_num] = format;
+	return NO_ERR;
+}
+
+u08 scandal_get_out_channel_format(u16 chan_num){
+	if(chan_num >= NUM_OUT_CHANNELS)
+		return SCANDAL_FORMAT_CHANNEL;
+	return sc_self->out_channel_formats[chan_num];
+}
+
+static u08 packed_fits(u08 format, s32 value){
+	if(format == SCANDAL_FORMAT_PACKED16)
+		return value >= PACKED16_MIN && value <= PACKED16_MAX;
+	return value >= PACKED24_MIN && value <= PACKED24_MAX;
+}
+
+u08 scandal_build_packed_msg(can_msg *msg, u08 pri, u08 format, u16 first_chan,
+			s32 *values, u08 count, sc_time_t timestamp){
+	u08 type, width, i;
+	u08 *p;
+
+	if(format == SCANDAL_FORMAT_PACKED16)
+		type = PACKED16_TYPE;
+	else if(format == SCANDAL_FORMAT_PACKED24)
+		type = PACKED24_TYPE;
+	else
+		return LEN_ERR;
+
+	if(count == 0 || count > scandal_packed_max_values(type))
+		return LEN_ERR;
+
+	width = scandal_packed_width(type);
+
+	msg->id = scandal_mk_packed_id(pri, type, scandal_get_addr(), first_chan);
+	msg->ext = CAN_EXT_MSG;
+	msg->length = PACKED_TIME_BYTES + width * count;
+
+	msg->data[0] = (timestamp >> 8) & 0xFF;
+	msg->data[1] = (timestamp >> 0) & 0xFF;
+
+	p = &msg->data[PACKED_TIME_BYTES];
+	for(i=0; i<count; i++){
+		if(width == 3)
+			*p++ = (values[i] >> 16) & 0xFF;
+		*p++ = (values[i] >> 8) & 0xFF;
+		*p++ = (values[i] >> 0) & 0xFF;
+	}
+
+	return NO_ERR;
+}
+
+/* Sends count consecutive channels, starting at first_chan, in one packed
+   frame. Values which don't fit the format are an error */
+u08 scandal_send_packed_channels(u08 pri, u08 format, u16 first_chan, s32 *values, u08 count){
+	can_msg *msg;
+	u08 i, err;
+
+	for(i=0; i<count; i++)
+		if(!packed_fits(format, values[i]))
+			return LEN_ERR;
+
+	if((msg = can_tx_reserve()) == 0)
+		return BUF_FULL_ERR;
+
+	err = scandal_build_packed_msg(msg, pri, format, first_chan, values, count,
+			scandal_get_realtime32());
+	if(err != NO_ERR)
+		return err;
+
+	return can_tx_commit(msg, 1);
+}
+
+/* Sends count consecutive out-channels, starting at first_chan, using each
+   channel's configured format. Neighbouring channels with the same packed
+   format share frames. A value too big for its channel's packed format goes
+   in a plain channel frame instead. If a frame can't be sent the rest are
+   still tried, and the last error is returned */
+u08 scandal_send_channels(u08 pri, u16 first_chan, s32 *values, u16 count){
+	return scandal_send_channels_with_timestamp(pri, first_chan, values, count,
+			scandal_get_realtime32());
+}
+
+/* As above, for values taken at timestamp rather than now */
+u08 scandal_send_channels_with_timestamp(u08 pri, u16 first_chan, s32 *values,
+			u16 count, sc_time_t timestamp){
+	u16 i, n, max;
+	u08 format, err, result = NO_ERR;
+	can_msg *msg;
+
+	for(i=0; i<count; i += n){
+		format = scandal_get_out_channel_format(first_chan + i);
+
+		if(format == SCANDAL_FORMAT_SHORT){
+			err = scandal_send_short_channel(pri, first_chan + i, values[i]);
+			n = 1;
+		} else if(format == SCANDAL_FORMAT_CHANNEL || !packed_fits(format, values[i])){
+			err = scandal_send_channel_with_timestamp(pri, first_chan + i, values[i], timestamp);
+			n = 1;
+		} else {
+			max = (format == SCANDAL_FORMAT_PACKED16) ? PACKED16_MAX_VALUES : PACKED24_MAX_VALUES;
+			for(n = 1; n < max && i + n < count; n++){
+				if(scandal_get_out_channel_format(first_chan + i + n) != format ||
+				   !packed_fits(format, values[i + n]))
+					break;
+			}
+
+			if((msg = can_tx_reserve()) == 0){
+				err = BUF_FULL_ERR;
+			} else {
+				scandal_build_packed_msg(msg, pri, format, first_chan + i, &values[i], n, timestamp);
+				err = can_tx_commit(msg, 1);
+			}
+		}
+
+		if(err != NO_ERR)
+			result = err;
+	}
+
+	return result;
+}
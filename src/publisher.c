@@ -0,0 +1,190 @@
+/* --------------------------------------------------------------------------
+	Scandal Out-Channel Publisher
+	File name: publisher.c
+
+	Rate limiting, deadband and keep-alive for out-channels. See
+	scandal/publisher.h for the rules.
+   -------------------------------------------------------------------------- */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <project/scandal_config.h>
+
+#include <scandal/types.h>
+#include <scandal/timer.h>
+#include <scandal/error.h>
+#include <scandal/message.h>
+#include <scandal/utils.h>
+#include <scandal/scheduler.h>
+#include <scandal/publisher.h>
+#include <scandal/packed.h>
+#include <scandal/context.h>
+
+#include <string.h>
+
+
+static void publisher_task(void *arg);
+
+void scandal_init_publisher(void){
+	memset(sc_self->publisher, 0, sizeof(sc_self->publisher));
+
+#if NUM_OUT_CHANNELS > 0
+	scandal_add_task(publisher_task, 0, SCANDAL_PUBLISHER_PERIOD,
+			SCANDAL_PUBLISHER_PERIOD, 1);
+#endif
+}
+
+/* Sends the channel's value in its configured format (see scandal/packed.h).
+   If there is no room to queue it, it stays pending and the publisher task
+   tries again */
+static u08 publisher_send(u16 chan_num, sc_time_t now){
+	publisher_channel *chan = &sc_self->publisher[chan_num];
+	u08 err;
+
+	err = scandal_send_channels_with_timestamp(chan->priority, chan_num,
+			&chan->value, 1, chan->timestamp);
+	if(err != NO_ERR){
+		chan->flags |= PUBLISHER_PENDING;
+		return err;
+	}
+
+	chan->sent_value = chan->value;
+	chan->sent_time = now;
+	chan->flags |= PUBLISHER_HAVE_SENT;
+	chan->flags &= ~PUBLISHER_PENDING;
+	chan->stats.sent++;
+	return NO_ERR;
+}
+
+/* Has the value moved far enough from the last one sent to be worth sending.
+   The difference is taken unsigned, as two s32s can be further apart than
+   an s32 can hold */
+static u08 publisher_changed(publisher_channel *chan){
+	u32 delta;
+
+	if(!(chan->flags & PUBLISHER_HAVE_SENT))
+		return 1;
+
+	if(chan->value >= chan->sent_value)
+		delta = (u32)chan->value - (u32)chan->sent_value;
+	else
+		delta = (u32)chan->sent_value - (u32)chan->value;
+
+	return delta >= chan->params.deadband;
+}
+
+/* Hand a new value for an out-channel to the publisher. It is sent now, sent
+   later by the publisher task, or dropped, depending on the channel's
+   publisher parameters */
+u08 scandal_publish(u08 pri, u16 chan_num, s32 value){
+	publisher_channel *chan;
+	sc_time_t now;
+
+	if(chan_num >= NUM_OUT_CHANNELS)
+		return LEN_ERR;
+
+	chan = &sc_self->publisher[chan_num];
+	now = sc_get_timer();
+
+	/* A value which was held back and now never will be sent */
+	if(chan->flags & PUBLISHER_PENDING)
+		chan->stats.suppressed++;
+
+	chan->value = value;
+	chan->timestamp = scandal_get_realtime32();
+	chan->priority = pri;
+	chan->flags |= PUBLISHER_HAVE_VALUE;
+	chan->flags &= ~PUBLISHER_PENDING;
+
+	if(!publisher_changed(chan)){
+		/* Not worth sending, unless it is time for a keep-alive */
+		if(chan->params.max_interval != 0 &&
+		   now - chan->sent_time >= chan->params.max_interval)
+			return publisher_send(chan_num, now);
+
+		chan->stats.suppressed++;
+		return NO_ERR;
+	}
+
+	if((chan->flags & PUBLISHER_HAVE_SENT) &&
+	   now - chan->sent_time < chan->params.min_interval){
+		chan->flags |= PUBLISHER_PENDING;
+		return NO_ERR;
+	}
+
+	return publisher_send(chan_num, now);
+}
+
+/* As above, but the value goes through the channel's m and b first, like
+   scandal_send_scaled_channel() */
+u08 scandal_publish_scaled(u08 pri, u16 chan_num, s32 value){
+	scandal_get_scaled_value(chan_num, &value);
+	return scandal_publish(pri, chan_num, value);
+}
+
+/* Sends values held back by the min interval, and keep-alives */
+static void publisher_task(void *arg){
+	u16 i;
+	sc_time_t now = sc_get_timer();
+	publisher_channel *chan;
+
+	for(i=0; i<NUM_OUT_CHANNELS; i++){
+		chan = &sc_self->publisher[i];
+
+		if(chan->flags & PUBLISHER_PENDING){
+			if(now - chan->sent_time >= chan->params.min_interval)
+				publisher_send(i, now);
+		} else if((chan->flags & PUBLISHER_HAVE_VALUE) &&
+			  chan->params.max_interval != 0 &&
+			  now - chan->sent_time >= chan->params.max_interval){
+			publisher_send(i, now);
+		}
+	}
+}
+
+/* Parameters are kept in RAM only and go back to the defaults on reset */
+u08 scandal_set_publisher_params(u16 chan_num, scandal_publisher_params *params){
+	if(chan_num >= NUM_OUT_CHANNELS)
+		return LEN_ERR;
+
+	sc_self->publisher[chan_num].params = *params;
+	return NO_ERR;
+}
+
+u08 scandal_get_publisher_params(u16 chan_num, scandal_publisher_params *params){
+	if(chan_num >= NUM_OUT_CHANNELS)
+		return LEN_ERR;
+
+	*params = sc_self->publisher[chan_num].params;
+	return NO_ERR;
+}
+
+u08 scandal_get_publisher_stats(u16 chan_num, scandal_publisher_stats *stats){
+	if(chan_num >= NUM_OUT_CHANNELS)
+		return LEN_ERR;
+
+	*stats = sc_self->publisher[chan_num].stats;
+	return NO_ERR;
+}
+
+void scandal_reset_publisher_stats(void){
+	u16 i;
+
+	for(i=0; i<NUM_OUT_CHANNELS; i++)
+		memset(&sc_self->publisher[i].stats, 0, sizeof(scandal_publisher_stats));
+}
@@ -0,0 +1,236 @@
+/* --------------------------------------------------------------------------
+	Scandal Task Scheduler
+	File name: scheduler.c
+
+	Cooperative periodic tasks, run from handle_scandal(). Tasks live in
+	fixed slots (so a task id stays valid until the task is removed), and
+	the slots are ordered by release time in a binary min-heap.
+   -------------------------------------------------------------------------- */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <project/scandal_config.h>
+
+#include <scandal/types.h>
+#include <scandal/timer.h>
+#include <scandal/error.h>
+#include <scandal/scheduler.h>
+#include <scandal/context.h>
+
+#include <string.h>
+
+/* True if time a is before time b, allowing for the timer wrapping */
+#define TIME_BEFORE(a, b)	((s32)((a) - (b)) < 0)
+
+
+/* Ordering of the heap: earliest release first, then highest priority */
+static u08 task_earlier(u08 a, u08 b){
+	scandal_task *ta = &sc_self->scheduler.tasks[a];
+	scandal_task *tb = &sc_self->scheduler.tasks[b];
+
+	if(ta->release_us != tb->release_us)
+		return TIME_BEFORE(ta->release_us, tb->release_us);
+	return ta->priority < tb->priority;
+}
+
+static void task_swap(u08 i, u08 j){
+	u08 a = sc_self->scheduler.heap[i];
+	u08 b = sc_self->scheduler.heap[j];
+
+	sc_self->scheduler.heap[i] = b;
+	sc_self->scheduler.heap[j] = a;
+	sc_self->scheduler.tasks[b].pos = i;
+	sc_self->scheduler.tasks[a].pos = j;
+}
+
+static void task_sift_up(u08 i){
+	u08 parent;
+
+	while(i > 0){
+		parent = (i - 1) >> 1;
+		if(!task_earlier(sc_self->scheduler.heap[i], sc_self->scheduler.heap[parent]))
+			break;
+		task_swap(i, parent);
+		i = parent;
+	}
+}
+
+static void task_sift_down(u08 i){
+	u08 child, first;
+
+	for(;;){
+		first = i;
+		child = 2 * i + 1;
+		if(child < sc_self->scheduler.count &&
+		   task_earlier(sc_self->scheduler.heap[child], sc_self->scheduler.heap[first]))
+			first = child;
+		child++;
+		if(child < sc_self->scheduler.count &&
+		   task_earlier(sc_self->scheduler.heap[child], sc_self->scheduler.heap[first]))
+			first = child;
+		if(first == i)
+			break;
+		task_swap(i, first);
+		i = first;
+	}
+}
+
+static u08 task_valid(u08 task_id){
+	return task_id < SCANDAL_MAX_TASKS && sc_self->scheduler.tasks[task_id].fn != 0;
+}
+
+void scandal_init_scheduler(void){
+	memset(&sc_self->scheduler, 0, sizeof(sc_self->scheduler));
+}
+
+/* Registers a task to be called every period_ms, starting phase_ms from now.
+   Returns the task id, or SCANDAL_NO_TASK if there are no free slots or the
+   period is out of range. */
+u08 scandal_add_task(scandal_task_fn fn, void *arg, u32 period_ms, u32 phase_ms, u08 priority){
+	u08 id;
+	scandal_task *task;
+
+	if(fn == 0 || period_ms == 0 || period_ms > SCANDAL_TASK_MAX_PERIOD ||
+	   phase_ms > SCANDAL_TASK_MAX_PERIOD)
+		return SCANDAL_NO_TASK;
+
+	for(id = 0; id < SCANDAL_MAX_TASKS; id++)
+		if(sc_self->scheduler.tasks[id].fn == 0)
+			break;
+	if(id == SCANDAL_MAX_TASKS)
+		return SCANDAL_NO_TASK;
+
+	task = &sc_self->scheduler.tasks[id];
+	memset(task, 0, sizeof(*task));
+	task->fn = fn;
+	task->arg = arg;
+	task->period_us = period_ms * 1000;
+	task->release_us = sc_get_timer_us() + phase_ms * 1000;
+	task->priority = priority;
+
+	task->pos = sc_self->scheduler.count;
+	sc_self->scheduler.heap[sc_self->scheduler.count++] = id;
+	task_sift_up(task->pos);
+
+	return id;
+}
+
+u08 scandal_remove_task(u08 task_id){
+	u08 i, last, moved;
+
+	if(!task_valid(task_id))
+		return LEN_ERR;
+
+	i = sc_self->scheduler.tasks[task_id].pos;
+	last = --sc_self->scheduler.count;
+	if(i != last){
+		task_swap(i, last);
+		moved = sc_self->scheduler.heap[i];
+		task_sift_up(i);
+		task_sift_down(sc_self->scheduler.tasks[moved].pos);
+	}
+
+	sc_self->scheduler.tasks[task_id].fn = 0;
+	return NO_ERR;
+}
+
+/* The new period takes effect from the task's next release */
+u08 scandal_set_task_period(u08 task_id, u32 period_ms){
+	if(!task_valid(task_id) || period_ms == 0 || period_ms > SCANDAL_TASK_MAX_PERIOD)
+		return LEN_ERR;
+
+	sc_self->scheduler.tasks[task_id].period_us = period_ms * 1000;
+	return NO_ERR;
+}
+
+u08 scandal_get_task_stats(u08 task_id, scandal_task_stats *stats){
+	if(!task_valid(task_id))
+		return LEN_ERR;
+
+	*stats = sc_self->scheduler.tasks[task_id].stats;
+	return NO_ERR;
+}
+
+void scandal_reset_task_stats(u08 task_id){
+	if(task_valid(task_id))
+		memset(&sc_self->scheduler.tasks[task_id].stats, 0, sizeof(scandal_task_stats));
+}
+
+/* How long until the next task is due, in us. 0 if one is due already, and
+   0xFFFFFFFF if there are no tasks. Useful for deciding how long to sleep. */
+sc_utime_t scandal_time_to_next_task(void){
+	sc_utime_t now, release;
+
+	if(sc_self->scheduler.count == 0)
+		return 0xFFFFFFFF;
+
+	now = sc_get_timer_us();
+	release = sc_self->scheduler.tasks[sc_self->scheduler.heap[0]].release_us;
+	if(!TIME_BEFORE(now, release))
+		return 0;
+	return release - now;
+}
+
+/* Run every task which is due. The next release of each task is worked out
+   before it is called, and is always in the future, so each task runs at
+   most once per call and a task may safely remove or re-time itself. */
+void scandal_run_tasks(void){
+	u08		id;
+	scandal_task	*task;
+	scandal_task_fn	fn;
+	sc_utime_t	now, start, end, jitter, next;
+
+	now = sc_get_timer_us();
+
+	while(sc_self->scheduler.count != 0){
+		id = sc_self->scheduler.heap[0];
+		task = &sc_self->scheduler.tasks[id];
+		if(TIME_BEFORE(now, task->release_us))
+			break;
+
+		start = sc_get_timer_us();
+		jitter = start - task->release_us;
+
+		/* Releases are on a fixed grid from the first one, so a late
+		   start doesn't push every later run back. Any releases we have
+		   missed altogether are skipped and counted. */
+		next = task->release_us + task->period_us;
+		while(!TIME_BEFORE(start, next)){
+			next += task->period_us;
+			task->stats.overruns++;
+		}
+		task->release_us = next;
+		task_sift_down(0);
+
+		fn = task->fn;
+		fn(task->arg);
+		end = sc_get_timer_us();
+
+		/* The task may have removed itself */
+		if(task->fn != fn)
+			continue;
+
+		task->stats.runs++;
+		task->stats.last_jitter_us = jitter;
+		if(jitter > task->stats.max_jitter_us)
+			task->stats.max_jitter_us = jitter;
+		task->stats.last_runtime_us = end - start;
+		if(end - start > task->stats.max_runtime_us)
+			task->stats.max_runtime_us = end - start;
+	}
+}
@@ -0,0 +1,109 @@
+/* --------------------------------------------------------------------------
+	Scandal User Storage
+	File name: user_store.c
+
+	RAM cache of the user storage, written back through the config log.
+	See scandal/user_store.h.
+   -------------------------------------------------------------------------- */
+
+/*
+ * This file is part of Scandal.
+ *
+ * Scandal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * Scandal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with Scandal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <scandal/types.h>
+#include <scandal/error.h>
+#include <scandal/eeprom.h>
+#include <scandal/timer.h>
+#include <scandal/conf_log.h>
+#include <scandal/user_store.h>
+#include <scandal/context.h>
+
+#include <string.h>
+
+/* Like the log, only archs with a backend have it. The LPC1768's flash
+   driver still has its own stubs */
+#ifdef SC_CONF_BANKS
+
+void sc_user_store_load(void){
+	sc_conf_log_read(CONF_LOG_USER_OFFSET, sc_self->user_store.cache, SC_USER_STORE_SIZE);
+	sc_self->user_store.dirty_start = 0;
+	sc_self->user_store.dirty_end = 0;
+}
+
+void sc_user_store_flush(void){
+	u16 start = sc_self->user_store.dirty_start;
+	u16 end = sc_self->user_store.dirty_end;
+
+	if(start == end)
+		return;
+
+	sc_conf_log_write(CONF_LOG_USER_OFFSET + start, &sc_self->user_store.cache[start], end - start);
+	sc_self->user_store.dirty_start = 0;
+	sc_self->user_store.dirty_end = 0;
+	sc_self->user_store.flushes++;
+}
+
+u08 sc_user_store_dirty(void){
+	return sc_self->user_store.dirty_start != sc_self->user_store.dirty_end;
+}
+
+void sc_user_store_poll(void){
+	if(sc_user_store_dirty() &&
+	   sc_get_timer() - sc_self->user_store.dirtied >= SC_USER_STORE_FLUSH_DELAY)
+		sc_user_store_flush();
+}
+
+u08 sc_user_eeprom_read_block(u32 loc, u08 *data, u08 length){
+	if(loc + length > SC_USER_STORE_SIZE)
+		return LEN_ERR;
+
+	memcpy(data, &sc_self->user_store.cache[loc], length);
+	return NO_ERR;
+}
+
+u08 sc_user_eeprom_write_block(u32 loc, u08 *data, u08 length){
+	u16 start = loc, end = loc + length;
+
+	if(loc + length > SC_USER_STORE_SIZE)
+		return LEN_ERR;
+
+	/* Rewriting what is already there leaves nothing to flush */
+	while(start < end && sc_self->user_store.cache[start] == data[start - loc])
+		start++;
+	while(end > start && sc_self->user_store.cache[end - 1] == data[end - 1 - loc])
+		end--;
+	if(start == end)
+		return NO_ERR;
+
+	memcpy(&sc_self->user_store.cache[start], &data[start - loc], end - start);
+	if(!sc_user_store_dirty()){
+		sc_self->user_store.dirty_start = start;
+		sc_self->user_store.dirty_end = end;
+		sc_self->user_store.dirtied = sc_get_timer();
+	} else {
+		if(start < sc_self->user_store.dirty_start)
+			sc_self->user_store.dirty_start = start;
+		if(end > sc_self->user_store.dirty_end)
+			sc_self->user_store.dirty_end = end;
+	}
+
+#if SC_USER_STORE_FLUSH_DELAY == 0
+	sc_user_store_flush();
+#endif
+	return NO_ERR;
+}
+
+#endif